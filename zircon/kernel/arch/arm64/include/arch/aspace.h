@@ -14,6 +14,7 @@
 #include <arch/arm64/mmu.h>
 #include <fbl/canary.h>
 #include <fbl/mutex.h>
+#include <ktl/atomic.h>
 #include <vm/arch_vm_aspace.h>
 #include <vm/pmm.h>
 
@@ -38,6 +39,10 @@ class ArmArchVmAspace final : public ArchVmAspaceInterface {
   zx_status_t Protect(vaddr_t vaddr, size_t count, uint mmu_flags) override;
 
   zx_status_t Query(vaddr_t vaddr, paddr_t* paddr, uint* mmu_flags) override;
+  zx_status_t QueryEntrySize(vaddr_t vaddr, size_t* size) override;
+  zx_status_t HarvestAccessed(vaddr_t vaddr, size_t count,
+                              const HarvestCallback& accessed_callback) override;
+  zx_status_t MarkAccessed(vaddr_t vaddr, size_t count) override;
 
   vaddr_t PickSpot(vaddr_t base, uint prev_region_mmu_flags, vaddr_t end,
                    uint next_region_mmu_flags, vaddr_t align, size_t size, uint mmu_flags) override;
@@ -91,7 +96,13 @@ class ArmArchVmAspace final : public ArchVmAspaceInterface {
   zx_status_t ProtectPages(vaddr_t vaddr, size_t size, pte_t attrs, vaddr_t vaddr_base,
                            uint top_size_shift, uint top_index_shift, uint page_size_shift)
       TA_REQ(lock_);
-  zx_status_t QueryLocked(vaddr_t vaddr, paddr_t* paddr, uint* mmu_flags) TA_REQ(lock_);
+  // |entry_size|, if not null, is set to the size of the range the translating entry maps.
+  zx_status_t QueryLocked(vaddr_t vaddr, paddr_t* paddr, uint* mmu_flags, size_t* entry_size)
+      TA_REQ(lock_);
+
+  // Returns the page or block entry that maps |vaddr| in a user aspace, or null if there is none.
+  // |*entry_size| is set to the size of the range the entry maps.
+  volatile pte_t* GetUserEntryLocked(vaddr_t vaddr, size_t* entry_size) TA_REQ(lock_);
 
   void FlushTLBEntry(vaddr_t vaddr, bool terminal) TA_REQ(lock_);
 
@@ -99,8 +110,13 @@ class ArmArchVmAspace final : public ArchVmAspaceInterface {
 
   DECLARE_MUTEX(ArmArchVmAspace) lock_;
 
+  // The ASID of the kernel aspace, or the VMID of a guest aspace.
   uint16_t asid_ = MMU_ARM64_UNUSED_ASID;
 
+  // The ASID of a user aspace in the low MMU_ARM64_ASID_BITS, and the generation it was assigned
+  // in above them. Assigned when the aspace is switched to; zero until then.
+  ktl::atomic<uint64_t> asid_context_{0};
+
   // Pointer to the translation table.
   paddr_t tt_phys_ = 0;
   volatile pte_t* tt_virt_ = nullptr;
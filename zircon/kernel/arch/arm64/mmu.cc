@@ -11,6 +11,7 @@
 #include <debug.h>
 #include <err.h>
 #include <inttypes.h>
+#include <lib/counters.h>
 #include <lib/heap.h>
 #include <lib/ktrace.h>
 #include <stdlib.h>
@@ -26,8 +27,11 @@
 #include <bitmap/storage.h>
 #include <fbl/auto_call.h>
 #include <fbl/auto_lock.h>
+#include <kernel/cpu.h>
 #include <kernel/mutex.h>
+#include <kernel/spinlock.h>
 #include <ktl/algorithm.h>
+#include <ktl/atomic.h>
 #include <vm/arch_vm_aspace.h>
 #include <vm/physmap.h>
 #include <vm/pmm.h>
@@ -48,6 +52,8 @@ static_assert(((long)KERNEL_ASPACE_BASE >> MMU_KERNEL_SIZE_SHIFT) == -1, "");
 static_assert(MMU_KERNEL_SIZE_SHIFT <= 48, "");
 static_assert(MMU_KERNEL_SIZE_SHIFT >= 25, "");
 
+KCOUNTER(asid_rollovers, "mmu.asid_rollovers")
+
 // Static relocated base to prepare for KASLR. Used at early boot and by gdb
 // script to know the target relocated address.
 // TODO(SEC-31): Choose it randomly.
@@ -65,71 +71,158 @@ pte_t* arm64_get_kernel_ptable() { return arm64_kernel_translation_table; }
 
 namespace {
 
+// ASIDs are assigned to user aspaces lazily, when they are switched to, and are tagged with a
+// generation in the bits above MMU_ARM64_ASID_BITS. Once the ASID space runs out the generation
+// is bumped: the ASIDs that are live on some CPU carry over, everything else is up for grabs, and
+// each CPU flushes its TLB before it next loads an ASID of the new generation. ASIDs therefore
+// never need to be freed, and the number of aspaces is not limited by the number of ASIDs.
 class AsidAllocator {
  public:
   AsidAllocator() { bitmap_.Reset(MMU_ARM64_MAX_USER_ASID + 1); }
   ~AsidAllocator() = default;
 
-  zx_status_t Alloc(uint16_t* asid);
-  zx_status_t Free(uint16_t asid);
+  // Returns the context (generation and ASID) to run the aspace owning |context| with on the
+  // current CPU, assigning a new ASID if needed. Called with interrupts disabled.
+  uint64_t Activate(ktl::atomic<uint64_t>* context);
+
+  static uint16_t ToAsid(uint64_t context) {
+    return static_cast<uint16_t>(context & MMU_ARM64_MAX_USER_ASID);
+  }
 
  private:
   DISALLOW_COPY_ASSIGN_AND_MOVE(AsidAllocator);
 
-  DECLARE_MUTEX(AsidAllocator) lock_;
+  static constexpr uint64_t kGenerationStep = 1ul << MMU_ARM64_ASID_BITS;
+
+  bool IsCurrent(uint64_t context) const {
+    return (context & ~(kGenerationStep - 1)) == generation_.load();
+  }
+
+  uint64_t NewContextLocked(uint64_t context) TA_REQ(lock_);
+  bool UpdateReservedLocked(uint64_t context, uint64_t new_context) TA_REQ(lock_);
+  void RolloverLocked() TA_REQ(lock_);
+
+  DECLARE_SPINLOCK(AsidAllocator) lock_;
+
+  ktl::atomic<uint64_t> generation_{kGenerationStep};
   uint16_t last_ TA_GUARDED(lock_) = MMU_ARM64_FIRST_USER_ASID - 1;
 
   bitmap::RawBitmapGeneric<bitmap::FixedStorage<MMU_ARM64_MAX_USER_ASID + 1>> bitmap_
       TA_GUARDED(lock_);
 
+  // The context each CPU is running with, or zero once a rollover has reserved it.
+  ktl::atomic<uint64_t> active_[SMP_MAX_CPUS] = {};
+  // The context each CPU was running with at the last rollover, which keeps its ASID.
+  uint64_t reserved_[SMP_MAX_CPUS] TA_GUARDED(lock_) = {};
+  // CPUs that have to flush their TLB before loading an ASID of the current generation.
+  cpu_mask_t flush_pending_ TA_GUARDED(lock_) = 0;
+
   static_assert(MMU_ARM64_ASID_BITS <= 16, "");
 };
 
-zx_status_t AsidAllocator::Alloc(uint16_t* asid) {
-  uint16_t new_asid;
+uint64_t AsidAllocator::Activate(ktl::atomic<uint64_t>* context) {
+  DEBUG_ASSERT(arch_ints_disabled());
+  const cpu_num_t cpu = arch_curr_cpu_num();
 
-  // use the bitmap allocator to allocate ids in the range of
-  // [MMU_ARM64_FIRST_USER_ASID, MMU_ARM64_MAX_USER_ASID]
-  // start the search from the last found id + 1 and wrap when hitting the end of the range
-  {
-    Guard<Mutex> al{&lock_};
+  // Fast path: the ASID is from the current generation, and no rollover has reserved this CPU's
+  // previous ASID since we last looked.
+  uint64_t id = context->load();
+  uint64_t old_active = active_[cpu].load();
+  if (old_active != 0 && IsCurrent(id) && active_[cpu].compare_exchange_strong(old_active, id)) {
+    return id;
+  }
 
-    size_t val;
-    bool notfound = bitmap_.Get(last_ + 1, MMU_ARM64_MAX_USER_ASID + 1, &val);
-    if (unlikely(notfound)) {
-      // search again from the start
-      notfound = bitmap_.Get(MMU_ARM64_FIRST_USER_ASID, MMU_ARM64_MAX_USER_ASID + 1, &val);
-      if (unlikely(notfound)) {
-        TRACEF("ARM64: out of ASIDs\n");
-        return ZX_ERR_NO_MEMORY;
-      }
-    }
-    bitmap_.SetOne(val);
+  Guard<SpinLock, NoIrqSave> guard{&lock_};
 
-    DEBUG_ASSERT(val <= UINT16_MAX);
+  id = context->load();
+  if (!IsCurrent(id)) {
+    id = NewContextLocked(id);
+    context->store(id);
+  }
 
-    new_asid = (uint16_t)val;
-    last_ = new_asid;
+  const cpu_mask_t cpu_bit = cpu_num_to_mask(cpu);
+  if (flush_pending_ & cpu_bit) {
+    flush_pending_ &= ~cpu_bit;
+    __asm__ volatile("tlbi vmalle1" ::: "memory");
+    __dsb(ARM_MB_NSH);
+    __isb(ARM_MB_SY);
   }
 
-  LTRACEF("new asid %#x\n", new_asid);
+  active_[cpu].store(id);
+  return id;
+}
 
-  *asid = new_asid;
+uint64_t AsidAllocator::NewContextLocked(uint64_t context) {
+  uint64_t generation = generation_.load();
 
-  return ZX_OK;
-}
+  if (context != 0) {
+    const uint16_t old_asid = ToAsid(context);
+    // An ASID that was live on some CPU at the last rollover keeps its number, so that TLB
+    // maintenance by ASID still reaches CPUs that have not switched since.
+    if (UpdateReservedLocked(context, generation | old_asid)) {
+      return generation | old_asid;
+    }
+    // Otherwise hold on to the same ASID if nobody has taken it in this generation.
+    if (!bitmap_.GetOne(old_asid)) {
+      bitmap_.SetOne(old_asid);
+      return generation | old_asid;
+    }
+  }
 
-zx_status_t AsidAllocator::Free(uint16_t asid) {
-  LTRACEF("free asid %#x\n", asid);
+  // Search from the last found id + 1 and wrap when hitting the end of the range. If the whole
+  // range is taken, start a new generation; at most one ASID per CPU carries over into it.
+  size_t val;
+  bool notfound = bitmap_.Get(last_ + 1, MMU_ARM64_MAX_USER_ASID + 1, &val);
+  if (unlikely(notfound)) {
+    notfound = bitmap_.Get(MMU_ARM64_FIRST_USER_ASID, MMU_ARM64_MAX_USER_ASID + 1, &val);
+    if (unlikely(notfound)) {
+      RolloverLocked();
+      generation = generation_.load();
+      notfound = bitmap_.Get(MMU_ARM64_FIRST_USER_ASID, MMU_ARM64_MAX_USER_ASID + 1, &val);
+      DEBUG_ASSERT(!notfound);
+    }
+  }
+  bitmap_.SetOne(val);
 
-  Guard<Mutex> al{&lock_};
+  DEBUG_ASSERT(val <= UINT16_MAX);
+  last_ = static_cast<uint16_t>(val);
 
-  bitmap_.ClearOne(asid);
+  LTRACEF("new asid %#zx\n", val);
 
-  return ZX_OK;
+  return generation | val;
 }
 
-AsidAllocator asid;
+bool AsidAllocator::UpdateReservedLocked(uint64_t context, uint64_t new_context) {
+  // Several CPUs may have been running the same aspace; update all of their reservations.
+  bool hit = false;
+  for (cpu_num_t i = 0; i < SMP_MAX_CPUS; i++) {
+    if (reserved_[i] == context) {
+      reserved_[i] = new_context;
+      hit = true;
+    }
+  }
+  return hit;
+}
+
+void AsidAllocator::RolloverLocked() {
+  generation_.fetch_add(kGenerationStep);
+  kcounter_add(asid_rollovers, 1);
+
+  bitmap_.ClearAll();
+  for (cpu_num_t i = 0; i < SMP_MAX_CPUS; i++) {
+    uint64_t id = active_[i].exchange(0);
+    // A CPU that has not switched aspaces since the previous rollover is still running with the
+    // ASID reserved for it back then.
+    if (id == 0) {
+      id = reserved_[i];
+    }
+    bitmap_.SetOne(ToAsid(id));
+    reserved_[i] = id;
+  }
+  flush_pending_ = ~0u;
+}
+
+AsidAllocator asid_allocator;
 
 }  // namespace
 
@@ -289,11 +382,141 @@ static void s2_pte_attr_to_mmu_flags(pte_t pte, uint* mmu_flags) {
 template <page_alloc_fn_t paf>
 zx_status_t ArmArchVmAspace<paf>::Query(vaddr_t vaddr, paddr_t* paddr, uint* mmu_flags) {
   Guard<Mutex> al{&lock_};
-  return QueryLocked(vaddr, paddr, mmu_flags);
+  return QueryLocked(vaddr, paddr, mmu_flags, nullptr);
+}
+
+template <page_alloc_fn_t paf>
+zx_status_t ArmArchVmAspace<paf>::QueryEntrySize(vaddr_t vaddr, size_t* size) {
+  Guard<Mutex> al{&lock_};
+  return QueryLocked(vaddr, nullptr, nullptr, size);
+}
+
+template <page_alloc_fn_t paf>
+zx_status_t ArmArchVmAspace<paf>::HarvestAccessed(vaddr_t vaddr, size_t count,
+                                                  const HarvestCallback& accessed_callback) {
+  if (!IsValidVaddr(vaddr)) {
+    return ZX_ERR_OUT_OF_RANGE;
+  }
+
+  Guard<Mutex> al{&lock_};
+
+  if (flags_ & (ARCH_ASPACE_FLAG_KERNEL | ARCH_ASPACE_FLAG_GUEST)) {
+    // Kernel and stage 2 entries always have the access flag set, so report everything that is
+    // mapped as accessed.
+    for (size_t i = 0; i < count; i++) {
+      const vaddr_t va = vaddr + i * PAGE_SIZE;
+      paddr_t pa;
+      if (QueryLocked(va, &pa, nullptr, nullptr) == ZX_OK) {
+        accessed_callback(pa, va);
+      }
+    }
+    return ZX_OK;
+  }
+
+  // The hardware does not manage the access flag, so an entry only changes under |lock_| and it
+  // is safe to rewrite it. The next access to a cleared entry takes an access flag fault, which
+  // sets the flag again through MarkAccessed().
+  const vaddr_t end = vaddr + count * PAGE_SIZE;
+  bool flushed = false;
+  vaddr_t va = vaddr;
+  while (va < end) {
+    size_t entry_size;
+    volatile pte_t* entry = GetUserEntryLocked(va, &entry_size);
+    if (entry == nullptr) {
+      va += PAGE_SIZE;
+      continue;
+    }
+
+    const vaddr_t entry_base = ROUNDDOWN(va, entry_size);
+    const vaddr_t entry_end = ktl::min(entry_base + entry_size, end);
+    const pte_t pte = *entry;
+    if (pte & MMU_PTE_ATTR_AF) {
+      *entry = pte & ~MMU_PTE_ATTR_AF;
+      // The TLB may still hold the entry with the flag set, in which case accesses would go
+      // unnoticed.
+      FlushTLBEntry(entry_base, true);
+      flushed = true;
+
+      const paddr_t paddr_base = pte & MMU_PTE_OUTPUT_ADDR_MASK;
+      for (; va < entry_end; va += PAGE_SIZE) {
+        accessed_callback(paddr_base + (va - entry_base), va);
+      }
+    }
+    va = entry_end;
+  }
+  if (flushed) {
+    __dsb(ARM_MB_SY);
+  }
+  return ZX_OK;
+}
+
+template <page_alloc_fn_t paf>
+zx_status_t ArmArchVmAspace<paf>::MarkAccessed(vaddr_t vaddr, size_t count) {
+  if (!IsValidVaddr(vaddr)) {
+    return ZX_ERR_OUT_OF_RANGE;
+  }
+  // Only user entries ever have the access flag cleared.
+  if (flags_ & (ARCH_ASPACE_FLAG_KERNEL | ARCH_ASPACE_FLAG_GUEST)) {
+    return ZX_OK;
+  }
+
+  Guard<Mutex> al{&lock_};
+  bool updated = false;
+  for (size_t i = 0; i < count; i++) {
+    size_t entry_size;
+    volatile pte_t* entry = GetUserEntryLocked(vaddr + i * PAGE_SIZE, &entry_size);
+    if (entry != nullptr && !(*entry & MMU_PTE_ATTR_AF)) {
+      *entry |= MMU_PTE_ATTR_AF;
+      updated = true;
+    }
+  }
+  if (updated) {
+    // Entries that fault are never held in the TLB, so the updates only need to be visible to
+    // the table walker.
+    __dsb(ARM_MB_ISHST);
+    __isb(ARM_MB_SY);
+  }
+  return ZX_OK;
 }
 
 template <page_alloc_fn_t paf>
-zx_status_t ArmArchVmAspace<paf>::QueryLocked(vaddr_t vaddr, paddr_t* paddr, uint* mmu_flags) {
+volatile pte_t* ArmArchVmAspace<paf>::GetUserEntryLocked(vaddr_t vaddr, size_t* entry_size) {
+  DEBUG_ASSERT(!(flags_ & (ARCH_ASPACE_FLAG_KERNEL | ARCH_ASPACE_FLAG_GUEST)));
+  DEBUG_ASSERT(IsValidVaddr(vaddr));
+
+  const uint page_size_shift = MMU_USER_PAGE_SIZE_SHIFT;
+  uint index_shift = MMU_USER_TOP_SHIFT;
+  vaddr_t vaddr_rem = vaddr;
+  volatile pte_t* page_table = tt_virt_;
+
+  while (true) {
+    const ulong index = vaddr_rem >> index_shift;
+    vaddr_rem -= (vaddr_t)index << index_shift;
+    const pte_t pte = page_table[index];
+    const uint descriptor_type = pte & MMU_PTE_DESCRIPTOR_MASK;
+
+    if (descriptor_type == MMU_PTE_DESCRIPTOR_INVALID) {
+      return nullptr;
+    }
+
+    if (descriptor_type == ((index_shift > page_size_shift) ? MMU_PTE_L012_DESCRIPTOR_BLOCK
+                                                            : MMU_PTE_L3_DESCRIPTOR_PAGE)) {
+      *entry_size = 1ul << index_shift;
+      return &page_table[index];
+    }
+
+    if (index_shift <= page_size_shift || descriptor_type != MMU_PTE_L012_DESCRIPTOR_TABLE) {
+      PANIC_UNIMPLEMENTED;
+    }
+
+    page_table = static_cast<volatile pte_t*>(paddr_to_physmap(pte & MMU_PTE_OUTPUT_ADDR_MASK));
+    index_shift -= page_size_shift - 3;
+  }
+}
+
+template <page_alloc_fn_t paf>
+zx_status_t ArmArchVmAspace<paf>::QueryLocked(vaddr_t vaddr, paddr_t* paddr, uint* mmu_flags,
+                                              size_t* entry_size) {
   ulong index;
   uint index_shift;
   uint page_size_shift;
@@ -371,6 +594,9 @@ zx_status_t ArmArchVmAspace<paf>::QueryLocked(vaddr_t vaddr, paddr_t* paddr, uin
   if (paddr) {
     *paddr = pte_addr + vaddr_rem;
   }
+  if (entry_size) {
+    *entry_size = 1ul << index_shift;
+  }
   if (mmu_flags) {
     *mmu_flags = 0;
     if (flags_ & ARCH_ASPACE_FLAG_GUEST) {
@@ -541,11 +767,13 @@ void ArmArchVmAspace<paf>::FlushTLBEntry(vaddr_t vaddr, bool terminal) {
       ARM64_TLBI(vaae1is, vaddr >> 12);
     }
   } else {
-    // flush this address for the specific asid
+    // flush this address for the specific asid. The ASID may change on a rollover, but any CPU
+    // that could hold entries for the old one flushes its whole TLB before using the new one.
+    const vaddr_t asid = AsidAllocator::ToAsid(asid_context_.load());
     if (terminal) {
-      ARM64_TLBI(vale1is, vaddr >> 12 | (vaddr_t)asid_ << 48);
+      ARM64_TLBI(vale1is, vaddr >> 12 | asid << 48);
     } else {
-      ARM64_TLBI(vae1is, vaddr >> 12 | (vaddr_t)asid_ << 48);
+      ARM64_TLBI(vae1is, vaddr >> 12 | asid << 48);
     }
   }
 }
@@ -1102,9 +1330,7 @@ zx_status_t ArmArchVmAspace<paf>::Init(vaddr_t base, size_t size, uint flags) {
       DEBUG_ASSERT(base + size <= 1UL << MMU_GUEST_SIZE_SHIFT);
     } else {
       DEBUG_ASSERT(base + size <= 1UL << MMU_USER_SIZE_SHIFT);
-      if (asid.Alloc(&asid_) != ZX_OK) {
-        return ZX_ERR_NO_MEMORY;
-      }
+      // An ASID is assigned the first time the aspace is switched to.
     }
 
     base_ = base;
@@ -1153,10 +1379,13 @@ zx_status_t ArmArchVmAspace<paf>::Destroy() {
     paddr_t vttbr = arm64_vttbr(asid_, tt_phys_);
     __UNUSED zx_status_t status = arm64_el2_tlbi_vmid(vttbr);
     DEBUG_ASSERT(status == ZX_OK);
-  } else {
-    ARM64_TLBI(ASIDE1IS, asid_);
-    asid.Free(asid_);
-    asid_ = MMU_ARM64_UNUSED_ASID;
+  } else if (const uint64_t context = asid_context_.load(); context != 0) {
+    // The ASID is not handed out again before every CPU has flushed its TLB, but a rollover can
+    // keep it reserved for a CPU that has not switched since, so drop any entries tagged with it
+    // now rather than leave them pointing at freed page tables. If a rollover already gave the
+    // ASID to someone else this only costs them a refill.
+    ARM64_TLBI(ASIDE1IS, AsidAllocator::ToAsid(context));
+    __dsb(ARM_MB_ISH);
   }
 
   return ZX_OK;
@@ -1175,7 +1404,8 @@ void ArmArchVmAspace<paf>::ContextSwitch(ArmArchVmAspace* old_aspace, ArmArchVmA
     DEBUG_ASSERT((aspace->flags_ & (ARCH_ASPACE_FLAG_KERNEL | ARCH_ASPACE_FLAG_GUEST)) == 0);
 
     tcr = MMU_TCR_FLAGS_USER;
-    ttbr = ((uint64_t)aspace->asid_ << 48) | aspace->tt_phys_;
+    const uint64_t asid = AsidAllocator::ToAsid(asid_allocator.Activate(&aspace->asid_context_));
+    ttbr = (asid << 48) | aspace->tt_phys_;
     __arm_wsr64("ttbr0_el1", ttbr);
     __isb(ARM_MB_SY);
 
@@ -0,0 +1,115 @@
+// Copyright 2020 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#include <err.h>
+#include <lib/unittest/unittest.h>
+#include <zircon/types.h>
+
+#include <arch/arch_ops.h>
+#include <arch/arm64/mmu.h>
+#include <arch/aspace.h>
+#include <arch/kernel_aspace.h>
+#include <arch/mmu.h>
+#include <fbl/alloc_checker.h>
+#include <ktl/unique_ptr.h>
+#include <vm/arch_vm_aspace.h>
+#include <vm/pmm.h>
+
+namespace {
+
+using Aspace = ArmArchVmAspace<pmm_alloc_page>;
+
+constexpr vaddr_t kTestVaddr = USER_ASPACE_BASE;
+constexpr uint kTestMmuFlags =
+    ARCH_MMU_FLAG_PERM_READ | ARCH_MMU_FLAG_PERM_WRITE | ARCH_MMU_FLAG_PERM_USER;
+
+// Switches to |aspace| and translates |kTestVaddr| the way a user access would, which goes
+// through (and fills) the TLB. Returns the ASID the aspace ran with.
+uint16_t TranslateIn(Aspace* aspace, paddr_t* pa, zx_status_t* status) {
+  arch_disable_ints();
+  Aspace::ContextSwitch(nullptr, aspace);
+  const uint16_t asid = static_cast<uint16_t>(__arm_rsr64("ttbr0_el1") >> 48);
+  *status = arm64_mmu_translate(kTestVaddr, pa, /*user=*/true, /*write=*/false);
+  Aspace::ContextSwitch(aspace, nullptr);
+  arch_enable_ints();
+  return asid;
+}
+
+}  // namespace
+
+// Runs through more aspaces than there are ASIDs, so that the generation rolls over, and checks
+// that no aspace sees a translation cached for another one that ran with the same ASID.
+static bool arm64_asid_rollover_test() {
+  BEGIN_TEST;
+
+  vm_page_t* kept_page;
+  vm_page_t* other_page;
+  paddr_t kept_pa, other_pa;
+  ASSERT_EQ(ZX_OK, pmm_alloc_page(0, &kept_page, &kept_pa));
+  ASSERT_EQ(ZX_OK, pmm_alloc_page(0, &other_page, &other_pa));
+
+  Aspace kept;
+  ASSERT_EQ(ZX_OK, kept.Init(USER_ASPACE_BASE, USER_ASPACE_SIZE, 0));
+  size_t mapped;
+  ASSERT_EQ(ZX_OK, kept.MapContiguous(kTestVaddr, kept_pa, 1, kTestMmuFlags, &mapped));
+
+  paddr_t pa = 0;
+  zx_status_t status;
+  const uint16_t kept_asid = TranslateIn(&kept, &pa, &status);
+  EXPECT_EQ(ZX_OK, status);
+  EXPECT_EQ(kept_pa, pa);
+
+  // Every ASID is handed out at least once before the loop ends, including |kept_asid|, and the
+  // numbering starts over after the rollover.
+  bool wrapped = false;
+  uint16_t last_asid = kept_asid;
+  for (uint32_t i = 0; i <= MMU_ARM64_MAX_USER_ASID; i++) {
+    fbl::AllocChecker ac;
+    ktl::unique_ptr<Aspace> aspace(new (&ac) Aspace());
+    ASSERT_TRUE(ac.check());
+    ASSERT_EQ(ZX_OK, aspace->Init(USER_ASPACE_BASE, USER_ASPACE_SIZE, 0));
+    ASSERT_EQ(ZX_OK, aspace->MapContiguous(kTestVaddr, other_pa, 1, kTestMmuFlags, &mapped));
+
+    const uint16_t asid = TranslateIn(aspace.get(), &pa, &status);
+    EXPECT_EQ(ZX_OK, status);
+    EXPECT_EQ(other_pa, pa);
+    EXPECT_GE(asid, MMU_ARM64_FIRST_USER_ASID);
+    EXPECT_LE(asid, MMU_ARM64_MAX_USER_ASID);
+    if (asid <= last_asid) {
+      wrapped = true;
+    }
+    last_asid = asid;
+
+    size_t unmapped;
+    EXPECT_EQ(ZX_OK, aspace->Unmap(kTestVaddr, 1, &unmapped));
+    EXPECT_EQ(ZX_OK, aspace->Destroy());
+  }
+  EXPECT_TRUE(wrapped);
+
+  // |kept| is reassigned an ASID in the new generation, and still sees its own page.
+  TranslateIn(&kept, &pa, &status);
+  EXPECT_EQ(ZX_OK, status);
+  EXPECT_EQ(kept_pa, pa);
+
+  // A new aspace with nothing mapped must not pick up entries left behind under its ASID.
+  Aspace empty;
+  ASSERT_EQ(ZX_OK, empty.Init(USER_ASPACE_BASE, USER_ASPACE_SIZE, 0));
+  TranslateIn(&empty, &pa, &status);
+  EXPECT_NE(ZX_OK, status);
+  EXPECT_EQ(ZX_OK, empty.Destroy());
+
+  size_t unmapped;
+  EXPECT_EQ(ZX_OK, kept.Unmap(kTestVaddr, 1, &unmapped));
+  EXPECT_EQ(ZX_OK, kept.Destroy());
+  pmm_free_page(kept_page);
+  pmm_free_page(other_page);
+
+  END_TEST;
+}
+
+UNITTEST_START_TESTCASE(arm64_mmu_tests)
+UNITTEST("asid rollover tests", arm64_asid_rollover_test)
+UNITTEST_END_TESTCASE(arm64_mmu_tests, "arm64_mmu", "arm64 mmu tests")
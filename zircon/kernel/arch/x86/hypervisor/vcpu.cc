@@ -834,6 +834,8 @@ zx_status_t Vcpu::Resume(zx_port_packet_t* packet) {
       // flush microarchitectural buffers.
       mds_buff_overwrite();
     }
+    // The PCID our aspace is tagged with may have changed since the VMCS was set up.
+    vmcs.Write(VmcsFieldXX::HOST_CR3, x86_get_cr3());
     ktrace(TAG_VCPU_ENTER, 0, 0, 0, 0);
     running_.store(true);
     status = vmx_enter(&vmx_state_);
@@ -97,6 +97,11 @@ class X86ArchVmAspace final : public ArchVmAspaceInterface {
   zx_status_t Unmap(vaddr_t vaddr, size_t count, size_t* unmapped) override;
   zx_status_t Protect(vaddr_t vaddr, size_t count, uint mmu_flags) override;
   zx_status_t Query(vaddr_t vaddr, paddr_t* paddr, uint* mmu_flags) override;
+  zx_status_t QueryEntrySize(vaddr_t vaddr, size_t* size) override;
+  zx_status_t HarvestAccessed(vaddr_t vaddr, size_t count,
+                              const HarvestCallback& accessed_callback) override;
+  // The hardware sets the accessed bit itself.
+  zx_status_t MarkAccessed(vaddr_t vaddr, size_t count) override { return ZX_OK; }
 
   vaddr_t PickSpot(vaddr_t base, uint prev_region_mmu_flags, vaddr_t end,
                    uint next_region_mmu_flags, vaddr_t align, size_t size, uint mmu_flags) override;
@@ -107,6 +112,10 @@ class X86ArchVmAspace final : public ArchVmAspaceInterface {
 
   int active_cpus() { return active_cpus_.load(); }
 
+  // Makes the CPUs in |cpus| flush this aspace's PCID the next time they switch to it.
+  void MarkTlbStale(int cpus) { tlb_stale_cpus_.fetch_or(cpus); }
+  ktl::atomic<int>* tlb_stale_cpus() { return &tlb_stale_cpus_; }
+
   IoBitmap& io_bitmap() { return io_bitmap_; }
 
   static void ContextSwitch(X86ArchVmAspace* from, X86ArchVmAspace* to);
@@ -115,6 +124,10 @@ class X86ArchVmAspace final : public ArchVmAspaceInterface {
   // Test the vaddr against the address space's range.
   bool IsValidVaddr(vaddr_t vaddr) { return (vaddr >= base_ && vaddr <= base_ + size_ - 1); }
 
+  // Returns the CR3 value that switches the current CPU to this aspace's PCID, flushing
+  // whatever TLB entries the CPU may hold for it that are out of date.
+  ulong PcidCr3(uint32_t cpu, uint32_t cpu_bit);
+
   fbl::Canary<fbl::magic("VAAS")> canary_;
   IoBitmap io_bitmap_;
 
@@ -137,6 +150,13 @@ class X86ArchVmAspace final : public ArchVmAspaceInterface {
   // CPUs that are currently executing in this aspace.
   // Actually an mp_cpu_mask_t, but header dependencies.
   ktl::atomic<int> active_cpus_{0};
+
+  // CPUs that may hold out of date TLB entries tagged with this aspace's PCID.
+  ktl::atomic<int> tlb_stale_cpus_{0};
+
+  // The PCID assigned to this aspace in the low X86_PCID_BITS, and the generation it was
+  // assigned in above them. Zero until the aspace first runs with PCIDs enabled.
+  ktl::atomic<uint64_t> pcid_context_{0};
 };
 
 using ArchVmAspace = X86ArchVmAspace<pmm_alloc_page>;
@@ -113,6 +113,15 @@ void x86_mmu_init(void);
 
 paddr_t x86_kernel_cr3(void);
 
+// Invalidate all non-global TLB entries on the current CPU, for every PCID.
+void x86_tlb_nonglobal_invalidate_all(void);
+
+// Run user aspaces with PCID 0 until resumed, so that CR3 holds just the page table address.
+// Used while Intel PT is set up, since the trace records and filters on CR3. No-ops if PCIDs are
+// not enabled.
+void x86_mmu_suspend_pcid(void);
+void x86_mmu_resume_pcid(void);
+
 __END_CDECLS
 
 #endif  // !__ASSEMBLER__
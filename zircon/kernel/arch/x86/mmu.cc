@@ -21,6 +21,7 @@
 #include <arch/x86/feature.h>
 #include <arch/x86/mmu_mem_types.h>
 #include <kernel/mp.h>
+#include <kernel/spinlock.h>
 #include <lib/cmdline.h>
 #include <vm/arch_vm_aspace.h>
 #include <vm/physmap.h>
@@ -38,6 +39,11 @@ KCOUNTER(tlb_invalidations_received, "mmu.tlb_invalidation_batches_received")
 KCOUNTER(tlb_invalidations_full_global_received, "mmu.tlb_invalidation_full_global_received")
 // Count of the number of TLB invalidation requests for all non-global entries on each CPU
 KCOUNTER(tlb_invalidations_full_nonglobal_received, "mmu.tlb_invalidation_full_nonglobal_received")
+// Count of the number of times the PCID space was exhausted and a new generation started
+KCOUNTER(pcid_rollovers, "mmu.pcid_rollovers")
+// Count of the number of context switches on each CPU that flushed the entries of a single PCID
+// because of invalidations made while the aspace was not running there
+KCOUNTER(pcid_stale_flushes, "mmu.pcid_stale_flushes")
 
 /* Default address width including virtual/physical address.
  * newer versions fetched below */
@@ -70,6 +76,36 @@ volatile pt_entry_t linear_map_pdp[(64ULL * GB) / (2 * MB)] __ALIGNED(PAGE_SIZE)
 // caches for the active PCID may be preserved. If the bit is clear, entries will be cleared.
 // See Intel Volume 3A, 4.10.4.1
 #define X86_PCID_CR3_SAVE_ENTRIES (63)
+#define X86_PCID_MASK ((1ul << X86_PCID_BITS) - 1)
+
+// INVPCID invalidation types. See Intel Volume 2A, INVPCID.
+#define X86_INVPCID_TYPE_ALL_INCLUDING_GLOBAL (2)
+#define X86_INVPCID_TYPE_ALL_NON_GLOBAL (3)
+
+namespace {
+
+// Set once PCIDs are enabled in CR4. User aspaces are then tagged with their own PCID and the
+// kernel aspace uses PCID 0.
+bool pcid_enabled = false;
+
+// PCIDs are handed out to user aspaces in order, tagged with a generation. Once the PCID space
+// runs out the generation is bumped and numbering starts over. A CPU flushes all non-global TLB
+// entries the first time it loads a PCID of a newer generation, so entries left behind by a
+// PCID's previous owner are never used, and PCIDs never need to be freed.
+constexpr uint64_t kFirstUserPcid = 1;
+DECLARE_SINGLETON_SPINLOCK(pcid_lock);
+uint64_t pcid_next TA_GUARDED(pcid_lock::Get()) = kFirstUserPcid;
+ktl::atomic<uint64_t> pcid_generation{1};
+
+// Set while Intel PT is set up. User aspaces then run with PCID 0, so that the CR3 values in the
+// trace and in IA32_RTIT_CR3_MATCH are the page table addresses logged for each process.
+ktl::atomic<bool> pcid_suspended{false};
+
+// The newest PCID generation loaded on each CPU since its last full flush. Only accessed by the
+// CPU itself, with interrupts disabled.
+uint64_t cpu_pcid_generation[SMP_MAX_CPUS];
+
+}  // namespace
 
 // Static relocated base to prepare for KASLR. Used at early boot and by gdb
 // script to know the target relocated address.
@@ -133,6 +169,14 @@ bool x86_mmu_check_paddr(paddr_t paddr) {
   return paddr <= max_paddr;
 }
 
+static void x86_invpcid(uint64_t type, uint64_t pcid, vaddr_t addr) {
+  struct {
+    uint64_t pcid;
+    uint64_t addr;
+  } desc = {pcid, addr};
+  __asm__ volatile("invpcid %0, %1" ::"m"(desc), "r"(type) : "memory");
+}
+
 /**
  * @brief  invalidate all TLB entries, including global entries
  */
@@ -142,20 +186,37 @@ static void x86_tlb_global_invalidate() {
   if (likely(cr4 & X86_CR4_PGE)) {
     x86_set_cr4(cr4 & ~X86_CR4_PGE);
     x86_set_cr4(cr4);
+  } else if (cr4 & X86_CR4_PCIDE) {
+    // Reloading CR3 would only invalidate the current PCID.
+    x86_invpcid(X86_INVPCID_TYPE_ALL_INCLUDING_GLOBAL, 0, 0);
   } else {
     x86_set_cr3(x86_get_cr3());
   }
 }
 
 /**
- * @brief  invalidate all TLB entries, excluding global entries
+ * @brief  invalidate all TLB entries for the current PCID, excluding global entries
  */
 static void x86_tlb_nonglobal_invalidate() { x86_set_cr3(x86_get_cr3()); }
 
+/**
+ * @brief  invalidate all TLB entries for all PCIDs, excluding global entries
+ */
+void x86_tlb_nonglobal_invalidate_all() {
+  if (x86_get_cr4() & X86_CR4_PCIDE) {
+    x86_invpcid(X86_INVPCID_TYPE_ALL_NON_GLOBAL, 0, 0);
+  } else {
+    x86_set_cr3(x86_get_cr3());
+  }
+}
+
 /* Task used for invalidating a TLB entry on each CPU */
 struct TlbInvalidatePage_context {
   ulong target_cr3;
   const PendingTlbInvalidation* pending;
+  // If set, a CPU that is no longer running the target aspace marks itself here instead, so that
+  // it flushes the aspace's PCID when it next switches back.
+  ktl::atomic<int>* tlb_stale_cpus;
 };
 static void TlbInvalidatePage_task(void* raw_context) {
   DEBUG_ASSERT(arch_ints_disabled());
@@ -163,13 +224,21 @@ static void TlbInvalidatePage_task(void* raw_context) {
 
   kcounter_add(tlb_invalidations_received, 1);
 
-  ulong cr3 = x86_get_cr3();
+  ulong cr3 = x86_get_cr3() & ~X86_PCID_MASK;
   if (context->target_cr3 != cr3 && !context->pending->contains_global) {
     /* This invalidation doesn't apply to this CPU, ignore it */
+    if (context->tlb_stale_cpus != nullptr) {
+      context->tlb_stale_cpus->fetch_or(cpu_num_to_mask(arch_curr_cpu_num()));
+    }
     return;
   }
 
-  if (context->pending->full_shootdown) {
+  /* Without global pages, kernel translations are cached under every PCID, but invlpg only
+   * reaches the current one. */
+  bool all_pcids =
+      context->pending->contains_global && pcid_enabled && !(x86_get_cr4() & X86_CR4_PGE);
+
+  if (context->pending->full_shootdown || all_pcids) {
     if (context->pending->contains_global) {
       kcounter_add(tlb_invalidations_full_global_received, 1);
       x86_tlb_global_invalidate();
@@ -209,41 +278,113 @@ static void x86_tlb_invalidate_page(const X86PageTableBase<paf>* pt,
 
   kcounter_add(tlb_invalidations_sent, 1);
 
-  ulong cr3 = pt ? pt->phys() : x86_get_cr3();
+  ulong cr3 = pt ? pt->phys() : x86_get_cr3() & ~X86_PCID_MASK;
   struct TlbInvalidatePage_context task_context = {
       .target_cr3 = cr3,
       .pending = pending,
+      .tlb_stale_cpus = nullptr,
   };
 
   /* Target only CPUs this aspace is active on.  It may be the case that some
    * other CPU will become active in it after this load, or will have left it
    * just before this load.  In the former case, it is becoming active after
    * the write to the page table, so it will see the change.  In the latter
-   * case, it will get a spurious request to flush. */
+   * case, it will get a spurious request to flush.
+   *
+   * With PCIDs, CPUs that ran this aspace earlier may still hold entries for
+   * it.  Rather than interrupting them, the CPUs it is not active on are told
+   * to flush the aspace's PCID the next time they switch to it.  A CPU that
+   * switches to it meanwhile either sees that or shows up when the active
+   * CPUs are sampled again; see X86ArchVmAspace::ContextSwitch.  A CPU that
+   * switches away after the first sample marks itself when the IPI arrives. */
   mp_ipi_target_t target;
   cpu_mask_t target_mask = 0;
   if (pending->contains_global || pt == nullptr) {
     target = MP_IPI_TARGET_ALL;
   } else {
     target = MP_IPI_TARGET_MASK;
-    target_mask = static_cast<X86ArchVmAspace<paf>*>(pt->ctx())->active_cpus();
+    auto aspace = static_cast<X86ArchVmAspace<paf>*>(pt->ctx());
+    target_mask = aspace->active_cpus();
+    if (pcid_enabled) {
+      aspace->MarkTlbStale(~target_mask);
+      target_mask |= aspace->active_cpus();
+      task_context.tlb_stale_cpus = aspace->tlb_stale_cpus();
+    }
   }
 
   mp_sync_exec(target, target_mask, TlbInvalidatePage_task, &task_context);
   pending->clear();
 }
 
-bool x86_enable_pcid() {
+static bool x86_enable_pcid() {
   DEBUG_ASSERT(arch_ints_disabled());
   if (!g_x86_feature_pcid_good) {
     return false;
   }
 
+  // CR4.PCIDE can only be set while the current PCID is 0.
+  ulong cr3 = x86_get_cr3();
+  DEBUG_ASSERT((cr3 & X86_PCID_MASK) == 0);
   ulong cr4 = x86_get_cr4();
   x86_set_cr4(cr4 | X86_CR4_PCIDE);
+
+  // Nothing is known about what this CPU's TLB holds, so flush before loading any user PCID.
+  cpu_pcid_generation[arch_curr_cpu_num()] = 0;
+  pcid_enabled = true;
   return true;
 }
 
+static void x86_pcid_suspend_task(void*) {
+  DEBUG_ASSERT(arch_ints_disabled());
+  // Move whatever is running here to PCID 0, flushing that PCID's non-global entries. Later
+  // context switches see |pcid_suspended| and do the same.
+  x86_set_cr3(x86_get_cr3() & ~X86_PCID_MASK);
+}
+
+void x86_mmu_suspend_pcid() {
+  if (!pcid_enabled) {
+    return;
+  }
+  pcid_suspended.store(true);
+  mp_sync_exec(MP_IPI_TARGET_ALL, 0, x86_pcid_suspend_task, nullptr);
+}
+
+void x86_mmu_resume_pcid() {
+  if (!pcid_enabled) {
+    return;
+  }
+  {
+    // Nothing tracked which aspaces' entries changed while they ran as PCID 0, so start a new
+    // generation. Every CPU then flushes before loading a user PCID again.
+    Guard<SpinLock, IrqSave> guard{pcid_lock::Get()};
+    pcid_generation.fetch_add(1, ktl::memory_order_relaxed);
+    pcid_next = kFirstUserPcid;
+  }
+  pcid_suspended.store(false);
+}
+
+// Returns the aspace's PCID context, tagged with the current generation.
+static uint64_t x86_pcid_assign(ktl::atomic<uint64_t>* context) {
+  Guard<SpinLock, NoIrqSave> guard{pcid_lock::Get()};
+
+  uint64_t generation = pcid_generation.load(ktl::memory_order_relaxed);
+  uint64_t current = context->load(ktl::memory_order_relaxed);
+  if ((current >> X86_PCID_BITS) == generation) {
+    // Another CPU switching to the same aspace got here first.
+    return current;
+  }
+
+  if (pcid_next > X86_PCID_MASK) {
+    generation++;
+    pcid_generation.store(generation, ktl::memory_order_relaxed);
+    pcid_next = kFirstUserPcid;
+    kcounter_add(pcid_rollovers, 1);
+  }
+  current = (generation << X86_PCID_BITS) | pcid_next++;
+  context->store(current, ktl::memory_order_relaxed);
+  return current;
+}
+
 template <page_alloc_fn_t paf>
 bool X86PageTableMmu<paf>::check_paddr(paddr_t paddr) {
   return x86_mmu_check_paddr(paddr);
@@ -664,6 +805,8 @@ zx_status_t X86ArchVmAspace<paf>::Init(vaddr_t base, size_t size, uint mmu_flags
     LTRACEF("user aspace: pt phys %#" PRIxPTR ", virt %p\n", pt_->phys(), pt_->virt());
   }
   ktl::atomic_init(&active_cpus_, 0);
+  ktl::atomic_init(&tlb_stale_cpus_, 0);
+  ktl::atomic_init(&pcid_context_, uint64_t{0});
 
   return ZX_OK;
 }
@@ -715,22 +858,53 @@ zx_status_t X86ArchVmAspace<paf>::Protect(vaddr_t vaddr, size_t count, uint mmu_
   return pt_->ProtectPages(vaddr, count, mmu_flags);
 }
 
+template <page_alloc_fn_t paf>
+ulong X86ArchVmAspace<paf>::PcidCr3(uint32_t cpu, uint32_t cpu_bit) {
+  uint64_t context = pcid_context_.load(ktl::memory_order_relaxed);
+  if (unlikely((context >> X86_PCID_BITS) != pcid_generation.load(ktl::memory_order_relaxed))) {
+    context = x86_pcid_assign(&pcid_context_);
+  }
+  const uint64_t generation = context >> X86_PCID_BITS;
+  const ulong cr3 = pt_phys() | (context & X86_PCID_MASK);
+
+  if (unlikely(cpu_pcid_generation[cpu] != generation)) {
+    // This CPU may still hold entries tagged by this PCID's previous owner.
+    DEBUG_ASSERT(cpu_pcid_generation[cpu] < generation);
+    x86_tlb_nonglobal_invalidate_all();
+    cpu_pcid_generation[cpu] = generation;
+  } else if (unlikely(tlb_stale_cpus_.load() & cpu_bit)) {
+    // Page tables changed while we weren't running here; loading CR3 without the save bit
+    // flushes only this PCID.
+    tlb_stale_cpus_.fetch_and(~cpu_bit);
+    kcounter_add(pcid_stale_flushes, 1);
+    return cr3;
+  }
+  return cr3 | (1ul << X86_PCID_CR3_SAVE_ENTRIES);
+}
+
 template <page_alloc_fn_t paf>
 void X86ArchVmAspace<paf>::ContextSwitch(X86ArchVmAspace* old_aspace, X86ArchVmAspace* aspace) {
-  cpu_mask_t cpu_bit = cpu_num_to_mask(arch_curr_cpu_num());
+  const cpu_num_t cpu = arch_curr_cpu_num();
+  cpu_mask_t cpu_bit = cpu_num_to_mask(cpu);
+  // While PCIDs are suspended, user aspaces share PCID 0 with the kernel aspace, so nothing may
+  // be kept across the switch.
+  const bool use_pcid = pcid_enabled && !pcid_suspended.load(ktl::memory_order_relaxed);
   if (aspace != nullptr) {
     aspace->canary_.Assert();
     paddr_t phys = aspace->pt_phys();
     LTRACEF_LEVEL(3, "switching to aspace %p, pt %#" PRIXPTR "\n", aspace, phys);
-    x86_set_cr3(phys);
 
     if (old_aspace != nullptr) {
       old_aspace->active_cpus_.fetch_and(~cpu_bit);
     }
+    // Become active before checking for stale TLB entries, so that a concurrent invalidation
+    // either sees us in active_cpus_ or has already marked us stale.
     aspace->active_cpus_.fetch_or(cpu_bit);
+    x86_set_cr3(use_pcid ? aspace->PcidCr3(cpu, cpu_bit) : phys);
   } else {
     LTRACEF_LEVEL(3, "switching to kernel aspace, pt %#" PRIxPTR "\n", kernel_pt_phys);
-    x86_set_cr3(kernel_pt_phys);
+    // The kernel aspace always uses PCID 0, whose entries are only ever invalidated directly.
+    x86_set_cr3(use_pcid ? kernel_pt_phys | (1ul << X86_PCID_CR3_SAVE_ENTRIES) : kernel_pt_phys);
     if (old_aspace != nullptr) {
       old_aspace->active_cpus_.fetch_and(~cpu_bit);
     }
@@ -753,6 +927,36 @@ zx_status_t X86ArchVmAspace<paf>::Query(vaddr_t vaddr, paddr_t* paddr, uint* mmu
   return pt_->QueryVaddr(vaddr, paddr, mmu_flags);
 }
 
+template <page_alloc_fn_t paf>
+zx_status_t X86ArchVmAspace<paf>::QueryEntrySize(vaddr_t vaddr, size_t* size) {
+  if (!IsValidVaddr(vaddr))
+    return ZX_ERR_INVALID_ARGS;
+
+  return pt_->QueryEntrySize(vaddr, size);
+}
+
+template <page_alloc_fn_t paf>
+zx_status_t X86ArchVmAspace<paf>::HarvestAccessed(vaddr_t vaddr, size_t count,
+                                                  const HarvestCallback& accessed_callback) {
+  if (!IsValidVaddr(vaddr))
+    return ZX_ERR_INVALID_ARGS;
+
+  if (flags_ & ARCH_ASPACE_FLAG_GUEST) {
+    // EPT accessed flags are optional and we do not enable them, so report everything that is
+    // mapped as accessed.
+    for (size_t i = 0; i < count; i++) {
+      const vaddr_t va = vaddr + i * PAGE_SIZE;
+      paddr_t pa;
+      if (pt_->QueryVaddr(va, &pa, nullptr) == ZX_OK) {
+        accessed_callback(pa, va);
+      }
+    }
+    return ZX_OK;
+  }
+
+  return pt_->HarvestAccessed(vaddr, count, accessed_callback);
+}
+
 void x86_mmu_percpu_init(void) {
   ulong cr0 = x86_get_cr0();
   /* Set write protect bit in CR0*/
@@ -779,6 +983,9 @@ void x86_mmu_percpu_init(void) {
   if (g_enable_isolation == 1) {
     disable_global_pages();
   }
+
+  // Tag user TLB entries with per-aspace PCIDs so they survive context switches.
+  x86_enable_pcid();
 }
 
 template <page_alloc_fn_t paf>
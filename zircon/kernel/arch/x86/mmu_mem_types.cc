@@ -171,7 +171,7 @@ static void x86_pat_sync_task(void* raw_context) {
 
   /* Step 7: If the PGE flag wasn't set, flush the TLB via CR3 */
   if (!pge_was_set) {
-    x86_set_cr3(x86_get_cr3());
+    x86_tlb_nonglobal_invalidate_all();
   }
 
   /* Step 8: Disable MTRRs */
@@ -216,7 +216,7 @@ static void x86_pat_sync_task(void* raw_context) {
 
   /* Step 11: Flush all cache and the TLB again */
   __asm volatile("wbinvd" ::: "memory");
-  x86_set_cr3(x86_get_cr3());
+  x86_tlb_nonglobal_invalidate_all();
 
   /* Step 12: Enter the normal cache mode */
   cr0 = x86_get_cr0();
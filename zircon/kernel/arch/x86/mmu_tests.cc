@@ -9,8 +9,10 @@
 #include <lib/unittest/unittest.h>
 #include <zircon/types.h>
 
+#include <arch/arch_ops.h>
 #include <arch/aspace.h>
 #include <arch/mmu.h>
+#include <arch/x86.h>
 #include <arch/x86/mmu.h>
 #include <vm/arch_vm_aspace.h>
 #include <vm/pmm.h>
@@ -84,6 +86,53 @@ static bool x86_arch_vmaspace_usermmu_tests() {
   END_TEST;
 }
 
+static bool x86_arch_vmaspace_pcid_tests() {
+  BEGIN_TEST;
+
+  if (!(x86_get_cr4() & X86_CR4_PCIDE)) {
+    printf("PCIDs not enabled, skipping test\n");
+    END_TEST;
+  }
+
+  constexpr uint64_t kTestAspaceSize = 4ull * 1024 * 1024 * 1024;
+  constexpr ulong kPcidMask = (1ul << 12) - 1;
+  X86ArchVmAspace<pmm_alloc_page> a;
+  X86ArchVmAspace<pmm_alloc_page> b;
+  ASSERT_EQ(ZX_OK, a.Init(0, kTestAspaceSize, /*mmu_flags=*/0));
+  ASSERT_EQ(ZX_OK, b.Init(0, kTestAspaceSize, /*mmu_flags=*/0));
+
+  // Switch a -> b -> a and back to the kernel aspace, as a kernel thread would see it.
+  ulong cr3_a, cr3_b, cr3_a_again, cr3_kernel;
+  arch_disable_ints();
+  X86ArchVmAspace<pmm_alloc_page>::ContextSwitch(nullptr, &a);
+  cr3_a = x86_get_cr3();
+  X86ArchVmAspace<pmm_alloc_page>::ContextSwitch(&a, &b);
+  cr3_b = x86_get_cr3();
+  X86ArchVmAspace<pmm_alloc_page>::ContextSwitch(&b, &a);
+  cr3_a_again = x86_get_cr3();
+  X86ArchVmAspace<pmm_alloc_page>::ContextSwitch(&a, nullptr);
+  cr3_kernel = x86_get_cr3();
+  arch_enable_ints();
+
+  // Each user aspace runs with its own, stable, non-zero PCID; the kernel aspace uses PCID 0.
+  EXPECT_EQ(a.pt_phys(), cr3_a & ~kPcidMask);
+  EXPECT_EQ(b.pt_phys(), cr3_b & ~kPcidMask);
+  EXPECT_NE(0u, cr3_a & kPcidMask);
+  EXPECT_NE(0u, cr3_b & kPcidMask);
+  EXPECT_NE(cr3_a & kPcidMask, cr3_b & kPcidMask);
+  EXPECT_EQ(cr3_a, cr3_a_again);
+  EXPECT_EQ(x86_kernel_cr3(), cr3_kernel);
+
+  EXPECT_EQ(0, a.active_cpus());
+  EXPECT_EQ(0, b.active_cpus());
+
+  a.Destroy();
+  b.Destroy();
+
+  END_TEST;
+}
+
 UNITTEST_START_TESTCASE(x86_mmu_tests)
 UNITTEST("user-aspace page table tests", x86_arch_vmaspace_usermmu_tests)
+UNITTEST("pcid tagging tests", x86_arch_vmaspace_pcid_tests)
 UNITTEST_END_TESTCASE(x86_mmu_tests, "x86_mmu", "x86 mmu tests")
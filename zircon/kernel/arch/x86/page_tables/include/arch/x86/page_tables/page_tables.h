@@ -91,6 +91,9 @@ class X86PageTableBase {
   zx_status_t ProtectPages(vaddr_t vaddr, size_t count, uint flags);
 
   zx_status_t QueryVaddr(vaddr_t vaddr, paddr_t* paddr, uint* mmu_flags);
+  zx_status_t QueryEntrySize(vaddr_t vaddr, size_t* size);
+  zx_status_t HarvestAccessed(vaddr_t vaddr, size_t count,
+                              const ArchVmAspaceInterface::HarvestCallback& accessed_callback);
 
  protected:
   // Initialize an empty page table, assigning this given context to it.
@@ -1051,6 +1051,70 @@ zx_status_t X86PageTableBase<paf>::QueryVaddr(vaddr_t vaddr, paddr_t* paddr, uin
   return ZX_OK;
 }
 
+template <page_alloc_fn_t paf>
+zx_status_t X86PageTableBase<paf>::QueryEntrySize(vaddr_t vaddr, size_t* size) {
+  canary_.Assert();
+
+  Guard<Mutex> a{&lock_};
+
+  PageTableLevel ret_level;
+  volatile pt_entry_t* last_valid_entry;
+  zx_status_t status = GetMapping(virt_, vaddr, top_level(), &ret_level, &last_valid_entry);
+  if (status != ZX_OK)
+    return status;
+
+  *size = page_size(ret_level);
+  return ZX_OK;
+}
+
+template <page_alloc_fn_t paf>
+zx_status_t X86PageTableBase<paf>::HarvestAccessed(
+    vaddr_t vaddr, size_t count, const ArchVmAspaceInterface::HarvestCallback& accessed_callback) {
+  canary_.Assert();
+
+  LTRACEF("aspace %p, vaddr %#" PRIxPTR " count %#zx\n", this, vaddr, count);
+
+  if (!check_vaddr(vaddr))
+    return ZX_ERR_INVALID_ARGS;
+
+  const vaddr_t end = vaddr + count * PAGE_SIZE;
+  ConsistencyManager cm(this);
+  {
+    Guard<Mutex> a{&lock_};
+    vaddr_t va = vaddr;
+    while (va < end) {
+      PageTableLevel level;
+      volatile pt_entry_t* pte;
+      if (GetMapping(virt_, va, top_level(), &level, &pte) != ZX_OK) {
+        va += PAGE_SIZE;
+        continue;
+      }
+
+      const size_t ps = page_size(level);
+      const vaddr_t entry_base = ROUNDDOWN(va, ps);
+      const vaddr_t entry_end = fbl::min(entry_base + ps, end);
+
+      // The hardware may set the dirty bit concurrently, so the accessed bit has to be cleared
+      // atomically rather than by rewriting the entry.
+      const pt_entry_t olde = __atomic_fetch_and(const_cast<pt_entry_t*>(pte), ~X86_MMU_PG_A,
+                                                 __ATOMIC_RELAXED);
+      if (olde & X86_MMU_PG_A) {
+        cm.cache_line_flusher()->FlushPtEntry(pte);
+        // Until the TLB entry is gone the hardware will not set the bit again.
+        cm.pending_tlb()->enqueue(entry_base, level, is_kernel_address(entry_base), true);
+
+        const paddr_t paddr_base = paddr_from_pte(level, olde);
+        for (; va < entry_end; va += PAGE_SIZE) {
+          accessed_callback(paddr_base + (va - entry_base), va);
+        }
+      }
+      va = entry_end;
+    }
+    cm.Finish();
+  }
+  return ZX_OK;
+}
+
 template <page_alloc_fn_t paf>
 void X86PageTableBase<paf>::Destroy(vaddr_t base, size_t size) {
   canary_.Assert();
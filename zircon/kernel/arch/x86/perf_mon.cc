@@ -1719,7 +1719,8 @@ static bool pmi_interrupt_handler(x86_iframe_t* frame, PerfmonState* state) {
 
   const uint64_t status = read_msr(IA32_PERF_GLOBAL_STATUS);
   uint64_t bits_to_clear = 0;
-  uint64_t cr3 = x86_get_cr3();
+  // Records identify the aspace by its page table, whatever PCID it is running with.
+  uint64_t cr3 = x86_get_cr3() & X86_CR3_BASE_MASK;
 
   LTRACEF("cpu %u: status 0x%" PRIx64 "\n", cpu, status);
 
@@ -138,7 +138,8 @@ void x86_processor_trace_init(void) {
 // Intel Processor Trace support needs to be able to map cr3 values that
 // appear in the trace to pids that ld.so uses to dump memory maps.
 void arch_trace_process_create(uint64_t pid, paddr_t pt_phys) {
-  // The cr3 value that appears in Intel PT h/w tracing.
+  // The cr3 value that appears in Intel PT h/w tracing. PCIDs are suspended while tracing is set
+  // up, so CR3 holds no PCID bits then.
   uint64_t cr3 = pt_phys;
   ktrace(TAG_IPT_PROCESS_CREATE, (uint32_t)pid, (uint32_t)(pid >> 32), (uint32_t)cr3,
          (uint32_t)(cr3 >> 32));
@@ -201,6 +202,10 @@ zx_status_t x86_ipt_alloc_trace(zx_insntrace_trace_mode_t mode, uint32_t num_tra
   if (!ipt_trace_state)
     return ZX_ERR_NO_MEMORY;
 
+  // Both PIP packets and IA32_RTIT_CR3_MATCH use the whole of CR3, which would include the PCID.
+  // Those are recycled, so keep CR3 equal to the page table address while tracing.
+  x86_mmu_suspend_pcid();
+
   mp_sync_exec(MP_IPI_TARGET_ALL, 0, x86_ipt_set_mode_task,
                reinterpret_cast<void*>(static_cast<uintptr_t>(mode)));
 
@@ -238,6 +243,9 @@ zx_status_t x86_ipt_free_trace() {
     DEBUG_ASSERT(!active);
   }
 
+  if (ipt_trace_state) {
+    x86_mmu_resume_pcid();
+  }
   free(ipt_trace_state);
   ipt_trace_state = nullptr;
   return ZX_OK;
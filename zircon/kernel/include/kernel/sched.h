@@ -51,6 +51,13 @@ bool sched_unblock_list(struct list_node* list) __WARN_UNUSED_RESULT TA_REQ(thre
 
 void sched_transition_off_cpu(cpu_num_t old_cpu) TA_REQ(thread_lock);
 
+// Arms or disarms a handoff for the current thread. While armed, the first fair
+// thread the current thread wakes that last ran on this cpu is queued on this
+// cpu and runs as soon as the current thread blocks, instead of waiting for its
+// turn in the run queue. Used for synchronous IPC, where the current thread is
+// about to block on a reply from the thread it wakes.
+void sched_set_handoff(bool armed);
+
 // sched_preempt_timer_tick is called when the preemption timer for a CPU has fired.
 //
 // This function is logically private and should only be called by timer.cpp.
@@ -42,6 +42,16 @@ class Scheduler {
   // runtime of each thread.
   static constexpr size_t kExpectedRuntimeAdjustmentRateShift = 8;
 
+  // The number of levels of the topology hierarchy, starting at the processor
+  // node, that are considered when searching for a target CPU in order of
+  // increasing cache distance.
+  static constexpr size_t kMaxCacheAffinityLevels = 4;
+
+  // Run queues with less expected runtime than this are considered lightly
+  // loaded enough to stop searching for a target CPU further away in the
+  // cache hierarchy.
+  static constexpr SchedDuration kCacheAffinityLoadThreshold = kDefaultMinimumGranularity;
+
   Scheduler() = default;
   ~Scheduler() = default;
 
@@ -58,6 +68,11 @@ class Scheduler {
   // Returns the number of the CPU this scheduler instance is associated with.
   cpu_num_t this_cpu() const { return this_cpu_; }
 
+  // Computes the cache affinity masks of every CPU from the system topology.
+  // Called once after the system topology and the percpu structures are
+  // initialized.
+  static void InitializeCacheAffinity();
+
  private:
   // Allow percpu to init our cpu number.
   friend struct percpu;
@@ -80,6 +95,7 @@ class Scheduler {
   friend bool sched_unblock_list(struct list_node* list);
   friend void sched_transition_off_cpu(cpu_num_t old_cpu);
   friend void sched_preempt_timer_tick(zx_time_t now);
+  friend void sched_set_handoff(bool armed);
 
   // Static scheduler methods called by the wrapper API above.
   static void InitializeThread(Thread* thread, int priority);
@@ -101,6 +117,7 @@ class Scheduler {
   static void InheritWeight(Thread* thread, int priority, cpu_mask_t* cpus_to_reschedule_mask)
       TA_REQ(thread_lock);
   static void TimerTick(SchedTime now);
+  static void SetHandoff(bool armed);
 
   // Specifies how to place a thread in the virtual timeline and run queue.
   enum class Placement {
@@ -159,8 +176,16 @@ class Scheduler {
   void QueueThread(Thread* thread, Placement placement, SchedTime now = SchedTime{0},
                    SchedDuration total_runtime_ns = SchedDuration{0}) TA_REQ(thread_lock);
 
-  // Removes the thread at the head of the fair run queue and returns it.
-  Thread* DequeueFairThread() TA_REQ(thread_lock);
+  // Removes the eligible thread with the earliest virtual finish time from the
+  // fair run queue and returns it. If |preferred| is in the fair run queue and
+  // eligible, it is taken instead.
+  Thread* DequeueFairThread(Thread* preferred = nullptr) TA_REQ(thread_lock);
+
+  // Moves the best eligible fair thread from the busiest run queue in the same
+  // cache domain as this CPU into this CPU's run queue. Returns true if a
+  // thread was stolen. Only called when this CPU would otherwise go idle; a
+  // CPU with a light but non-empty queue does not pull work.
+  bool StealWork(SchedTime now) TA_REQ(thread_lock);
 
   // Removes the eligible thread with the earliest deadline in the deadline run
   // queue and returns it.
@@ -281,6 +306,12 @@ class Scheduler {
   TA_GUARDED(thread_lock)
   Thread* active_thread_{nullptr};
 
+  // Thread in the fair run queue that was woken by the active thread while it
+  // had a handoff armed. It is selected ahead of the other fair threads when
+  // the active thread blocks.
+  TA_GUARDED(thread_lock)
+  Thread* handoff_thread_{nullptr};
+
   // Monotonically increasing counter to break ties when queuing tasks with
   // the same key. This has the effect of placing newly queued tasks behind
   // already queued tasks with the same key. This is also necessary to
@@ -359,6 +390,13 @@ class Scheduler {
   TA_GUARDED(thread_lock)
   SchedDuration peak_latency_grans_{kDefaultPeakLatency / kDefaultMinimumGranularity};
 
+  // Masks of the CPUs that share successively larger parts of the topology
+  // hierarchy with this CPU: index 0 holds the CPUs of the same processor node
+  // (SMT siblings), index 1 the CPUs under its parent (typically the shared
+  // last level cache or cluster), and so on. Unused levels are zero.
+  TA_GUARDED(thread_lock)
+  cpu_mask_t cache_affinity_masks_[kMaxCacheAffinityLevels]{};
+
   // The CPU this scheduler instance is associated with.
   // NOTE: This member is not initialized to prevent clobbering the value set
   // by sched_early_init(), which is called before the global ctors that
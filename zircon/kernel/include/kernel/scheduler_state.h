@@ -208,6 +208,10 @@ class SchedulerState {
 
   // Flag indicating whether this thread is associated with a run queue.
   bool active_{false};
+
+  // Flag indicating whether the next thread woken by this thread should run
+  // as soon as this thread blocks. Only accessed by the thread itself.
+  bool handoff_armed_{false};
 };
 
 #endif  // ZIRCON_KERNEL_INCLUDE_KERNEL_SCHEDULER_STATE_H_
@@ -36,6 +36,10 @@ class Semaphore {
   // of ZX_ERR_INTERNAL_INTR errors if the thread had a signal delivered.
   zx_status_t Wait(const Deadline& deadline);
 
+  // Without blocking, decrement the count by up to |max|, stopping early if the count reaches
+  // zero.  Returns the amount by which the count was decremented.
+  uint64_t TryWaitMany(uint64_t max);
+
   // Observe the current internal count of the semaphore.
   uint64_t count() {
     Guard<spin_lock_t, IrqSave> guard{ThreadLock::Get()};
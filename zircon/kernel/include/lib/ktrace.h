@@ -36,6 +36,11 @@ constexpr auto TraceNever = TraceEnabled<false>{};
 
 static inline uint64_t ktrace_timestamp() { return current_ticks(); }
 
+// Passed instead of an explicit timestamp to have a record stamped with the
+// time it is written to the buffer. The timestamp is then read with interrupts
+// disabled, so the records of each cpu are in timestamp order.
+constexpr uint64_t kKtraceTimestampNow = UINT64_MAX;
+
 // Utility macro to convert string literals passed to local tracing macros into
 // StringRef literals.
 //
@@ -50,10 +55,10 @@ static inline uint64_t ktrace_timestamp() { return current_ticks(); }
 #define KTRACE_STRING_REF_CAT(a, b) a##b
 #define KTRACE_STRING_REF(string) KTRACE_STRING_REF_CAT(string, _stringref)
 
-// Allocates a new trace record in the trace buffer. Returns a pointer to the
-// start of the record or nullptr if tracing is disabled or the end of the
-// buffer is reached.
-void* ktrace_open(uint32_t tag, uint64_t ts = ktrace_timestamp());
+// Writes a trace record to the current cpu's trace buffer. The record's
+// payload is the KTRACE_LEN(tag) - KTRACE_HDRSIZE bytes at |payload|. Returns
+// false if tracing is disabled or the record did not fit in the buffer.
+bool ktrace_write_record(uint32_t tag, const void* payload, uint64_t ts = kKtraceTimestampNow);
 
 // Emits a tiny trace record.
 void ktrace_tiny(uint32_t tag, uint32_t arg);
@@ -62,16 +67,13 @@ void ktrace_tiny(uint32_t tag, uint32_t arg);
 // is false.
 template <bool enabled>
 inline void ktrace(TraceEnabled<enabled>, TraceContext context, uint32_t tag, uint32_t a,
-                   uint32_t b, uint32_t c, uint32_t d, uint64_t explicit_ts = ktrace_timestamp()) {
+                   uint32_t b, uint32_t c, uint32_t d,
+                   uint64_t explicit_ts = kKtraceTimestampNow) {
   if constexpr (enabled) {
     const uint32_t effective_tag =
         KTRACE_TAG_FLAGS(tag, context == TraceContext::Thread ? 0 : KTRACE_FLAGS_CPU);
-    if (uint32_t* data = static_cast<uint32_t*>(ktrace_open(effective_tag, explicit_ts))) {
-      data[0] = a;
-      data[1] = b;
-      data[2] = c;
-      data[3] = d;
-    }
+    const uint32_t args[] = {a, b, c, d};
+    ktrace_write_record(effective_tag, args, explicit_ts);
   } else {
     (void)context;
     (void)tag;
@@ -85,7 +87,7 @@ inline void ktrace(TraceEnabled<enabled>, TraceContext context, uint32_t tag, ui
 // Backwards-compatible API for existing users of unconditional thread-context
 // traces.
 static inline void ktrace(uint32_t tag, uint32_t a, uint32_t b, uint32_t c, uint32_t d,
-                          uint64_t explicit_ts = ktrace_timestamp()) {
+                          uint64_t explicit_ts = kKtraceTimestampNow) {
   ktrace(TraceAlways, TraceContext::Thread, tag, a, b, c, d, explicit_ts);
 }
 
@@ -105,7 +107,7 @@ inline void ktrace_probe(TraceEnabled<enabled>, TraceContext context, StringRef*
     const uint32_t effective_tag =
         KTRACE_TAG_FLAGS(tag, context == TraceContext::Thread ? 0 : KTRACE_FLAGS_CPU);
 
-    ktrace_open(effective_tag);
+    ktrace_write_record(effective_tag, nullptr);
   } else {
     (void)context;
     (void)string_ref;
@@ -120,12 +122,8 @@ inline void ktrace_probe(TraceEnabled<enabled>, TraceContext context, StringRef*
     const uint32_t effective_tag =
         KTRACE_TAG_FLAGS(tag, context == TraceContext::Thread ? 0 : KTRACE_FLAGS_CPU);
 
-    void* const payload = ktrace_open(effective_tag);
-    uint32_t* const args = static_cast<uint32_t*>(payload);
-    if (args) {
-      args[0] = a;
-      args[1] = b;
-    }
+    const uint32_t args[] = {a, b};
+    ktrace_write_record(effective_tag, args);
   } else {
     (void)context;
     (void)string_ref;
@@ -142,11 +140,8 @@ inline void ktrace_probe(TraceEnabled<enabled>, TraceContext context, StringRef*
     const uint32_t effective_tag =
         KTRACE_TAG_FLAGS(tag, context == TraceContext::Thread ? 0 : KTRACE_FLAGS_CPU);
 
-    void* const payload = ktrace_open(effective_tag);
-    uint64_t* const args = static_cast<uint64_t*>(payload);
-    if (args) {
-      args[0] = a;
-    }
+    const uint64_t args[] = {a};
+    ktrace_write_record(effective_tag, args);
   } else {
     (void)context;
     (void)string_ref;
@@ -162,12 +157,8 @@ inline void ktrace_probe(TraceEnabled<enabled>, TraceContext context, StringRef*
     const uint32_t effective_tag =
         KTRACE_TAG_FLAGS(tag, context == TraceContext::Thread ? 0 : KTRACE_FLAGS_CPU);
 
-    void* const payload = ktrace_open(effective_tag);
-    uint64_t* const args = static_cast<uint64_t*>(payload);
-    if (args) {
-      args[0] = a;
-      args[1] = b;
-    }
+    const uint64_t args[] = {a, b};
+    ktrace_write_record(effective_tag, args);
   } else {
     (void)context;
     (void)string_ref;
@@ -184,7 +175,7 @@ inline void ktrace_begin_duration(TraceEnabled<enabled>, TraceContext context, u
     const uint32_t effective_tag =
         KTRACE_TAG_FLAGS(tag, context == TraceContext::Thread ? 0 : KTRACE_FLAGS_CPU);
 
-    ktrace_open(effective_tag);
+    ktrace_write_record(effective_tag, nullptr);
   } else {
     (void)context;
     (void)group;
@@ -200,7 +191,7 @@ inline void ktrace_end_duration(TraceEnabled<enabled>, TraceContext context, uin
     const uint32_t effective_tag =
         KTRACE_TAG_FLAGS(tag, context == TraceContext::Thread ? 0 : KTRACE_FLAGS_CPU);
 
-    ktrace_open(effective_tag);
+    ktrace_write_record(effective_tag, nullptr);
   } else {
     (void)context;
     (void)group;
@@ -216,12 +207,8 @@ inline void ktrace_begin_duration(TraceEnabled<enabled>, TraceContext context, u
     const uint32_t effective_tag =
         KTRACE_TAG_FLAGS(tag, context == TraceContext::Thread ? 0 : KTRACE_FLAGS_CPU);
 
-    void* const payload = ktrace_open(effective_tag);
-    uint64_t* const args = static_cast<uint64_t*>(payload);
-    if (args) {
-      args[0] = a;
-      args[1] = b;
-    }
+    const uint64_t args[] = {a, b};
+    ktrace_write_record(effective_tag, args);
   } else {
     (void)context;
     (void)group;
@@ -239,12 +226,8 @@ inline void ktrace_end_duration(TraceEnabled<enabled>, TraceContext context, uin
     const uint32_t effective_tag =
         KTRACE_TAG_FLAGS(tag, context == TraceContext::Thread ? 0 : KTRACE_FLAGS_CPU);
 
-    void* const payload = ktrace_open(effective_tag);
-    uint64_t* const args = static_cast<uint64_t*>(payload);
-    if (args) {
-      args[0] = a;
-      args[1] = b;
-    }
+    const uint64_t args[] = {a, b};
+    ktrace_write_record(effective_tag, args);
   } else {
     (void)context;
     (void)group;
@@ -262,12 +245,8 @@ inline void ktrace_flow_begin(TraceEnabled<enabled>, TraceContext context, uint3
     const uint32_t effective_tag =
         KTRACE_TAG_FLAGS(tag, context == TraceContext::Thread ? 0 : KTRACE_FLAGS_CPU);
 
-    void* const payload = ktrace_open(effective_tag);
-    uint64_t* const args = static_cast<uint64_t*>(payload);
-    if (args) {
-      args[0] = flow_id;
-      args[1] = a;
-    }
+    const uint64_t args[] = {flow_id, a};
+    ktrace_write_record(effective_tag, args);
   } else {
     (void)context;
     (void)group;
@@ -285,12 +264,8 @@ inline void ktrace_flow_end(TraceEnabled<enabled>, TraceContext context, uint32_
     const uint32_t effective_tag =
         KTRACE_TAG_FLAGS(tag, context == TraceContext::Thread ? 0 : KTRACE_FLAGS_CPU);
 
-    void* const payload = ktrace_open(effective_tag);
-    uint64_t* const args = static_cast<uint64_t*>(payload);
-    if (args) {
-      args[0] = flow_id;
-      args[1] = a;
-    }
+    const uint64_t args[] = {flow_id, a};
+    ktrace_write_record(effective_tag, args);
   } else {
     (void)context;
     (void)group;
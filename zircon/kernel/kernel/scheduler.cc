@@ -12,6 +12,7 @@
 #include <inttypes.h>
 #include <lib/counters.h>
 #include <lib/ktrace.h>
+#include <lib/system-topology.h>
 #include <platform.h>
 #include <stdio.h>
 #include <string.h>
@@ -32,6 +33,7 @@
 #include <kernel/thread.h>
 #include <kernel/thread_lock.h>
 #include <ktl/move.h>
+#include <lk/init.h>
 #include <vm/vm.h>
 
 using ffl::FromRatio;
@@ -76,6 +78,7 @@ KCOUNTER(demand_counter, "thread.demand_accum")
 KCOUNTER(latency_counter, "thread.latency_accum")
 KCOUNTER(runnable_counter, "thread.runnable_accum")
 KCOUNTER(samples_counter, "thread.samples_accum")
+KCOUNTER(handoff_counter, "thread.handoffs")
 
 namespace {
 
@@ -241,6 +244,56 @@ size_t Scheduler::GetRunnableTasks() const {
   return static_cast<size_t>(total_runnable_tasks);
 }
 
+namespace {
+
+// Returns the mask of the logical CPUs under the given topology node.
+cpu_mask_t TopologyNodeCpuMask(const system_topology::Node* node) {
+  if (node->entity_type == ZBI_TOPOLOGY_ENTITY_PROCESSOR) {
+    cpu_mask_t mask = 0;
+    const zbi_topology_processor_t& processor = node->entity.processor;
+    for (size_t i = 0; i < processor.logical_id_count; i++) {
+      mask |= cpu_num_to_mask(processor.logical_ids[i]);
+    }
+    return mask;
+  }
+
+  cpu_mask_t mask = 0;
+  for (const system_topology::Node* child : node->children) {
+    mask |= TopologyNodeCpuMask(child);
+  }
+  return mask;
+}
+
+}  // anonymous namespace
+
+void Scheduler::InitializeCacheAffinity() {
+  const cpu_num_t processor_count = static_cast<cpu_num_t>(percpu::processor_count());
+
+  Guard<spin_lock_t, IrqSave> guard{ThreadLock::Get()};
+  for (const system_topology::Node* processor : system_topology::GetSystemTopology().processors()) {
+    // Compute the masks once per processor node and share them among its
+    // logical CPUs, since SMT siblings have identical cache affinity.
+    cpu_mask_t masks[kMaxCacheAffinityLevels] = {};
+    const system_topology::Node* node = processor;
+    for (size_t level = 0; level < kMaxCacheAffinityLevels && node != nullptr; level++) {
+      masks[level] = TopologyNodeCpuMask(node);
+      node = node->parent;
+    }
+
+    const zbi_topology_processor_t& info = processor->entity.processor;
+    for (size_t i = 0; i < info.logical_id_count; i++) {
+      const cpu_num_t cpu = info.logical_ids[i];
+      if (cpu >= processor_count) {
+        continue;
+      }
+      Scheduler* const queue = Get(cpu);
+      for (size_t level = 0; level < kMaxCacheAffinityLevels; level++) {
+        queue->cache_affinity_masks_[level] = masks[level];
+      }
+    }
+  }
+}
+
 // Performs an augmented binary search for the task with the earliest finish
 // time that is also equal to or later than the given eligible time.
 //
@@ -340,7 +393,7 @@ void Scheduler::InitializeThread(Thread* thread, const zx_sched_deadline_params_
 
 // Dequeues the eligible thread with the earliest virtual finish time. The
 // caller must ensure that there is at least one thread in the queue.
-Thread* Scheduler::DequeueFairThread() {
+Thread* Scheduler::DequeueFairThread(Thread* preferred) {
   LocalTraceDuration<KTRACE_DETAILED> trace{"dequeue_fair_thread"_stringref};
 
   // Snap the virtual clock to the earliest start time.
@@ -366,9 +419,75 @@ Thread* Scheduler::DequeueFairThread() {
                    earliest_thread.scheduler_state_.min_finish_time_.raw_value());
 
   virtual_time_ = eligible_time;
+
+  // A preferred thread only gets ahead of the others while it has not received
+  // more than its share, so it cannot starve them.
+  if (preferred != nullptr && preferred->scheduler_state_.start_time_ <= eligible_time) {
+    return fair_run_queue_.erase(*preferred);
+  }
   return fair_run_queue_.erase(*eligible_thread);
 }
 
+bool Scheduler::StealWork(SchedTime now) {
+  LocalTraceDuration<KTRACE_DETAILED> trace{"steal_work: victim,stolen"_stringref};
+
+  const cpu_mask_t current_cpu_mask = cpu_num_to_mask(this_cpu());
+  const cpu_mask_t active_mask = mp_get_active_mask();
+  if ((active_mask & current_cpu_mask) == 0) {
+    return false;
+  }
+
+  // Only steal from CPUs that share a cache with this one. The domain is empty
+  // until the cache affinity masks are initialized, which disables stealing
+  // during early boot.
+  const cpu_mask_t domain_mask =
+      (cache_affinity_masks_[0] | cache_affinity_masks_[1]) & active_mask & ~current_cpu_mask;
+  if (domain_mask == 0) {
+    return false;
+  }
+
+  // Find the busiest queue in the domain with at least one thread waiting to
+  // run that is permitted to run on this CPU.
+  Scheduler* victim_queue = nullptr;
+  Thread* victim_thread = nullptr;
+  for (cpu_mask_t search_mask = domain_mask; search_mask != 0;) {
+    const cpu_num_t candidate_cpu = lowest_cpu_set(search_mask);
+    search_mask &= ~cpu_num_to_mask(candidate_cpu);
+
+    Scheduler* const candidate_queue = Get(candidate_cpu);
+    if (candidate_queue->fair_run_queue_.is_empty()) {
+      continue;
+    }
+    if (victim_queue != nullptr &&
+        candidate_queue->total_expected_runtime_ns_ <= victim_queue->total_expected_runtime_ns_) {
+      continue;
+    }
+
+    // The run queue is ordered by start time, so the first thread with a
+    // compatible affinity is the best eligible candidate.
+    for (Thread& thread : candidate_queue->fair_run_queue_) {
+      if (thread.hard_affinity_ & current_cpu_mask) {
+        victim_queue = candidate_queue;
+        victim_thread = &thread;
+        break;
+      }
+    }
+  }
+
+  if (victim_thread == nullptr) {
+    trace.End(INVALID_CPU, 0);
+    return false;
+  }
+
+  victim_queue->fair_run_queue_.erase(*victim_thread);
+  victim_queue->Remove(victim_thread);
+  Insert(now, victim_thread);
+
+  SCHED_LTRACEF("stole thread=%s from cpu=%u\n", victim_thread->name_, victim_queue->this_cpu());
+  trace.End(victim_queue->this_cpu(), 1);
+  return true;
+}
+
 // Dequeues the eligible thread with the earliest deadline. The caller must
 // ensure that there is at least one eligible thread in the queue.
 Thread* Scheduler::DequeueDeadlineThread(SchedTime eligible_time) {
@@ -492,9 +611,30 @@ Thread* Scheduler::EvaluateNextThread(SchedTime now, Thread* current_thread, boo
   // Note the that predicates in this block must be evaluated here, since the
   // operations above may change the queues and invalidate the predicates
   // evaluated at the start of this method.
+  Thread* const handoff_thread = handoff_thread_;
+  handoff_thread_ = nullptr;
+
   if (IsDeadlineThreadEligible(now)) {
     return DequeueDeadlineThread(now);
   } else if (likely(!fair_run_queue_.is_empty())) {
+    // If the current thread blocked right after waking a thread on this CPU,
+    // for example to wait for the reply to a channel call, prefer running the
+    // woken thread over the thread with the earliest virtual finish time, as
+    // long as it is eligible. The thread may have switched to the deadline
+    // discipline since, in which case it is scheduled normally.
+    if (handoff_thread != nullptr && !is_active && IsFairThread(handoff_thread)) {
+      DEBUG_ASSERT(handoff_thread->scheduler_state_.InQueue());
+      DEBUG_ASSERT(handoff_thread->curr_cpu_ == this_cpu());
+      Thread* const next_thread = DequeueFairThread(handoff_thread);
+      if (next_thread == handoff_thread) {
+        handoff_counter.Add(1);
+      }
+      return next_thread;
+    }
+    return DequeueFairThread();
+  } else if (StealWork(now)) {
+    // The local queue ran dry: run a thread pulled from an overloaded CPU in
+    // the same cache domain instead of going idle.
     return DequeueFairThread();
   } else {
     return &percpu::Get(this_cpu()).idle_thread;
@@ -537,12 +677,6 @@ cpu_num_t Scheduler::FindTargetCpu(Thread* thread) {
 
   target_queue = Get(target_cpu);
 
-  // See if there is a better target in the set of available CPUs.
-  // TODO(eieio): Replace this with a search in order of increasing cache
-  // distance from the initial target cpu when topology information is available.
-  // TODO(eieio): Add some sort of threshold to terminate search when a
-  // sufficiently unloaded target is found.
-
   const auto compare_fair = [](Scheduler* const queue_a,
                                Scheduler* const queue_b) TA_REQ(thread_lock) {
     if (queue_a->total_expected_runtime_ns_ == queue_b->total_expected_runtime_ns_) {
@@ -566,20 +700,57 @@ cpu_num_t Scheduler::FindTargetCpu(Thread* thread) {
            queue->total_expected_runtime_ns_ == SchedDuration{0};
   };
 
+  const auto is_lightly_loaded_fair = [](Scheduler* const queue) TA_REQ(thread_lock) {
+    return queue->total_expected_runtime_ns_ < kCacheAffinityLoadThreshold;
+  };
+  const auto is_lightly_loaded_deadline = [](Scheduler* const queue) TA_REQ(thread_lock) {
+    return queue->total_deadline_utilization_ == SchedUtilization{0} &&
+           queue->total_expected_runtime_ns_ < kCacheAffinityLoadThreshold;
+  };
+
   const auto compare = IsFairThread(thread) ? compare_fair : compare_deadline;
   const auto is_idle = IsFairThread(thread) ? is_idle_fair : is_idle_deadline;
+  const auto is_lightly_loaded =
+      IsFairThread(thread) ? is_lightly_loaded_fair : is_lightly_loaded_deadline;
+
+  // See if there is a better target in the set of available CPUs. Candidates
+  // are visited in order of increasing cache distance from the CPU the thread
+  // last ran on, so that a migration stays within the smallest cache domain
+  // that has capacity. The search terminates at the first idle CPU, or at the
+  // end of a cache domain if the best target found so far is lightly loaded
+  // and within that domain.
+  // The final level covers all remaining CPUs, which also handles CPUs for
+  // which no topology information is available.
+  const cpu_num_t origin_cpu = last_cpu_mask != 0 ? thread->last_cpu_ : target_cpu;
+  const Scheduler* const origin_queue = Get(origin_cpu);
 
   cpu_mask_t remaining_mask = available_mask & ~cpu_num_to_mask(target_cpu);
-  while (remaining_mask != 0 && !is_idle(target_queue)) {
-    const cpu_num_t candidate_cpu = lowest_cpu_set(remaining_mask);
-    Scheduler* const candidate_queue = Get(candidate_cpu);
+  cpu_mask_t searched_mask = 0;
+  for (size_t level = 0; level <= kMaxCacheAffinityLevels; level++) {
+    if (remaining_mask == 0 || is_idle(target_queue)) {
+      break;
+    }
+
+    const cpu_mask_t domain_mask =
+        level < kMaxCacheAffinityLevels ? origin_queue->cache_affinity_masks_[level] : CPU_MASK_ALL;
+    cpu_mask_t search_mask = remaining_mask & domain_mask;
+    searched_mask |= domain_mask;
+    while (search_mask != 0 && !is_idle(target_queue)) {
+      const cpu_num_t candidate_cpu = lowest_cpu_set(search_mask);
+      Scheduler* const candidate_queue = Get(candidate_cpu);
+
+      if (compare(candidate_queue, target_queue)) {
+        target_cpu = candidate_cpu;
+        target_queue = candidate_queue;
+      }
 
-    if (compare(candidate_queue, target_queue)) {
-      target_cpu = candidate_cpu;
-      target_queue = candidate_queue;
+      search_mask &= ~cpu_num_to_mask(candidate_cpu);
+      remaining_mask &= ~cpu_num_to_mask(candidate_cpu);
     }
 
-    remaining_mask &= ~cpu_num_to_mask(candidate_cpu);
+    if ((cpu_num_to_mask(target_cpu) & searched_mask) && is_lightly_loaded(target_queue)) {
+      break;
+    }
   }
 
   SCHED_LTRACEF("thread=%s target_cpu=%u\n", thread->name_, target_cpu);
@@ -1061,6 +1232,12 @@ void Scheduler::Remove(Thread* thread) {
   SchedulerState* const state = &thread->scheduler_state_;
   DEBUG_ASSERT(!state->InQueue());
 
+  // A thread leaving this CPU, for example by being stolen, can no longer be
+  // handed off to.
+  if (handoff_thread_ == thread) {
+    handoff_thread_ = nullptr;
+  }
+
   // Ensure that removal happens only once, even if Block() is called multiple times.
   if (state->OnRemove()) {
     thread->curr_cpu_ = INVALID_CPU;
@@ -1118,13 +1295,29 @@ bool Scheduler::Unblock(Thread* thread) {
   const SchedTime now = CurrentTime();
   SCHED_LTRACEF("thread=%s now=%" PRId64 "\n", thread->name_, now.raw_value());
 
-  const cpu_num_t target_cpu = FindTargetCpu(thread);
+  // If the current thread armed a handoff and is about to block waiting on
+  // this thread, keep this thread on the current CPU when it last ran here
+  // rather than searching for another CPU: this one is about to become free.
+  Thread* const current_thread = Thread::Current::Get();
+  const cpu_num_t current_cpu = arch_curr_cpu_num();
+  const bool handoff =
+      current_thread->scheduler_state_.handoff_armed_ && !arch_blocking_disallowed() &&
+      IsFairThread(current_thread) && IsFairThread(thread) && thread->last_cpu_ == current_cpu &&
+      (GetEffectiveCpuMask(mp_get_active_mask(), thread) & cpu_num_to_mask(current_cpu)) != 0;
+
+  const cpu_num_t target_cpu = handoff ? current_cpu : FindTargetCpu(thread);
   Scheduler* const target = Get(target_cpu);
 
   thread->state_ = THREAD_READY;
   target->Insert(now, thread);
 
-  if (target_cpu == arch_curr_cpu_num()) {
+  if (handoff) {
+    // Only the first thread woken is handed off to.
+    current_thread->scheduler_state_.handoff_armed_ = false;
+    target->handoff_thread_ = thread;
+  }
+
+  if (target_cpu == current_cpu) {
     return true;
   } else {
     mp_reschedule(cpu_num_to_mask(target_cpu), 0);
@@ -1625,6 +1818,10 @@ void Scheduler::TimerTick(SchedTime now) {
   Thread::Current::PreemptSetPending();
 }
 
+void Scheduler::SetHandoff(bool armed) {
+  Thread::Current::Get()->scheduler_state_.handoff_armed_ = armed;
+}
+
 // Temporary compatibility with the thread layer.
 
 void sched_init_thread(Thread* thread, int priority) {
@@ -1690,3 +1887,13 @@ void sched_change_deadline(Thread* thread, const zx_sched_deadline_params_t& par
 }
 
 void sched_preempt_timer_tick(zx_time_t now) { Scheduler::TimerTick(SchedTime{now}); }
+
+void sched_set_handoff(bool armed) { Scheduler::SetHandoff(armed); }
+
+static void scheduler_cache_affinity_init(uint32_t /*level*/) {
+  Scheduler::InitializeCacheAffinity();
+}
+
+// Runs after both the system topology and the secondary percpu structures are
+// initialized.
+LK_INIT_HOOK(scheduler_cache_affinity, scheduler_cache_affinity_init, LK_INIT_LEVEL_VM + 4)
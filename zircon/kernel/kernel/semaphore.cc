@@ -46,3 +46,11 @@ zx_status_t Semaphore::Wait(const Deadline& deadline) {
   current_thread->interruptable_ = false;
   return ret;
 }
+
+uint64_t Semaphore::TryWaitMany(uint64_t max) {
+  Guard<spin_lock_t, IrqSave> guard{ThreadLock::Get()};
+
+  const uint64_t taken = (count_ < max) ? count_ : max;
+  count_ -= taken;
+  return taken;
+}
@@ -78,6 +78,27 @@ static bool timeout_test() {
   END_TEST;
 }
 
+static bool try_wait_many_test() {
+  BEGIN_TEST;
+
+  Semaphore sema(5);
+  ASSERT_EQ(0u, sema.TryWaitMany(0));
+  ASSERT_EQ(5u, sema.count());
+
+  ASSERT_EQ(3u, sema.TryWaitMany(3));
+  ASSERT_EQ(2u, sema.count());
+
+  // Asking for more than is available takes what there is without blocking.
+  ASSERT_EQ(2u, sema.TryWaitMany(10));
+  ASSERT_EQ(0u, sema.count());
+  ASSERT_EQ(0u, sema.num_waiters());
+
+  ASSERT_EQ(0u, sema.TryWaitMany(1));
+  ASSERT_EQ(0u, sema.count());
+
+  END_TEST;
+}
+
 static int wait_sema_thread(void* arg) {
   auto sema = reinterpret_cast<Semaphore*>(arg);
   auto status = sema->Wait(Deadline::infinite());
@@ -143,6 +164,7 @@ static bool signal_test() {
 UNITTEST_START_TESTCASE(semaphore_tests)
 UNITTEST("smoke_test", smoke_test)
 UNITTEST("timeout_test", timeout_test)
+UNITTEST("try_wait_many_test", try_wait_many_test)
 UNITTEST("post_signal_test", signal_test<Signal::kPost>)
 UNITTEST("kill_signal_test", signal_test<Signal::kKill>)
 UNITTEST("suspend_signal_test", signal_test<Signal::kSuspend>)
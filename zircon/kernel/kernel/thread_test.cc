@@ -16,6 +16,7 @@
 #include <kernel/event.h>
 #include <kernel/mp.h>
 #include <kernel/mutex.h>
+#include <kernel/sched.h>
 #include <kernel/thread.h>
 #include <ktl/popcount.h>
 #include <ktl/unique_ptr.h>
@@ -263,6 +264,75 @@ bool thread_conflicting_soft_and_hard_affinity() {
   END_TEST;
 }
 
+// One side of a pair of threads that keep waking each other with a handoff,
+// as a synchronous IPC client and server would.
+struct HandoffPingPong {
+  Event* self;
+  Event* peer;
+  volatile int* should_stop;
+
+  static int Body(void* arg) {
+    auto* side = reinterpret_cast<HandoffPingPong*>(arg);
+    while (atomic_load(side->should_stop) == 0) {
+      sched_set_handoff(true);
+      side->peer->SignalNoResched();
+      sched_set_handoff(false);
+      side->self->Wait(Deadline::infinite());
+    }
+    // Release the peer in case it is waiting for us.
+    side->peer->SignalNoResched();
+    return 0;
+  }
+};
+
+bool thread_handoff_does_not_starve() {
+  BEGIN_TEST;
+
+  // Run a pair of threads that hand the cpu to each other and a spinning
+  // thread, all of equal weight, on the same cpu. The pair is never runnable
+  // at the same time, so the spinner should get about half of the cpu, and
+  // must not be starved by the handoffs.
+  const cpu_mask_t online = mp_get_online_mask();
+  ASSERT_NE(online, 0u, "Expected at least one CPU to be online.");
+  const cpu_mask_t cpu_mask = cpu_num_to_mask(lowest_cpu_set(online));
+
+  Event ping{EVENT_FLAG_AUTOUNSIGNAL};
+  Event pong{EVENT_FLAG_AUTOUNSIGNAL};
+  volatile int should_stop = 0;
+  HandoffPingPong sides[2] = {{&ping, &pong, &should_stop}, {&pong, &ping, &should_stop}};
+  Thread* threads[2];
+  for (size_t i = 0; i < 2; i++) {
+    threads[i] = Thread::Create("handoff_ping_pong", &HandoffPingPong::Body, &sides[i],
+                                LOW_PRIORITY);
+    ASSERT_NONNULL(threads[i], "thread_create failed.");
+    threads[i]->SetCpuAffinity(cpu_mask);
+  }
+
+  WorkerThread spinner("handoff_spinner");
+  spinner.thread()->SetCpuAffinity(cpu_mask);
+  spinner.Start();
+  spinner.WaitForWorkerProgress();
+  for (Thread* thread : threads) {
+    thread->Resume();
+  }
+
+  constexpr zx_duration_t kTestDuration = ZX_MSEC(500);
+  const zx_duration_t spinner_start = spinner.thread()->Runtime();
+  Thread::Current::SleepRelative(kTestDuration);
+  const zx_duration_t spinner_runtime = spinner.thread()->Runtime() - spinner_start;
+
+  atomic_store(&should_stop, 1);
+  for (Thread* thread : threads) {
+    int unused_retcode;
+    ASSERT_EQ(thread->Join(&unused_retcode, ZX_TIME_INFINITE), ZX_OK, "Failed to join thread.");
+  }
+  spinner.Join();
+
+  EXPECT_GE(spinner_runtime, kTestDuration / 4, "Spinning thread was starved by handoffs.");
+
+  END_TEST;
+}
+
 }  // namespace
 
 UNITTEST_START_TESTCASE(thread_tests)
@@ -272,4 +342,5 @@ UNITTEST("thread_last_cpu_new_thread", thread_last_cpu_new_thread)
 UNITTEST("thread_last_cpu_running_thread", thread_last_cpu_running_thread)
 UNITTEST("thread_empty_soft_affinity_mask", thread_empty_soft_affinity_mask)
 UNITTEST("thread_conflicting_soft_and_hard_affinity", thread_conflicting_soft_and_hard_affinity)
+UNITTEST("thread_handoff_does_not_starve", thread_handoff_does_not_starve)
 UNITTEST_END_TESTCASE(thread_tests, "thread", "thread tests")
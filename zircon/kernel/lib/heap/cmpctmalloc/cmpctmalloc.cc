@@ -787,28 +787,8 @@ static void cmpct_test_return_to_os(void) TA_EXCL(TheHeapLock::Get()) {
 }
 #endif  // HEAP_ENABLE_TESTS
 
-/****************************************************
- *
- * Public API
- *
- ****************************************************/
-
-void* cmpct_alloc(size_t size) {
-  if (size == 0u) {
-    return NULL;
-  }
-
-  // Large allocations are no longer allowed. See ZX-1318 for details.
-  if (size > (HEAP_LARGE_ALLOC_BYTES - sizeof(header_t))) {
-    return NULL;
-  }
-
-  size_t rounded_up;
-  int start_bucket = size_to_index_allocating(size, &rounded_up);
-
-  rounded_up += sizeof(header_t);
-
-  Guard<Mutex> guard(TheHeapLock::Get());
+static void* cmpct_alloc_locked(size_t size, size_t rounded_up, int start_bucket)
+    TA_REQ(TheHeapLock::Get()) {
   int bucket = find_nonempty_bucket(start_bucket);
   if (bucket == -1) {
     // Grow heap by at least 12% if we can.
@@ -850,30 +830,7 @@ void* cmpct_alloc(size_t size) {
   return result;
 }
 
-void* cmpct_realloc(void* payload, size_t size) {
-  if (payload == NULL) {
-    return cmpct_alloc(size);
-  }
-  header_t* header = (header_t*)payload - 1;
-  size_t old_size = header->size - sizeof(header_t);
-
-  void* new_payload = cmpct_alloc(size);
-  if (new_payload == NULL) {
-    return NULL;
-  }
-
-  memcpy(new_payload, payload, ktl::min(size, old_size));
-  cmpct_free(payload);
-  return new_payload;
-}
-
-void cmpct_free(void* payload) {
-  if (payload == NULL) {
-    return;
-  }
-
-  Guard<Mutex> guard(TheHeapLock::Get());
-
+static void cmpct_free_locked(void* payload) TA_REQ(TheHeapLock::Get()) {
   header_t* header = (header_t*)payload - 1;
   DEBUG_ASSERT(!is_tagged_as_free(header));  // Double free!
   size_t size = header->size;
@@ -908,6 +865,97 @@ void cmpct_free(void* payload) {
   }
 }
 
+/****************************************************
+ *
+ * Public API
+ *
+ ****************************************************/
+
+void* cmpct_alloc(size_t size) {
+  if (size == 0u) {
+    return NULL;
+  }
+
+  // Large allocations are no longer allowed. See ZX-1318 for details.
+  if (size > (HEAP_LARGE_ALLOC_BYTES - sizeof(header_t))) {
+    return NULL;
+  }
+
+  size_t rounded_up;
+  int start_bucket = size_to_index_allocating(size, &rounded_up);
+
+  rounded_up += sizeof(header_t);
+
+  Guard<Mutex> guard(TheHeapLock::Get());
+  return cmpct_alloc_locked(size, rounded_up, start_bucket);
+}
+
+size_t cmpct_alloc_many(size_t size, void** ptrs, size_t count) {
+  if (size == 0u || size > (HEAP_LARGE_ALLOC_BYTES - sizeof(header_t))) {
+    return 0;
+  }
+
+  size_t rounded_up;
+  int start_bucket = size_to_index_allocating(size, &rounded_up);
+
+  rounded_up += sizeof(header_t);
+
+  Guard<Mutex> guard(TheHeapLock::Get());
+  size_t allocated = 0;
+  while (allocated < count) {
+    void* ptr = cmpct_alloc_locked(size, rounded_up, start_bucket);
+    if (ptr == NULL) {
+      break;
+    }
+    ptrs[allocated++] = ptr;
+  }
+  return allocated;
+}
+
+void* cmpct_realloc(void* payload, size_t size) {
+  if (payload == NULL) {
+    return cmpct_alloc(size);
+  }
+  header_t* header = (header_t*)payload - 1;
+  size_t old_size = header->size - sizeof(header_t);
+
+  void* new_payload = cmpct_alloc(size);
+  if (new_payload == NULL) {
+    return NULL;
+  }
+
+  memcpy(new_payload, payload, ktl::min(size, old_size));
+  cmpct_free(payload);
+  return new_payload;
+}
+
+void cmpct_free(void* payload) {
+  if (payload == NULL) {
+    return;
+  }
+
+  Guard<Mutex> guard(TheHeapLock::Get());
+  cmpct_free_locked(payload);
+}
+
+void cmpct_free_many(void** ptrs, size_t count) {
+  Guard<Mutex> guard(TheHeapLock::Get());
+  for (size_t i = 0; i < count; i++) {
+    if (ptrs[i] != NULL) {
+      cmpct_free_locked(ptrs[i]);
+    }
+  }
+}
+
+size_t cmpct_usable_size(const void* payload) {
+  // The size of a live allocation is only ever changed by its owner, so no lock is needed. The
+  // free bit of its own header is likewise only set when the owner frees it, which lets callers
+  // that free without going through cmpct_free_locked keep its double free check.
+  const header_t* header = (const header_t*)payload - 1;
+  DEBUG_ASSERT(((uintptr_t)header->left & FREE_BIT) == 0);  // Double free!
+  return header->size - sizeof(header_t);
+}
+
 void* cmpct_memalign(size_t size, size_t alignment) {
   if (alignment < 8) {
     return cmpct_alloc(size);
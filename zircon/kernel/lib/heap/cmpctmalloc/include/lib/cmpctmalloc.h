@@ -22,6 +22,16 @@ void* cmpct_realloc(void*, size_t) TA_EXCL(TheHeapLock::Get());
 void cmpct_free(void*) TA_EXCL(TheHeapLock::Get());
 void* cmpct_memalign(size_t size, size_t alignment) TA_EXCL(TheHeapLock::Get());
 
+// Allocates up to |count| blocks of |size| bytes into |ptrs| under a single acquisition of the heap
+// lock. Returns the number of blocks allocated, which is only less than |count| if the heap could
+// not be grown.
+size_t cmpct_alloc_many(size_t size, void** ptrs, size_t count) TA_EXCL(TheHeapLock::Get());
+// Frees the |count| blocks in |ptrs| under a single acquisition of the heap lock.
+void cmpct_free_many(void** ptrs, size_t count) TA_EXCL(TheHeapLock::Get());
+// Returns the number of bytes usable in the block at |payload|, which is at least the size it was
+// allocated with.
+size_t cmpct_usable_size(const void* payload);
+
 void cmpct_init(void) TA_EXCL(TheHeapLock::Get());
 void cmpct_dump(bool panic_time) TA_EXCL(TheHeapLock::Get());
 void cmpct_get_info(size_t* size_bytes, size_t* free_bytes) TA_EXCL(TheHeapLock::Get());
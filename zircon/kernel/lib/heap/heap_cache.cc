@@ -0,0 +1,276 @@
+// Copyright 2020 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#include "heap_cache.h"
+
+#include <assert.h>
+#include <debug.h>
+#include <lib/cmpctmalloc.h>
+#include <lib/counters.h>
+#include <platform.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <arch/ops.h>
+#include <fbl/algorithm.h>
+#include <kernel/align.h>
+#include <kernel/spinlock.h>
+
+namespace {
+
+constexpr size_t kClassSizes[] = {16, 32, 48, 64, 96, 128, 192, 256};
+constexpr size_t kNumClasses = fbl::count_of(kClassSizes);
+
+// Number of blocks moved between a cache and cmpctmalloc at a time. Each size class of a cache holds
+// at most twice this many blocks.
+constexpr size_t kBatchSize = 16;
+constexpr size_t kCapacity = 2 * kBatchSize;
+
+#if defined(DEBUG) || LK_DEBUGLEVEL > 2
+#define HEAP_CACHE_DEBUG
+#endif
+
+// The same patterns cmpctmalloc fills blocks with, so a block looks the same to a debugger whether
+// it came from a cache or not.
+constexpr uint8_t kAllocFill = 0x99;
+constexpr uint8_t kFreeFill = 0x77;
+constexpr uint8_t kPaddingFill = 0x55;
+
+KCOUNTER(heap_cache_alloc_hit, "heap.cache.alloc_hit")
+KCOUNTER(heap_cache_alloc_miss, "heap.cache.alloc_miss")
+KCOUNTER(heap_cache_free_count, "heap.cache.free")
+KCOUNTER(heap_cache_drain_count, "heap.cache.drain")
+
+// Cached blocks are linked through their first word. The second holds a cookie derived from the
+// block's address, which lets a free of a block that is already cached be caught without searching
+// the caches. The smallest size class is 16 bytes, so both words always fit.
+struct FreeBlock {
+  FreeBlock* next;
+  uintptr_t cookie;
+};
+static_assert(sizeof(FreeBlock) <= kClassSizes[0]);
+
+constexpr uintptr_t kCachedMagic = 0x6865617063616368;  // "heapcach"
+
+uintptr_t CachedCookie(const FreeBlock* block) {
+  return reinterpret_cast<uintptr_t>(block) ^ kCachedMagic;
+}
+
+struct Magazine {
+  FreeBlock* head = nullptr;
+  size_t count = 0;
+};
+
+struct CpuCache {
+  // Interrupts are disabled while the lock is held so the owning thread cannot be preempted, which
+  // keeps the lock uncontended unless a thread migrates between reading the cpu number and taking
+  // it.
+  SpinLock lock;
+  Magazine magazines[kNumClasses] TA_GUARDED(lock);
+} __CPU_ALIGN;
+
+CpuCache caches[SMP_MAX_CPUS];
+
+CpuCache& CurrentCache() { return caches[arch_curr_cpu_num()]; }
+
+// Returns the smallest class that can hold |size| bytes.
+size_t AllocClass(size_t size) {
+  size_t cls = 0;
+  while (kClassSizes[cls] < size) {
+    cls++;
+  }
+  return cls;
+}
+
+// Returns the class a block with |usable| bytes can serve, or -1 if caching it would waste too
+// much of it.
+int FreeClass(size_t usable) {
+  if (usable < kClassSizes[0]) {
+    return -1;
+  }
+  size_t cls = kNumClasses - 1;
+  while (kClassSizes[cls] > usable) {
+    cls--;
+  }
+  if (usable - kClassSizes[cls] > kClassSizes[cls] / 2) {
+    return -1;
+  }
+  return static_cast<int>(cls);
+}
+
+// Marks |block|, which serves class |cls|, as cached. Like cmpctmalloc, debug builds fill the rest
+// of the block so that writes to it after it is freed are caught when it is next allocated.
+void TagCached(FreeBlock* block, size_t cls) {
+  block->cookie = CachedCookie(block);
+#ifdef HEAP_CACHE_DEBUG
+  memset(block + 1, kFreeFill, kClassSizes[cls] - sizeof(FreeBlock));
+#endif
+}
+
+// Takes |block| out of a cache to hand it to a caller wanting |size| bytes of class |cls|.
+void* UntagCached(FreeBlock* block, size_t cls, size_t size) {
+  DEBUG_ASSERT(block->cookie == CachedCookie(block));
+#ifdef HEAP_CACHE_DEBUG
+  const auto* bytes = reinterpret_cast<const uint8_t*>(block);
+  for (size_t i = sizeof(FreeBlock); i < kClassSizes[cls]; i++) {
+    if (bytes[i] != kFreeFill) {
+      platform_panic_start();
+      printf("Heap cache free fill check fail.  Cached block:\n");
+      hexdump8(block, kClassSizes[cls]);
+      panic("allocating %zu bytes, fill was %02x, offset %zu\n", size, bytes[i], i);
+    }
+  }
+#endif
+  block->next = nullptr;
+  block->cookie = 0;
+#ifdef HEAP_CACHE_DEBUG
+  memset(block, kAllocFill, size);
+  memset(reinterpret_cast<uint8_t*>(block) + size, kPaddingFill, kClassSizes[cls] - size);
+#endif
+  return block;
+}
+
+// Pushes |count| blocks, at most kBatchSize, onto the current cpu's magazine for |cls|. If the
+// magazine overflows, its oldest blocks are handed back to cmpctmalloc.
+void PushBlocks(size_t cls, void** blocks, size_t count) {
+  DEBUG_ASSERT(count <= kBatchSize);
+  void* drain[kBatchSize + 1];
+  size_t drain_count = 0;
+
+  for (size_t i = 0; i < count; i++) {
+    TagCached(static_cast<FreeBlock*>(blocks[i]), cls);
+  }
+
+  CpuCache& cache = CurrentCache();
+  {
+    Guard<SpinLock, IrqSave> guard{&cache.lock};
+    Magazine& mag = cache.magazines[cls];
+    for (size_t i = 0; i < count; i++) {
+      auto* block = static_cast<FreeBlock*>(blocks[i]);
+      block->next = mag.head;
+      mag.head = block;
+      if (++mag.count <= kCapacity) {
+        continue;
+      }
+      // Keep the most recently freed blocks, which are the most likely to still be in this cpu's
+      // data cache.
+      FreeBlock* last = mag.head;
+      for (size_t j = 1; j < kCapacity - kBatchSize; j++) {
+        last = last->next;
+      }
+      for (FreeBlock* old = last->next; old != nullptr; old = old->next) {
+        old->cookie = 0;
+        drain[drain_count++] = old;
+      }
+      last->next = nullptr;
+      mag.count = kCapacity - kBatchSize;
+    }
+  }
+
+  if (drain_count > 0) {
+    DEBUG_ASSERT(drain_count <= fbl::count_of(drain));
+    heap_cache_drain_count.Add(1);
+    cmpct_free_many(drain, drain_count);
+  }
+}
+
+}  // namespace
+
+void* heap_cache_alloc(size_t size) {
+  if (size == 0 || size > kClassSizes[kNumClasses - 1]) {
+    return nullptr;
+  }
+
+  const size_t cls = AllocClass(size);
+  CpuCache& cache = CurrentCache();
+  FreeBlock* block = nullptr;
+  {
+    Guard<SpinLock, IrqSave> guard{&cache.lock};
+    Magazine& mag = cache.magazines[cls];
+    if (mag.head != nullptr) {
+      block = mag.head;
+      mag.head = block->next;
+      mag.count--;
+    }
+  }
+  if (block != nullptr) {
+    heap_cache_alloc_hit.Add(1);
+    return UntagCached(block, cls, size);
+  }
+
+  heap_cache_alloc_miss.Add(1);
+  void* blocks[kBatchSize];
+  const size_t count = cmpct_alloc_many(kClassSizes[cls], blocks, kBatchSize);
+  if (count == 0) {
+    return nullptr;
+  }
+  // Keep the first block for the caller and cache the rest on whichever cpu we are now on.
+  PushBlocks(cls, blocks + 1, count - 1);
+  return blocks[0];
+}
+
+bool heap_cache_free(void* ptr) {
+  // cmpct_usable_size catches frees of blocks cmpctmalloc already has back.
+  const int cls = FreeClass(cmpct_usable_size(ptr));
+  if (cls < 0) {
+    return false;
+  }
+  DEBUG_ASSERT_MSG(!heap_cache_is_cached(ptr), "Double free of cached block %p\n", ptr);
+  heap_cache_free_count.Add(1);
+  PushBlocks(cls, &ptr, 1);
+  return true;
+}
+
+void heap_cache_drain() {
+  for (auto& cache : caches) {
+    for (size_t cls = 0; cls < kNumClasses; cls++) {
+      void* blocks[kCapacity];
+      size_t count = 0;
+      {
+        Guard<SpinLock, IrqSave> guard{&cache.lock};
+        Magazine& mag = cache.magazines[cls];
+        for (FreeBlock* block = mag.head; block != nullptr; block = block->next) {
+          block->cookie = 0;
+          blocks[count++] = block;
+        }
+        DEBUG_ASSERT(count == mag.count);
+        mag.head = nullptr;
+        mag.count = 0;
+      }
+      if (count > 0) {
+        cmpct_free_many(blocks, count);
+      }
+    }
+  }
+}
+
+bool heap_cache_is_cached(const void* ptr) {
+  const auto* block = static_cast<const FreeBlock*>(ptr);
+  return block->cookie == CachedCookie(block);
+}
+
+size_t heap_cache_cached_bytes() {
+  size_t bytes = 0;
+  for (auto& cache : caches) {
+    Guard<SpinLock, IrqSave> guard{&cache.lock};
+    for (size_t cls = 0; cls < kNumClasses; cls++) {
+      bytes += cache.magazines[cls].count * kClassSizes[cls];
+    }
+  }
+  return bytes;
+}
+
+void heap_cache_dump() {
+  printf("Per-cpu heap caches:\n");
+  for (size_t cls = 0; cls < kNumClasses; cls++) {
+    size_t count = 0;
+    for (auto& cache : caches) {
+      Guard<SpinLock, IrqSave> guard{&cache.lock};
+      count += cache.magazines[cls].count;
+    }
+    printf("\tsize %3zu: %zu blocks cached\n", kClassSizes[cls], count);
+  }
+}
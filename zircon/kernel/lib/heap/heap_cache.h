@@ -0,0 +1,38 @@
+// Copyright 2020 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#ifndef ZIRCON_KERNEL_LIB_HEAP_HEAP_CACHE_H_
+#define ZIRCON_KERNEL_LIB_HEAP_HEAP_CACHE_H_
+
+#include <stddef.h>
+
+// Per-cpu caches of small heap blocks, sorted into a handful of size classes, that sit in front of
+// cmpctmalloc. Blocks in a cache are still allocated as far as cmpctmalloc is concerned, which lets
+// most small allocations and frees avoid TheHeapLock entirely. Caches refill from and drain to
+// cmpctmalloc in batches.
+
+// Returns a block of at least |size| bytes from the current cpu's cache, refilling it if it is
+// empty. Returns nullptr if |size| is not cached or the heap is exhausted.
+void* heap_cache_alloc(size_t size);
+
+// Puts |ptr| in the current cpu's cache if its size fits one of the size classes. Returns false
+// if it does not, in which case the caller must free it to cmpctmalloc.
+bool heap_cache_free(void* ptr);
+
+// Returns true if |ptr|, which must be a block cmpctmalloc considers allocated, is sitting in a
+// cache. Freeing such a block again is a double free.
+bool heap_cache_is_cached(const void* ptr);
+
+// Returns every cached block to cmpctmalloc.
+void heap_cache_drain();
+
+// Returns the number of bytes held by the caches.
+size_t heap_cache_cached_bytes();
+
+// Prints the number of blocks cached for each size class.
+void heap_cache_dump();
+
+#endif  // ZIRCON_KERNEL_LIB_HEAP_HEAP_CACHE_H_
@@ -0,0 +1,137 @@
+// Copyright 2020 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#include <lib/unittest/unittest.h>
+#include <stdint.h>
+
+#include <arch/ops.h>
+#include <kernel/auto_preempt_disabler.h>
+#include <kernel/mp.h>
+#include <kernel/thread.h>
+#include <pow2.h>
+
+#include "heap_cache.h"
+
+namespace {
+
+constexpr size_t kTestSize = 32;
+
+// Preemption is disabled around each sequence of cache operations so that no other thread on the
+// cpu can take the block out of the cache in between. They can still run if cmpctmalloc has to
+// block on its lock, which these tests avoid by always freeing a block they just allocated.
+
+bool double_free_is_detected() {
+  BEGIN_TEST;
+
+  AutoPreemptDisabler<APDInitialState::PREEMPT_DISABLED> ap_disabler;
+  void* ptr = heap_cache_alloc(kTestSize);
+  ASSERT_NONNULL(ptr);
+  EXPECT_FALSE(heap_cache_is_cached(ptr));
+
+  ASSERT_TRUE(heap_cache_free(ptr));
+  // A second free of |ptr| here would trip heap_cache_free's double free check.
+  EXPECT_TRUE(heap_cache_is_cached(ptr));
+
+  // The cache is LIFO, so the block comes straight back and is no longer marked as cached.
+  void* again = heap_cache_alloc(kTestSize);
+  EXPECT_EQ(ptr, again);
+  EXPECT_FALSE(heap_cache_is_cached(again));
+  EXPECT_TRUE(heap_cache_free(again));
+
+  END_TEST;
+}
+
+bool cached_blocks_are_filled() {
+  BEGIN_TEST;
+
+#if defined(DEBUG) || LK_DEBUGLEVEL > 2
+  AutoPreemptDisabler<APDInitialState::PREEMPT_DISABLED> ap_disabler;
+  auto* ptr = static_cast<uint8_t*>(heap_cache_alloc(kTestSize));
+  ASSERT_NONNULL(ptr);
+  ASSERT_TRUE(heap_cache_free(ptr));
+  // The first two words link the block into its cache and mark it as cached.
+  for (size_t i = 2 * sizeof(uintptr_t); i < kTestSize; i++) {
+    EXPECT_EQ(0x77, ptr[i]);
+  }
+
+  auto* again = static_cast<uint8_t*>(heap_cache_alloc(kTestSize - 8));
+  ASSERT_EQ(ptr, again);
+  for (size_t i = 0; i < kTestSize - 8; i++) {
+    EXPECT_EQ(0x99, again[i]);
+  }
+  for (size_t i = kTestSize - 8; i < kTestSize; i++) {
+    EXPECT_EQ(0x55, again[i]);
+  }
+  EXPECT_TRUE(heap_cache_free(again));
+#endif
+
+  END_TEST;
+}
+
+struct CrossCpuArgs {
+  void* ptr;
+  bool cached_after_free;
+  void* reallocated;
+};
+
+bool cross_cpu_free() {
+  BEGIN_TEST;
+
+  const cpu_mask_t online = mp_get_online_mask();
+  if (ispow2(online)) {
+    unittest_printf("Skipping test, need more than one cpu\n");
+    END_TEST;
+  }
+  const cpu_num_t alloc_cpu = lowest_cpu_set(online);
+  const cpu_num_t free_cpu = highest_cpu_set(online);
+
+  Thread* const current = Thread::Current::Get();
+  const cpu_mask_t old_affinity = current->GetCpuAffinity();
+  current->SetCpuAffinity(cpu_num_to_mask(alloc_cpu));
+
+  CrossCpuArgs args = {};
+  args.ptr = heap_cache_alloc(kTestSize);
+  ASSERT_NONNULL(args.ptr);
+
+  // Free the block on another cpu, where it should land in that cpu's cache and be handed out by
+  // it.
+  auto free_body = +[](void* arg) -> int {
+    auto* args = static_cast<CrossCpuArgs*>(arg);
+    AutoPreemptDisabler<APDInitialState::PREEMPT_DISABLED> ap_disabler;
+    if (!heap_cache_free(args->ptr)) {
+      return ZX_ERR_INTERNAL;
+    }
+    args->cached_after_free = heap_cache_is_cached(args->ptr);
+    args->reallocated = heap_cache_alloc(kTestSize);
+    return ZX_OK;
+  };
+  Thread* worker = Thread::Create("heap_cache_free_worker", free_body, &args, DEFAULT_PRIORITY);
+  ASSERT_NONNULL(worker);
+  worker->SetCpuAffinity(cpu_num_to_mask(free_cpu));
+  worker->Resume();
+
+  int retcode;
+  ASSERT_EQ(ZX_OK, worker->Join(&retcode, ZX_TIME_INFINITE));
+  current->SetCpuAffinity(old_affinity);
+
+  EXPECT_EQ(ZX_OK, retcode);
+  EXPECT_TRUE(args.cached_after_free);
+  EXPECT_EQ(args.ptr, args.reallocated);
+  EXPECT_FALSE(heap_cache_is_cached(args.reallocated));
+
+  // The block can go back to a cache on any cpu.
+  EXPECT_TRUE(heap_cache_free(args.reallocated));
+
+  END_TEST;
+}
+
+}  // namespace
+
+UNITTEST_START_TESTCASE(heap_cache_tests)
+UNITTEST("double_free_is_detected", double_free_is_detected)
+UNITTEST("cached_blocks_are_filled", cached_blocks_are_filled)
+UNITTEST("cross_cpu_free", cross_cpu_free)
+UNITTEST_END_TESTCASE(heap_cache_tests, "heap_cache", "Per-cpu heap cache tests")
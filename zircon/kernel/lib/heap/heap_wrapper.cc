@@ -23,8 +23,15 @@
 #include <vm/pmm.h>
 #include <vm/vm.h>
 
+#include "heap_cache.h"
+
 #define LOCAL_TRACE 0
 
+// Set by the build to put per-cpu caches of small blocks in front of cmpctmalloc.
+#ifndef HEAP_PERCPU_CACHE
+#define HEAP_PERCPU_CACHE 0
+#endif
+
 #ifndef HEAP_PANIC_ON_ALLOC_FAIL
 #if LK_DEBUGLEVEL > 2
 #define HEAP_PANIC_ON_ALLOC_FAIL 1
@@ -126,11 +133,33 @@ void dump_stats() {
   }
 }
 
+void* heap_alloc(size_t size) {
+  if (HEAP_PERCPU_CACHE) {
+    void* ptr = heap_cache_alloc(size);
+    if (ptr) {
+      return ptr;
+    }
+  }
+  return cmpct_alloc(size);
+}
+
+void heap_free(void* ptr) {
+  if (HEAP_PERCPU_CACHE && ptr && heap_cache_free(ptr)) {
+    return;
+  }
+  cmpct_free(ptr);
+}
+
 }  // namespace
 
 void heap_init() { cmpct_init(); }
 
-void heap_trim() { cmpct_trim(); }
+void heap_trim() {
+  if (HEAP_PERCPU_CACHE) {
+    heap_cache_drain();
+  }
+  cmpct_trim();
+}
 
 void* malloc(size_t size) {
   DEBUG_ASSERT(!arch_blocking_disallowed());
@@ -139,7 +168,7 @@ void* malloc(size_t size) {
 
   add_stat(__GET_CALLER(), size);
 
-  void* ptr = cmpct_alloc(size);
+  void* ptr = heap_alloc(size);
   if (unlikely(heap_trace)) {
     printf("caller %p malloc %zu -> %p\n", __GET_CALLER(), size, ptr);
   }
@@ -158,7 +187,7 @@ void* malloc_debug_caller_(size_t size, void* caller) {
 
   add_stat(caller, size);
 
-  void* ptr = cmpct_alloc(size);
+  void* ptr = heap_alloc(size);
   if (unlikely(heap_trace)) {
     printf("caller %p malloc %zu -> %p\n", caller, size, ptr);
   }
@@ -217,7 +246,7 @@ void* calloc(size_t count, size_t size) {
 
   size_t realsize = count * size;
 
-  void* ptr = cmpct_alloc(realsize);
+  void* ptr = heap_alloc(realsize);
   if (likely(ptr)) {
     memset(ptr, 0, realsize);
   }
@@ -254,13 +283,24 @@ void free(void* ptr) {
     printf("caller %p free %p\n", __GET_CALLER(), ptr);
   }
 
-  cmpct_free(ptr);
+  heap_free(ptr);
 }
 
-static void heap_dump(bool panic_time) { cmpct_dump(panic_time); }
+static void heap_dump(bool panic_time) {
+  cmpct_dump(panic_time);
+  // Unlike cmpctmalloc's state the caches cannot be walked without taking their locks, so leave
+  // them out at panic time.
+  if (HEAP_PERCPU_CACHE && !panic_time) {
+    heap_cache_dump();
+  }
+}
 
 void heap_get_info(size_t* size_bytes, size_t* free_bytes) {
   cmpct_get_info(size_bytes, free_bytes);
+  // Cached blocks are allocated as far as cmpctmalloc knows, but are available to any caller.
+  if (HEAP_PERCPU_CACHE) {
+    *free_bytes += heap_cache_cached_bytes();
+  }
 }
 
 static void heap_test() { cmpct_test(); }
@@ -10,14 +10,23 @@
 #include <lib/ktrace.h>
 #include <lib/ktrace/string_ref.h>
 #include <lib/syscalls/zx-syscall-numbers.h>
+#include <lib/unittest/unittest.h>
 #include <lib/zircon-internal/thread_annotations.h>
 #include <platform.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include <arch/ops.h>
 #include <arch/user_copy.h>
 #include <fbl/alloc_checker.h>
 #include <hypervisor/ktrace.h>
+#include <kernel/align.h>
+#include <kernel/mp.h>
+#include <kernel/mutex.h>
+#include <kernel/spinlock.h>
+#include <kernel/thread.h>
+#include <ktl/algorithm.h>
+#include <ktl/atomic.h>
 #include <ktl/iterator.h>
 #include <lk/init.h>
 #include <object/thread_dispatcher.h>
@@ -74,59 +83,429 @@ static void ktrace_report_probes(void) {
   }
 }
 
-typedef struct ktrace_state {
-  // where the next record will be written
-  int offset;
+namespace {
+
+// Records never straddle a block boundary, which lets a reader of a wrapped
+// buffer find the oldest whole record by skipping to the next block.
+constexpr uint64_t kBlockSize = 4096;
+
+// The largest record that can be described by a tag. Padding is written in
+// chunks of at most this size.
+constexpr uint32_t kMaxRecordSize = KTRACE_LEN(0xF);
+
+// Size of the VERSION and TICKS_PER_MS records that start every trace.
+constexpr uint32_t kMetadataSize = KTRACE_RECSIZE * 2;
+
+struct CpuBuffer {
+  // Logical offset just past the last complete record. Only advanced by the
+  // owning cpu, with interrupts disabled, once the record has been written.
+  // In SAVE mode this is an offset in the whole trace buffer instead.
+  ktl::atomic<uint64_t> head;
+
+  // In SAVE mode, the offset in the trace buffer just past the block this
+  // cpu is filling, or 0 before it has been handed one.
+  ktl::atomic<uint64_t> block_end;
+
+  // Logical offset of the oldest record not yet consumed by a streaming read.
+  ktl::atomic<uint64_t> tail;
+
+  // Number of records dropped because the buffer was full.
+  ktl::atomic<uint64_t> dropped;
+} __CPU_ALIGN;
+
+CpuBuffer cpu_buffers[SMP_MAX_CPUS];
+
+// In SAVE mode the trace buffer is not split between cpus up front. Instead
+// each cpu is handed whole blocks as it fills them, so tracing only stops once
+// every block is in use. This is the index of the next block to hand out.
+ktl::atomic<uint32_t> save_next_block;
 
+// Marks a block that has not been handed to a cpu yet.
+constexpr uint16_t kNoCpu = UINT16_MAX;
+
+// Serializes reads and the control operations that reset the buffers.
+DECLARE_SINGLETON_MUTEX(KtraceReadLock);
+
+}  // namespace
+
+typedef struct ktrace_state {
   // mask of groups we allow, 0 == tracing disabled
   int grpmask;
 
-  // total size of the trace buffer
+  // what to do when a buffer is full, one of KTRACE_MODE_*
+  int mode;
+
+  // number of per-cpu buffers and the size of each, a multiple of kBlockSize
+  uint32_t num_buffers;
   uint32_t bufsize;
 
-  // offset where tracing was stopped, 0 if tracing active
-  uint32_t marker;
+  // number of blocks in the whole buffer, and the cpu each one was handed to
+  // in SAVE mode
+  uint32_t num_blocks;
+  ktl::atomic<uint16_t>* block_cpu;
 
-  // raw trace buffer
+  // true until the first streaming read after a rewind, which starts with
+  // the metadata records
+  bool metadata_pending;
+
+  // raw trace buffer, holding the per-cpu buffers back to back
   uint8_t* buffer;
 } ktrace_state_t;
 
 static ktrace_state_t KTRACE_STATE;
 
-ssize_t ktrace_read_user(void* ptr, uint32_t off, size_t len) {
+static uint8_t* ktrace_cpu_buffer(cpu_num_t cpu) {
+  return KTRACE_STATE.buffer + static_cast<size_t>(cpu) * KTRACE_STATE.bufsize;
+}
+
+static void ktrace_write_padding(uint8_t* dst, uint64_t len) {
+  while (len > 0) {
+    const uint32_t chunk = static_cast<uint32_t>(ktl::min<uint64_t>(len, kMaxRecordSize));
+    const uint32_t tag = KTRACE_TAG(KTRACE_EVENT(TAG_PADDING), KTRACE_GRP_META, chunk);
+    memcpy(dst, &tag, sizeof(tag));
+    dst += chunk;
+    len -= chunk;
+  }
+}
+
+// Reserves |len| bytes for the current cpu in SAVE mode, handing it the next
+// free block if the one it is filling has no room left. Returns nullptr once
+// every block is in use.
+static uint8_t* ktrace_save_reserve(cpu_num_t cpu, CpuBuffer* cb, uint32_t len) {
   ktrace_state_t* ks = &KTRACE_STATE;
+  uint64_t head = cb->head.load(ktl::memory_order_relaxed);
+  const uint64_t block_end = cb->block_end.load(ktl::memory_order_relaxed);
+  if (head + len <= block_end) {
+    return ks->buffer + head;
+  }
+
+  const uint32_t block = save_next_block.fetch_add(1, ktl::memory_order_relaxed);
+  if (block >= ks->num_blocks) {
+    return nullptr;
+  }
+  if (block_end != 0) {
+    ktrace_write_padding(ks->buffer + head, block_end - head);
+  }
+  // Readers find the block through |block_cpu|, so publish where this cpu is
+  // writing before that.
+  head = static_cast<uint64_t>(block) * kBlockSize;
+  cb->block_end.store(head + kBlockSize, ktl::memory_order_release);
+  cb->head.store(head, ktl::memory_order_release);
+  ks->block_cpu[block].store(static_cast<uint16_t>(cpu), ktl::memory_order_release);
+  return ks->buffer + head;
+}
+
+// Reserves |len| bytes in the current cpu's buffer and passes them, and the
+// current time, to |fill|. Interrupts are disabled throughout, so each buffer
+// only ever has a single writer, a record becomes visible to readers once it
+// is complete, and the records of each cpu are in timestamp order.
+template <typename Fill>
+static bool ktrace_emit(uint32_t len, Fill fill) {
+  ktrace_state_t* ks = &KTRACE_STATE;
+  DEBUG_ASSERT(len > 0 && len <= kMaxRecordSize);
+
+  spin_lock_saved_state_t state;
+  arch_interrupt_save(&state, SPIN_LOCK_FLAG_INTERRUPTS);
+
+  bool written = false;
+  const cpu_num_t cpu = arch_curr_cpu_num();
+  if (likely(cpu < ks->num_buffers)) {
+    CpuBuffer* cb = &cpu_buffers[cpu];
+    const int mode = atomic_load(&ks->mode);
+    if (mode == KTRACE_MODE_SAVE) {
+      if (uint8_t* dst = ktrace_save_reserve(cpu, cb, len)) {
+        fill(dst, ktrace_timestamp());
+        cb->head.fetch_add(len, ktl::memory_order_release);
+        written = true;
+      } else {
+        // if we arrive at the end, stop
+        atomic_store(&ks->grpmask, 0);
+      }
+    } else {
+      const uint64_t head = cb->head.load(ktl::memory_order_relaxed);
+      const uint64_t block_left = kBlockSize - head % kBlockSize;
+      const uint64_t start = len > block_left ? head + block_left : head;
+      const uint64_t end = start + len;
+
+      if (mode == KTRACE_MODE_STREAMING &&
+          end - cb->tail.load(ktl::memory_order_acquire) > ks->bufsize) {
+        cb->dropped.fetch_add(1, ktl::memory_order_relaxed);
+      } else {
+        uint8_t* const buffer = ktrace_cpu_buffer(cpu);
+        if (start != head) {
+          ktrace_write_padding(buffer + head % ks->bufsize, block_left);
+        }
+        fill(buffer + start % ks->bufsize, ktrace_timestamp());
+        cb->head.store(end, ktl::memory_order_release);
+        written = true;
+      }
+    }
+  }
+
+  arch_interrupt_restore(state, SPIN_LOCK_FLAG_INTERRUPTS);
+  return written;
+}
 
-  // Buffer size is limited by the marker if set,
-  // otherwise limited by offset (last written point).
-  // Offset can end up pointing past the end, so clip
-  // it to the actual buffer size to be safe.
-  uint32_t max;
-  if (ks->marker) {
-    max = ks->marker;
+// Discards the contents of the buffers.
+static void ktrace_reset_buffers() TA_REQ(KtraceReadLock::Get()) {
+  ktrace_state_t* ks = &KTRACE_STATE;
+  for (auto& cb : cpu_buffers) {
+    cb.head.store(0);
+    cb.block_end.store(0);
+    cb.tail.store(0);
+    cb.dropped.store(0);
+  }
+  save_next_block.store(0);
+  for (uint32_t i = 0; i < ks->num_blocks; i++) {
+    ks->block_cpu[i].store(kNoCpu);
+  }
+  ks->metadata_pending = true;
+}
+
+// Returns the cpu that SAVE mode handed |block| to, and how many bytes of
+// whole records it holds. Returns kNoCpu if the block is not in use yet.
+static uint16_t ktrace_save_block(uint32_t block, uint64_t* bytes) {
+  const uint16_t cpu = KTRACE_STATE.block_cpu[block].load(ktl::memory_order_acquire);
+  if (cpu == kNoCpu) {
+    return kNoCpu;
+  }
+  const CpuBuffer* cb = &cpu_buffers[cpu];
+  const uint64_t start = static_cast<uint64_t>(block) * kBlockSize;
+  const uint64_t head = cb->head.load(ktl::memory_order_acquire);
+  if (cb->block_end.load(ktl::memory_order_acquire) == start + kBlockSize) {
+    // The cpu is still filling this block.
+    *bytes = head >= start ? head - start : 0;
   } else {
-    max = ks->offset;
-    if (max > ks->bufsize) {
-      max = ks->bufsize;
+    // The cpu has moved on, after padding out the rest of this block.
+    *bytes = kBlockSize;
+  }
+  return cpu;
+}
+
+// Returns the logical range of |cb| holding whole records that have not been
+// consumed or overwritten.
+static void ktrace_readable_range(const CpuBuffer* cb, uint64_t* start, uint64_t* end) {
+  *end = cb->head.load(ktl::memory_order_acquire);
+  *start = cb->tail.load(ktl::memory_order_relaxed);
+  if (*end - *start > KTRACE_STATE.bufsize) {
+    // The buffer wrapped and the oldest records were overwritten. The block
+    // following the one being written is the oldest one still intact.
+    *start = ROUNDUP(*end - KTRACE_STATE.bufsize, kBlockSize);
+  }
+}
+
+static void ktrace_fill_metadata(ktrace_rec_32b_t rec[2]) {
+  memset(rec, 0, kMetadataSize);
+  const uint64_t n = ktrace_ticks_per_ms();
+  rec[0].tag = TAG_VERSION;
+  rec[0].a = KTRACE_VERSION;
+  rec[1].tag = TAG_TICKS_PER_MS;
+  rec[1].a = static_cast<uint32_t>(n);
+  rec[1].b = static_cast<uint32_t>(n >> 32);
+}
+
+namespace {
+
+// Lays out the stream returned to readers as a sequence of pieces and copies
+// the part of it that falls within the range requested by the reader.
+class ReadCursor {
+ public:
+  ReadCursor(void* dst, uint64_t off, size_t len)
+      : dst_(static_cast<uint8_t*>(dst)), off_(off), len_(len) {}
+
+  // Appends |len| bytes at |src| to the stream. Returns false if copying to
+  // the reader failed.
+  bool Append(const void* src, size_t len) {
+    const uint64_t piece_start = total_;
+    total_ += len;
+    if (dst_ == nullptr) {
+      return true;
+    }
+    const uint64_t copy_start = ktl::max(piece_start, off_);
+    const uint64_t copy_end = ktl::min<uint64_t>(total_, off_ + len_);
+    if (copy_start >= copy_end) {
+      return true;
+    }
+    const size_t n = static_cast<size_t>(copy_end - copy_start);
+    if (arch_copy_to_user(dst_ + (copy_start - off_),
+                          static_cast<const uint8_t*>(src) + (copy_start - piece_start),
+                          n) != ZX_OK) {
+      return false;
+    }
+    copied_ += n;
+    return true;
+  }
+
+  // Appends the bytes in the logical range [start, end) of |cpu|'s buffer.
+  bool AppendBuffer(cpu_num_t cpu, uint64_t start, uint64_t end) {
+    const uint8_t* const buffer = ktrace_cpu_buffer(cpu);
+    const uint32_t bufsize = KTRACE_STATE.bufsize;
+    while (start < end) {
+      const uint64_t offset = start % bufsize;
+      const uint64_t len = ktl::min(end - start, bufsize - offset);
+      if (!Append(buffer + offset, static_cast<size_t>(len))) {
+        return false;
+      }
+      start += len;
+    }
+    return true;
+  }
+
+  // Appends the first |bytes| of |block| of the whole buffer, as used by
+  // SAVE mode.
+  bool AppendBlock(uint32_t block, uint64_t bytes) {
+    return Append(KTRACE_STATE.buffer + static_cast<uint64_t>(block) * kBlockSize,
+                  static_cast<size_t>(bytes));
+  }
+
+  // Appends the CPU_BUFFER record announcing |bytes| of records from |cpu|.
+  bool AppendBufferHeader(cpu_num_t cpu, uint64_t bytes, uint64_t dropped) {
+    ktrace_rec_32b_t rec = {};
+    rec.tag = TAG_CPU_BUFFER;
+    rec.a = cpu;
+    rec.b = static_cast<uint32_t>(bytes);
+    rec.c = static_cast<uint32_t>(ktl::min<uint64_t>(dropped, UINT32_MAX));
+    return Append(&rec, sizeof(rec));
+  }
+
+  uint64_t total() const { return total_; }
+  size_t copied() const { return copied_; }
+
+ private:
+  uint8_t* const dst_;
+  const uint64_t off_;
+  const size_t len_;
+  uint64_t total_ = 0;
+  size_t copied_ = 0;
+};
+
+}  // namespace
+
+// Returns everything that has been written, for the SAVE and CIRCULAR modes.
+static ssize_t ktrace_read_snapshot(void* ptr, uint32_t off, size_t len)
+    TA_REQ(KtraceReadLock::Get()) {
+  ktrace_state_t* ks = &KTRACE_STATE;
+  ReadCursor cursor(ptr, off, len);
+
+  ktrace_rec_32b_t metadata[2];
+  ktrace_fill_metadata(metadata);
+  if (!cursor.Append(metadata, sizeof(metadata))) {
+    return ZX_ERR_INVALID_ARGS;
+  }
+
+  if (atomic_load(&ks->mode) == KTRACE_MODE_SAVE) {
+    // Blocks are handed out in order, so each cpu's blocks appear in the
+    // order it wrote them.
+    const uint32_t num_blocks =
+        ktl::min(save_next_block.load(ktl::memory_order_acquire), ks->num_blocks);
+    for (uint32_t block = 0; block < num_blocks; block++) {
+      uint64_t bytes = 0;
+      const uint16_t cpu = ktrace_save_block(block, &bytes);
+      if (cpu == kNoCpu || bytes == 0) {
+        continue;
+      }
+      if (!cursor.AppendBufferHeader(cpu, bytes, 0) || !cursor.AppendBlock(block, bytes)) {
+        return ZX_ERR_INVALID_ARGS;
+      }
+    }
+  } else {
+    for (cpu_num_t cpu = 0; cpu < ks->num_buffers; cpu++) {
+      const CpuBuffer* cb = &cpu_buffers[cpu];
+      uint64_t start, end;
+      ktrace_readable_range(cb, &start, &end);
+      if (start == end) {
+        continue;
+      }
+      if (!cursor.AppendBufferHeader(cpu, end - start, cb->dropped.load()) ||
+          !cursor.AppendBuffer(cpu, start, end)) {
+        return ZX_ERR_INVALID_ARGS;
+      }
     }
   }
 
   // null read is a query for trace buffer size
+  return ptr == nullptr ? static_cast<ssize_t>(cursor.total())
+                        : static_cast<ssize_t>(cursor.copied());
+}
+
+// Returns and consumes as many whole records as fit in |len| bytes, for the
+// STREAMING mode.
+static ssize_t ktrace_read_stream(void* ptr, size_t len) TA_REQ(KtraceReadLock::Get()) {
+  ktrace_state_t* ks = &KTRACE_STATE;
+  ReadCursor cursor(ptr, 0, len);
+
+  // null read is a query for the number of bytes waiting to be read
   if (ptr == nullptr) {
-    return max;
+    uint64_t pending = ks->metadata_pending ? kMetadataSize : 0;
+    for (cpu_num_t cpu = 0; cpu < ks->num_buffers; cpu++) {
+      uint64_t start, end;
+      ktrace_readable_range(&cpu_buffers[cpu], &start, &end);
+      if (start != end) {
+        pending += KTRACE_RECSIZE + (end - start);
+      }
+    }
+    return static_cast<ssize_t>(pending);
   }
 
-  // constrain read to available buffer
-  if (off >= max) {
-    return 0;
+  if (ks->metadata_pending) {
+    if (len < kMetadataSize) {
+      return ZX_ERR_BUFFER_TOO_SMALL;
+    }
+    ktrace_rec_32b_t metadata[2];
+    ktrace_fill_metadata(metadata);
+    if (!cursor.Append(metadata, sizeof(metadata))) {
+      return ZX_ERR_INVALID_ARGS;
+    }
+    ks->metadata_pending = false;
   }
-  if (len > (max - off)) {
-    len = max - off;
+
+  for (cpu_num_t cpu = 0; cpu < ks->num_buffers; cpu++) {
+    CpuBuffer* cb = &cpu_buffers[cpu];
+    uint64_t start, end;
+    ktrace_readable_range(cb, &start, &end);
+    const uint64_t dropped = cb->dropped.load();
+    if ((start == end && dropped == 0) || cursor.total() + KTRACE_RECSIZE > len) {
+      continue;
+    }
+
+    // Take whole records until the reader's buffer is full.
+    const uint64_t space = len - cursor.total() - KTRACE_RECSIZE;
+    const uint8_t* const buffer = ktrace_cpu_buffer(cpu);
+    uint64_t stop = start;
+    while (stop < end) {
+      uint32_t tag;
+      memcpy(&tag, buffer + stop % ks->bufsize, sizeof(tag));
+      const uint32_t rec_len = KTRACE_LEN(tag);
+      DEBUG_ASSERT(rec_len > 0);
+      if (rec_len == 0 || stop + rec_len - start > space) {
+        break;
+      }
+      stop += rec_len;
+    }
+    if (stop == start && dropped == 0) {
+      continue;
+    }
+
+    if (!cursor.AppendBufferHeader(cpu, stop - start, dropped) ||
+        !cursor.AppendBuffer(cpu, start, stop)) {
+      return ZX_ERR_INVALID_ARGS;
+    }
+    cb->dropped.fetch_sub(dropped);
+    cb->tail.store(stop, ktl::memory_order_release);
   }
 
-  if (arch_copy_to_user(ptr, ks->buffer + off, len) != ZX_OK) {
-    return ZX_ERR_INVALID_ARGS;
+  return static_cast<ssize_t>(cursor.copied());
+}
+
+ssize_t ktrace_read_user(void* ptr, uint32_t off, size_t len) {
+  Guard<Mutex> guard{KtraceReadLock::Get()};
+  if (KTRACE_STATE.buffer == nullptr) {
+    return 0;
+  }
+  if (atomic_load(&KTRACE_STATE.mode) == KTRACE_MODE_STREAMING) {
+    return ktrace_read_stream(ptr, len);
   }
-  return len;
+  return ktrace_read_snapshot(ptr, off, len);
 }
 
 zx_status_t ktrace_control(uint32_t action, uint32_t options, void* ptr) {
@@ -135,30 +514,41 @@ zx_status_t ktrace_control(uint32_t action, uint32_t options, void* ptr) {
   switch (action) {
     case KTRACE_ACTION_START:
       options = KTRACE_GRP_TO_MASK(options);
-      ks->marker = 0;
       atomic_store(&ks->grpmask, options ? options : KTRACE_GRP_TO_MASK(KTRACE_GRP_ALL));
       ktrace_report_live_processes();
       ktrace_report_live_threads();
       break;
 
-    case KTRACE_ACTION_STOP: {
+    case KTRACE_ACTION_STOP:
       atomic_store(&ks->grpmask, 0);
-      uint32_t n = ks->offset;
-      if (n > ks->bufsize) {
-        ks->marker = ks->bufsize;
-      } else {
-        ks->marker = n;
-      }
       break;
-    }
 
-    case KTRACE_ACTION_REWIND:
-      // roll back to just after the metadata
-      atomic_store(&ks->offset, KTRACE_RECSIZE * 2);
+    case KTRACE_ACTION_REWIND: {
+      {
+        Guard<Mutex> guard{KtraceReadLock::Get()};
+        ktrace_reset_buffers();
+      }
       ktrace_report_syscalls();
       ktrace_report_probes();
       ktrace_report_vcpu_meta();
       break;
+    }
+
+    case KTRACE_ACTION_SET_MODE:
+      if (options != KTRACE_MODE_SAVE && options != KTRACE_MODE_CIRCULAR &&
+          options != KTRACE_MODE_STREAMING) {
+        return ZX_ERR_INVALID_ARGS;
+      }
+      if (atomic_load(&ks->grpmask) != 0) {
+        return ZX_ERR_BAD_STATE;
+      }
+      {
+        // The modes lay out the buffer differently, so start over.
+        Guard<Mutex> guard{KtraceReadLock::Get()};
+        atomic_store(&ks->mode, static_cast<int>(options));
+        ktrace_reset_buffers();
+      }
+      break;
 
     case KTRACE_ACTION_NEW_PROBE: {
       const char* const string_in = static_cast<const char*>(ptr);
@@ -214,6 +604,14 @@ void ktrace_init(unsigned level) {
 
   mb *= (1024 * 1024);
 
+  // Give each cpu an equal share of the buffer, in whole blocks.
+  const uint32_t num_buffers = arch_max_num_cpus();
+  const uint32_t bufsize = ROUNDDOWN(mb / num_buffers, static_cast<uint32_t>(kBlockSize));
+  if (bufsize == 0) {
+    dprintf(INFO, "ktrace: buffer too small for %u cpus\n", num_buffers);
+    return;
+  }
+
   zx_status_t status;
   VmAspace* aspace = VmAspace::kernel_aspace();
   if ((status = aspace->Alloc("ktrace", mb, reinterpret_cast<void**>(&ks->buffer), 0,
@@ -223,23 +621,26 @@ void ktrace_init(unsigned level) {
     return;
   }
 
-  // The last packet written can overhang the end of the buffer,
-  // so we reduce the reported size by the max size of a record
-  ks->bufsize = mb - 256;
+  const uint32_t num_blocks = mb / static_cast<uint32_t>(kBlockSize);
+  fbl::AllocChecker ac;
+  ks->block_cpu = new (&ac) ktl::atomic<uint16_t>[num_blocks];
+  if (!ac.check()) {
+    dprintf(INFO, "ktrace: cannot alloc block table\n");
+    return;
+  }
+  for (uint32_t i = 0; i < num_blocks; i++) {
+    ks->block_cpu[i].store(kNoCpu);
+  }
 
-  dprintf(INFO, "ktrace: buffer at %p (%u bytes)\n", ks->buffer, mb);
+  ks->num_buffers = num_buffers;
+  ks->bufsize = bufsize;
+  ks->num_blocks = num_blocks;
+  ks->metadata_pending = true;
+  ks->mode = gCmdline.GetBool("ktrace.circular", false) ? KTRACE_MODE_CIRCULAR : KTRACE_MODE_SAVE;
 
-  // write metadata to the first two event slots
-  uint64_t n = ktrace_ticks_per_ms();
-  ktrace_rec_32b_t* rec = reinterpret_cast<ktrace_rec_32b_t*>(ks->buffer);
-  rec[0].tag = TAG_VERSION;
-  rec[0].a = KTRACE_VERSION;
-  rec[1].tag = TAG_TICKS_PER_MS;
-  rec[1].a = static_cast<uint32_t>(n);
-  rec[1].b = static_cast<uint32_t>(n >> 32);
+  dprintf(INFO, "ktrace: buffer at %p (%u bytes, %u per cpu)\n", ks->buffer, mb, bufsize);
 
   // enable tracing
-  atomic_store(&ks->offset, KTRACE_RECSIZE * 2);
   ktrace_report_syscalls();
   ktrace_report_probes();
   atomic_store(&ks->grpmask, KTRACE_GRP_TO_MASK(grpmask));
@@ -261,39 +662,34 @@ void ktrace_tiny(uint32_t tag, uint32_t arg) {
   ktrace_state_t* ks = &KTRACE_STATE;
   if (tag & atomic_load(&ks->grpmask)) {
     tag = (tag & 0xFFFFFFF0) | 2;
-    int off;
-    if ((off = atomic_add(&ks->offset, KTRACE_HDRSIZE)) >= static_cast<int>(ks->bufsize)) {
-      // if we arrive at the end, stop
-      atomic_store(&ks->grpmask, 0);
-    } else {
-      ktrace_header_t* hdr = reinterpret_cast<ktrace_header_t*>(ks->buffer + off);
-      hdr->ts = ktrace_timestamp();
+    ktrace_emit(KTRACE_HDRSIZE, [&](uint8_t* dst, uint64_t now) {
+      ktrace_header_t* hdr = reinterpret_cast<ktrace_header_t*>(dst);
+      hdr->ts = now;
       hdr->tag = tag;
       hdr->tid = arg;
-    }
+    });
   }
 }
 
-void* ktrace_open(uint32_t tag, uint64_t ts) {
+bool ktrace_write_record(uint32_t tag, const void* payload, uint64_t ts) {
   ktrace_state_t* ks = &KTRACE_STATE;
   if (!(tag & atomic_load(&ks->grpmask))) {
-    return nullptr;
-  }
-
-  int off;
-  if ((off = atomic_add(&ks->offset, KTRACE_LEN(tag))) >= static_cast<int>(ks->bufsize)) {
-    // if we arrive at the end, stop
-    atomic_store(&ks->grpmask, 0);
-    return nullptr;
+    return false;
   }
 
-  ktrace_header_t* hdr = reinterpret_cast<ktrace_header_t*>(ks->buffer + off);
-  hdr->ts = ts;
-  hdr->tag = tag;
-  hdr->tid = KTRACE_FLAGS(tag) & KTRACE_FLAGS_CPU
-                 ? arch_curr_cpu_num()
-                 : static_cast<uint32_t>(Thread::Current::Get()->user_tid_);
-  return hdr + 1;
+  const uint32_t tid = KTRACE_FLAGS(tag) & KTRACE_FLAGS_CPU
+                           ? arch_curr_cpu_num()
+                           : static_cast<uint32_t>(Thread::Current::Get()->user_tid_);
+  const uint32_t len = KTRACE_LEN(tag);
+  return ktrace_emit(len, [&](uint8_t* dst, uint64_t now) {
+    ktrace_header_t* hdr = reinterpret_cast<ktrace_header_t*>(dst);
+    hdr->ts = ts == kKtraceTimestampNow ? now : ts;
+    hdr->tag = tag;
+    hdr->tid = tid;
+    if (len > KTRACE_HDRSIZE) {
+      memcpy(hdr + 1, payload, len - KTRACE_HDRSIZE);
+    }
+  });
 }
 
 void ktrace_name_etc(uint32_t tag, uint32_t id, uint32_t arg, const char* name, bool always) {
@@ -304,20 +700,110 @@ void ktrace_name_etc(uint32_t tag, uint32_t id, uint32_t arg, const char* name,
     // set size to: sizeof(hdr) + len + 1, round up to multiple of 8
     tag = (tag & 0xFFFFFFF0) | ((KTRACE_NAMESIZE + len + 1 + 7) >> 3);
 
-    int off;
-    if ((off = atomic_add(&ks->offset, KTRACE_LEN(tag))) >= static_cast<int>(ks->bufsize)) {
-      // if we arrive at the end, stop
-      atomic_store(&ks->grpmask, 0);
-    } else {
-      ktrace_rec_name_t* rec = reinterpret_cast<ktrace_rec_name_t*>(ks->buffer + off);
+    ktrace_emit(KTRACE_LEN(tag), [&](uint8_t* dst, uint64_t) {
+      ktrace_rec_name_t* rec = reinterpret_cast<ktrace_rec_name_t*>(dst);
       rec->tag = tag;
       rec->id = id;
       rec->arg = arg;
       memcpy(rec->name, name, len);
       rec->name[len] = 0;
-    }
+    });
   }
 }
 
 // Finish initialization before starting userspace (i.e. before debug syscalls can occur).
 LK_INIT_HOOK(ktrace, ktrace_init, LK_INIT_LEVEL_USER - 1)
+
+namespace {
+
+// Probe written by the tests below.
+constexpr uint32_t kTestProbeId = 0x7ff;
+
+int ktrace_test_writer(void* arg) {
+  const uint32_t args[] = {arch_curr_cpu_num(), 0};
+  while (ktrace_write_record(TAG_PROBE_24(kTestProbeId), args)) {
+  }
+  return 0;
+}
+
+// Fills the buffer in SAVE mode from every cpu at once, then checks that
+// tracing only stopped once every block was in use, and that each cpu's
+// records are in its own blocks and in timestamp order.
+bool ktrace_save_mode_test() {
+  BEGIN_TEST;
+
+  ktrace_state_t* ks = &KTRACE_STATE;
+  if (ks->buffer == nullptr) {
+    unittest_printf("ktrace is disabled, skipping\n");
+    END_TEST;
+  }
+
+  // This discards whatever has been traced so far.
+  const int old_grpmask = atomic_load(&ks->grpmask);
+  const int old_mode = atomic_load(&ks->mode);
+  atomic_store(&ks->grpmask, 0);
+  ASSERT_EQ(ZX_OK, ktrace_control(KTRACE_ACTION_SET_MODE, KTRACE_MODE_SAVE, nullptr));
+  atomic_store(&ks->grpmask, static_cast<int>(KTRACE_GRP_TO_MASK(KTRACE_GRP_PROBE)));
+
+  Thread* writers[SMP_MAX_CPUS] = {};
+  const cpu_mask_t online_cpus = mp_get_online_mask();
+  for (cpu_num_t cpu = 0; cpu < ks->num_buffers; cpu++) {
+    if ((cpu_num_to_mask(cpu) & online_cpus) == 0) {
+      continue;
+    }
+    writers[cpu] = Thread::Create("ktrace test writer", ktrace_test_writer, nullptr,
+                                  DEFAULT_PRIORITY);
+    ASSERT_NONNULL(writers[cpu]);
+    writers[cpu]->SetCpuAffinity(cpu_num_to_mask(cpu));
+    writers[cpu]->Resume();
+  }
+  for (Thread* writer : writers) {
+    if (writer != nullptr) {
+      int retcode;
+      EXPECT_EQ(ZX_OK, writer->Join(&retcode, ZX_TIME_INFINITE));
+    }
+  }
+  EXPECT_EQ(0, atomic_load(&ks->grpmask));
+  EXPECT_GE(save_next_block.load(), ks->num_blocks);
+
+  uint64_t last_ts[SMP_MAX_CPUS] = {};
+  for (uint32_t block = 0; block < ks->num_blocks; block++) {
+    uint64_t bytes = 0;
+    const uint16_t cpu = ktrace_save_block(block, &bytes);
+    ASSERT_NE(kNoCpu, cpu);
+    ASSERT_LT(cpu, ks->num_buffers);
+    const uint8_t* const records = ks->buffer + static_cast<uint64_t>(block) * kBlockSize;
+    uint64_t offset = 0;
+    while (offset < bytes) {
+      uint32_t tag;
+      memcpy(&tag, records + offset, sizeof(tag));
+      const uint32_t len = KTRACE_LEN(tag);
+      ASSERT_GT(len, 0u);
+      if (tag == TAG_PROBE_24(kTestProbeId)) {
+        ktrace_header_t hdr;
+        uint32_t writer_cpu;
+        memcpy(&hdr, records + offset, sizeof(hdr));
+        memcpy(&writer_cpu, records + offset + sizeof(hdr), sizeof(writer_cpu));
+        EXPECT_EQ(writer_cpu, cpu);
+        EXPECT_LE(last_ts[cpu], hdr.ts);
+        last_ts[cpu] = hdr.ts;
+      }
+      offset += len;
+    }
+    EXPECT_EQ(bytes, offset);
+  }
+
+  atomic_store(&ks->grpmask, 0);
+  EXPECT_EQ(ZX_OK,
+            ktrace_control(KTRACE_ACTION_SET_MODE, static_cast<uint32_t>(old_mode), nullptr));
+  EXPECT_EQ(ZX_OK, ktrace_control(KTRACE_ACTION_REWIND, 0, nullptr));
+  atomic_store(&ks->grpmask, old_grpmask);
+
+  END_TEST;
+}
+
+}  // namespace
+
+UNITTEST_START_TESTCASE(ktrace_tests)
+UNITTEST("save mode fills the whole buffer", ktrace_save_mode_test)
+UNITTEST_END_TESTCASE(ktrace_tests, "ktrace", "ktrace tests")
@@ -364,6 +364,249 @@ zx_status_t sys_channel_write_etc(zx_handle_t handle_value, uint32_t options,
   return channel_write(handle_value, options, user_bytes, num_bytes, user_handles, num_handles);
 }
 
+// The number of messages zx_channel_read_many() and zx_channel_write_many() move under each
+// acquisition of the channel lock.
+static constexpr size_t kChannelBatchSize = 16;
+
+// Builds the MessagePacket for one message of zx_channel_write_many(). As with
+// zx_channel_write(), the handles of the message are consumed whether or not this succeeds.
+static zx_status_t msg_create(ProcessDispatcher* up, ChannelDispatcher* channel,
+                              const zx_channel_message_t& message, MessagePacketPtr* msg) {
+  user_in_ptr<const zx_handle_t> user_handles =
+      make_user_in_ptr(static_cast<const zx_handle_t*>(message.handles));
+  uint32_t num_handles = message.num_handles;
+
+  auto cleanup = fbl::MakeAutoCall([&]() { RemoveUserHandles(user_handles, num_handles, up); });
+
+  zx_status_t status = MessagePacket::Create(
+      make_user_in_ptr(static_cast<const char*>(message.bytes)), message.num_bytes, num_handles,
+      msg);
+  if (status != ZX_OK) {
+    return status;
+  }
+
+  // msg_put_handles() always consumes all handles.
+  cleanup.cancel();
+
+  if (num_handles > 0u) {
+    return msg_put_handles(up, msg->get(), user_handles, num_handles,
+                           static_cast<Dispatcher*>(channel));
+  }
+  return ZX_OK;
+}
+
+// Like msg_get_handles(), except that |msg| keeps its handles if they can't be copied out, so
+// that zx_channel_read_many() can put it back on the channel.
+static __WARN_UNUSED_RESULT zx_status_t msg_get_handles_or_keep(ProcessDispatcher* up,
+                                                                MessagePacket* msg,
+                                                                user_out_ptr<zx_handle_t> handles,
+                                                                uint32_t num_handles) {
+  Handle* const* handle_list = msg->handles();
+
+  zx_handle_t hvs[kMaxMessageHandles];
+  for (size_t i = 0; i < num_handles; ++i) {
+    MapHandleToValue(up, handle_list[i], &hvs[i]);
+  }
+
+  zx_status_t status = handles.copy_array_to_user(hvs, num_handles);
+  if (status != ZX_OK) {
+    return status;
+  }
+  msg->set_owns_handles(false);
+
+  for (size_t i = 0; i < num_handles; ++i) {
+    if (handle_list[i]->dispatcher()->is_waitable())
+      handle_list[i]->dispatcher()->Cancel(handle_list[i]);
+    HandleOwner handle(handle_list[i]);
+    // TODO(ZX-969): This takes a lock per call. Consider doing these in a batch.
+    up->AddHandle(ktl::move(handle));
+  }
+
+  return ZX_OK;
+}
+
+// zx_status_t zx_channel_read_many
+zx_status_t sys_channel_read_many(zx_handle_t handle_value, uint32_t options,
+                                  user_inout_ptr<zx_channel_message_t> user_messages,
+                                  size_t num_messages, user_out_ptr<size_t> actual_out) {
+  LTRACEF("handle %x messages %p num_messages %zu options 0x%x\n", handle_value,
+          user_messages.get(), num_messages, options);
+
+  if (options != 0u || num_messages == 0u)
+    return ZX_ERR_INVALID_ARGS;
+
+  auto up = ProcessDispatcher::GetCurrent();
+
+  fbl::RefPtr<ChannelDispatcher> channel;
+  zx_status_t result = up->GetDispatcherWithRights(handle_value, ZX_RIGHT_READ, &channel);
+  if (result != ZX_OK)
+    return result;
+
+  size_t total = 0;
+  while (total < num_messages) {
+    const size_t batch = fbl::min(num_messages - total, kChannelBatchSize);
+    zx_channel_message_t messages[kChannelBatchSize];
+    zx_status_t status = user_messages.element_offset(total).copy_array_from_user(messages, batch);
+    if (status != ZX_OK)
+      return status;
+
+    uint32_t sizes[kChannelBatchSize];
+    uint32_t handle_counts[kChannelBatchSize];
+    for (size_t ix = 0; ix < batch; ++ix) {
+      sizes[ix] = messages[ix].num_bytes;
+      handle_counts[ix] = messages[ix].num_handles;
+    }
+
+    MessagePacketPtr msgs[kChannelBatchSize];
+    size_t actual = 0;
+    result = channel->ReadMany(up->get_koid(), sizes, handle_counts, msgs, batch, &actual);
+
+    size_t delivered = 0;
+    for (; delivered < actual; ++delivered) {
+      const size_t ix = delivered;
+      if (sizes[ix] > 0u) {
+        if (msgs[ix]->CopyDataTo(make_user_out_ptr(static_cast<char*>(messages[ix].bytes))) !=
+            ZX_OK) {
+          status = ZX_ERR_INVALID_ARGS;
+          break;
+        }
+      }
+      if (handle_counts[ix] > 0u) {
+        status = msg_get_handles_or_keep(up, msgs[ix].get(),
+                                         make_user_out_ptr(messages[ix].handles),
+                                         handle_counts[ix]);
+        if (status != ZX_OK)
+          break;
+      }
+      messages[ix].num_bytes = sizes[ix];
+      messages[ix].num_handles = handle_counts[ix];
+      messages[ix].status = ZX_OK;
+
+      record_recv_msg_sz(sizes[ix]);
+      ktrace(TAG_CHANNEL_READ, (uint32_t)channel->get_koid(), sizes[ix], handle_counts[ix], 0);
+    }
+
+    size_t reported = delivered;
+    if (delivered < actual) {
+      // A message could not be copied out. Rather than lose it, and the ones after it, put them
+      // back at the head of the queue. The messages already delivered are still reported.
+      channel->Unread(&msgs[delivered], actual - delivered);
+      result = status;
+    } else if (result == ZX_ERR_BUFFER_TOO_SMALL) {
+      // Report the size of a message that did not fit in its buffers.
+      messages[actual].num_bytes = sizes[actual];
+      messages[actual].num_handles = handle_counts[actual];
+      messages[actual].status = ZX_ERR_BUFFER_TOO_SMALL;
+      ++reported;
+    }
+    status = user_messages.element_offset(total).copy_array_to_user(messages, reported);
+
+    total += delivered;
+    if (status != ZX_OK) {
+      // The messages delivered so far are already owned by the caller, so they are counted even
+      // though their entries could not be updated.
+      result = status;
+      break;
+    }
+    if (result != ZX_OK || actual < batch)
+      break;
+  }
+
+  // Running out of messages, or finding one that does not fit, after reading at least one
+  // message is not an error.
+  if (total == 0)
+    return result;
+
+  if (actual_out) {
+    zx_status_t status = actual_out.copy_to_user(total);
+    if (status != ZX_OK)
+      return status;
+  }
+  return ZX_OK;
+}
+
+// zx_status_t zx_channel_write_many
+zx_status_t sys_channel_write_many(zx_handle_t handle_value, uint32_t options,
+                                   user_inout_ptr<zx_channel_message_t> user_messages,
+                                   size_t num_messages, user_out_ptr<size_t> actual_out) {
+  LTRACEF("handle %x messages %p num_messages %zu options 0x%x\n", handle_value,
+          user_messages.get(), num_messages, options);
+
+  auto up = ProcessDispatcher::GetCurrent();
+
+  // Like zx_channel_write(), the handles of every message are consumed, even when the messages
+  // can't be written. Messages after the first one that fails are not written.
+  zx_status_t result = ZX_OK;
+  fbl::RefPtr<ChannelDispatcher> channel;
+  if (options != 0u) {
+    result = ZX_ERR_INVALID_ARGS;
+  } else {
+    result = up->GetDispatcherWithRights(handle_value, ZX_RIGHT_WRITE, &channel);
+  }
+  const bool channel_ok = result == ZX_OK;
+
+  size_t written = 0;
+  for (size_t offset = 0; offset < num_messages; offset += kChannelBatchSize) {
+    const size_t batch = fbl::min(num_messages - offset, kChannelBatchSize);
+    zx_channel_message_t messages[kChannelBatchSize];
+    zx_status_t status = user_messages.element_offset(offset).copy_array_from_user(messages, batch);
+    if (status != ZX_OK)
+      return status;
+
+    MessagePacketPtr msgs[kChannelBatchSize];
+    size_t ready = 0;
+    for (size_t ix = 0; ix < batch; ++ix) {
+      if (result != ZX_OK) {
+        RemoveUserHandles(make_user_in_ptr(static_cast<const zx_handle_t*>(messages[ix].handles)),
+                          messages[ix].num_handles, up);
+        messages[ix].status = ZX_ERR_CANCELED;
+        continue;
+      }
+      messages[ix].status = msg_create(up, channel.get(), messages[ix], &msgs[ready]);
+      if (messages[ix].status != ZX_OK) {
+        result = messages[ix].status;
+        continue;
+      }
+      ++ready;
+    }
+
+    if (ready > 0u) {
+      status = channel->WriteMany(up->get_koid(), msgs, ready);
+      if (status != ZX_OK) {
+        // None of the messages that were ready got written. They are the first |ready| messages
+        // of the batch, because no message is made ready after one fails.
+        for (size_t ix = 0; ix < ready; ++ix) {
+          messages[ix].status = status;
+        }
+        result = status;
+      } else {
+        for (size_t ix = 0; ix < ready; ++ix) {
+          ktrace(TAG_CHANNEL_WRITE, (uint32_t)channel->get_koid(), messages[ix].num_bytes,
+                 messages[ix].num_handles, 0);
+        }
+        written += ready;
+      }
+    }
+
+    // Without a channel there is nothing to report per message.
+    if (channel_ok) {
+      status = user_messages.element_offset(offset).copy_array_to_user(messages, batch);
+      if (status != ZX_OK)
+        return status;
+    }
+  }
+
+  if (!channel_ok)
+    return result;
+
+  if (actual_out) {
+    zx_status_t status = actual_out.copy_to_user(written);
+    if (status != ZX_OK)
+      return status;
+  }
+  return result;
+}
+
 // zx_status_t zx_channel_call_noretry
 zx_status_t sys_channel_call_noretry(zx_handle_t handle_value, uint32_t options, zx_time_t deadline,
                                      user_in_ptr<const zx_channel_call_args_t> user_args,
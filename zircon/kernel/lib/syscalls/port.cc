@@ -11,6 +11,7 @@
 #include <zircon/syscalls/policy.h>
 #include <zircon/types.h>
 
+#include <fbl/algorithm.h>
 #include <fbl/alloc_checker.h>
 #include <fbl/ref_ptr.h>
 #include <object/handle.h>
@@ -94,6 +95,71 @@ zx_status_t sys_port_wait(zx_handle_t handle, zx_time_t deadline,
   return ZX_OK;
 }
 
+// The number of packets zx_port_wait_many() dequeues at once. Larger requests are filled with
+// further batches of packets that are already queued.
+static constexpr size_t kPortWaitManyBatchSize = 16;
+
+// zx_status_t zx_port_wait_many
+zx_status_t sys_port_wait_many(zx_handle_t handle, zx_time_t deadline,
+                               user_out_ptr<zx_port_packet_t> packets_out, size_t count,
+                               user_out_ptr<size_t> actual_out) {
+  LTRACEF("handle %x count %zu\n", handle, count);
+
+  if (count == 0)
+    return ZX_ERR_INVALID_ARGS;
+
+  auto up = ProcessDispatcher::GetCurrent();
+
+  fbl::RefPtr<PortDispatcher> port;
+  zx_status_t status = up->GetDispatcherWithRights(handle, ZX_RIGHT_READ, &port);
+  if (status != ZX_OK)
+    return status;
+
+  const Deadline slackDeadline(deadline, up->GetTimerSlackPolicy());
+
+  ktrace(TAG_PORT_WAIT, (uint32_t)port->get_koid(), 0, 0, 0);
+
+  // Only the first batch waits for |deadline|. Later batches only pick up packets that are
+  // already queued, and stop at the first one that comes back short.
+  size_t total = 0;
+  zx_status_t st = ZX_OK;
+  while (total < count) {
+    zx_port_packet_t pp[kPortWaitManyBatchSize];
+    const size_t batch = fbl::min(count - total, kPortWaitManyBatchSize);
+    size_t actual = 0;
+    st = port->DequeueMany(total == 0 ? slackDeadline : Deadline::no_slack(ZX_TIME_INFINITE_PAST),
+                           pp, batch, &actual);
+    if (st != ZX_OK)
+      break;
+
+    status = packets_out.element_offset(total).copy_array_to_user(pp, actual);
+    if (status != ZX_OK) {
+      // Like with zx_port_wait(), the packets that could not be copied out are lost. Packets
+      // that were already delivered are still reported.
+      if (total == 0)
+        return status;
+      break;
+    }
+
+    total += actual;
+    if (actual < batch)
+      break;
+  }
+
+  ktrace(TAG_PORT_WAIT_DONE, (uint32_t)port->get_koid(), st, 0, 0);
+
+  // Running out of queued packets after the first batch is not an error.
+  if (total == 0)
+    return st;
+
+  if (actual_out) {
+    status = actual_out.copy_to_user(total);
+    if (status != ZX_OK)
+      return status;
+  }
+  return ZX_OK;
+}
+
 // zx_status_t zx_port_cancel
 zx_status_t sys_port_cancel(zx_handle_t handle, zx_handle_t source, uint64_t key) {
   auto up = ProcessDispatcher::GetCurrent();
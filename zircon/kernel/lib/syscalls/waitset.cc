@@ -0,0 +1,140 @@
+// Copyright 2020 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#include <err.h>
+#include <inttypes.h>
+#include <lib/user_copy/user_ptr.h>
+#include <trace.h>
+#include <zircon/types.h>
+
+#include <fbl/algorithm.h>
+#include <fbl/ref_ptr.h>
+#include <object/handle.h>
+#include <object/process_dispatcher.h>
+#include <object/wait_set_dispatcher.h>
+
+#include "priv.h"
+
+#define LOCAL_TRACE 0
+
+// The number of results zx_waitset_wait() collects per pass over the ready list.
+static constexpr size_t kWaitSetBatchSize = 32;
+
+// zx_status_t zx_waitset_create
+zx_status_t sys_waitset_create(uint32_t options, user_out_handle* out) {
+  LTRACEF("options %u\n", options);
+
+  KernelHandle<WaitSetDispatcher> handle;
+  zx_rights_t rights;
+  zx_status_t status = WaitSetDispatcher::Create(options, &handle, &rights);
+  if (status != ZX_OK)
+    return status;
+  return out->make(ktl::move(handle), rights);
+}
+
+// zx_status_t zx_waitset_add
+zx_status_t sys_waitset_add(zx_handle_t handle, uint64_t cookie, zx_handle_t object,
+                            zx_signals_t signals) {
+  LTRACEF("handle %x cookie %" PRIx64 " object %x\n", handle, cookie, object);
+
+  auto up = ProcessDispatcher::GetCurrent();
+
+  // As with zx_object_wait_async(), hold the handle table lock so that the
+  // Handle the entry is keyed on can't be destroyed out from under us.
+  Guard<BrwLockPi, BrwLockPi::Reader> guard{up->handle_table_lock()};
+
+  Handle* wait_set_handle = up->GetHandleLocked(handle);
+  if (!wait_set_handle)
+    return ZX_ERR_BAD_HANDLE;
+  fbl::RefPtr<Dispatcher> disp = wait_set_handle->dispatcher();
+  fbl::RefPtr<WaitSetDispatcher> wait_set = DownCastDispatcher<WaitSetDispatcher>(&disp);
+  if (!wait_set)
+    return ZX_ERR_WRONG_TYPE;
+  if (!wait_set_handle->HasRights(ZX_RIGHT_WRITE))
+    return ZX_ERR_ACCESS_DENIED;
+
+  Handle* object_handle = up->GetHandleLocked(object);
+  if (!object_handle)
+    return ZX_ERR_BAD_HANDLE;
+  if (!object_handle->HasRights(ZX_RIGHT_WAIT))
+    return ZX_ERR_ACCESS_DENIED;
+
+  return wait_set->Add(object_handle, cookie, signals);
+}
+
+// zx_status_t zx_waitset_remove
+zx_status_t sys_waitset_remove(zx_handle_t handle, uint64_t cookie) {
+  LTRACEF("handle %x cookie %" PRIx64 "\n", handle, cookie);
+
+  auto up = ProcessDispatcher::GetCurrent();
+
+  fbl::RefPtr<WaitSetDispatcher> wait_set;
+  zx_status_t status = up->GetDispatcherWithRights(handle, ZX_RIGHT_WRITE, &wait_set);
+  if (status != ZX_OK)
+    return status;
+
+  return wait_set->Remove(cookie);
+}
+
+// zx_status_t zx_waitset_wait
+zx_status_t sys_waitset_wait(zx_handle_t handle, zx_time_t deadline,
+                             user_out_ptr<zx_waitset_result_t> results_out, size_t count,
+                             user_out_ptr<size_t> actual_out) {
+  LTRACEF("handle %x count %zu\n", handle, count);
+
+  if (count == 0)
+    return ZX_ERR_INVALID_ARGS;
+
+  auto up = ProcessDispatcher::GetCurrent();
+
+  fbl::RefPtr<WaitSetDispatcher> wait_set;
+  zx_status_t status = up->GetDispatcherWithRights(handle, ZX_RIGHT_READ, &wait_set);
+  if (status != ZX_OK)
+    return status;
+
+  const Deadline slackDeadline(deadline, up->GetTimerSlackPolicy());
+
+  // Only the first batch waits for |deadline|. Later batches only pick up entries the previous
+  // ones did not get to, since entries that stay ready are rotated to the back of the list.
+  size_t total = 0;
+  size_t unvisited = count;
+  zx_status_t st = ZX_OK;
+  while (total < count && unvisited > 0) {
+    zx_waitset_result_t results[kWaitSetBatchSize];
+    const size_t batch = fbl::min(fbl::min(count - total, kWaitSetBatchSize), unvisited);
+    size_t actual = 0;
+    // Entries reported as canceled are freed at the end of the batch, once they have been copied
+    // out.
+    WaitSetDispatcher::EntryTree canceled;
+    st = wait_set->Wait(total == 0 ? slackDeadline : Deadline::no_slack(ZX_TIME_INFINITE_PAST),
+                        results, batch, &actual, &unvisited, &canceled);
+    if (st != ZX_OK)
+      break;
+
+    status = results_out.element_offset(total).copy_array_to_user(results, actual);
+    if (status != ZX_OK) {
+      // Don't lose the canceled entries; the next wait reports them again.
+      wait_set->Restore(&canceled);
+      if (total == 0)
+        return status;
+      // Earlier batches did reach the caller.
+      break;
+    }
+
+    total += actual;
+  }
+
+  // Running out of ready entries after the first batch is not an error.
+  if (total == 0)
+    return st;
+
+  if (actual_out) {
+    status = actual_out.copy_to_user(total);
+    if (status != ZX_OK)
+      return status;
+  }
+  return ZX_OK;
+}
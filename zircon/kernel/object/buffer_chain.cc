@@ -6,6 +6,102 @@
 
 #include "object/buffer_chain.h"
 
+#include <lib/counters.h>
+
+#include <arch/ops.h>
+#include <kernel/align.h>
+#include <kernel/spinlock.h>
+
+namespace {
+
+// Channel messages are usually freed soon after being allocated, so a handful of pages per cpu is
+// enough to serve most allocations without taking the PMM lock. Frees beyond this many cached pages
+// go straight back to the PMM.
+constexpr size_t kCacheHighWater = 32;
+
+KCOUNTER(buffer_chain_cache_hit, "channel.buffer_chain.cache_hit")
+KCOUNTER(buffer_chain_cache_miss, "channel.buffer_chain.cache_miss")
+KCOUNTER(buffer_chain_cache_reclaimed, "channel.buffer_chain.cache_reclaimed")
+
+struct PageCache {
+  SpinLock lock;
+  list_node pages TA_GUARDED(lock) = LIST_INITIAL_VALUE(pages);
+  size_t count TA_GUARDED(lock) = 0;
+} __CPU_ALIGN;
+
+PageCache page_caches[SMP_MAX_CPUS];
+
+}  // namespace
+
+zx_status_t BufferChain::AllocPages(size_t count, list_node* pages) {
+  size_t cached = 0;
+  {
+    PageCache& cache = page_caches[arch_curr_cpu_num()];
+    Guard<SpinLock, IrqSave> guard{&cache.lock};
+    while (cached < count && cache.count > 0) {
+      list_add_tail(pages, list_remove_head(&cache.pages));
+      cache.count--;
+      cached++;
+    }
+  }
+  if (cached > 0) {
+    pmm_remove_cached_pages(cached);
+  }
+  if (cached == count) {
+    buffer_chain_cache_hit.Add(1);
+    return ZX_OK;
+  }
+  buffer_chain_cache_miss.Add(1);
+
+  list_node fresh = LIST_INITIAL_VALUE(fresh);
+  zx_status_t status = pmm_alloc_pages(count - cached, 0, &fresh);
+  if (unlikely(status != ZX_OK)) {
+    FreePages(pages);
+    return status;
+  }
+  vm_page_t* page;
+  list_for_every_entry (&fresh, page, vm_page_t, queue_node) {
+    DEBUG_ASSERT(page->state() == VM_PAGE_STATE_ALLOC);
+    page->set_state(VM_PAGE_STATE_IPC);
+  }
+  list_splice_after(&fresh, pages);
+  return ZX_OK;
+}
+
+void BufferChain::FreePages(list_node* pages) {
+  size_t cached = 0;
+  {
+    PageCache& cache = page_caches[arch_curr_cpu_num()];
+    Guard<SpinLock, IrqSave> guard{&cache.lock};
+    while (cache.count < kCacheHighWater && !list_is_empty(pages)) {
+      list_add_head(&cache.pages, list_remove_head(pages));
+      cache.count++;
+      cached++;
+    }
+  }
+  // Cached pages are reclaimed under memory pressure, so count them as free until then.
+  if (cached > 0) {
+    pmm_add_cached_pages(cached);
+  }
+  if (!list_is_empty(pages)) {
+    pmm_free(pages);
+  }
+}
+
+void BufferChain::ReclaimCachedPages() {
+  list_node pages = LIST_INITIAL_VALUE(pages);
+  size_t reclaimed = 0;
+  for (auto& cache : page_caches) {
+    Guard<SpinLock, IrqSave> guard{&cache.lock};
+    list_splice_after(&cache.pages, &pages);
+    reclaimed += cache.count;
+    cache.count = 0;
+  }
+  buffer_chain_cache_reclaimed.Add(reclaimed);
+  pmm_remove_cached_pages(reclaimed);
+  pmm_free(&pages);
+}
+
 // Makes a const char* look like a user_in_ptr<const char>.
 //
 // Sometimes we need to copy data from kernel space. KernelPtrAdapter allows us to implement the
@@ -19,6 +19,7 @@
 #include <fbl/alloc_checker.h>
 #include <fbl/auto_lock.h>
 #include <kernel/event.h>
+#include <kernel/sched.h>
 #include <object/handle.h>
 #include <object/message_packet.h>
 #include <object/process_dispatcher.h>
@@ -208,6 +209,59 @@ zx_status_t ChannelDispatcher::Read(zx_koid_t owner, uint32_t* msg_size, uint32_
   return rv;
 }
 
+zx_status_t ChannelDispatcher::ReadMany(zx_koid_t owner, uint32_t* msg_sizes,
+                                        uint32_t* msg_handle_counts, MessagePacketPtr* msgs,
+                                        size_t count, size_t* actual) {
+  canary_.Assert();
+
+  *actual = 0;
+
+  Guard<fbl::Mutex> guard{get_lock()};
+
+  if (owner != owner_)
+    return ZX_ERR_BAD_HANDLE;
+
+  if (messages_.is_empty())
+    return peer_ ? ZX_ERR_SHOULD_WAIT : ZX_ERR_PEER_CLOSED;
+
+  zx_status_t rv = ZX_OK;
+  size_t ix = 0;
+  for (; ix < count && !messages_.is_empty(); ++ix) {
+    const uint32_t size = messages_.front().data_size();
+    const uint32_t handle_count = messages_.front().num_handles();
+    const bool fits = size <= msg_sizes[ix] && handle_count <= msg_handle_counts[ix];
+    msg_sizes[ix] = size;
+    msg_handle_counts[ix] = handle_count;
+    if (!fits) {
+      rv = ZX_ERR_BUFFER_TOO_SMALL;
+      break;
+    }
+    msgs[ix] = messages_.pop_front();
+  }
+  *actual = ix;
+
+  if (messages_.is_empty())
+    UpdateStateLocked(ZX_CHANNEL_READABLE, 0u);
+
+  return rv;
+}
+
+void ChannelDispatcher::Unread(MessagePacketPtr* msgs, size_t count) {
+  canary_.Assert();
+
+  if (count == 0)
+    return;
+
+  Guard<fbl::Mutex> guard{get_lock()};
+
+  const bool was_empty = messages_.is_empty();
+  for (size_t ix = count; ix > 0; --ix) {
+    messages_.push_front(ktl::move(msgs[ix - 1]));
+  }
+  if (was_empty)
+    UpdateStateLocked(0u, ZX_CHANNEL_READABLE);
+}
+
 zx_status_t ChannelDispatcher::Write(zx_koid_t owner, MessagePacketPtr msg) {
   canary_.Assert();
 
@@ -230,6 +284,28 @@ zx_status_t ChannelDispatcher::Write(zx_koid_t owner, MessagePacketPtr msg) {
   return ZX_OK;
 }
 
+zx_status_t ChannelDispatcher::WriteMany(zx_koid_t owner, MessagePacketPtr* msgs, size_t count) {
+  canary_.Assert();
+
+  AutoReschedDisable resched_disable;  // Must come before the lock guard.
+  resched_disable.Disable();
+  Guard<fbl::Mutex> guard{get_lock()};
+
+  // See Write() for an explanation of this test.
+  if (owner != owner_)
+    return ZX_ERR_BAD_HANDLE;
+
+  if (!peer_)
+    return ZX_ERR_PEER_CLOSED;
+
+  AssertHeld(*peer_->get_lock());
+  for (size_t ix = 0; ix < count; ++ix) {
+    peer_->WriteSelf(ktl::move(msgs[ix]));
+  }
+
+  return ZX_OK;
+}
+
 zx_status_t ChannelDispatcher::Call(zx_koid_t owner, MessagePacketPtr msg, zx_time_t deadline,
                                     MessagePacketPtr* reply) {
   canary_.Assert();
@@ -279,9 +355,13 @@ zx_status_t ChannelDispatcher::Call(zx_koid_t owner, MessagePacketPtr msg, zx_ti
     // waiter to the list.
     waiters_.push_back(waiter);
 
-    // (1) Write outbound message to opposing endpoint.
+    // (1) Write outbound message to opposing endpoint. If that wakes a server
+    // thread that last ran on this cpu, let it run as soon as we block below
+    // rather than going through the run queue.
     AssertHeld(*peer_->get_lock());
+    sched_set_handoff(true);
     peer_->WriteSelf(ktl::move(msg));
+    sched_set_handoff(false);
   }
 
   auto process = ProcessDispatcher::GetCurrent();
@@ -345,7 +425,11 @@ void ChannelDispatcher::WriteSelf(MessagePacketPtr msg) {
       // Remove waiter from list.
       if (waiter.get_txid() == txid) {
         waiters_.erase(waiter);
+        // The replying thread is likely to block waiting for the next request
+        // soon, so hand the cpu straight back to the caller when it does.
+        sched_set_handoff(true);
         waiter.Deliver(ktl::move(msg));
+        sched_set_handoff(false);
         return;
       }
     }
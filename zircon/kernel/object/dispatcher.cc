@@ -25,6 +25,7 @@ KCOUNTER(dispatcher_observe_count, "dispatcher.observer.add")
 KCOUNTER(dispatcher_cancel_count, "dispatcher.observer.cancel")
 KCOUNTER(dispatcher_cancel_bk_count, "dispatcher.observer.cancel.by_key.handled")
 KCOUNTER(dispatcher_cancel_bk_nh_count, "dispatcher.observer.cancel.by_key.not_handled")
+KCOUNTER(dispatcher_update_lockfree_count, "dispatcher.update_state.lock_free")
 
 namespace {
 ktl::atomic<zx_koid_t> global_koid(ZX_KOID_FIRST);
@@ -66,7 +67,7 @@ class SafeDeleter {
 }  // namespace
 
 Dispatcher::Dispatcher(zx_signals_t signals)
-    : koid_(GenerateKernelObjectId()), handle_count_(0u), signals_(signals) {
+    : koid_(GenerateKernelObjectId()), handle_count_(0u), state_(signals) {
   kcounter_add(dispatcher_create_count, 1);
 }
 
@@ -119,8 +120,8 @@ StateObserver::Flags CancelWithFunc(Dispatcher::ObserverList* observers,
 
 // Since this conditionally takes the dispatcher's |lock_|, based on
 // the type of Mutex (either fbl::Mutex or fbl::NullLock), the thread
-// safety analysis is unable to prove that the accesses to |signals_|
-// and to |observers_| are always protected.
+// safety analysis is unable to prove that the accesses to |observers_|
+// are always protected.
 template <typename LockType>
 void Dispatcher::AddObserverHelper(StateObserver* observer, const StateObserver::CountInfo* cinfo,
                                    Lock<LockType>* lock) TA_NO_THREAD_SAFETY_ANALYSIS {
@@ -132,9 +133,16 @@ void Dispatcher::AddObserverHelper(StateObserver* observer, const StateObserver:
   {
     Guard<LockType> guard{lock};
 
-    flags = observer->OnInitialize(signals_, cinfo);
+    // Publishing kObserversPresent and sampling the signals in one step means a
+    // lock-free update either lands before |initial_state| or sees the flag and
+    // comes through the lock to notify us.
+    uint64_t state = state_.fetch_or(kObserversPresent, ktl::memory_order_acq_rel);
+    flags = observer->OnInitialize(static_cast<zx_signals_t>(state), cinfo);
     if (flags & StateObserver::kNeedRemoval) {
       observer->OnRemoved();
+      if (observers_.is_empty()) {
+        state_.fetch_and(~kObserversPresent, ktl::memory_order_relaxed);
+      }
     } else {
       observers_.push_front(observer);
     }
@@ -171,6 +179,9 @@ bool Dispatcher::RemoveObserver(StateObserver* observer) {
 
   if (StateObserver::ObserverListTraits::node_state(*observer).InContainer()) {
     observers_.erase(*observer);
+    if (observers_.is_empty()) {
+      state_.fetch_and(~kObserversPresent, ktl::memory_order_relaxed);
+    }
     return true;
   }
 
@@ -204,7 +215,7 @@ bool Dispatcher::CancelByKey(const Handle* handle, const void* port, uint64_t ke
 
 // Since this conditionally takes the dispatcher's |lock_|, based on
 // the type of Mutex (either fbl::Mutex or fbl::NullLock), the thread
-// safety analysis is unable to prove that the accesses to |signals_|
+// safety analysis is unable to prove that the accesses to |observers_|
 // are always protected.
 template <typename LockType>
 void Dispatcher::UpdateStateHelper(zx_signals_t clear_mask, zx_signals_t set_mask,
@@ -215,15 +226,23 @@ void Dispatcher::UpdateStateHelper(zx_signals_t clear_mask, zx_signals_t set_mas
   {
     Guard<LockType> guard{lock};
 
-    auto previous_signals = signals_;
-    signals_ &= ~clear_mask;
-    signals_ |= set_mask;
-
-    if (previous_signals == signals_)
+    // Lock-free updates may still race with us while kObserversPresent is
+    // clear, so the signals are always changed with an atomic read-modify-write.
+    uint64_t previous = state_.load(ktl::memory_order_relaxed);
+    uint64_t next;
+    do {
+      next = (previous & ~static_cast<uint64_t>(clear_mask)) | set_mask;
+      if (previous == next)
+        return;
+    } while (!state_.compare_exchange_weak(previous, next, ktl::memory_order_acq_rel,
+                                           ktl::memory_order_relaxed));
+
+    if (!(next & kObserversPresent))
       return;
 
+    const zx_signals_t signals = static_cast<zx_signals_t>(next);
     for (auto it = observers_.begin(); it != observers_.end();) {
-      StateObserver::Flags it_flags = it->OnStateChange(signals_);
+      StateObserver::Flags it_flags = it->OnStateChange(signals);
       if (it_flags & StateObserver::kNeedRemoval) {
         auto to_remove = it;
         ++it;
@@ -233,12 +252,37 @@ void Dispatcher::UpdateStateHelper(zx_signals_t clear_mask, zx_signals_t set_mas
         ++it;
       }
     }
+
+    if (observers_.is_empty()) {
+      state_.fetch_and(~kObserversPresent, ktl::memory_order_relaxed);
+    }
   }
 }
 
+bool Dispatcher::TryUpdateStateLockFree(zx_signals_t clear_mask, zx_signals_t set_mask) {
+  canary_.Assert();
+  ZX_DEBUG_ASSERT(is_waitable());
+
+  uint64_t previous = state_.load(ktl::memory_order_relaxed);
+  uint64_t next;
+  do {
+    if (previous & kObserversPresent)
+      return false;
+    next = (previous & ~static_cast<uint64_t>(clear_mask)) | set_mask;
+    if (previous == next)
+      break;
+  } while (!state_.compare_exchange_weak(previous, next, ktl::memory_order_acq_rel,
+                                         ktl::memory_order_relaxed));
+
+  kcounter_add(dispatcher_update_lockfree_count, 1);
+  return true;
+}
+
 void Dispatcher::UpdateState(zx_signals_t clear_mask, zx_signals_t set_mask) {
   canary_.Assert();
 
+  if (TryUpdateStateLockFree(clear_mask, set_mask))
+    return;
   UpdateStateHelper(clear_mask, set_mask, get_lock());
 }
 
@@ -17,6 +17,7 @@
 #include <zircon/types.h>
 
 #include <lk/init.h>
+#include <object/buffer_chain.h>
 #include <object/diagnostics.h>
 #include <object/event_dispatcher.h>
 #include <object/executor.h>
@@ -24,6 +25,7 @@
 #include <object/port_dispatcher.h>
 #include <platform/crashlog.h>
 #include <platform/halt_helper.h>
+#include <vm/scanner.h>
 
 static Executor gExecutor;
 
@@ -62,6 +64,11 @@ static Event mem_state_signal(EVENT_FLAG_AUTOUNSIGNAL);
 static ktl::atomic<PressureLevel> mem_event_idx = PressureLevel::kNormal;
 static PressureLevel prev_mem_event_idx = mem_event_idx;
 
+// Amount of free memory, in bytes, that page eviction aims for once we drop below the normal memory
+// state. This is just above the warning watermark so that a successful eviction returns us to the
+// normal state. Set once during init.
+static uint64_t mem_evict_target = 0;
+
 fbl::RefPtr<EventDispatcher> GetMemPressureEvent(uint32_t kind) {
   switch (kind) {
     case ZX_SYSTEM_EVENT_OUT_OF_MEMORY:
@@ -154,6 +161,13 @@ static int oom_thread(void* unused) {
     }
     prev_mem_event_idx = idx;
 
+    // Before anything else try to free up memory by dropping cached channel buffers and evicting
+    // pager backed pages that have not been accessed recently.
+    if (idx < PressureLevel::kNormal) {
+      BufferChain::ReclaimCachedPages();
+      scanner_trigger_evict(mem_evict_target);
+    }
+
     // If we're below the out-of-memory watermark, trigger OOM behavior.
     if (idx == 0) {
       on_oom();
@@ -188,6 +202,8 @@ static void memory_pressure_init() {
     mem_watermarks[PressureLevel::kCritical] =
         gCmdline.GetUInt64("kernel.oom.critical-mb", 150) * MB;
     mem_watermarks[PressureLevel::kWarning] = gCmdline.GetUInt64("kernel.oom.warning-mb", 300) * MB;
+    // Target one debounce interval past the warning watermark.
+    mem_evict_target = mem_watermarks[PressureLevel::kWarning] + MB;
 
     zx_status_t status = pmm_init_reclamation(&mem_watermarks[PressureLevel::kOutOfMemory],
                                               kNumWatermarks, MB, mem_avail_state_updated_cb);
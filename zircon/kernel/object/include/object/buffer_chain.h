@@ -25,7 +25,8 @@
 // BufferChain is a list of fixed-size buffers allocated from the PMM.
 //
 // It's designed for use with channel messages.  Pages backing a BufferChain are marked as
-// VM_PAGE_STATE_IPC.
+// VM_PAGE_STATE_IPC.  Freed pages are kept in small per-cpu caches for reuse by the next chain
+// rather than going straight back to the PMM.
 //
 // The BufferChain object itself lives *inside* its first buffer.  Here's what it looks like:
 //
@@ -95,7 +96,7 @@ class BufferChain {
 
     // Allocate a list of pages.
     list_node pages = LIST_INITIAL_VALUE(pages);
-    zx_status_t status = pmm_alloc_pages(num_buffers, 0, &pages);
+    zx_status_t status = AllocPages(num_buffers, &pages);
     if (unlikely(status != ZX_OK)) {
       return nullptr;
     }
@@ -104,8 +105,7 @@ class BufferChain {
     BufferChain::BufferList temp;
     vm_page_t* page;
     list_for_every_entry (&pages, page, vm_page_t, queue_node) {
-      DEBUG_ASSERT(page->state() == VM_PAGE_STATE_ALLOC);
-      page->set_state(VM_PAGE_STATE_IPC);
+      DEBUG_ASSERT(page->state() == VM_PAGE_STATE_IPC);
       void* va = paddr_to_physmap(page->paddr());
       temp.push_front(new (va) BufferChain::Buffer);
     }
@@ -131,9 +131,12 @@ class BufferChain {
       BufferChain::Buffer* buf = buffers.pop_front();
       buf->Buffer::~Buffer();
     }
-    pmm_free(&pages);
+    FreePages(&pages);
   }
 
+  // Returns all pages held in the per-cpu caches to the PMM. Called when memory is running low.
+  static void ReclaimCachedPages();
+
   // Copies |size| bytes from |src| to this chain starting at offset |dst_offset|.
   //
   // |dst_offset| must be in the range [0, kContig).
@@ -181,6 +184,13 @@ class BufferChain {
 
   ~BufferChain() { DEBUG_ASSERT(list_is_empty(&pages_)); }
 
+  // Moves |count| pages in the VM_PAGE_STATE_IPC state onto |pages|, taking them from the current
+  // cpu's cache where possible.
+  static zx_status_t AllocPages(size_t count, list_node* pages);
+
+  // Frees |pages| to the current cpu's cache, or to the PMM once the cache is full.
+  static void FreePages(list_node* pages);
+
   // |PTR_IN| is a user_in_ptr-like type.
   template <typename PTR_IN>
   zx_status_t CopyInCommon(PTR_IN src, size_t dst_offset, size_t size) {
@@ -41,11 +41,29 @@ class ChannelDispatcher final
   zx_status_t Read(zx_koid_t owner, uint32_t* msg_size, uint32_t* msg_handle_count,
                    MessagePacketPtr* msg, bool may_disard);
 
+  // Read up to |count| messages from this endpoint's message queue under a single acquisition
+  // of the lock. |msg_sizes| and |msg_handle_counts| are in-out arrays of |count| entries that
+  // work like the parameters of Read() for each message. Messages are read in order until one
+  // does not fit; that message stays queued, its entries are set to its actual size and handle
+  // count, and ZX_ERR_BUFFER_TOO_SMALL is returned. |*actual| is set to the number of messages
+  // returned in |msgs|. If the queue is empty, returns the same error as Read().
+  zx_status_t ReadMany(zx_koid_t owner, uint32_t* msg_sizes, uint32_t* msg_handle_counts,
+                       MessagePacketPtr* msgs, size_t count, size_t* actual);
+
+  // Return |count| messages obtained from ReadMany() to the head of the message queue, in order,
+  // because they could not be delivered. Another thread may already have read messages that were
+  // queued behind them, in which case those are delivered out of order.
+  void Unread(MessagePacketPtr* msgs, size_t count);
+
   // Write to the opposing endpoint's message queue. |owner| is the process attempting to
   // write to the channel, or ZX_KOID_INVALID if kernel is doing it. If |owner| does not
   // match what was last set by Dispatcher::set_owner() the call will fail.
   zx_status_t Write(zx_koid_t owner, MessagePacketPtr msg);
 
+  // Write |count| messages, in order, to the opposing endpoint's message queue under a single
+  // acquisition of the lock. Either all of the messages are written or none of them are.
+  zx_status_t WriteMany(zx_koid_t owner, MessagePacketPtr* msgs, size_t count);
+
   // Perform a transacted Write + Read. |owner| is the process attempting to write
   // to the channel, or ZX_KOID_INVALID if kernel is doing it. If |owner| does not
   // match what was last set by Dispatcher::set_owner() the call will fail.
@@ -25,6 +25,7 @@
 #include <fbl/ref_ptr.h>
 #include <kernel/lockdep.h>
 #include <kernel/spinlock.h>
+#include <ktl/atomic.h>
 #include <ktl/move.h>
 #include <ktl/type_traits.h>
 #include <ktl/unique_ptr.h>
@@ -75,6 +76,7 @@ DECLARE_DISPTAG(ExceptionDispatcher, ZX_OBJ_TYPE_EXCEPTION, "EXCD")
 DECLARE_DISPTAG(ClockDispatcher, ZX_OBJ_TYPE_CLOCK, "CLOK")
 DECLARE_DISPTAG(StreamDispatcher, ZX_OBJ_TYPE_STREAM, "STRM")
 DECLARE_DISPTAG(MsiInterruptDispatcher, ZX_OBJ_TYPE_MSI_INTERRUPT, "MSII")
+DECLARE_DISPTAG(WaitSetDispatcher, ZX_OBJ_TYPE_WAITSET, "WSET")
 
 #undef DECLARE_DISPTAG
 
@@ -194,11 +196,24 @@ class Dispatcher : private fbl::RefCountedUpgradeable<Dispatcher>,
   // Notify others of a change in state (possibly waking them). (Clearing satisfied signals or
   // setting satisfiable signals should not wake anyone.)
   //
+  // UpdateState does not take the lock when no observers are registered.
+  //
   // May only be called when |is_waitable| reports true.
   void UpdateState(zx_signals_t clear_mask, zx_signals_t set_mask);
   void UpdateStateLocked(zx_signals_t clear_mask, zx_signals_t set_mask) TA_REQ(get_lock());
 
-  zx_signals_t GetSignalsStateLocked() const TA_REQ(get_lock()) { return signals_; }
+  // Updates the signal state without taking the lock, provided no observers are
+  // registered. Returns false, changing nothing, if there are observers to notify;
+  // the caller must then use UpdateState or UpdateStateLocked.
+  //
+  // May only be called when |is_waitable| reports true.
+  bool TryUpdateStateLockFree(zx_signals_t clear_mask, zx_signals_t set_mask);
+
+  // Signals that don't belong to the caller's own state machine may be changed
+  // concurrently by TryUpdateStateLockFree, even while the lock is held.
+  zx_signals_t GetSignalsStateLocked() const TA_REQ(get_lock()) {
+    return static_cast<zx_signals_t>(state_.load(ktl::memory_order_acquire));
+  }
 
   // Dispatcher subtypes should use this lock to protect their internal state.
   virtual Lock<fbl::Mutex>* get_lock() const = 0;
@@ -223,7 +238,13 @@ class Dispatcher : private fbl::RefCountedUpgradeable<Dispatcher>,
   const zx_koid_t koid_;
   ktl::atomic<uint32_t> handle_count_;
 
-  zx_signals_t signals_ TA_GUARDED(get_lock());
+  // Set in |state_| whenever |observers_| may be non-empty. It is only set or cleared with
+  // the lock held, but it shares a word with the signals so that TryUpdateStateLockFree can
+  // check for observers and change the signals in one atomic step.
+  static constexpr uint64_t kObserversPresent = 1ull << 32;
+
+  // The low 32 bits are the current zx_signals_t, the rest is kObserversPresent.
+  ktl::atomic<uint64_t> state_;
 
   // Active observers are elements in |observers_|.
   ObserverList observers_ TA_GUARDED(get_lock());
@@ -329,6 +350,11 @@ class PeeredDispatcher : public Dispatcher {
     if ((set_mask & ~allowed_signals) || (clear_mask & ~allowed_signals))
       return ZX_ERR_INVALID_ARGS;
 
+    // Signaling ourselves doesn't need |peer_|, so skip the shared lock when
+    // nobody is waiting.
+    if (TryUpdateStateLockFree(clear_mask, set_mask))
+      return ZX_OK;
+
     Guard<fbl::Mutex> guard{get_lock()};
 
     UpdateStateLocked(clear_mask, set_mask);
@@ -11,7 +11,6 @@
 #include <zircon/types.h>
 
 #include <fbl/intrusive_double_list.h>
-#include <fbl/intrusive_hash_table.h>
 #include <fbl/mutex.h>
 #include <fbl/ref_ptr.h>
 #include <kernel/lockdep.h>
@@ -137,11 +136,13 @@ class FutexContext {
   // thread exits, it take two FutexStates out of the free pool and lets them
   // expire.
   //
-  // There is a master spin lock for each process which protects the sets of
-  // active and free FutexStates.  Any time a thread needs to work with futex
-  // ID X, it must first obtain the process-wide pool lock and either find the
-  // FutexState in the active set with that ID, or activate one from the free
-  // list.  After this, the process wide pool lock is immediately released.
+  // Active FutexStates live in a table of buckets selected by hashing the
+  // futex ID, and each bucket has its own spin lock.  Any time a thread needs
+  // to work with futex ID X, it must first obtain the lock of X's bucket and
+  // either find the FutexState in the bucket with that ID, or activate one
+  // from the free list.  After this, the bucket lock is immediately released.
+  // The free list has a process-wide lock of its own, which is only taken
+  // (inside of a bucket lock) when a FutexState is activated or retired.
   //
   // In order to keep this FutexState from disappearing out from under
   // the thread during its Wait/Wake/Requeue operation, a "pending operation"
@@ -151,7 +152,7 @@ class FutexContext {
   // FutexState objects are managed using ktl::unique_ptr.  At all times, a
   // FutexState will be in one of three states.
   //
-  // 1) A member of a FutexContext's active_futexes_ hashtable.  Futexes in this state are
+  // 1) A member of one of a FutexContext's active futex buckets.  Futexes in this state are
   //    currently involved in at least one futex operation.  Their futex ID will
   //    be non-zero as will their pending operation count..
   // 2) A member of a FutexContext's free_futexes_ list.  These futexes are
@@ -169,7 +170,7 @@ class FutexContext {
     // PendingOpRef to represent the borrow from the pool instead of a raw
     // FutexState pointer.  By default, these object will release a pending
     // operation reference when they go out of scope.  They do this under the
-    // protection of the outer FutexContext's pool_lock_, returning the
+    // protection of the lock of the FutexState's bucket, returning the
     // FutexState to the FutexContext's free pool when the pending operation
     // count reaches zero.
     //
@@ -246,14 +247,24 @@ class FutexContext {
       }
 
       void TakeRefs(PendingOpRef* other, uint32_t count) {
-        Guard<SpinLock, IrqSave> pool_lock_guard{&ctx_->pool_lock_};
         DEBUG_ASSERT(state_ != nullptr);
         DEBUG_ASSERT(other->state_ != nullptr);
-        DEBUG_ASSERT(state_->pending_operation_count_ > 0);
-        DEBUG_ASSERT(other->state_->pending_operation_count_ > count);
 
-        state_->pending_operation_count_ += count;
-        other->state_->pending_operation_count_ -= count;
+        // The two states may live in different buckets.  Neither count can
+        // reach zero here because both refs are still held, so the counts can
+        // be adjusted one bucket at a time.
+        {
+          Bucket& bucket = ctx_->BucketFor(state_->id());
+          Guard<SpinLock, IrqSave> bucket_guard{&bucket.lock};
+          DEBUG_ASSERT(state_->pending_operation_count_ > 0);
+          state_->pending_operation_count_ += count;
+        }
+        {
+          Bucket& bucket = ctx_->BucketFor(other->state_->id());
+          Guard<SpinLock, IrqSave> bucket_guard{&bucket.lock};
+          DEBUG_ASSERT(other->state_->pending_operation_count_ > count);
+          other->state_->pending_operation_count_ -= count;
+        }
       }
 
       void CancelRef() {
@@ -270,18 +281,21 @@ class FutexContext {
      private:
       void Release() {
         if (state_ != nullptr) {
-          Guard<SpinLock, IrqSave> pool_lock_guard{&ctx_->pool_lock_};
+          DEBUG_ASSERT(state_->id() != 0);
+          Bucket& bucket = ctx_->BucketFor(state_->id());
+          Guard<SpinLock, IrqSave> bucket_guard{&bucket.lock};
           uint32_t release_count = 1 + extra_refs_;
 
-          DEBUG_ASSERT(state_ != nullptr);
-          DEBUG_ASSERT(state_->id() != 0);
           DEBUG_ASSERT(state_->pending_operation_count_ >= release_count);
 
           state_->pending_operation_count_ -= release_count;
           if (state_->pending_operation_count_ == 0) {
-            ctx_->free_futexes_.push_front(ctx_->active_futexes_.erase(*state_));
+            ktl::unique_ptr<FutexState> retired = bucket.futexes.erase(*state_);
             state_->id_ = 0;
             state_->waiters_.AssertNotOwned();
+
+            Guard<SpinLock, NoIrqSave> pool_lock_guard{&ctx_->pool_lock_};
+            ctx_->free_futexes_.push_front(ktl::move(retired));
           }
 
           state_ = nullptr;
@@ -298,10 +312,6 @@ class FutexContext {
 
     uintptr_t id() const { return id_; }
 
-    // hashtable support
-    uintptr_t GetKey() const { return id(); }
-    static size_t GetHash(uintptr_t key) { return (key >> 3); }
-
    private:
     friend typename ktl::unique_ptr<FutexState>::deleter_type;
     friend class FutexContext;
@@ -319,8 +329,9 @@ class FutexContext {
     uintptr_t id_ = 0;
     OwnedWaitQueue waiters_;
 
-    // pending operation count is protected by the outer FutexContext pool lock.
-    // Sadly, there is no good way to express this using static annotations.
+    // pending operation count is protected by the lock of the bucket that the
+    // state's id hashes to.  Sadly, there is no good way to express this using
+    // static annotations.
     uint32_t pending_operation_count_ = 0;
 
     DECLARE_MUTEX(FutexContext) lock_ TA_ACQ_BEFORE(thread_lock);
@@ -352,16 +363,38 @@ class FutexContext {
   static void* operator new(size_t) = delete;
   static void* operator new[](size_t) = delete;
 
+  // A bucket of the active futex table.  Its lock protects the list and the
+  // pending operation counts of the FutexStates on it.
+  struct Bucket {
+    // Note that lockdep tracking is disabled on this lock because it is
+    // acquired while holding the thread lock.
+    DECLARE_SPINLOCK(Bucket, lockdep::LockFlagsTrackingDisabled) lock;
+    fbl::DoublyLinkedList<ktl::unique_ptr<FutexState>> futexes TA_GUARDED(lock);
+  };
+
+  // Must be a power of two.
+  static constexpr size_t kNumBuckets = 64;
+
+  Bucket& BucketFor(uintptr_t id) {
+    // Futexes are 4 byte aligned, and are often found at the same offset in
+    // page sized or page aligned structures, so mix all of the bits of the id
+    // into the bucket index.
+    const uint64_t hash = static_cast<uint64_t>(id >> 2) * 0x9e3779b97f4a7c15ull;
+    return buckets_[hash >> (64 - __builtin_ctzll(kNumBuckets))];
+  }
+
   // Find the futex state for a given ID in the futex table, increment its
   // pending operation reference count, and return an RAII helper which helps to
   // manage the pending operation references.
-  FutexState::PendingOpRef FindActiveFutex(uintptr_t id) TA_EXCL(pool_lock_) {
-    Guard<SpinLock, IrqSave> pool_lock_guard{&pool_lock_};
-    return FindActiveFutexLocked(id);
+  FutexState::PendingOpRef FindActiveFutex(uintptr_t id) {
+    Bucket& bucket = BucketFor(id);
+    Guard<SpinLock, IrqSave> bucket_guard{&bucket.lock};
+    return FindActiveFutexLocked(bucket, id);
   }
 
-  FutexState::PendingOpRef FindActiveFutexLocked(uintptr_t id) TA_REQ(pool_lock_) {
-    auto iter = active_futexes_.find(id);
+  FutexState::PendingOpRef FindActiveFutexLocked(Bucket& bucket, uintptr_t id)
+      TA_REQ(bucket.lock) {
+    auto iter = bucket.futexes.find_if([id](const FutexState& state) { return state.id() == id; });
 
     if (iter.IsValid()) {
       DEBUG_ASSERT(iter->pending_operation_count_ > 0);
@@ -374,18 +407,25 @@ class FutexContext {
 
   // Find a futex with the specified ID, increment its pending_operation_count
   // and return it to the caller.  If the given futex ID is not currently
-  // active, grab a free one and activate it.
-  FutexState::PendingOpRef ActivateFutex(uintptr_t id) TA_EXCL(pool_lock_) {
-    Guard<SpinLock, IrqSave> pool_lock_guard{&pool_lock_};
-    return ActivateFutexLocked(id);
-  }
-
-  FutexState::PendingOpRef ActivateFutexLocked(uintptr_t id) TA_REQ(pool_lock_) {
-    if (auto ret = FindActiveFutexLocked(id); ret != nullptr) {
+  // active, grab a free one and activate it.  If |was_active| is non-null, it
+  // is set to whether or not the futex was already active.
+  FutexState::PendingOpRef ActivateFutex(uintptr_t id, bool* was_active = nullptr)
+      TA_EXCL(pool_lock_) {
+    Bucket& bucket = BucketFor(id);
+    Guard<SpinLock, IrqSave> bucket_guard{&bucket.lock};
+
+    if (auto ret = FindActiveFutexLocked(bucket, id); ret != nullptr) {
+      if (was_active != nullptr) {
+        *was_active = true;
+      }
       return ret;
     }
 
-    ktl::unique_ptr<FutexState> new_state = free_futexes_.pop_front();
+    ktl::unique_ptr<FutexState> new_state;
+    {
+      Guard<SpinLock, NoIrqSave> pool_lock_guard{&pool_lock_};
+      new_state = free_futexes_.pop_front();
+    }
 
     // Sanity checks.
     DEBUG_ASSERT(new_state != nullptr);
@@ -396,15 +436,20 @@ class FutexContext {
     FutexState* ptr = new_state.get();
     ptr->id_ = id;
     ++ptr->pending_operation_count_;
-    active_futexes_.insert(ktl::move(new_state));
-
+    bucket.futexes.push_front(ktl::move(new_state));
+    if (was_active != nullptr) {
+      *was_active = false;
+    }
     return {this, ptr};
   }
 
-  // Protects the free futex pool, and active futex table.  This is an
-  // irq-disable spin lock because it should _never_ be held during any blocking
-  // operations.  Only when putting FutexStates into and out of the free pool,
-  // and when moving Futexes states to and from the active table.
+  // The table of FutexStates currently in use (eg; futexes with waiters).
+  Bucket buckets_[kNumBuckets];
+
+  // Protects the free futex pool.  This is an irq-disable spin lock because it
+  // should _never_ be held during any blocking operations.  Only when putting
+  // FutexStates into and out of the free pool.  When it is taken together with
+  // a bucket lock, the bucket lock must be acquired first.
   //
   // There are times where an individual futex state must be held invariant
   // while a decision to return a futex into the free pool needs to be made.  In
@@ -416,11 +461,6 @@ class FutexContext {
   // while holding the thread lock.
   DECLARE_SPINLOCK(FutexContext, lockdep::LockFlagsTrackingDisabled) pool_lock_;
 
-  // Hash table for FutexStates currently in use (eg; futexes with waiters).
-  fbl::HashTable<uintptr_t, ktl::unique_ptr<FutexState>,
-                 fbl::DoublyLinkedList<ktl::unique_ptr<FutexState>>>
-      active_futexes_ TA_GUARDED(pool_lock_);
-
   // Free list for all futexes which are currently not in use.
   fbl::DoublyLinkedList<ktl::unique_ptr<FutexState>> free_futexes_ TA_GUARDED(pool_lock_);
 };
@@ -173,8 +173,9 @@ class PortObserver final : public StateObserver {
 // linked list and case 3 uses |interrupt_packets_| linked list.
 //
 // The threads that wish to receive notifications block on Dequeue() (which
-// maps to zx_port_wait()) and will receive packets from any of the four sources
-// depending on what kind of object the port has been 'bound' to.
+// maps to zx_port_wait()) or DequeueMany() (which maps to zx_port_wait_many())
+// and will receive packets from any of the four sources depending on what kind
+// of object the port has been 'bound' to.
 //
 // When a packet from any of the sources arrives to the port, one waiting
 // thread unblocks and gets the packet. In all cases |sema_| is used to signal
@@ -197,6 +198,11 @@ class PortDispatcher final : public SoloDispatcher<PortDispatcher, ZX_DEFAULT_PO
   zx_status_t QueueUser(const zx_port_packet_t& packet);
   bool QueueInterruptPacket(PortInterruptPacket* port_packet, zx_time_t timestamp);
   zx_status_t Dequeue(const Deadline& deadline, zx_port_packet_t* packet);
+  // Like Dequeue(), but once a packet is available also takes up to |count| - 1 further packets
+  // that are already queued, acquiring each of the port's locks only once. |count| must be
+  // nonzero. On success |*actual| is between 1 and |count|.
+  zx_status_t DequeueMany(const Deadline& deadline, zx_port_packet_t* packets, size_t count,
+                          size_t* actual);
   bool RemoveInterruptPacket(PortInterruptPacket* port_packet);
 
   // This method determines the observer's fate. Upon return, one of the following will have
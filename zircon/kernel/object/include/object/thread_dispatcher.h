@@ -61,7 +61,7 @@ class ThreadDispatcher final : public SoloDispatcher<ThreadDispatcher, ZX_DEFAUL
     CHANNEL,
     // zx_object_wait_one
     WAIT_ONE,
-    // zx_object_wait_many
+    // zx_object_wait_many, zx_waitset_wait
     WAIT_MANY,
     // zx_interrupt_wait
     INTERRUPT,
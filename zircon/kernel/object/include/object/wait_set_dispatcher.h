@@ -0,0 +1,145 @@
+// Copyright 2020 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#ifndef ZIRCON_KERNEL_OBJECT_INCLUDE_OBJECT_WAIT_SET_DISPATCHER_H_
+#define ZIRCON_KERNEL_OBJECT_INCLUDE_OBJECT_WAIT_SET_DISPATCHER_H_
+
+#include <stdint.h>
+#include <zircon/rights.h>
+#include <zircon/types.h>
+
+#include <fbl/canary.h>
+#include <fbl/intrusive_double_list.h>
+#include <fbl/intrusive_wavl_tree.h>
+#include <fbl/ref_ptr.h>
+#include <kernel/event.h>
+#include <kernel/mutex.h>
+#include <ktl/unique_ptr.h>
+#include <object/dispatcher.h>
+#include <object/handle.h>
+#include <object/state_observer.h>
+
+class WaitSetDispatcher;
+
+// One object registered with a wait set. Each entry stays registered with its object until it
+// is removed from the set, the handle it was added with is closed, or the set goes away.
+class WaitSetEntry final : public StateObserver,
+                           public fbl::WAVLTreeContainable<ktl::unique_ptr<WaitSetEntry>> {
+ public:
+  using ReadyNodeState = fbl::DoublyLinkedListNodeState<WaitSetEntry*>;
+
+  struct ReadyListTraits {
+    static ReadyNodeState& node_state(WaitSetEntry& obj) { return obj.ready_node_state_; }
+  };
+
+  using ReadyList = fbl::DoublyLinkedList<WaitSetEntry*, ReadyListTraits>;
+
+  WaitSetEntry(WaitSetDispatcher* wait_set, const Handle* handle, uint64_t cookie,
+               zx_signals_t signals);
+  ~WaitSetEntry() = default;
+
+  uint64_t GetKey() const { return cookie_; }
+
+ private:
+  friend class WaitSetDispatcher;
+
+  WaitSetEntry(const WaitSetEntry&) = delete;
+  WaitSetEntry& operator=(const WaitSetEntry&) = delete;
+
+  // StateObserver overrides.
+  Flags OnInitialize(zx_signals_t initial_state, const StateObserver::CountInfo* cinfo) final;
+  Flags OnStateChange(zx_signals_t new_state) final;
+  Flags OnCancel(const Handle* handle) final;
+  void OnRemoved() final;
+
+  WaitSetDispatcher* const wait_set_;
+  // Only used as a cookie; no methods are called on it.
+  const void* const handle_;
+  const uint64_t cookie_;
+  const zx_signals_t trigger_;
+
+  // The following are guarded by the wait set's lock.
+
+  // The observed object. Null once the entry has been detached from it, after which no
+  // callbacks may touch the ready list on its behalf.
+  fbl::RefPtr<Dispatcher> dispatcher_;
+  zx_signals_t observed_ = 0u;
+  zx_status_t status_ = ZX_OK;
+  ReadyNodeState ready_node_state_;
+};
+
+// The WaitSetDispatcher implements the wait set kernel object, a persistent, level-triggered
+// alternative to zx_object_wait_many().
+//
+// Objects are added once with zx_waitset_add() and stay registered across waits. Each entry
+// observes its object like a port observer does, but instead of queueing a packet it keeps
+// itself on |ready_| for as long as any of its trigger signals are asserted. zx_waitset_wait()
+// then only has to look at |ready_|, so its cost depends on the number of ready entries rather
+// than the number of registered ones.
+//
+// Lock ordering is |update_lock_|, then the observed object's lock, then get_lock(). Observer
+// callbacks run with the object's lock held and only take get_lock(); add and remove hold
+// |update_lock_| so that an entry is never freed while it is being registered.
+class WaitSetDispatcher final
+    : public SoloDispatcher<WaitSetDispatcher, ZX_DEFAULT_WAITSET_RIGHTS> {
+ public:
+  // The maximum number of entries in a wait set.
+  static constexpr size_t kMaxEntries = 65536u;
+
+  using EntryTree = fbl::WAVLTree<uint64_t, ktl::unique_ptr<WaitSetEntry>>;
+
+  static zx_status_t Create(uint32_t options, KernelHandle<WaitSetDispatcher>* handle,
+                            zx_rights_t* rights);
+
+  ~WaitSetDispatcher() final;
+  zx_obj_type_t get_type() const final { return ZX_OBJ_TYPE_WAITSET; }
+  void on_zero_handles() final;
+
+  // Registers interest in |signals| on |handle|'s object under |cookie|.
+  // Called under the handle table lock.
+  zx_status_t Add(Handle* handle, uint64_t cookie, zx_signals_t signals);
+
+  // Unregisters the entry for |cookie|.
+  zx_status_t Remove(uint64_t cookie);
+
+  // Waits until at least one entry is ready, then reports up to |count| ready entries. Entries
+  // whose handle was closed are reported once with ZX_ERR_CANCELED and moved from the set to
+  // |*canceled|, so the caller can free them once the results have reached userspace or hand
+  // them back with Restore() if they could not be delivered. Entries that stay ready are moved to
+  // the back of the ready list so that repeated waits with a small |count| still see all of them.
+  // |*unvisited| is set to the number of ready entries this call did not get to, which bounds how
+  // many a follow-up call can report without repeats.
+  zx_status_t Wait(const Deadline& deadline, zx_waitset_result_t* results, size_t count,
+                   size_t* actual, size_t* unvisited, EntryTree* canceled);
+
+  // Puts canceled entries returned by Wait() back on the ready list so a later wait reports them
+  // again. Entries whose cookie has been reused in the meantime are freed.
+  void Restore(EntryTree* canceled);
+
+ private:
+  friend class WaitSetEntry;
+
+  WaitSetDispatcher();
+
+  // Called by entries from their observer callbacks.
+  void UpdateEntry(WaitSetEntry* entry, zx_signals_t signals);
+  void CancelEntry(WaitSetEntry* entry);
+
+  void MakeReadyLocked(WaitSetEntry* entry) TA_REQ(get_lock());
+  void MakeNotReadyLocked(WaitSetEntry* entry) TA_REQ(get_lock());
+
+  mutable DECLARE_MUTEX(WaitSetDispatcher) update_lock_;
+
+  // Signaled while |ready_| is non-empty, or once the last handle is gone.
+  Event event_;
+
+  bool zero_handles_ TA_GUARDED(get_lock()) = false;
+  EntryTree entries_ TA_GUARDED(get_lock());
+  WaitSetEntry::ReadyList ready_ TA_GUARDED(get_lock());
+  size_t ready_count_ TA_GUARDED(get_lock()) = 0u;
+};
+
+#endif  // ZIRCON_KERNEL_OBJECT_INCLUDE_OBJECT_WAIT_SET_DISPATCHER_H_
@@ -37,6 +37,7 @@ KCOUNTER(port_arena_count, "port.arena.count")
 KCOUNTER(port_full_count, "port.full.count")
 KCOUNTER(port_dequeue_count, "port.dequeue.count")
 KCOUNTER(port_dequeue_spurious_count, "port.dequeue.spurious.count")
+KCOUNTER(port_dequeue_many_count, "port.dequeue.many.count")
 KCOUNTER(dispatcher_port_create_count, "dispatcher.port.create")
 KCOUNTER(dispatcher_port_destroy_count, "dispatcher.port.destroy")
 
@@ -339,8 +340,16 @@ zx_status_t PortDispatcher::Queue(PortPacket* port_packet, zx_signals_t observed
 }
 
 zx_status_t PortDispatcher::Dequeue(const Deadline& deadline, zx_port_packet_t* out_packet) {
+  size_t actual;
+  return DequeueMany(deadline, out_packet, 1, &actual);
+}
+
+zx_status_t PortDispatcher::DequeueMany(const Deadline& deadline, zx_port_packet_t* out_packets,
+                                        size_t count, size_t* actual) {
   canary_.Assert();
+  DEBUG_ASSERT(count > 0);
 
+  size_t dequeued = 0;
   while (true) {
     // Wait until one of the queues has a packet.
     {
@@ -350,53 +359,78 @@ zx_status_t PortDispatcher::Dequeue(const Deadline& deadline, zx_port_packet_t*
         return st;
     }
 
+    // Every queued packet holds one count of |sema_|. Claim the counts of the other packets we
+    // are going to take so that no other waiter wakes up for them.
+    const size_t claimed = 1 + ((count > 1) ? sema_.TryWaitMany(count - 1) : 0);
+
     // Interrupt packets are higher priority so service the interrupt packet queue first.
     if (options_ == ZX_PORT_BIND_TO_INTERRUPT) {
       Guard<SpinLock, IrqSave> guard{&spinlock_};
-      PortInterruptPacket* port_interrupt_packet = interrupt_packets_.pop_front();
-      if (port_interrupt_packet != nullptr) {
+      while (dequeued < claimed) {
+        PortInterruptPacket* port_interrupt_packet = interrupt_packets_.pop_front();
+        if (port_interrupt_packet == nullptr) {
+          break;
+        }
+        zx_port_packet_t* out_packet = &out_packets[dequeued++];
         *out_packet = {};
         out_packet->key = port_interrupt_packet->key;
         out_packet->type = ZX_PKT_TYPE_INTERRUPT;
         out_packet->status = ZX_OK;
         out_packet->interrupt.timestamp = port_interrupt_packet->timestamp;
-        break;
       }
     }
 
-    // No interrupt packets queued. Check the regular packets.
-    {
-      Guard<fbl::Mutex> guard{get_lock()};
-      PortPacket* port_packet = packets_.pop_front();
-      if (port_packet != nullptr) {
-        if (IsDefaultAllocatedEphemeral(*port_packet)) {
-          --num_ephemeral_packets_;
-        }
-        *out_packet = port_packet->packet;
-
-        bool is_ephemeral = port_packet->is_ephemeral();
-        // The reference to the port that the observer holds cannot be the last one
-        // because another reference was used to call Dequeue, so we don't need to
-        // worry about destroying ourselves.
-        port_packet->observer.reset();
-        guard.Release();
-
-        // If the packet is ephemeral, free it outside of the lock. We need to read
-        // is_ephemeral inside the lock because it's possible for a non-ephemeral packet
-        // to get deleted after a call to |MaybeReap| as soon as we release the lock.
-        if (is_ephemeral) {
-          port_packet->Free();
+    // Check the regular packets.
+    if (dequeued < claimed) {
+      // Ephemeral packets are freed outside of the lock.
+      fbl::DoublyLinkedList<PortPacket*> ephemeral;
+      {
+        Guard<fbl::Mutex> guard{get_lock()};
+        while (dequeued < claimed) {
+          PortPacket* port_packet = packets_.pop_front();
+          if (port_packet == nullptr) {
+            break;
+          }
+          if (IsDefaultAllocatedEphemeral(*port_packet)) {
+            --num_ephemeral_packets_;
+          }
+          out_packets[dequeued++] = port_packet->packet;
+
+          // The reference to the port that the observer holds cannot be the last one
+          // because another reference was used to call Dequeue, so we don't need to
+          // worry about destroying ourselves.
+          port_packet->observer.reset();
+
+          // We need to read is_ephemeral inside the lock because it's possible for a
+          // non-ephemeral packet to get deleted after a call to |MaybeReap| as soon as we
+          // release the lock.
+          if (port_packet->is_ephemeral()) {
+            ephemeral.push_back(port_packet);
+          }
         }
-        break;
+      }
+
+      while (!ephemeral.is_empty()) {
+        ephemeral.pop_front()->Free();
       }
     }
 
+    if (dequeued > 0) {
+      // Any claimed counts we could not match with a packet belonged to packets that were
+      // cancelled before we got to them, just like a spurious wakeup below.
+      break;
+    }
+
     // Both queues were empty. The packet must have been removed before we were able to
     // dequeue. Loop back and wait again.
     kcounter_add(port_dequeue_spurious_count, 1);
   }
 
-  kcounter_add(port_dequeue_count, 1);
+  kcounter_add(port_dequeue_count, dequeued);
+  if (count > 1) {
+    kcounter_add(port_dequeue_many_count, 1);
+  }
+  *actual = dequeued;
   return ZX_OK;
 }
 
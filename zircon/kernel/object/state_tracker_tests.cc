@@ -24,6 +24,16 @@ class TestDispatcher final : public SoloDispatcher<TestDispatcher, ZX_RIGHTS_BAS
   // Heler: Causes OnStateChange() to be called.
   void CallUpdateState() { UpdateState(0, 1); }
 
+  // Helper: Updates the signals through the regular path.
+  void CallUpdateState(zx_signals_t clear_mask, zx_signals_t set_mask) {
+    UpdateState(clear_mask, set_mask);
+  }
+
+  // Helper: Updates the signals only if no observer would need to be told.
+  bool CallTryUpdateStateLockFree(zx_signals_t clear_mask, zx_signals_t set_mask) {
+    return TryUpdateStateLockFree(clear_mask, set_mask);
+  }
+
   // Helper: Causes most On*() hooks (except for OnInitialized) to
   // be called on all of |st|'s observers.
   void CallAllOnHooks() {
@@ -172,6 +182,69 @@ bool on_cancel_by_key() {
 
 }  // namespace removal
 
+// Tests for the lock-free update path
+namespace lock_free {
+
+class RecordingObserver : public StateObserver {
+ public:
+  zx_signals_t initial_state() const { return initial_state_; }
+  zx_signals_t last_state() const { return last_state_; }
+  int changes() const { return changes_; }
+
+ private:
+  Flags OnInitialize(zx_signals_t initial_state, const StateObserver::CountInfo* cinfo) override {
+    initial_state_ = initial_state;
+    return 0;
+  }
+  Flags OnStateChange(zx_signals_t new_state) override {
+    last_state_ = new_state;
+    changes_++;
+    return 0;
+  }
+  Flags OnCancel(const Handle* handle) override { return 0; }
+  Flags OnCancelByKey(const Handle* handle, const void* port, uint64_t key) override { return 0; }
+  void OnRemoved() override {}
+
+  zx_signals_t initial_state_ = 0u;
+  zx_signals_t last_state_ = 0u;
+  int changes_ = 0;
+};
+
+bool observers_see_lock_free_updates() {
+  BEGIN_TEST;
+
+  TestDispatcher st;
+
+  // Nobody is watching, so the fast path applies.
+  EXPECT_TRUE(st.CallTryUpdateStateLockFree(0u, 1u));
+
+  RecordingObserver obs;
+  ASSERT_EQ(ZX_OK, st.AddObserver(&obs));
+  EXPECT_EQ(1u, obs.initial_state());
+
+  // Now the update must go through the lock so |obs| hears about it, and the refused update
+  // leaves the signals alone.
+  EXPECT_FALSE(st.CallTryUpdateStateLockFree(0u, 2u));
+  EXPECT_EQ(0, obs.changes());
+
+  // Clearing and re-setting the bit while |obs| is attached is reported each time.
+  st.CallUpdateState(1u, 0u);
+  EXPECT_EQ(1, obs.changes());
+  EXPECT_EQ(0u, obs.last_state());
+  st.CallUpdateState(0u, 1u);
+  EXPECT_EQ(2, obs.changes());
+  EXPECT_EQ(1u, obs.last_state());
+
+  // Once the last observer is gone the fast path is available again.
+  EXPECT_TRUE(st.RemoveObserver(&obs));
+  EXPECT_TRUE(st.CallTryUpdateStateLockFree(1u, 0u));
+  EXPECT_EQ(2, obs.changes());
+
+  END_TEST;
+}
+
+}  // namespace lock_free
+
 #define ST_UNITTEST(fname) UNITTEST(#fname, fname)
 
 UNITTEST_START_TESTCASE(state_tracker_tests)
@@ -180,5 +253,6 @@ ST_UNITTEST(removal::on_initialize)
 ST_UNITTEST(removal::on_state_change_via_update_state)
 ST_UNITTEST(removal::on_cancel)
 ST_UNITTEST(removal::on_cancel_by_key)
+ST_UNITTEST(lock_free::observers_see_lock_free_updates)
 
 UNITTEST_END_TESTCASE(state_tracker_tests, "statetracker", "StateTracker test")
@@ -0,0 +1,277 @@
+// Copyright 2020 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#include "object/wait_set_dispatcher.h"
+
+#include <err.h>
+#include <lib/counters.h>
+#include <zircon/rights.h>
+
+#include <fbl/alloc_checker.h>
+#include <kernel/thread.h>
+#include <object/thread_dispatcher.h>
+
+KCOUNTER(dispatcher_wait_set_create_count, "dispatcher.wait_set.create")
+KCOUNTER(dispatcher_wait_set_destroy_count, "dispatcher.wait_set.destroy")
+KCOUNTER(wait_set_entry_add_count, "wait_set.entry.add")
+KCOUNTER(wait_set_entry_remove_count, "wait_set.entry.remove")
+KCOUNTER(wait_set_entry_cancel_count, "wait_set.entry.cancel")
+
+WaitSetEntry::WaitSetEntry(WaitSetDispatcher* wait_set, const Handle* handle, uint64_t cookie,
+                           zx_signals_t signals)
+    : wait_set_(wait_set),
+      handle_(handle),
+      cookie_(cookie),
+      trigger_(signals),
+      dispatcher_(handle->dispatcher()) {}
+
+StateObserver::Flags WaitSetEntry::OnInitialize(zx_signals_t initial_state,
+                                                const StateObserver::CountInfo* cinfo) {
+  wait_set_->UpdateEntry(this, initial_state);
+  return 0;
+}
+
+StateObserver::Flags WaitSetEntry::OnStateChange(zx_signals_t new_state) {
+  wait_set_->UpdateEntry(this, new_state);
+  return 0;
+}
+
+StateObserver::Flags WaitSetEntry::OnCancel(const Handle* handle) {
+  if (handle != handle_)
+    return 0;
+  // The rest happens in OnRemoved(), once the dispatcher is done with us.
+  return kHandled | kNeedRemoval;
+}
+
+void WaitSetEntry::OnRemoved() { wait_set_->CancelEntry(this); }
+
+/////////////////////////////////////////////////////////////////////////////////////////
+
+zx_status_t WaitSetDispatcher::Create(uint32_t options, KernelHandle<WaitSetDispatcher>* handle,
+                                      zx_rights_t* rights) {
+  if (options != 0u)
+    return ZX_ERR_INVALID_ARGS;
+
+  fbl::AllocChecker ac;
+  KernelHandle new_handle(fbl::AdoptRef(new (&ac) WaitSetDispatcher()));
+  if (!ac.check())
+    return ZX_ERR_NO_MEMORY;
+
+  *rights = default_rights();
+  *handle = ktl::move(new_handle);
+  return ZX_OK;
+}
+
+WaitSetDispatcher::WaitSetDispatcher() { kcounter_add(dispatcher_wait_set_create_count, 1); }
+
+WaitSetDispatcher::~WaitSetDispatcher() {
+  DEBUG_ASSERT(entries_.is_empty());
+  DEBUG_ASSERT(ready_.is_empty());
+  kcounter_add(dispatcher_wait_set_destroy_count, 1);
+}
+
+void WaitSetDispatcher::on_zero_handles() {
+  canary_.Assert();
+
+  Guard<fbl::Mutex> update_guard{&update_lock_};
+
+  EntryTree entries;
+  {
+    Guard<fbl::Mutex> guard{get_lock()};
+    zero_handles_ = true;
+    ready_.clear();
+    ready_count_ = 0u;
+    entries.swap(entries_);
+  }
+  // Wake any waiters so they can notice the set is gone.
+  event_.Signal(ZX_ERR_CANCELED);
+
+  // Detach every entry outside of get_lock(), which the observed objects take in our callbacks.
+  while (!entries.is_empty()) {
+    ktl::unique_ptr<WaitSetEntry> entry = entries.pop_front();
+    fbl::RefPtr<Dispatcher> dispatcher;
+    {
+      Guard<fbl::Mutex> guard{get_lock()};
+      dispatcher = ktl::move(entry->dispatcher_);
+    }
+    // A null dispatcher means the entry was canceled and has already been removed.
+    if (dispatcher)
+      dispatcher->RemoveObserver(entry.get());
+  }
+}
+
+zx_status_t WaitSetDispatcher::Add(Handle* handle, uint64_t cookie, zx_signals_t signals) {
+  canary_.Assert();
+
+  fbl::RefPtr<Dispatcher> dispatcher = handle->dispatcher();
+  if (!dispatcher->is_waitable())
+    return ZX_ERR_NOT_SUPPORTED;
+
+  fbl::AllocChecker ac;
+  ktl::unique_ptr<WaitSetEntry> entry(new (&ac) WaitSetEntry(this, handle, cookie, signals));
+  if (!ac.check())
+    return ZX_ERR_NO_MEMORY;
+  WaitSetEntry* raw_entry = entry.get();
+
+  // Held until the entry is registered, so Remove() can't free it in the meantime.
+  Guard<fbl::Mutex> update_guard{&update_lock_};
+
+  {
+    Guard<fbl::Mutex> guard{get_lock()};
+    if (zero_handles_)
+      return ZX_ERR_BAD_STATE;
+    if (entries_.find(cookie).IsValid())
+      return ZX_ERR_ALREADY_EXISTS;
+    if (entries_.size() >= kMaxEntries)
+      return ZX_ERR_NO_RESOURCES;
+    entries_.insert(ktl::move(entry));
+  }
+
+  zx_status_t status = dispatcher->AddObserver(raw_entry);
+  if (status != ZX_OK) {
+    Guard<fbl::Mutex> guard{get_lock()};
+    MakeNotReadyLocked(raw_entry);
+    entries_.erase(*raw_entry);
+    return status;
+  }
+
+  kcounter_add(wait_set_entry_add_count, 1);
+  return ZX_OK;
+}
+
+zx_status_t WaitSetDispatcher::Remove(uint64_t cookie) {
+  canary_.Assert();
+
+  Guard<fbl::Mutex> update_guard{&update_lock_};
+
+  ktl::unique_ptr<WaitSetEntry> entry;
+  fbl::RefPtr<Dispatcher> dispatcher;
+  {
+    Guard<fbl::Mutex> guard{get_lock()};
+    auto iter = entries_.find(cookie);
+    if (!iter.IsValid())
+      return ZX_ERR_NOT_FOUND;
+    entry = entries_.erase(iter);
+    MakeNotReadyLocked(entry.get());
+    dispatcher = ktl::move(entry->dispatcher_);
+  }
+
+  if (dispatcher)
+    dispatcher->RemoveObserver(entry.get());
+
+  kcounter_add(wait_set_entry_remove_count, 1);
+  return ZX_OK;
+}
+
+zx_status_t WaitSetDispatcher::Wait(const Deadline& deadline, zx_waitset_result_t* results,
+                                    size_t count, size_t* actual, size_t* unvisited,
+                                    EntryTree* canceled) {
+  canary_.Assert();
+  DEBUG_ASSERT(count > 0u);
+
+  for (;;) {
+    size_t reported = 0u;
+    {
+      Guard<fbl::Mutex> guard{get_lock()};
+      if (zero_handles_)
+        return ZX_ERR_CANCELED;
+
+      // Look at each ready entry at most once, rotating the ones that stay ready to the back.
+      const size_t ready = ready_count_;
+      size_t i = 0;
+      for (; i < ready && reported < count; ++i) {
+        WaitSetEntry* entry = ready_.pop_front();
+        results[reported++] = {entry->cookie_, entry->status_, entry->observed_};
+        if (entry->status_ != ZX_OK) {
+          --ready_count_;
+          canceled->insert(entries_.erase(*entry));
+        } else {
+          ready_.push_back(entry);
+        }
+      }
+      if (ready_.is_empty())
+        event_.Unsignal();
+      *unvisited = ready - i;
+    }
+
+    if (reported > 0u) {
+      *actual = reported;
+      return ZX_OK;
+    }
+
+    zx_status_t status;
+    {
+      ThreadDispatcher::AutoBlocked by(ThreadDispatcher::Blocked::WAIT_MANY);
+      status = event_.Wait(deadline);
+    }
+    if (status != ZX_OK && status != ZX_ERR_CANCELED)
+      return status;
+  }
+}
+
+void WaitSetDispatcher::Restore(EntryTree* canceled) {
+  canary_.Assert();
+
+  // Entries that can't go back are freed after the lock is dropped.
+  EntryTree dropped;
+  {
+    Guard<fbl::Mutex> guard{get_lock()};
+    while (!canceled->is_empty()) {
+      ktl::unique_ptr<WaitSetEntry> entry = canceled->pop_front();
+      if (zero_handles_ || entries_.find(entry->cookie_).IsValid()) {
+        dropped.insert(ktl::move(entry));
+        continue;
+      }
+      WaitSetEntry* raw_entry = entry.get();
+      entries_.insert(ktl::move(entry));
+      MakeReadyLocked(raw_entry);
+    }
+  }
+}
+
+void WaitSetDispatcher::UpdateEntry(WaitSetEntry* entry, zx_signals_t signals) {
+  canary_.Assert();
+
+  Guard<fbl::Mutex> guard{get_lock()};
+  // The entry may be in the middle of being removed from the set.
+  if (zero_handles_ || !entry->dispatcher_)
+    return;
+  entry->observed_ = signals;
+  if (signals & entry->trigger_) {
+    MakeReadyLocked(entry);
+  } else {
+    MakeNotReadyLocked(entry);
+  }
+}
+
+void WaitSetDispatcher::CancelEntry(WaitSetEntry* entry) {
+  canary_.Assert();
+
+  Guard<fbl::Mutex> guard{get_lock()};
+  if (zero_handles_ || !entry->dispatcher_)
+    return;
+  // The object no longer refers to the entry, so it can be freed as soon as Wait() reports it.
+  entry->dispatcher_.reset();
+  entry->status_ = ZX_ERR_CANCELED;
+  MakeReadyLocked(entry);
+  kcounter_add(wait_set_entry_cancel_count, 1);
+}
+
+void WaitSetDispatcher::MakeReadyLocked(WaitSetEntry* entry) {
+  if (entry->ready_node_state_.InContainer())
+    return;
+  ready_.push_back(entry);
+  if (ready_count_++ == 0u)
+    event_.Signal();
+}
+
+void WaitSetDispatcher::MakeNotReadyLocked(WaitSetEntry* entry) {
+  if (!entry->ready_node_state_.InContainer())
+    return;
+  ready_.erase(*entry);
+  if (--ready_count_ == 0u)
+    event_.Unsignal();
+}
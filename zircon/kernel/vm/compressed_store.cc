@@ -0,0 +1,254 @@
+// Copyright 2020 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#include <lib/cmdline.h>
+#include <lib/counters.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <fbl/algorithm.h>
+#include <kernel/mutex.h>
+#include <ktl/atomic.h>
+#include <lk/init.h>
+#include <vm/compressed_store.h>
+#include <vm/physmap.h>
+#include <vm/vm.h>
+
+// Header of the heap allocation holding a compressed page. The compressed bytes directly follow it.
+struct VmCompressedPage {
+  size_t size;
+
+  uint8_t* data() { return reinterpret_cast<uint8_t*>(this + 1); }
+  size_t alloc_size() const { return sizeof(VmCompressedPage) + size; }
+};
+
+namespace {
+
+// Pages are compressed with a byte oriented LZ77 scheme using the LZ4 block layout. Each sequence
+// starts with a token byte whose high nibble is the number of literals and low nibble is the match
+// length minus kMinMatch. A nibble of 15 is followed by extension bytes that are added to it, up
+// to and including the first byte that is not 255. The literals come next and then, unless this is
+// the final sequence, the little endian 16 bit distance back to the match.
+constexpr size_t kMinMatch = 4;
+constexpr size_t kHashBits = 12;
+
+// Compressed copies larger than this do not save enough memory to justify the cost of faulting
+// them back in, and the page is left alone.
+constexpr size_t kMaxCompressedSize = PAGE_SIZE * 3 / 4;
+
+KCOUNTER(compression_compressed_pages, "vm.compression.compressed_pages")
+KCOUNTER(compression_decompressed_pages, "vm.compression.decompressed_pages")
+KCOUNTER(compression_rejected_pages, "vm.compression.rejected_pages")
+// The ratio of input_bytes to output_bytes is the average compression ratio achieved.
+KCOUNTER(compression_input_bytes, "vm.compression.input_bytes")
+KCOUNTER(compression_output_bytes, "vm.compression.output_bytes")
+
+DECLARE_SINGLETON_MUTEX(compression_lock);
+// Scratch state for the compressor. Compression is expected to only happen from the scanner, so
+// sharing a single set of buffers costs nothing in practice and keeps them off the stack.
+uint16_t compression_hash_table[1u << kHashBits] TA_GUARDED(compression_lock::Get());
+uint8_t compression_buffer[kMaxCompressedSize] TA_GUARDED(compression_lock::Get());
+
+ktl::atomic<uint64_t> stored_pages = 0;
+ktl::atomic<uint64_t> stored_bytes = 0;
+// Set once during init.
+uint64_t budget_bytes = 0;
+
+uint32_t HashSequence(uint32_t seq) { return (seq * 2654435761u) >> (32 - kHashBits); }
+
+uint32_t LoadSequence(const uint8_t* p) {
+  uint32_t seq;
+  memcpy(&seq, p, sizeof(seq));
+  return seq;
+}
+
+bool PutLength(size_t len, uint8_t* dst, size_t cap, size_t* pos) {
+  while (len >= 255) {
+    if (*pos >= cap) {
+      return false;
+    }
+    dst[(*pos)++] = 255;
+    len -= 255;
+  }
+  if (*pos >= cap) {
+    return false;
+  }
+  dst[(*pos)++] = static_cast<uint8_t>(len);
+  return true;
+}
+
+// Appends a sequence of |lit_len| literals followed by a match of |match_len| bytes at |distance|.
+// A |match_len| of 0 denotes the final sequence. Returns false if |dst| is too small.
+bool PutSequence(const uint8_t* lit, size_t lit_len, size_t distance, size_t match_len,
+                 uint8_t* dst, size_t cap, size_t* pos) {
+  const size_t extra_match = match_len ? match_len - kMinMatch : 0;
+  if (*pos >= cap) {
+    return false;
+  }
+  dst[(*pos)++] =
+      static_cast<uint8_t>((fbl::min(lit_len, 15ul) << 4) | fbl::min(extra_match, 15ul));
+  if (lit_len >= 15 && !PutLength(lit_len - 15, dst, cap, pos)) {
+    return false;
+  }
+  if (cap - *pos < lit_len) {
+    return false;
+  }
+  memcpy(dst + *pos, lit, lit_len);
+  *pos += lit_len;
+  if (match_len == 0) {
+    return true;
+  }
+  if (cap - *pos < 2) {
+    return false;
+  }
+  dst[(*pos)++] = static_cast<uint8_t>(distance);
+  dst[(*pos)++] = static_cast<uint8_t>(distance >> 8);
+  return extra_match < 15 || PutLength(extra_match - 15, dst, cap, pos);
+}
+
+// Compresses the PAGE_SIZE bytes at |src| into |dst|. Returns the compressed size, or 0 if it would
+// exceed |cap|.
+size_t CompressPage(const uint8_t* src, uint8_t* dst, size_t cap) TA_REQ(compression_lock::Get()) {
+  // Entries hold the position of the last sequence with that hash plus one, so that 0 is empty.
+  memset(compression_hash_table, 0, sizeof(compression_hash_table));
+
+  size_t ip = 0;
+  size_t anchor = 0;
+  size_t pos = 0;
+  while (ip + kMinMatch <= PAGE_SIZE) {
+    const uint32_t seq = LoadSequence(src + ip);
+    const uint32_t hash = HashSequence(seq);
+    const size_t candidate = compression_hash_table[hash];
+    compression_hash_table[hash] = static_cast<uint16_t>(ip + 1);
+    if (candidate == 0 || LoadSequence(src + candidate - 1) != seq) {
+      ip++;
+      continue;
+    }
+    const size_t ref = candidate - 1;
+    size_t len = kMinMatch;
+    while (ip + len < PAGE_SIZE && src[ref + len] == src[ip + len]) {
+      len++;
+    }
+    if (!PutSequence(src + anchor, ip - anchor, ip - ref, len, dst, cap, &pos)) {
+      return 0;
+    }
+    ip += len;
+    anchor = ip;
+  }
+  if (!PutSequence(src + anchor, PAGE_SIZE - anchor, 0, 0, dst, cap, &pos)) {
+    return 0;
+  }
+  return pos;
+}
+
+size_t GetLength(const uint8_t* src, size_t* ip) {
+  size_t len = 0;
+  uint8_t b;
+  do {
+    b = src[(*ip)++];
+    len += b;
+  } while (b == 255);
+  return len;
+}
+
+void DecompressPage(const uint8_t* src, size_t size, uint8_t* dst) {
+  size_t ip = 0;
+  size_t op = 0;
+  while (true) {
+    const uint8_t token = src[ip++];
+    size_t lit_len = token >> 4;
+    if (lit_len == 15) {
+      lit_len += GetLength(src, &ip);
+    }
+    DEBUG_ASSERT(ip + lit_len <= size && op + lit_len <= PAGE_SIZE);
+    memcpy(dst + op, src + ip, lit_len);
+    ip += lit_len;
+    op += lit_len;
+    if (ip == size) {
+      break;
+    }
+    const size_t distance = src[ip] | (static_cast<size_t>(src[ip + 1]) << 8);
+    ip += 2;
+    size_t match_len = token & 0xf;
+    if (match_len == 15) {
+      match_len += GetLength(src, &ip);
+    }
+    match_len += kMinMatch;
+    DEBUG_ASSERT(distance > 0 && distance <= op && op + match_len <= PAGE_SIZE);
+    // Matches may overlap the bytes they produce, so this must copy forwards a byte at a time.
+    for (size_t i = 0; i < match_len; i++) {
+      dst[op + i] = dst[op + i - distance];
+    }
+    op += match_len;
+  }
+  DEBUG_ASSERT(op == PAGE_SIZE);
+}
+
+}  // namespace
+
+bool compressed_store_has_budget() { return stored_bytes.load() < budget_bytes; }
+
+VmCompressedPage* compressed_store_compress(const vm_page_t* page) {
+  if (!compressed_store_has_budget()) {
+    compression_rejected_pages.Add(1);
+    return nullptr;
+  }
+
+  Guard<Mutex> guard{compression_lock::Get()};
+  const auto* src = static_cast<const uint8_t*>(paddr_to_physmap(page->paddr()));
+  const size_t size = CompressPage(src, compression_buffer, sizeof(compression_buffer));
+  if (size == 0) {
+    compression_rejected_pages.Add(1);
+    return nullptr;
+  }
+
+  const size_t alloc_size = sizeof(VmCompressedPage) + size;
+  if (stored_bytes.load() + alloc_size > budget_bytes) {
+    compression_rejected_pages.Add(1);
+    return nullptr;
+  }
+  auto* compressed = static_cast<VmCompressedPage*>(malloc(alloc_size));
+  if (!compressed) {
+    compression_rejected_pages.Add(1);
+    return nullptr;
+  }
+  compressed->size = size;
+  memcpy(compressed->data(), compression_buffer, size);
+
+  stored_pages.fetch_add(1);
+  stored_bytes.fetch_add(alloc_size);
+  compression_compressed_pages.Add(1);
+  compression_input_bytes.Add(PAGE_SIZE);
+  compression_output_bytes.Add(size);
+  return compressed;
+}
+
+void compressed_store_decompress(VmCompressedPage* compressed, vm_page_t* page) {
+  DecompressPage(compressed->data(), compressed->size,
+                 static_cast<uint8_t*>(paddr_to_physmap(page->paddr())));
+  compression_decompressed_pages.Add(1);
+  compressed_store_free(compressed);
+}
+
+void compressed_store_free(VmCompressedPage* compressed) {
+  stored_pages.fetch_sub(1);
+  stored_bytes.fetch_sub(compressed->alloc_size());
+  free(compressed);
+}
+
+CompressedStoreStats compressed_store_get_stats() {
+  return CompressedStoreStats{
+      .stored_pages = stored_pages.load(),
+      .stored_bytes = stored_bytes.load(),
+      .budget_bytes = budget_bytes,
+  };
+}
+
+static void compressed_store_init_func(uint level) {
+  budget_bytes = gCmdline.GetUInt64("kernel.page-compression.budget-mb", 64) * MB;
+}
+
+LK_INIT_HOOK(compressed_store_init, &compressed_store_init_func, LK_INIT_LEVEL_LAST)
@@ -0,0 +1,161 @@
+// Copyright 2020 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#include <lib/counters.h>
+#include <string.h>
+
+#include <fbl/alloc_checker.h>
+#include <fbl/intrusive_wavl_tree.h>
+#include <kernel/mutex.h>
+#include <lk/init.h>
+#include <vm/dedup_store.h>
+#include <vm/physmap.h>
+#include <vm/pmm.h>
+#include <vm/vm.h>
+
+#include "vm_priv.h"
+
+namespace {
+
+KCOUNTER(dedup_merged_pages, "vm.dedup.merged_pages")
+KCOUNTER(dedup_promoted_pages, "vm.dedup.promoted_pages")
+KCOUNTER(dedup_hash_collisions, "vm.dedup.hash_collisions")
+KCOUNTER(dedup_rejected_pages, "vm.dedup.rejected_pages")
+KCOUNTER(dedup_cow_copies, "vm.dedup.cow_copies")
+KCOUNTER(dedup_cow_reclaims, "vm.dedup.cow_reclaims")
+
+DedupStore global_store;
+
+// Set once during init.
+uint64_t zero_page_hash = 0;
+
+const void* PageContent(const vm_page_t* page) { return paddr_to_physmap(page->paddr()); }
+
+}  // namespace
+
+DedupStore::~DedupStore() {
+  Guard<Mutex> guard{&lock_};
+  DEBUG_ASSERT(shared_pages_.is_empty());
+}
+
+DedupStore* DedupStore::Get() { return &global_store; }
+
+void DedupStore::RemoveLocked(VmSharedPage* shared) {
+  shared_pages_.erase(*shared);
+  shared_references_--;
+}
+
+uint64_t dedup_hash_page(const vm_page_t* page) {
+  const auto* words = static_cast<const uint64_t*>(PageContent(page));
+  uint64_t hash = 0;
+  for (size_t i = 0; i < PAGE_SIZE / sizeof(uint64_t); i++) {
+    hash = (hash ^ words[i]) * 0x9e3779b97f4a7c15ul;
+    hash ^= hash >> 29;
+  }
+  return hash;
+}
+
+void DedupStore::BeginScan() {
+  Guard<Mutex> guard{&lock_};
+  memset(candidate_bitmap_, 0, sizeof(candidate_bitmap_));
+}
+
+bool DedupStore::IsCandidate(uint64_t hash) {
+  if (hash == zero_page_hash) {
+    return false;
+  }
+
+  Guard<Mutex> guard{&lock_};
+  if (shared_pages_.find(hash).IsValid()) {
+    return true;
+  }
+  const size_t bit = hash & ((1u << kCandidateBits) - 1);
+  const uint64_t mask = 1ul << (bit % 64);
+  const bool seen = candidate_bitmap_[bit / 64] & mask;
+  candidate_bitmap_[bit / 64] |= mask;
+  return seen;
+}
+
+VmSharedPage* DedupStore::Merge(vm_page_t* page, uint64_t hash, bool* took_page) {
+  Guard<Mutex> guard{&lock_};
+
+  auto existing = shared_pages_.find(hash);
+  if (existing.IsValid()) {
+    if (memcmp(PageContent(existing->page), PageContent(page), PAGE_SIZE) != 0) {
+      dedup_hash_collisions.Add(1);
+      dedup_rejected_pages.Add(1);
+      return nullptr;
+    }
+    existing->ref_count++;
+    shared_references_++;
+    *took_page = false;
+    dedup_merged_pages.Add(1);
+    return &*existing;
+  }
+
+  fbl::AllocChecker ac;
+  auto* shared = new (&ac) VmSharedPage;
+  if (!ac.check()) {
+    dedup_rejected_pages.Add(1);
+    return nullptr;
+  }
+  shared->store = this;
+  shared->page = page;
+  shared->hash = hash;
+  shared->ref_count = 1;
+  shared_pages_.insert(shared);
+  shared_references_++;
+  *took_page = true;
+  dedup_promoted_pages.Add(1);
+  return shared;
+}
+
+DedupStoreStats DedupStore::GetStats() {
+  Guard<Mutex> guard{&lock_};
+  return DedupStoreStats{
+      .shared_pages = shared_pages_.size(),
+      .references = shared_references_,
+  };
+}
+
+vm_page_t* dedup_store_page(const VmSharedPage* shared) { return shared->page; }
+
+vm_page_t* dedup_store_take(VmSharedPage* shared) {
+  {
+    DedupStore* store = shared->store;
+    Guard<Mutex> guard{&store->lock_};
+    if (shared->ref_count > 1) {
+      // The caller is breaking the sharing with a copy instead.
+      dedup_cow_copies.Add(1);
+      return nullptr;
+    }
+    store->RemoveLocked(shared);
+  }
+  vm_page_t* page = shared->page;
+  delete shared;
+  dedup_cow_reclaims.Add(1);
+  return page;
+}
+
+void dedup_store_release(VmSharedPage* shared) {
+  {
+    DedupStore* store = shared->store;
+    Guard<Mutex> guard{&store->lock_};
+    if (--shared->ref_count > 0) {
+      store->shared_references_--;
+      return;
+    }
+    store->RemoveLocked(shared);
+  }
+  pmm_free_page(shared->page);
+  delete shared;
+}
+
+static void dedup_store_init_func(uint level) {
+  zero_page_hash = dedup_hash_page(vm_get_zero_page());
+}
+
+LK_INIT_HOOK(dedup_store_init, &dedup_store_init_func, LK_INIT_LEVEL_LAST)
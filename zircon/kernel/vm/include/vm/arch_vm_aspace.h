@@ -11,6 +11,7 @@
 #include <zircon/types.h>
 
 #include <arch/mmu.h>
+#include <fbl/function.h>
 #include <fbl/macros.h>
 #include <vm/page.h>
 
@@ -73,6 +74,24 @@ class ArchVmAspaceInterface {
 
   virtual zx_status_t Query(vaddr_t vaddr, paddr_t* paddr, uint* mmu_flags) = 0;
 
+  // Returns in |size| the number of bytes mapped by the single entry that translates |vaddr|, which
+  // is more than PAGE_SIZE for a large page. Returns ZX_ERR_NOT_FOUND if |vaddr| is not mapped.
+  virtual zx_status_t QueryEntrySize(vaddr_t vaddr, size_t* size) = 0;
+
+  // Walks the given virtual address range and calls |accessed_callback| for every page that has
+  // been accessed since the last harvest, clearing the accessed state as it goes. The callback is
+  // invoked with internal locks held and must not call back into the aspace.
+  //
+  // Architectures that cannot track accesses report every mapped page as accessed.
+  using HarvestCallback = fbl::Function<void(paddr_t paddr, vaddr_t vaddr)>;
+  virtual zx_status_t HarvestAccessed(vaddr_t vaddr, size_t count,
+                                      const HarvestCallback& accessed_callback) = 0;
+
+  // Marks the pages mapped in the given range as accessed again after HarvestAccessed() cleared
+  // them. Called from the page fault path for pages that are already mapped, which is how
+  // architectures that do not track accesses in hardware learn about them.
+  virtual zx_status_t MarkAccessed(vaddr_t vaddr, size_t count) = 0;
+
   virtual vaddr_t PickSpot(vaddr_t base, uint prev_region_mmu_flags, vaddr_t end,
                            uint next_region_mmu_flags, vaddr_t align, size_t size,
                            uint mmu_flags) = 0;
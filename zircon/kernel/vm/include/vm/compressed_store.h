@@ -0,0 +1,48 @@
+// Copyright 2020 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#ifndef ZIRCON_KERNEL_VM_INCLUDE_VM_COMPRESSED_STORE_H_
+#define ZIRCON_KERNEL_VM_INCLUDE_VM_COMPRESSED_STORE_H_
+
+#include <stdint.h>
+
+#include <vm/page.h>
+
+// The compressed store holds the content of cold anonymous pages in compressed form, allowing the
+// page itself to be returned to the pmm. A compressed page is owned by the VmPageOrMarker slot that
+// references it and is turned back into a page by compressed_store_decompress the next time its
+// content is needed.
+//
+// The total size of all compressed pages is limited by the kernel.page-compression.budget-mb
+// command line option, with a budget of 0 disabling compression entirely.
+struct VmCompressedPage;
+
+struct CompressedStoreStats {
+  // Number of pages currently held in compressed form.
+  uint64_t stored_pages;
+  // Bytes of heap used by those pages, including headers.
+  uint64_t stored_bytes;
+  // Upper limit on |stored_bytes|.
+  uint64_t budget_bytes;
+};
+
+// Returns true if the store has room for more compressed pages.
+bool compressed_store_has_budget();
+
+// Compresses the content of |page|. Returns nullptr if the page does not compress well enough to be
+// worth keeping, if the budget is exhausted, or if memory for the compressed copy could not be
+// allocated. |page| is not modified and remains owned by the caller in all cases.
+VmCompressedPage* compressed_store_compress(const vm_page_t* page);
+
+// Writes the original content of |compressed| into |page| and frees |compressed|.
+void compressed_store_decompress(VmCompressedPage* compressed, vm_page_t* page);
+
+// Frees |compressed| without decompressing it, for when its content is no longer needed.
+void compressed_store_free(VmCompressedPage* compressed);
+
+CompressedStoreStats compressed_store_get_stats();
+
+#endif  // ZIRCON_KERNEL_VM_INCLUDE_VM_COMPRESSED_STORE_H_
@@ -0,0 +1,105 @@
+// Copyright 2020 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#ifndef ZIRCON_KERNEL_VM_INCLUDE_VM_DEDUP_STORE_H_
+#define ZIRCON_KERNEL_VM_INCLUDE_VM_DEDUP_STORE_H_
+
+#include <lib/zircon-internal/thread_annotations.h>
+#include <stdint.h>
+
+#include <fbl/intrusive_wavl_tree.h>
+#include <fbl/macros.h>
+#include <kernel/mutex.h>
+#include <vm/page.h>
+
+// The dedup store holds single read-only copies of page content that was found in more than one
+// anonymous page. Each VmPageOrMarker slot referencing a shared page holds one reference to it,
+// and a write to the slot breaks the sharing by giving the slot a private copy again.
+//
+// Candidates are found by hashing page content. A hash seen for the first time during a scan is
+// only remembered, the page seen second is moved into the store, and any later page with the same
+// content, including the first one on the next scan, is merged with it.
+class DedupStore;
+
+struct VmSharedPage : public fbl::WAVLTreeContainable<VmSharedPage*> {
+  DedupStore* store;
+  vm_page_t* page;
+  uint64_t hash;
+  uint64_t ref_count;
+
+  uint64_t GetKey() const { return hash; }
+};
+
+struct DedupStoreStats {
+  // Number of distinct pages held by the store.
+  uint64_t shared_pages;
+  // Number of slots referencing those pages. The difference to |shared_pages| is the number of
+  // pages saved.
+  uint64_t references;
+};
+
+// Every shared page remembers the store it belongs to, so stores other than the one used by the
+// page scanner can be created, for example by tests.
+class DedupStore {
+ public:
+  DedupStore() = default;
+  // All references to pages of the store must have been released.
+  ~DedupStore();
+
+  DISALLOW_COPY_ASSIGN_AND_MOVE(DedupStore);
+
+  // Returns the store used by the page scanner.
+  static DedupStore* Get();
+
+  // Forgets which hashes were seen by previous calls to IsCandidate.
+  void BeginScan();
+
+  // Returns true if a page with content hashing to |hash| is worth passing to Merge, which is the
+  // case if the store already holds such a page or the hash was seen before in the current scan.
+  // Pages of all zeroes are never candidates, as the zero page scanner can free them outright.
+  bool IsCandidate(uint64_t hash);
+
+  // Shares the content of |page|, whose content hashes to |hash| and cannot change for the
+  // duration of the call. If the store already holds a page with the same content a reference to
+  // it is returned and |page| remains owned by the caller, otherwise |page| itself is moved into
+  // the store and |took_page| is set. Returns nullptr if a different page with the same hash is
+  // already held, or if memory could not be allocated.
+  VmSharedPage* Merge(vm_page_t* page, uint64_t hash, bool* took_page);
+
+  DedupStoreStats GetStats();
+
+ private:
+  friend vm_page_t* dedup_store_take(VmSharedPage* shared);
+  friend void dedup_store_release(VmSharedPage* shared);
+
+  // Hashes seen during the current scan are remembered in a bitmap indexed by the low bits of the
+  // hash. A false positive only costs a page being moved into the store without a partner.
+  static constexpr size_t kCandidateBits = 16;
+
+  void RemoveLocked(VmSharedPage* shared) TA_REQ(lock_);
+
+  DECLARE_MUTEX(DedupStore) lock_;
+  fbl::WAVLTree<uint64_t, VmSharedPage*> shared_pages_ TA_GUARDED(lock_);
+  uint64_t shared_references_ TA_GUARDED(lock_) = 0;
+  uint64_t candidate_bitmap_[(1u << kCandidateBits) / 64] TA_GUARDED(lock_) = {};
+};
+
+// Returns a hash of the content of |page|.
+uint64_t dedup_hash_page(const vm_page_t* page);
+
+// Returns the page holding the content of |shared|. It must only ever be mapped read-only.
+vm_page_t* dedup_store_page(const VmSharedPage* shared);
+
+// Called when a write needs to break the sharing of |shared|. If the caller holds the only
+// reference to |shared|, removes it from its store and returns its page, which the caller now
+// owns. Returns nullptr otherwise, in which case the caller still holds its reference and should
+// copy the page.
+vm_page_t* dedup_store_take(VmSharedPage* shared);
+
+// Drops a reference to |shared|, freeing the page once no references remain.
+void dedup_store_release(VmSharedPage* shared);
+
+#endif  // ZIRCON_KERNEL_VM_INCLUDE_VM_DEDUP_STORE_H_
@@ -54,13 +54,27 @@ typedef struct vm_page {
       // be moved into the child instead of setting the second bit.
       uint8_t cow_left_split : 1;
       uint8_t cow_right_split : 1;
+
+      // Set on pages of pager backed VmObjects that may differ from what the pager supplied,
+      // either because they were written or because they were pinned for a device. Such pages
+      // cannot be evicted as the pager would not be able to recreate them.
+      uint8_t dirty : 1;
+
+      // Set on pages of anonymous VmObjects when a harvest of the accessed bits of their mappings
+      // found the page had been accessed since the previous harvest. Used to find cold pages that
+      // are worth compressing.
+      uint8_t accessed : 1;
+
+      // Set along with |accessed|, but only cleared by de-dup passes, so that de-duping does not
+      // make the working set look cold to the compression pass that follows it and vice versa.
+      uint8_t dedup_accessed : 1;
       // This struct has no type name and exists inside an unpacked parent and so it really doesn't
       // need to have any padding. By making it packed we allow the next outer variables, to use
       // space we would have otherwise wasted in padding, without breaking alignment rules.
     } __PACKED object;  // attached to a vm object
   };
 
-  // offset 0x29
+  // offset 0x2a
 
   struct {
     uint8_t flags;
@@ -68,11 +82,11 @@ typedef struct vm_page {
     uint8_t state_priv : VM_PAGE_STATE_BITS;
   };
 
-  // offset 0x2b
+  // offset 0x2c
 
-  // five bytes of padding would be inserted here to make sizeof(vm_page) a multiple of 8
+  // four bytes of padding would be inserted here to make sizeof(vm_page) a multiple of 8
   // explicit padding is added to validate all commented offsets were indeed correct.
-  char padding[5];
+  char padding[4];
 
   // helper routines
   bool is_free() const { return state_priv == VM_PAGE_STATE_FREE; }
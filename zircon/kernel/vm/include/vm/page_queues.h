@@ -10,6 +10,7 @@
 #include <zircon/listnode.h>
 
 #include <fbl/macros.h>
+#include <fbl/ref_ptr.h>
 #include <kernel/lockdep.h>
 #include <kernel/spinlock.h>
 #include <vm/page.h>
@@ -24,8 +25,17 @@ class VmObjectPaged;
 // must not be used until the page has been Remove'd. It is not sufficient to call list_delete on
 // the queue_node yourself as this operation is not atomic and needs to be performed whilst holding
 // the PageQueues::lock_.
+//
+// Pager backed pages are additionally aged. They are kept in kNumPagerBacked generations, where
+// generation 0 holds the most recently accessed pages. RotatePagerBackedQueues periodically ages
+// every page by one generation and MarkAccessed moves a page back to generation 0, so that the
+// oldest generation approximates the least recently used pages.
 class PageQueues {
  public:
+  // Number of pager backed generations. Pages reach the oldest one after this many rotations
+  // without being accessed.
+  static constexpr size_t kNumPagerBacked = 4;
+
   PageQueues();
   ~PageQueues();
 
@@ -50,8 +60,29 @@ class PageQueues {
   // Removes the page from any page list and returns ownership of the queue_node.
   void Remove(vm_page_t* page);
 
+  // Moves |page| to the newest pager backed generation if it is currently in the pager backed
+  // queue, and otherwise does nothing. Safe to call with any page, provided it cannot be freed
+  // concurrently.
+  void MarkAccessed(vm_page_t* page);
+  // Ages all pager backed pages by one generation. Pages already in the oldest generation stay
+  // there.
+  void RotatePagerBackedQueues();
+
+  // Reference to a pager backed page and the object that contains it.
+  struct VmoBacklink {
+    fbl::RefPtr<VmObjectPaged> vmo;
+    vm_page_t* page = nullptr;
+    uint64_t offset = 0;
+  };
+  // Finds the least recently used pager backed page in a generation no newer than |lowest_queue|,
+  // skipping pages whose object is being destroyed. Returns false if there is none. The page is
+  // left in its queue and the backlink is only a hint; it must be revalidated under the object's
+  // lock before the page is used.
+  bool PeekPagerBacked(size_t lowest_queue, VmoBacklink* out) const;
+
   // Helper struct to group queue length counts returned by DebugQueueCounts.
   struct Counts {
+    // Sum over all pager backed generations.
     size_t pager_backed = 0;
     size_t unswappable = 0;
     size_t wired = 0;
@@ -74,8 +105,10 @@ class PageQueues {
  private:
   DECLARE_SPINLOCK(PageQueues) mutable lock_;
   // pager_backed_ denotes pages that both have a user level pager associated with them, and could
-  // be evicted such that the pager could re-create the page.
-  list_node_t pager_backed_ TA_GUARDED(lock_) = LIST_INITIAL_CLEARED_VALUE;
+  // be evicted such that the pager could re-create the page. Index 0 is the newest generation.
+  // Within a generation, pages are added at the head, so the tail of the oldest non-empty
+  // generation is the least recently used page.
+  list_node_t pager_backed_[kNumPagerBacked] TA_GUARDED(lock_);
   // unswappable_ pages have no user level mechanism to swap/evict them, but are modifiable by the
   // kernel and could have compression etc applied to them.
   list_node_t unswappable_ TA_GUARDED(lock_) = LIST_INITIAL_CLEARED_VALUE;
@@ -52,6 +52,8 @@ zx_status_t pmm_get_arena_info(size_t count, uint64_t i, pmm_arena_info_t* buffe
 #define PMM_ALLOC_FLAG_LO_MEM (1 << 0)  // allocate only from arenas marked LO_MEM
 // the caller can handle allocation failures with a delayed page_request_t request.
 #define PMM_ALLOC_DELAY_OK (1 << 1)
+// the allocation is opportunistic. Fail it rather than reclaim the per-cpu page caches.
+#define PMM_ALLOC_FLAG_NO_RECLAIM (1 << 2)
 
 // Debugging flag that can be used to induce artifical delayed page allocation by randomly
 // rejecting some fraction of the synchronous allocations which have PMM_ALLOC_DELAY_OK set.
@@ -96,9 +98,17 @@ void pmm_free(list_node* list) __NONNULL((1));
 // Free a single page.
 void pmm_free_page(vm_page_t* page) __NONNULL((1));
 
-// Return count of unallocated physical pages in system.
+// Return count of unallocated physical pages in system, including pages held by caches that give
+// them back under memory pressure.
 uint64_t pmm_count_free_pages();
 
+// Tell the PMM that |count| pages allocated from it are now sitting in a cache outside of the PMM
+// that returns them with pmm_free when memory runs low, so that they are counted as free by
+// pmm_count_free_pages and the mem avail watermarks. pmm_remove_cached_pages must be called before
+// such pages are handed out or freed again.
+void pmm_add_cached_pages(uint64_t count);
+void pmm_remove_cached_pages(uint64_t count);
+
 // Return amount of physical memory in system, in bytes.
 uint64_t pmm_count_total_bytes();
 
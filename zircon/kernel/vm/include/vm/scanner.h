@@ -7,6 +7,8 @@
 #ifndef ZIRCON_KERNEL_VM_INCLUDE_VM_SCANNER_H_
 #define ZIRCON_KERNEL_VM_INCLUDE_VM_SCANNER_H_
 
+#include <stdint.h>
+
 // Increase the disable count of the scanner. This may need to block until the scanner finishes any
 // current work and so should not be called with other locks held that may conflict with the
 // scanner. Generally this is expected to be used by unittests.
@@ -16,4 +18,10 @@ void scanner_push_disable_count();
 // zero.
 void scanner_pop_disable_count();
 
+// Asks the scanner to evict pager backed pages, least recently used first, and then to de-dupe and
+// compress cold anonymous pages, until at least |free_mem_target| bytes of memory are free or no
+// page is old enough to be reclaimed. This happens asynchronously on the scanner thread and is
+// subject to the disable count.
+void scanner_trigger_evict(uint64_t free_mem_target);
+
 #endif  // ZIRCON_KERNEL_VM_INCLUDE_VM_SCANNER_H_
@@ -495,6 +495,10 @@ class VmMapping final : public VmAddressRegionOrMapping,
   // if necessary.
   zx_status_t RemoveWriteVmoRangeLocked(uint64_t offset, uint64_t len) const
       TA_REQ(object_->lock());
+  // Harvests and clears the accessed bits of the hardware mappings of this region, calling
+  // |accessed_fn| for every page that had been accessed.
+  void HarvestAccessedBitsLocked(const ArchVmAspace::HarvestCallback& accessed_fn) const
+      TA_REQ(object_->lock());
 
  protected:
   ~VmMapping() override;
@@ -539,6 +543,16 @@ class VmMapping final : public VmAddressRegionOrMapping,
   bool ObjectRangeToVaddrRange(uint64_t offset, uint64_t len, vaddr_t* base,
                                uint64_t* virtual_len) const TA_REQ(object_->lock());
 
+  // Called after a read fault at |va| has been resolved. Maps read-only those of the pages that
+  // follow |va| which the object already holds itself, skipping anything that would need to be
+  // allocated, zero-filled, decompressed or found in a parent. The window grows while faults arrive
+  // sequentially.
+  void FaultAroundLocked(vaddr_t va) TA_REQ(object_->lock());
+
+  // Called before an arch Unmap or Protect of [base, base + size). Counts the large pages that the
+  // operation is about to demote, which are those it covers only in part.
+  void CountLargePageDemotions(vaddr_t base, size_t size) const;
+
   // pointer and region of the object we are mapping
   fbl::RefPtr<VmObject> object_;
   uint64_t object_offset_ = 0;
@@ -548,6 +562,11 @@ class VmMapping final : public VmAddressRegionOrMapping,
 
   // used to detect recursions through the vmo fault path
   bool currently_faulting_ = false;
+
+  // Fault-around state, guarded by the aspace lock. |fault_around_next_va_| is the end of the
+  // window mapped by the last read fault, where the next fault of a sequential scan lands.
+  vaddr_t fault_around_next_va_ = 0;
+  size_t fault_around_pages_ = 0;
 };
 
 #endif  // ZIRCON_KERNEL_VM_INCLUDE_VM_VM_ADDRESS_REGION_H_
@@ -129,6 +129,9 @@ class VmAspace : public fbl::DoublyLinkedListable<VmAspace*>, public fbl::RefCou
 
   size_t AllocatedPages() const;
 
+  // Number of pages mapped by fault-around that would otherwise have taken their own page fault.
+  size_t FaultAroundPages() const;
+
   // Generates a soft fault against this aspace. This is similar to a PageFault except:
   //  * This aspace may not currently be active and this does not have to be called from the
   //    hardware exception handler.
@@ -223,6 +226,9 @@ class VmAspace : public fbl::DoublyLinkedListable<VmAspace*>, public fbl::RefCou
   // Access to this reference is guarded by lock_.
   fbl::RefPtr<VmAddressRegion> root_vmar_;
 
+  // Pages mapped by VmMapping fault-around in this aspace. Guarded by lock_.
+  size_t fault_around_pages_ = 0;
+
   // PRNG used by VMARs for address choices.  We record the seed to enable
   // reproducible debugging.
   crypto::PRNG aslr_prng_;
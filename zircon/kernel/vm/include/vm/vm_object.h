@@ -22,6 +22,7 @@
 #include <fbl/macros.h>
 #include <fbl/name.h>
 #include <fbl/ref_counted.h>
+#include <fbl/ref_counted_upgradeable.h>
 #include <fbl/ref_ptr.h>
 #include <kernel/lockdep.h>
 #include <kernel/mutex.h>
@@ -67,11 +68,16 @@ struct GlobalListTag {};
 //
 // Can be created without mapping and used as a container of data, or mappable
 // into an address space via VmAddressRegion::CreateVmMapping
-class VmObject : public fbl::RefCounted<VmObject>,
+class VmObject : private fbl::RefCountedUpgradeable<VmObject>,
                  public fbl::ContainableBaseClasses<
                      fbl::DoublyLinkedListable<VmObject*, internal::ChildListTag>,
                      fbl::DoublyLinkedListable<VmObject*, internal::GlobalListTag>> {
  public:
+  using fbl::RefCountedUpgradeable<VmObject>::AddRef;
+  using fbl::RefCountedUpgradeable<VmObject>::Release;
+  using fbl::RefCountedUpgradeable<VmObject>::Adopt;
+  using fbl::RefCountedUpgradeable<VmObject>::ref_count_debug;
+
   // public API
   virtual zx_status_t Resize(uint64_t size) { return ZX_ERR_NOT_SUPPORTED; }
 
@@ -240,6 +246,23 @@ class VmObject : public fbl::RefCounted<VmObject>,
     return ZX_ERR_NOT_SUPPORTED;
   }
 
+  // Returns in |pa| the physical address of the page at |offset| if it is resident in this object
+  // and owned by it alone. Unlike GetPageLocked, this never allocates, decompresses, or looks up
+  // the page in a parent, and does not count as an access to the page. Returns ZX_ERR_NOT_FOUND
+  // for any other kind of slot.
+  virtual zx_status_t LookupResidentPageLocked(uint64_t offset, paddr_t* pa) TA_REQ(lock_) {
+    return ZX_ERR_NOT_SUPPORTED;
+  }
+
+  // Commits a physically contiguous run of |count| pages, aligned to |count| pages, at the
+  // |offset|, which must be aligned to the same size. Returns the physical address of the first
+  // page in |pa|. Fails without side effects if the object cannot back the range with a single
+  // contiguous run, for instance because part of it is already committed.
+  virtual zx_status_t CommitContiguousRunLocked(uint64_t offset, size_t count, paddr_t* pa)
+      TA_REQ(lock_) {
+    return ZX_ERR_NOT_SUPPORTED;
+  }
+
   Lock<Mutex>* lock() const TA_RET_CAP(lock_) { return &lock_; }
   Lock<Mutex>& lock_ref() const TA_RET_CAP(lock_) { return lock_; }
 
@@ -320,7 +343,37 @@ class VmObject : public fbl::RefCounted<VmObject>,
   // period of time.
   virtual uint32_t ScanForZeroPages(bool reclaim) { return 0; }
 
+  // Walks through every VMO and calls HarvestAccessedBits on them. Like ScanAllForZeroPages this
+  // holds the AllVmosLock for the entire duration.
+  static void HarvestAllAccessedBits();
+
+  // Collects and clears the accessed bits of the hardware mappings of any pager backed pages in
+  // this VMO, marking those pages as accessed in the page queues.
+  virtual void HarvestAccessedBits() {}
+
+  // Walks through every VMO, calls CompressColdPages on them until |max_pages| pages have been
+  // compressed, and returns the number compressed. Like ScanAllForZeroPages this holds the
+  // AllVmosLock for the entire duration.
+  static uint64_t CompressAllColdPages(uint64_t max_pages);
+
+  // Moves up to |max_pages| pages that have not been accessed since the previous call into the
+  // compressed store, returning the number of pages compressed.
+  virtual uint64_t CompressColdPages(uint64_t max_pages) { return 0; }
+
+  // Starts a new scan of the global dedup store, walks through every VMO, calls DedupPages on them,
+  // and returns the sum. Like ScanAllForZeroPages this holds the AllVmosLock for the entire
+  // duration.
+  static uint64_t DedupAllPages();
+
+  // Replaces pages that have not been accessed since the previous call, and whose content is also
+  // held elsewhere, with references to a single read-only copy in |store|, returning the number of
+  // pages freed.
+  virtual uint64_t DedupPages(DedupStore* store) { return 0; }
+
  protected:
+  // Only object types that hand out raw back references, such as to PageQueues, expose this.
+  using fbl::RefCountedUpgradeable<VmObject>::AddRefMaybeInDestructor;
+
   explicit VmObject(fbl::RefPtr<vm_lock_t> root_lock);
 
   // private destructor, only called from refptr
@@ -31,6 +31,10 @@
 // the main VM object type, holding a list of pages
 class VmObjectPaged final : public VmObject {
  public:
+  // PageQueues keeps raw back references to the objects of pager backed pages and upgrades them
+  // when it hands pages out for eviction.
+  using VmObject::AddRefMaybeInDestructor;
+
   // |options_| is a bitmask of:
   static constexpr uint32_t kResizable = (1u << 0);
   static constexpr uint32_t kContiguous = (1u << 1);
@@ -132,6 +136,11 @@ class VmObjectPaged final : public VmObject {
                             PageRequest* page_request, vm_page_t**, paddr_t*) override
       TA_REQ(lock_);
 
+  zx_status_t LookupResidentPageLocked(uint64_t offset, paddr_t* pa) override TA_REQ(lock_);
+
+  zx_status_t CommitContiguousRunLocked(uint64_t offset, size_t count, paddr_t* pa) override
+      TA_REQ(lock_);
+
   zx_status_t CreateClone(Resizability resizable, CloneType type, uint64_t offset, uint64_t size,
                           bool copy_name, fbl::RefPtr<VmObject>* child_vmo) override;
   // Inserts |hidden_parent| as a hidden parent of |this|. This vmo and |hidden_parent|
@@ -147,16 +156,24 @@ class VmObjectPaged final : public VmObject {
   void RemoveChild(VmObject* child, Guard<Mutex>&& guard) override TA_REQ(lock_);
   bool OnChildAddedLocked() override TA_REQ(lock_);
 
-  void DetachSource() override {
-    DEBUG_ASSERT(page_source_);
-    page_source_->Detach();
-  }
+  void DetachSource() override;
 
   zx_status_t CreateChildSlice(uint64_t offset, uint64_t size, bool copy_name,
                                fbl::RefPtr<VmObject>* child_vmo) override;
 
   uint32_t ScanForZeroPages(bool reclaim) override;
 
+  void HarvestAccessedBits() override;
+
+  // Evicts |page|, which is expected to be at |offset|, back to the page source. Fails if the page
+  // has since moved, or has become pinned or dirty. Intended to be used with the back references
+  // returned by PageQueues::PeekPagerBacked.
+  bool EvictPage(vm_page_t* page, uint64_t offset);
+
+  uint64_t CompressColdPages(uint64_t max_pages) override;
+
+  uint64_t DedupPages(DedupStore* store) override;
+
  private:
   // private constructor (use Create())
   VmObjectPaged(uint32_t options, uint32_t pmm_alloc_flags, uint64_t size,
@@ -192,6 +209,42 @@ class VmObjectPaged final : public VmObject {
   zx_status_t PinLocked(uint64_t offset, uint64_t len) TA_REQ(lock_);
   void UnpinLocked(uint64_t offset, uint64_t len) TA_REQ(lock_);
 
+  // Marks an unpinned page of a pager backed object as no longer recreatable by the pager and
+  // moves it out of the pager backed page queue so that it is never evicted.
+  void MarkPageDirtyLocked(vm_page_t* page) TA_REQ(lock_);
+
+  // Removes any pages of a pager backed object in [start, end) from the page queues. Must be
+  // called before those pages are taken out of the page list to be freed.
+  void RemovePagesFromQueuesLocked(uint64_t start, uint64_t end) TA_REQ(lock_);
+
+  // Returns whether pages of this object may be moved into the compressed or dedup stores. This is
+  // limited to user mapped anonymous objects that share no pages with other objects, so that
+  // compressed and shared pages only ever need to be handled by the object that references them.
+  // In particular no object that has a parent or children is ever transformed, see the
+  // implementation for what lifting that would take.
+  bool CanTransformPagesLocked() const TA_REQ(lock_);
+
+  // Harvests the accessed bits of all mappings of this anonymous object into the |accessed| and
+  // |dedup_accessed| bits of its pages.
+  void HarvestAnonymousAccessedBitsLocked() TA_REQ(lock_);
+
+  // Replaces the compressed page in |slot| with a newly allocated page holding its content. The
+  // page is taken from |free_list| if it is non-empty.
+  zx_status_t DecompressPageLocked(VmPageOrMarker* slot, list_node_t* free_list) TA_REQ(lock_);
+
+  // Replaces the shared page reference in |slot|, which is at |offset|, with a page owned by this
+  // object, copying the shared page if other objects still reference it. The copy is taken from
+  // |free_list| if it is non-empty.
+  zx_status_t UnsharePageLocked(VmPageOrMarker* slot, uint64_t offset, list_node_t* free_list)
+      TA_REQ(lock_);
+
+  // Decompresses or unshares any compressed or shared pages in [offset, offset + len).
+  zx_status_t UnpackRangeLocked(uint64_t offset, uint64_t len) TA_REQ(lock_);
+
+  // Unpacks every page before this object gains a child. A no-op if it already has a parent or
+  // children, as those can't hold compressed or shared pages.
+  zx_status_t UnpackForCloneLocked() TA_REQ(lock_);
+
   // Internal decommit range helper that expects the lock to be held. On success it will populate
   // the past in page list with any pages that should be freed.
   zx_status_t DecommitRangeLocked(uint64_t offset, uint64_t len, list_node_t& free_list)
@@ -419,6 +472,9 @@ class VmObjectPaged final : public VmObject {
   // a contiguous vmo.
   uint64_t pinned_page_count_ TA_GUARDED(lock_) = 0;
 
+  // Number of CommitContiguousRunLocked() calls left to skip after one failed to find a free run.
+  uint32_t contiguous_run_skip_ TA_GUARDED(lock_) = 0;
+
   // The page source, if any.
   const fbl::RefPtr<PageSource> page_source_;
 
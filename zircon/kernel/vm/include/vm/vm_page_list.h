@@ -15,21 +15,27 @@
 #include <fbl/intrusive_wavl_tree.h>
 #include <fbl/macros.h>
 #include <ktl/unique_ptr.h>
+#include <vm/compressed_store.h>
+#include <vm/dedup_store.h>
 #include <vm/page.h>
 #include <vm/vm.h>
 
 // RAII helper for representing owned pages in a page list node. This supports being in one of
-// three states
+// five states
 //  * Empty - Contains nothing
 //  * Page p - Contains a vm_page 'p'. This 'p' is considered owned by this wrapper and
 //             `ReleasePage` must be called to give up ownership.
 //  * Marker - Indicates that whilst not a page, it is also not empty. Markers can be used to
 //             separate the distinction between "there's no page because we've deduped to the zero
 //             page" and "there's no page because our parent contains the content".
+//  * Compressed c - Contains the content of a page in the compressed store. Like a page this is
+//                   owned by the wrapper and `ReleaseCompressed` must be called to give it up.
+//  * Shared s - Holds a reference to a read-only page in the dedup store. The reference is owned
+//               by the wrapper and `ReleaseShared` must be called to give it up.
 class VmPageOrMarker {
  public:
   VmPageOrMarker() : page_(nullptr) {}
-  ~VmPageOrMarker() { DEBUG_ASSERT(!IsPage()); }
+  ~VmPageOrMarker() { DEBUG_ASSERT(!IsPage() && !IsCompressed() && !IsShared()); }
   VmPageOrMarker(VmPageOrMarker&& other) : page_(other.Release()) {}
   VmPageOrMarker(const VmPageOrMarker&) = delete;
   VmPageOrMarker& operator=(const VmPageOrMarker&) = delete;
@@ -47,7 +53,41 @@ class VmPageOrMarker {
     return Release();
   }
 
-  bool IsPage() const { return !IsMarker() && !IsEmpty(); }
+  // Returns the underlying compressed page. Is only valid to call if `IsCompressed` is true.
+  VmCompressedPage* Compressed() const {
+    DEBUG_ASSERT(IsCompressed());
+    return reinterpret_cast<VmCompressedPage*>(reinterpret_cast<uintptr_t>(page_) & ~kTagMask);
+  }
+
+  // If this is a compressed page, moves it out and returns it. After this IsCompressed will be
+  // false and IsEmpty will be true.
+  VmCompressedPage* ReleaseCompressed() {
+    VmCompressedPage* c = Compressed();
+    Release();
+    return c;
+  }
+
+  // Returns the underlying shared page reference. Is only valid to call if `IsShared` is true.
+  VmSharedPage* Shared() const {
+    DEBUG_ASSERT(IsShared());
+    return reinterpret_cast<VmSharedPage*>(reinterpret_cast<uintptr_t>(page_) & ~kTagMask);
+  }
+
+  // If this is a shared page, moves the reference out and returns it. After this IsShared will be
+  // false and IsEmpty will be true.
+  VmSharedPage* ReleaseShared() {
+    VmSharedPage* s = Shared();
+    Release();
+    return s;
+  }
+
+  bool IsPage() const { return !IsMarker() && !IsEmpty() && !IsCompressed() && !IsShared(); }
+
+  bool IsCompressed() const {
+    return (reinterpret_cast<uintptr_t>(page_) & kTagMask) == kCompressedTag;
+  }
+
+  bool IsShared() const { return (reinterpret_cast<uintptr_t>(page_) & kTagMask) == kSharedTag; }
 
   bool IsMarker() const { return page_ == RawMarker(); }
 
@@ -55,7 +95,7 @@ class VmPageOrMarker {
 
   VmPageOrMarker& operator=(VmPageOrMarker&& other) {
     // Forbid overriding a page, as that would leak it.
-    DEBUG_ASSERT(!IsPage());
+    DEBUG_ASSERT(!IsPage() && !IsCompressed() && !IsShared());
     page_ = other.Release();
     return *this;
   }
@@ -73,9 +113,28 @@ class VmPageOrMarker {
     return {p};
   }
 
+  static VmPageOrMarker Compressed(VmCompressedPage* c) {
+    DEBUG_ASSERT(c);
+    DEBUG_ASSERT((reinterpret_cast<uintptr_t>(c) & kTagMask) == 0);
+    return {reinterpret_cast<vm_page*>(reinterpret_cast<uintptr_t>(c) | kCompressedTag)};
+  }
+
+  static VmPageOrMarker Shared(VmSharedPage* s) {
+    DEBUG_ASSERT(s);
+    DEBUG_ASSERT((reinterpret_cast<uintptr_t>(s) & kTagMask) == 0);
+    return {reinterpret_cast<vm_page*>(reinterpret_cast<uintptr_t>(s) | kSharedTag)};
+  }
+
  private:
   VmPageOrMarker(vm_page* p) : page_(p) {}
 
+  // Compressed and shared pages are distinguished by tagging the low bits, which are never set in
+  // the aligned pointers to a vm_page, VmCompressedPage or VmSharedPage. The marker value has
+  // neither tag.
+  static constexpr uintptr_t kTagMask = 3;
+  static constexpr uintptr_t kCompressedTag = 2;
+  static constexpr uintptr_t kSharedTag = 3;
+
   static vm_page* RawMarker() { return reinterpret_cast<vm_page*>(1); }
 
   vm_page* Release() {
@@ -140,10 +199,11 @@ class VmPageListNode final : public fbl::WAVLTreeContainable<ktl::unique_ptr<VmP
     return true;
   }
 
-  // Returns true if there are still allocated vm_page_t's owned by this node.
+  // Returns true if there are still allocated vm_page_t's, compressed pages or shared page
+  // references owned by this node.
   bool HasNoPages() const {
     for (const auto& p : pages_) {
-      if (p.IsPage()) {
+      if (p.IsPage() || p.IsCompressed() || p.IsShared()) {
         return false;
       }
     }
@@ -294,14 +354,16 @@ class VmPageList final {
   // Removes any page at |offset| from the list and returns it, or VmPageOrMarker::Empty() if none.
   VmPageOrMarker RemovePage(uint64_t offset);
   // Removes all pages from this list and puts them on |removed_pages|. The caller
-  // now owns the pages. Any markers are cleared.
+  // now owns the pages. Any markers are cleared, compressed pages are freed and shared page
+  // references are released.
   size_t RemoveAllPages(list_node_t* removed_pages);
   // Removes all pages in the range [start_offset, end_offset) and puts them
-  // on |removed_pages|. The caller now owns the pages. Any markers are cleared.
+  // on |removed_pages|. The caller now owns the pages. Any markers are cleared, compressed pages
+  // are freed and shared page references are released.
   void RemovePages(uint64_t start_offset, uint64_t end_offset, list_node_t* remove_page);
   // Invokes T on each page or marker in [start_offset, end_offset) and for any pages for
   // which it returns true, puts them on |removed_pages|. The caller now owns
-  // the pages.
+  // the pages. Compressed pages and shared page references for which it returns true are freed.
   template <typename T>
   void RemovePages(T per_page_fn, uint64_t start_offset, uint64_t end_offset,
                    list_node_t* removed_pages) {
@@ -328,6 +390,10 @@ class VmPageList final {
       if (per_page_fn(static_cast<const VmPageOrMarker&>(p), offset)) {
         if (p.IsPage()) {
           list_add_tail(removed_pages, &p.ReleasePage()->queue_node);
+        } else if (p.IsCompressed()) {
+          compressed_store_free(p.ReleaseCompressed());
+        } else if (p.IsShared()) {
+          dedup_store_release(p.ReleaseShared());
         }
         p = VmPageOrMarker::Empty();
       }
@@ -347,8 +413,8 @@ class VmPageList final {
 
   // Returns true if there are no pages or markers in the page list.
   bool IsEmpty() const;
-
-  // Returns true if the page list does not own any vm_page.
+  // Returns true if the page list does not own any vm_page, compressed page or shared page
+  // reference.
   bool HasNoPages() const;
 
   // Merges the pages in |other| in the range [|offset|, |end_offset|) into |this|
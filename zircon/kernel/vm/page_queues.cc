@@ -9,13 +9,17 @@
 #include <vm/vm_object_paged.h>
 
 PageQueues::PageQueues() {
-  list_initialize(&pager_backed_);
+  for (list_node_t& queue : pager_backed_) {
+    list_initialize(&queue);
+  }
   list_initialize(&unswappable_);
   list_initialize(&wired_);
 }
 
 PageQueues::~PageQueues() {
-  DEBUG_ASSERT(list_is_empty(&pager_backed_));
+  for (list_node_t& queue : pager_backed_) {
+    DEBUG_ASSERT(list_is_empty(&queue));
+  }
   DEBUG_ASSERT(list_is_empty(&unswappable_));
   DEBUG_ASSERT(list_is_empty(&wired_));
 }
@@ -73,7 +77,7 @@ void PageQueues::SetPagerBacked(vm_page_t* page, VmObjectPaged* object, uint64_t
   DEBUG_ASSERT(!list_in_list(&page->queue_node));
   page->object.set_object(reinterpret_cast<void*>(object));
   page->object.set_page_offset(page_offset);
-  list_add_head(&pager_backed_, &page->queue_node);
+  list_add_head(&pager_backed_[0], &page->queue_node);
 }
 
 void PageQueues::MoveToPagerBacked(vm_page_t* page, VmObjectPaged* object, uint64_t page_offset) {
@@ -86,7 +90,7 @@ void PageQueues::MoveToPagerBacked(vm_page_t* page, VmObjectPaged* object, uint6
   page->object.set_object(reinterpret_cast<void*>(object));
   page->object.set_page_offset(page_offset);
   list_delete(&page->queue_node);
-  list_add_head(&pager_backed_, &page->queue_node);
+  list_add_head(&pager_backed_[0], &page->queue_node);
 }
 
 void PageQueues::Remove(vm_page_t* page) {
@@ -97,10 +101,58 @@ void PageQueues::Remove(vm_page_t* page) {
   list_delete(&page->queue_node);
 }
 
+void PageQueues::MarkAccessed(vm_page_t* page) {
+  Guard<SpinLock, IrqSave> guard{&lock_};
+  // Only pages in the pager backed queue have a back reference, which makes it a cheap test for
+  // membership. The state check guards against reading the object fields of a page that is not
+  // owned by a VmObject at all.
+  if (page->state() != VM_PAGE_STATE_OBJECT || !page->object.get_object()) {
+    return;
+  }
+  DEBUG_ASSERT(list_in_list(&page->queue_node));
+  list_delete(&page->queue_node);
+  list_add_head(&pager_backed_[0], &page->queue_node);
+}
+
+void PageQueues::RotatePagerBackedQueues() {
+  Guard<SpinLock, IrqSave> guard{&lock_};
+  // Every generation moves one step older. The pages of the generation being merged into the
+  // oldest one are newer than those already there, so they go at its head.
+  for (size_t i = kNumPagerBacked - 1; i > 0; i--) {
+    list_splice_after(&pager_backed_[i - 1], &pager_backed_[i]);
+  }
+}
+
+bool PageQueues::PeekPagerBacked(size_t lowest_queue, VmoBacklink* out) const {
+  DEBUG_ASSERT(lowest_queue < kNumPagerBacked);
+  Guard<SpinLock, IrqSave> guard{&lock_};
+  for (size_t i = kNumPagerBacked; i-- > lowest_queue;) {
+    const list_node_t* queue = &pager_backed_[i];
+    for (list_node_t* node = queue->prev; node != queue; node = node->prev) {
+      vm_page_t* page = containerof(node, vm_page_t, queue_node);
+      VmObjectPaged* object = reinterpret_cast<VmObjectPaged*>(page->object.get_object());
+      DEBUG_ASSERT(object);
+      // The object removes its pages from the queues in its destructor, which needs our lock, so
+      // it is safe to try and upgrade the back reference whilst we hold it.
+      fbl::RefPtr<VmObjectPaged> vmo = fbl::MakeRefPtrUpgradeFromRaw(object, lock_);
+      if (!vmo) {
+        continue;
+      }
+      out->vmo = ktl::move(vmo);
+      out->page = page;
+      out->offset = page->object.get_page_offset();
+      return true;
+    }
+  }
+  return false;
+}
+
 PageQueues::Counts PageQueues::DebugQueueCounts() const {
   Counts counts;
   Guard<SpinLock, IrqSave> guard{&lock_};
-  counts.pager_backed = list_length(&pager_backed_);
+  for (const list_node_t& queue : pager_backed_) {
+    counts.pager_backed += list_length(&queue);
+  }
   counts.unswappable = list_length(&unswappable_);
   counts.wired = list_length(&wired_);
   return counts;
@@ -118,7 +170,12 @@ bool PageQueues::DebugPageInList(const list_node_t* list, const vm_page_t* page)
 }
 
 bool PageQueues::DebugPageIsPagerBacked(const vm_page_t* page) const {
-  return DebugPageInList(&pager_backed_, page);
+  for (const list_node_t& queue : pager_backed_) {
+    if (DebugPageInList(&queue, page)) {
+      return true;
+    }
+  }
+  return false;
 }
 
 bool PageQueues::DebugPageIsUnswappable(const vm_page_t* page) const {
@@ -109,6 +109,10 @@ void pmm_free_page(vm_page* page) { pmm_node.FreePage(page); }
 
 uint64_t pmm_count_free_pages() { return pmm_node.CountFreePages(); }
 
+void pmm_add_cached_pages(uint64_t count) { pmm_node.AddCachedPages(count); }
+
+void pmm_remove_cached_pages(uint64_t count) { pmm_node.RemoveCachedPages(count); }
+
 uint64_t pmm_count_total_bytes() { return pmm_node.CountTotalBytes(); }
 
 PageQueues* pmm_page_queues() { return pmm_node.GetPageQueues(); }
@@ -155,6 +159,20 @@ static void init_request_thread(unsigned int level) { pmm_node.InitRequestThread
 
 LK_INIT_HOOK(pmm, init_request_thread, LK_INIT_LEVEL_THREADING)
 
+// Size, in pages, of each cpu's cache of free pages. Zero disables the caches.
+static constexpr uint32_t kDefaultPageCacheSize = 64;
+
+static void init_page_caches(unsigned int level) {
+  const uint32_t size = gCmdline.GetUInt32("kernel.pmm.page-cache-size", kDefaultPageCacheSize);
+  zx_status_t status = pmm_node.InitPageCaches(size);
+  if (status != ZX_OK) {
+    printf("PMM: failed to initialize page caches: %d\n", status);
+  }
+}
+
+// The caches are sized by the number of cpus, which is known once the percpu structures exist.
+LK_INIT_HOOK(pmm_page_caches, init_page_caches, LK_INIT_LEVEL_THREADING)
+
 static int cmd_pmm(int argc, const cmd_args* argv, uint32_t flags) {
   bool is_panic = flags & CMD_FLAG_PANIC;
 
@@ -171,6 +189,8 @@ static int cmd_pmm(int argc, const cmd_args* argv, uint32_t flags) {
           argv[0].str);
       printf("%s mem_avail_state info : dump memstate info\n", argv[0].str);
       printf("%s drop_user_pt         : drop all user hardware page tables\n", argv[0].str);
+      printf("%s reclaim_caches       : return all per-cpu cached pages to the free list\n",
+             argv[0].str);
       printf("%s checker status       : prints the status of the pmm checker\n", argv[0].str);
       printf("%s checker enable       : enables the pmm checker\n", argv[0].str);
       printf("%s checker disable      : disables the pmm checker\n", argv[0].str);
@@ -242,6 +262,8 @@ static int cmd_pmm(int argc, const cmd_args* argv, uint32_t flags) {
     }
   } else if (!strcmp(argv[1].str, "drop_user_pt")) {
     VmAspace::DropAllUserPageTables();
+  } else if (!strcmp(argv[1].str, "reclaim_caches")) {
+    pmm_node.ReclaimPageCaches();
   } else if (!strcmp(argv[1].str, "checker")) {
     if (argc != 3) {
       goto usage;
@@ -11,8 +11,11 @@
 
 #include <new>
 
+#include <fbl/alloc_checker.h>
 #include <kernel/mp.h>
+#include <kernel/percpu.h>
 #include <kernel/thread.h>
+#include <ktl/move.h>
 #include <pretty/sizes.h>
 #include <vm/bootalloc.h>
 #include <vm/page_request.h>
@@ -25,6 +28,12 @@
 #define LOCAL_TRACE VM_GLOBAL_TRACE(0)
 
 KCOUNTER(pmm_alloc_async, "vm.pmm.alloc.async")
+KCOUNTER(pmm_page_cache_alloc_hit, "vm.pmm.page_cache.alloc_hit")
+KCOUNTER(pmm_page_cache_alloc_miss, "vm.pmm.page_cache.alloc_miss")
+KCOUNTER(pmm_page_cache_free, "vm.pmm.page_cache.free")
+KCOUNTER(pmm_page_cache_refill, "vm.pmm.page_cache.refill")
+KCOUNTER(pmm_page_cache_drain, "vm.pmm.page_cache.drain")
+KCOUNTER(pmm_page_cache_reclaim, "vm.pmm.page_cache.reclaim")
 
 namespace {
 
@@ -170,12 +179,234 @@ void PmmNode::CheckAllFreePages() {
 void PmmNode::EnableChecker() {
   Guard<fbl::Mutex> guard{&lock_};
   free_fill_enabled_ = true;
+
+  // Pages sitting in the per-cpu caches were never filled. Send them back through the free list so
+  // they pick up the pattern, and keep the caches out of the way while the checker is enabled.
+  UpdatePageCachesEnabledLocked();
+  ReclaimPageCachesLocked();
 }
 
 void PmmNode::DisableChecker() {
   Guard<fbl::Mutex> guard{&lock_};
   checker_.Disarm();
   free_fill_enabled_ = false;
+  UpdatePageCachesEnabledLocked();
+}
+
+zx_status_t PmmNode::InitPageCaches(size_t capacity) {
+  if (capacity < 2) {
+    return ZX_OK;
+  }
+
+  const size_t count = percpu::processor_count();
+  fbl::AllocChecker ac;
+  ktl::unique_ptr<PageCache[]> caches(new (&ac) PageCache[count]);
+  if (!ac.check()) {
+    return ZX_ERR_NO_MEMORY;
+  }
+
+  Guard<fbl::Mutex> guard{&lock_};
+  DEBUG_ASSERT(!page_caches_);
+
+  page_caches_ = ktl::move(caches);
+  page_cache_count_ = count;
+  page_cache_capacity_ = capacity;
+  page_cache_batch_ = capacity / 2;
+  UpdatePageCachesEnabledLocked();
+
+  LTRACEF("%zu page caches, capacity %zu\n", count, capacity);
+  return ZX_OK;
+}
+
+void PmmNode::ReclaimPageCaches() {
+  Guard<fbl::Mutex> guard{&lock_};
+  ReclaimPageCachesLocked();
+}
+
+void PmmNode::UpdatePageCachesEnabledLocked() {
+  const bool enabled = page_caches_ && mem_avail_state_cur_index_ > 0 && !free_fill_enabled_;
+  page_caches_enabled_.store(enabled, ktl::memory_order_release);
+}
+
+bool PmmNode::PageCachesUsable(uint alloc_flags) const {
+  if (!page_caches_enabled_.load(ktl::memory_order_acquire)) {
+    return false;
+  }
+#if RANDOM_DELAYED_ALLOC
+  // Let delayable allocations reach |InOomStateLocked| so they still get randomly delayed.
+  if (alloc_flags & PMM_ALLOC_DELAY_OK) {
+    return false;
+  }
+#endif
+  return true;
+}
+
+PmmNode::PageCache* PmmNode::CurrentPageCache() const {
+  // The calling thread may migrate as soon as the cpu number has been read. That only costs some
+  // locality; each cache is protected by its own lock.
+  const cpu_num_t cpu = arch_curr_cpu_num();
+  DEBUG_ASSERT(cpu < page_cache_count_);
+  return &page_caches_[cpu];
+}
+
+bool PmmNode::AllocPagesFromCache(size_t count, uint alloc_flags, list_node* list) {
+  if (count > page_cache_batch_ || !PageCachesUsable(alloc_flags)) {
+    return false;
+  }
+
+  PageCache* cache = CurrentPageCache();
+  {
+    Guard<SpinLock, IrqSave> guard{&cache->lock};
+    if (cache->count >= count) {
+      for (size_t i = 0; i < count; i++) {
+        vm_page* page = list_remove_head_type(&cache->list, vm_page, queue_node);
+        DEBUG_ASSERT(page->state() == VM_PAGE_STATE_ALLOC);
+        list_add_tail(list, &page->queue_node);
+      }
+      cache->count -= count;
+      cached_count_.fetch_sub(count, ktl::memory_order_relaxed);
+      kcounter_add(pmm_page_cache_alloc_hit, 1);
+      return true;
+    }
+  }
+
+  kcounter_add(pmm_page_cache_alloc_miss, 1);
+
+  // Pull the pages the caller needs plus a batch for the cache out of the free list in one go.
+  list_node refill = LIST_INITIAL_VALUE(refill);
+  size_t refill_count;
+  {
+    Guard<fbl::Mutex> guard{&lock_};
+    if (unlikely(InOomStateLocked()) || free_count_ < count) {
+      // Let the slow path sort out the low memory semantics.
+      return false;
+    }
+    // Count the pages meant for the cache as cached before they leave the free list, so that the
+    // watermarks do not see them as allocated in between.
+    refill_count = fbl::min(page_cache_batch_, static_cast<size_t>(free_count_) - count);
+    cached_count_.fetch_add(refill_count, ktl::memory_order_relaxed);
+    TakeFreePagesLocked(count + refill_count, &refill);
+  }
+  kcounter_add(pmm_page_cache_refill, 1);
+
+  for (size_t i = 0; i < count; i++) {
+    list_add_tail(list, list_remove_head(&refill));
+  }
+  if (refill_count == 0) {
+    return true;
+  }
+
+  {
+    Guard<SpinLock, IrqSave> guard{&cache->lock};
+    // The caches may have been disabled, or this cache filled up by frees from other threads,
+    // while |lock_| was dropped. In that case the extra pages go back to the free list.
+    if (page_caches_enabled_.load(ktl::memory_order_relaxed) &&
+        cache->count + refill_count <= page_cache_capacity_) {
+      list_splice_after(&refill, &cache->list);
+      cache->count += refill_count;
+      return true;
+    }
+  }
+
+  Guard<fbl::Mutex> guard{&lock_};
+  cached_count_.fetch_sub(refill_count, ktl::memory_order_relaxed);
+  FreeListLocked(&refill);
+  return true;
+}
+
+void PmmNode::FreeListToCache(list_node* list) {
+  if (!PageCachesUsable(0)) {
+    return;
+  }
+
+  list_node drain = LIST_INITIAL_VALUE(drain);
+  PageCache* cache = CurrentPageCache();
+  {
+    Guard<SpinLock, IrqSave> guard{&cache->lock};
+    const uint64_t old_count = cache->count;
+    vm_page* page;
+    while ((page = list_remove_head_type(list, vm_page, queue_node)) != nullptr) {
+      DEBUG_ASSERT(page->state() != VM_PAGE_STATE_OBJECT || page->object.pin_count == 0);
+      DEBUG_ASSERT(!page->is_free());
+
+      if (page->state() != VM_PAGE_STATE_ALLOC) {
+        page->set_state(VM_PAGE_STATE_ALLOC);
+      }
+      list_add_head(&cache->list, &page->queue_node);
+      kcounter_add(pmm_page_cache_free, 1);
+
+      if (++cache->count > page_cache_capacity_) {
+        // Drain a batch of the coldest pages, leaving room for the next batch of frees.
+        for (size_t i = 0; i < page_cache_batch_; i++) {
+          list_add_head(&drain, list_remove_tail(&cache->list));
+        }
+        cache->count -= page_cache_batch_;
+        break;
+      }
+    }
+    // The drained pages are counted by the caller freeing them to the free list.
+    if (cache->count >= old_count) {
+      cached_count_.fetch_add(cache->count - old_count, ktl::memory_order_relaxed);
+    } else {
+      cached_count_.fetch_sub(old_count - cache->count, ktl::memory_order_relaxed);
+    }
+  }
+
+  if (!list_is_empty(&drain)) {
+    kcounter_add(pmm_page_cache_drain, 1);
+    // Whatever is left in |list| is freed by the caller directly to the free list.
+    list_splice_after(&drain, list);
+  }
+}
+
+size_t PmmNode::TakeFreePagesLocked(size_t count, list_node* list) {
+  count = fbl::min(count, static_cast<size_t>(free_count_));
+  for (size_t i = 0; i < count; i++) {
+    vm_page* page = list_remove_head_type(&free_list_, vm_page, queue_node);
+    DEBUG_ASSERT(page);
+    AllocPageHelperLocked(page);
+    list_add_tail(list, &page->queue_node);
+  }
+
+  DecrementFreeCountLocked(count);
+  return count;
+}
+
+bool PmmNode::ReclaimPageCachesLocked() {
+  if (!page_caches_) {
+    return false;
+  }
+
+  uint64_t reclaimed = 0;
+  for (size_t i = 0; i < page_cache_count_; i++) {
+    PageCache& cache = page_caches_[i];
+    list_node list = LIST_INITIAL_VALUE(list);
+    {
+      Guard<SpinLock, IrqSave> guard{&cache.lock};
+      if (cache.count == 0) {
+        continue;
+      }
+      list_move(&cache.list, &list);
+      reclaimed += cache.count;
+      cache.count = 0;
+    }
+
+    // Not |FreeListLocked|, as this may be called while the mem avail state is being updated.
+    vm_page* page;
+    list_for_every_entry (&list, page, vm_page, queue_node) { FreePageHelperLocked(page); }
+    list_splice_after(&list, &free_list_);
+  }
+
+  if (reclaimed == 0) {
+    return false;
+  }
+
+  LTRACEF("reclaimed %" PRIu64 " pages from page caches\n", reclaimed);
+  kcounter_add(pmm_page_cache_reclaim, 1);
+  cached_count_.fetch_sub(reclaimed, ktl::memory_order_relaxed);
+  free_count_ += reclaimed;
+  free_pages_evt_.SignalNoResched();
+  return true;
 }
 
 void PmmNode::AllocPageHelperLocked(vm_page_t* page) {
@@ -192,6 +423,22 @@ void PmmNode::AllocPageHelperLocked(vm_page_t* page) {
 }
 
 zx_status_t PmmNode::AllocPage(uint alloc_flags, vm_page_t** page_out, paddr_t* pa_out) {
+  vm_page* page;
+
+  list_node list = LIST_INITIAL_VALUE(list);
+  if (AllocPagesFromCache(1, alloc_flags, &list)) {
+    page = list_remove_head_type(&list, vm_page, queue_node);
+    DEBUG_ASSERT(list_is_empty(&list));
+
+    if (pa_out) {
+      *pa_out = page->paddr();
+    }
+    if (page_out) {
+      *page_out = page;
+    }
+    return ZX_OK;
+  }
+
   Guard<fbl::Mutex> guard{&lock_};
 
   if (unlikely(InOomStateLocked())) {
@@ -201,9 +448,13 @@ zx_status_t PmmNode::AllocPage(uint alloc_flags, vm_page_t** page_out, paddr_t*
     }
   }
 
-  vm_page* page = list_remove_head_type(&free_list_, vm_page, queue_node);
+  page = list_remove_head_type(&free_list_, vm_page, queue_node);
   if (!page) {
-    return ZX_ERR_NO_MEMORY;
+    if (!ReclaimPageCachesLocked()) {
+      return ZX_ERR_NO_MEMORY;
+    }
+    page = list_remove_head_type(&free_list_, vm_page, queue_node);
+    DEBUG_ASSERT(page);
   }
 
   AllocPageHelperLocked(page);
@@ -236,12 +487,16 @@ zx_status_t PmmNode::AllocPages(size_t count, uint alloc_flags, list_node* list)
       list_add_tail(list, &page->queue_node);
     }
     return status;
+  } else if (AllocPagesFromCache(count, alloc_flags, list)) {
+    return ZX_OK;
   }
 
   Guard<fbl::Mutex> guard{&lock_};
 
   if (unlikely(count > free_count_)) {
-    return ZX_ERR_NO_MEMORY;
+    if (!ReclaimPageCachesLocked() || count > free_count_) {
+      return ZX_ERR_NO_MEMORY;
+    }
   }
 
   DecrementFreeCountLocked(count);
@@ -287,6 +542,9 @@ zx_status_t PmmNode::AllocRange(paddr_t address, size_t count, list_node* list)
 
   Guard<fbl::Mutex> guard{&lock_};
 
+  // The requested pages may be sitting in a per-cpu cache, where they look allocated.
+  ReclaimPageCachesLocked();
+
   // walk through the arenas, looking to see if the physical page belongs to it
   for (auto& a : arena_list_) {
     while (allocated < count && a.address_in_arena(address)) {
@@ -341,10 +599,21 @@ zx_status_t PmmNode::AllocContiguous(const size_t count, uint alloc_flags, uint8
 
   Guard<fbl::Mutex> guard{&lock_};
 
-  for (auto& a : arena_list_) {
-    vm_page_t* p = a.FindFreeContiguous(count, alignment_log2);
+  // Pages held in the per-cpu caches look allocated to the arenas and can break up otherwise free
+  // runs, so if the first search fails reclaim them and search once more.
+  for (bool retry = !(alloc_flags & PMM_ALLOC_FLAG_NO_RECLAIM);; retry = false) {
+    vm_page_t* p = nullptr;
+    for (auto& a : arena_list_) {
+      p = a.FindFreeContiguous(count, alignment_log2);
+      if (p) {
+        break;
+      }
+    }
     if (!p) {
-      continue;
+      if (retry && ReclaimPageCachesLocked()) {
+        continue;
+      }
+      break;
     }
 
     *pa = p->paddr();
@@ -386,11 +655,18 @@ void PmmNode::FreePageHelperLocked(vm_page* page) {
 }
 
 void PmmNode::FreePage(vm_page* page) {
-  Guard<fbl::Mutex> guard{&lock_};
-
   // pages freed individually shouldn't be in a queue
   DEBUG_ASSERT(!list_in_list(&page->queue_node));
 
+  if (PageCachesUsable(0)) {
+    list_node list = LIST_INITIAL_VALUE(list);
+    list_add_tail(&list, &page->queue_node);
+    FreeList(&list);
+    return;
+  }
+
+  Guard<fbl::Mutex> guard{&lock_};
+
   FreePageHelperLocked(page);
 
   // add it to the free queue
@@ -417,6 +693,11 @@ void PmmNode::FreeListLocked(list_node* list) {
 }
 
 void PmmNode::FreeList(list_node* list) {
+  FreeListToCache(list);
+  if (list_is_empty(list)) {
+    return;
+  }
+
   Guard<fbl::Mutex> guard{&lock_};
 
   FreeListLocked(list);
@@ -527,7 +808,20 @@ void PmmNode::ProcessPendingRequests() {
   }
 }
 
-uint64_t PmmNode::CountFreePages() const TA_NO_THREAD_SAFETY_ANALYSIS { return free_count_; }
+uint64_t PmmNode::CountFreePages() const TA_NO_THREAD_SAFETY_ANALYSIS {
+  // Cached pages are free as far as callers are concerned. |free_count_| is read without the lock,
+  // so the total is only approximate while pages are moving.
+  return AvailablePagesLocked();
+}
+
+void PmmNode::AddCachedPages(uint64_t count) {
+  cached_count_.fetch_add(count, ktl::memory_order_relaxed);
+}
+
+void PmmNode::RemoveCachedPages(uint64_t count) {
+  DEBUG_ASSERT(cached_count_.load(ktl::memory_order_relaxed) >= count);
+  cached_count_.fetch_sub(count, ktl::memory_order_relaxed);
+}
 
 uint64_t PmmNode::CountTotalBytes() const TA_NO_THREAD_SAFETY_ANALYSIS {
   return arena_cumulative_size_;
@@ -543,6 +837,15 @@ void PmmNode::Dump(bool is_panic) const {
   auto dump = [this]() TA_NO_THREAD_SAFETY_ANALYSIS {
     printf("pmm node %p: free_count %zu (%zu bytes), total size %zu\n", this, free_count_,
            free_count_ * PAGE_SIZE, arena_cumulative_size_);
+    if (page_caches_) {
+      uint64_t cached = 0;
+      for (size_t i = 0; i < page_cache_count_; i++) {
+        cached += page_caches_[i].count;
+      }
+      printf("\tpage caches: %zu cpus, capacity %zu, batch %zu, cached %zu (%zu bytes)\n",
+             page_cache_count_, page_cache_capacity_, page_cache_batch_, cached,
+             cached * PAGE_SIZE);
+    }
     for (auto& a : arena_list_) {
       a.Dump(false, false);
     }
@@ -603,20 +906,29 @@ zx_status_t PmmNode::InitReclamation(const uint64_t* watermarks, uint8_t waterma
   return ZX_OK;
 }
 
-void PmmNode::UpdateMemAvailStateLocked() {
+uint8_t PmmNode::MemAvailStateTargetLocked() const {
   // Find the smallest watermark which is greater than the number of free pages.
-  uint8_t target = mem_avail_state_watermark_count_;
   for (uint8_t i = 0; i < mem_avail_state_watermark_count_; i++) {
-    if (mem_avail_state_watermarks_[i] > free_count_) {
-      target = i;
-      break;
+    if (mem_avail_state_watermarks_[i] > AvailablePagesLocked()) {
+      return i;
     }
   }
+  return mem_avail_state_watermark_count_;
+}
+
+void PmmNode::UpdateMemAvailStateLocked() {
+  const uint8_t target = MemAvailStateTargetLocked();
+  // The per-cpu caches are bypassed in the OOM state, so hand their pages back to the free list
+  // where the allocations that are still allowed can get at them.
+  if (target == 0) {
+    ReclaimPageCachesLocked();
+  }
   SetMemAvailStateLocked(target);
 }
 
 void PmmNode::SetMemAvailStateLocked(uint8_t mem_avail_state) {
   mem_avail_state_cur_index_ = mem_avail_state;
+  UpdatePageCachesEnabledLocked();
 
   if (mem_avail_state_cur_index_ == 0) {
     free_pages_evt_.Unsignal();
@@ -678,7 +990,7 @@ uint64_t PmmNode::DebugNumPagesTillOomState() const {
   // we also need to clear the debounce amount. For simplicity we just always allocate the debounce
   // amount as well.
   uint64_t trigger = mem_avail_state_watermarks_[0] - mem_avail_state_debounce_;
-  return (free_count_ - trigger);
+  return (AvailablePagesLocked() - trigger);
 }
 
 static int pmm_node_request_loop(void* arg) {
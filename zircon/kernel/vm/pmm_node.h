@@ -9,8 +9,11 @@
 #include <fbl/canary.h>
 #include <fbl/intrusive_double_list.h>
 #include <fbl/mutex.h>
+#include <kernel/align.h>
 #include <kernel/event.h>
 #include <kernel/lockdep.h>
+#include <kernel/spinlock.h>
+#include <ktl/unique_ptr.h>
 #include <vm/pmm.h>
 #include <vm/pmm_checker.h>
 
@@ -99,19 +102,72 @@ class PmmNode {
   // For test and diagnostic purposes.
   PmmChecker* Checker() { return &checker_; }
 
+  // Set up a per-cpu cache of free pages in front of the free list. Each cache holds at most
+  // |capacity| pages and exchanges pages with the free list |capacity| / 2 at a time, so that most
+  // single page allocations and frees never touch |lock_|.
+  //
+  // Passing a |capacity| of less than two leaves the caches disabled. Should only be called once.
+  zx_status_t InitPageCaches(size_t capacity);
+
+  // Return every page held in the per-cpu caches to the free list.
+  void ReclaimPageCaches();
+
+  // Account for |count| allocated pages that a cache outside of the PMM is holding on to, and will
+  // give back under memory pressure, as free. See pmm_add_cached_pages.
+  void AddCachedPages(uint64_t count);
+  void RemoveCachedPages(uint64_t count);
+
  private:
+  // A per-cpu magazine of free pages.
+  //
+  // Pages sitting in a cache are kept in the VM_PAGE_STATE_ALLOC state so that they are invisible
+  // to the arenas' searches for free runs, and they are counted in |cached_count_| rather than
+  // |free_count_|. The caches are bypassed while the node is in the OOM state or while the free fill
+  // checker is enabled, and are reclaimed into the free list whenever the node would otherwise
+  // enter the OOM state.
+  struct PageCache {
+    DECLARE_SPINLOCK(PageCache) lock;
+    list_node list TA_GUARDED(lock) = LIST_INITIAL_VALUE(list);
+    uint64_t count TA_GUARDED(lock) = 0;
+  } __CPU_ALIGN;
+
+  // Returns true if the per-cpu caches may be used to satisfy an allocation with |alloc_flags|.
+  bool PageCachesUsable(uint alloc_flags) const;
+  PageCache* CurrentPageCache() const;
+
+  // Try to satisfy an allocation of |count| pages from the current cpu's cache, refilling it from
+  // the free list if needed. Returns false if the caller should fall back to the free list.
+  bool AllocPagesFromCache(size_t count, uint alloc_flags, list_node* list);
+  // Try to free |list| into the current cpu's cache. Any pages that did not fit are left in |list|.
+  void FreeListToCache(list_node* list);
+
+  // Move up to |count| pages from the head of the free list onto |list|. Returns the number moved.
+  size_t TakeFreePagesLocked(size_t count, list_node* list) TA_REQ(lock_);
+  // Returns true if any pages were moved back to the free list.
+  bool ReclaimPageCachesLocked() TA_REQ(lock_);
+  void UpdatePageCachesEnabledLocked() TA_REQ(lock_);
+
   void FreePageHelperLocked(vm_page* page) TA_REQ(lock_);
   void FreeListLocked(list_node* list) TA_REQ(lock_);
 
   void ProcessPendingRequests();
 
+  uint8_t MemAvailStateTargetLocked() const TA_REQ(lock_);
   void UpdateMemAvailStateLocked() TA_REQ(lock_);
   void SetMemAvailStateLocked(uint8_t mem_avail_state) TA_REQ(lock_);
 
+  // The number of pages the mem avail watermarks are compared against. Cached pages are counted
+  // as free, as they are given back before the node runs out of memory. Pages only move in and out
+  // of the caches without |lock_| while the caches are enabled, so a state change caused by them
+  // is noticed at the next change to |free_count_|.
+  uint64_t AvailablePagesLocked() const TA_REQ(lock_) {
+    return free_count_ + cached_count_.load(ktl::memory_order_relaxed);
+  }
+
   void IncrementFreeCountLocked(uint64_t amount) TA_REQ(lock_) {
     free_count_ += amount;
 
-    if (unlikely(free_count_ >= mem_avail_state_upper_bound_)) {
+    if (unlikely(AvailablePagesLocked() >= mem_avail_state_upper_bound_)) {
       UpdateMemAvailStateLocked();
     }
   }
@@ -119,7 +175,7 @@ class PmmNode {
     DEBUG_ASSERT(free_count_ >= amount);
     free_count_ -= amount;
 
-    if (unlikely(free_count_ <= mem_avail_state_lower_bound_)) {
+    if (unlikely(AvailablePagesLocked() <= mem_avail_state_lower_bound_)) {
       UpdateMemAvailStateLocked();
     }
   }
@@ -163,6 +219,18 @@ class PmmNode {
 
   bool free_fill_enabled_ TA_GUARDED(lock_) = false;
   PmmChecker checker_ TA_GUARDED(lock_);
+
+  // The per-cpu caches are set up once by |InitPageCaches| and never torn down until the node is
+  // destroyed, so they may be accessed without holding |lock_| once |page_caches_enabled_| has been
+  // observed to be true.
+  ktl::unique_ptr<PageCache[]> page_caches_;
+  size_t page_cache_count_ = 0;
+  size_t page_cache_capacity_ = 0;
+  size_t page_cache_batch_ = 0;
+  ktl::atomic<bool> page_caches_enabled_ = false;
+
+  // Pages held by the per-cpu caches, plus any pages added with |AddCachedPages|.
+  ktl::atomic<uint64_t> cached_count_ = 0;
 };
 
 // We don't need to hold the arena lock while executing this, since it is
@@ -6,14 +6,20 @@
 
 #include <lib/cmdline.h>
 #include <lib/console.h>
+#include <lib/counters.h>
+#include <platform.h>
 
 #include <kernel/event.h>
 #include <kernel/thread.h>
 #include <lk/init.h>
+#include <vm/compressed_store.h>
+#include <vm/dedup_store.h>
+#include <vm/pmm.h>
 #include <vm/scanner.h>
 #include <vm/vm.h>
 #include <vm/vm_aspace.h>
 #include <vm/vm_object.h>
+#include <vm/vm_object_paged.h>
 
 namespace {
 
@@ -22,6 +28,18 @@ static constexpr uint32_t kScannerOpDisable = 1u << 1;
 static constexpr uint32_t kScannerOpEnable = 1u << 2;
 static constexpr uint32_t kScannerOpDump = 1u << 3;
 static constexpr uint32_t kScannerOpReclaimAll = 1u << 4;
+static constexpr uint32_t kScannerOpEvict = 1u << 5;
+
+// How often accessed bits are harvested and the pager backed page queues are aged by one
+// generation.
+constexpr zx_duration_t kPageAgingPeriod = ZX_SEC(10);
+
+// Pages in generations newer than this are never evicted, so that the working set of the last
+// aging period survives even under memory pressure.
+constexpr size_t kEvictionLowestQueue = 1;
+
+KCOUNTER(scanner_aging_rotations, "vm.scanner.aging_rotations")
+KCOUNTER(scanner_pager_backed_evicted, "vm.scanner.pager_backed_evicted")
 
 // Tracks what the scanner should do when it is next woken up.
 ktl::atomic<uint32_t> scanner_operation = 0;
@@ -29,6 +47,12 @@ ktl::atomic<uint32_t> scanner_operation = 0;
 // Event to signal the scanner thread to wake up and perform work.
 Event scanner_request_event{EVENT_FLAG_AUTOUNSIGNAL};
 
+// Amount of free memory, in bytes, that a pending kScannerOpEvict should try to reach.
+ktl::atomic<uint64_t> scanner_evict_free_target = 0;
+
+// Whether pager backed pages may be evicted at all. Set once during init.
+bool scanner_eviction_enabled = false;
+
 // Event that is signaled whenever the scanner is disabled. This is used to synchronize disable
 // requests with the scanner thread.
 Event scanner_disabled_event{0};
@@ -40,19 +64,91 @@ void scanner_print_stats() {
   printf("[SCAN]: Found %lu zero pages that could be de-duped\n", zero_pages);
   PageQueues::Counts queue_counts = pmm_page_queues()->DebugQueueCounts();
   printf("[SCAN]: Found %lu user-paged backed pages\n", queue_counts.pager_backed);
+  CompressedStoreStats compressed = compressed_store_get_stats();
+  printf("[SCAN]: Holding %lu compressed pages in %lu of %lu budgeted bytes\n",
+         compressed.stored_pages, compressed.stored_bytes, compressed.budget_bytes);
+  DedupStoreStats dedup = DedupStore::Get()->GetStats();
+  printf("[SCAN]: Sharing %lu de-duped pages between %lu references\n", dedup.shared_pages,
+         dedup.references);
+}
+
+void scanner_do_aging() {
+  VmObject::HarvestAllAccessedBits();
+  pmm_page_queues()->RotatePagerBackedQueues();
+  scanner_aging_rotations.Add(1);
+}
+
+uint64_t scanner_evict_pager_backed(uint64_t free_target_pages) {
+  if (!scanner_eviction_enabled) {
+    return 0;
+  }
+  uint64_t evicted = 0;
+  while (pmm_count_free_pages() < free_target_pages) {
+    PageQueues::VmoBacklink backlink;
+    if (!pmm_page_queues()->PeekPagerBacked(kEvictionLowestQueue, &backlink)) {
+      break;
+    }
+    // Eviction only fails if the page was pinned, dirtied or removed since we peeked it, all of
+    // which also take it out of the pager backed queue, so the next peek makes progress.
+    if (backlink.vmo->EvictPage(backlink.page, backlink.offset)) {
+      evicted++;
+    }
+  }
+  scanner_pager_backed_evicted.Add(evicted);
+  return evicted;
+}
+
+uint64_t scanner_dedup_anonymous(uint64_t free_target_pages) {
+  if (pmm_count_free_pages() >= free_target_pages) {
+    return 0;
+  }
+  return VmObject::DedupAllPages();
+}
+
+uint64_t scanner_compress_anonymous(uint64_t free_target_pages) {
+  const uint64_t free_pages = pmm_count_free_pages();
+  if (free_pages >= free_target_pages || !compressed_store_has_budget()) {
+    return 0;
+  }
+  // Only a single pass is made, as every pass treats whatever was not accessed since the previous
+  // one as cold and so repeating it immediately would compress the working set.
+  return VmObject::CompressAllColdPages(free_target_pages - free_pages);
+}
+
+void scanner_do_evict(bool print) {
+  const uint64_t free_target_pages = scanner_evict_free_target.load() / PAGE_SIZE;
+  // Evicted pages can be recreated by their pager for free, so prefer them over anything done to
+  // anonymous pages. Of those, de-duped pages only cost a copy if they are written again, whereas
+  // compressed pages cost CPU on both the way out and the way back in.
+  const uint64_t evicted = scanner_evict_pager_backed(free_target_pages);
+  const uint64_t deduped = scanner_dedup_anonymous(free_target_pages);
+  const uint64_t compressed = scanner_compress_anonymous(free_target_pages);
+  if (print) {
+    printf("[SCAN]: Evicted %lu user-pager backed pages\n", evicted);
+    printf("[SCAN]: Freed %lu anonymous pages by de-duping them\n", deduped);
+    printf("[SCAN]: Compressed %lu anonymous pages\n", compressed);
+  }
 }
 
 void scanner_do_reclaim(bool print) {
   uint64_t zero_pages = VmObject::ScanAllForZeroPages(true);
+  // Zero pages are left to the zero page scan above, so this finds everything else.
+  uint64_t deduped = VmObject::DedupAllPages();
   if (print) {
     printf("[SCAN]: Found %lu zero pages that were de-duped\n", zero_pages);
+    printf("[SCAN]: Freed %lu anonymous pages by de-duping them\n", deduped);
   }
 }
 
 int scanner_request_thread(void *) {
   bool disabled = false;
+  zx_time_t next_aging = current_time() + kPageAgingPeriod;
   while (1) {
-    scanner_request_event.Wait(Deadline::infinite());
+    if (disabled) {
+      scanner_request_event.Wait(Deadline::infinite());
+    } else {
+      scanner_request_event.Wait(Deadline::no_slack(next_aging));
+    }
     uint32_t op = scanner_operation.exchange(0);
     // It is possible for enable and disable to happen at the same time. This indicates the disabled
     // count went from 1->0->1 and so we want to remain disabled. We do this by performing the
@@ -72,11 +168,19 @@ int scanner_request_thread(void *) {
       scanner_operation.fetch_or(op);
       continue;
     }
+    if (current_time() >= next_aging) {
+      scanner_do_aging();
+      next_aging = current_time() + kPageAgingPeriod;
+    }
     bool print = false;
     if (op & kScannerFlagPrint) {
       op &= ~kScannerFlagPrint;
       print = true;
     }
+    if (op & kScannerOpEvict) {
+      op &= ~kScannerOpEvict;
+      scanner_do_evict(print);
+    }
     if (op & kScannerOpReclaimAll) {
       op &= ~kScannerOpReclaimAll;
       scanner_do_reclaim(print);
@@ -113,6 +217,12 @@ void scanner_push_disable_count() {
   scanner_disabled_event.Wait(Deadline::infinite());
 }
 
+void scanner_trigger_evict(uint64_t free_mem_target) {
+  scanner_evict_free_target = free_mem_target;
+  scanner_operation.fetch_or(kScannerOpEvict);
+  scanner_request_event.Signal();
+}
+
 void scanner_pop_disable_count() {
   Guard<Mutex> guard{scanner_disabled_lock::Get()};
   DEBUG_ASSERT(scanner_disable_count > 0);
@@ -125,10 +235,13 @@ void scanner_pop_disable_count() {
 }
 
 static void scanner_init_func(uint level) {
+  scanner_eviction_enabled = gCmdline.GetBool("kernel.page-scanner.enable-eviction", true);
   Thread *thread =
       Thread::Create("scanner-request-thread", scanner_request_thread, nullptr, LOW_PRIORITY);
   DEBUG_ASSERT(thread);
-  if (!gCmdline.GetBool("kernel.page-scanner.start-at-boot", false)) {
+  // The scanner is what ages and evicts pager backed pages under memory pressure, so it runs by
+  // default.
+  if (!gCmdline.GetBool("kernel.page-scanner.start-at-boot", true)) {
     Guard<Mutex> guard{scanner_disabled_lock::Get()};
     scanner_disable_count++;
     scanner_operation.fetch_or(kScannerOpDisable);
@@ -148,6 +261,7 @@ static int cmd_scanner(int argc, const cmd_args *argv, uint32_t flags) {
     printf("%s push_disable : increase scanner disable count\n", argv[0].str);
     printf("%s pop_disable  : decrease scanner disable count\n", argv[0].str);
     printf("%s reclaim_all  : attempt to reclaim all possible memory\n", argv[0].str);
+    printf("%s evict <MB>   : evict, de-dupe or compress pages until <MB> are free\n", argv[0].str);
     return ZX_ERR_INTERNAL;
   }
   if (!strcmp(argv[1].str, "dump")) {
@@ -159,6 +273,13 @@ static int cmd_scanner(int argc, const cmd_args *argv, uint32_t flags) {
   } else if (!strcmp(argv[1].str, "reclaim_all")) {
     scanner_operation.fetch_or(kScannerOpReclaimAll | kScannerFlagPrint);
     scanner_request_event.Signal();
+  } else if (!strcmp(argv[1].str, "evict")) {
+    if (argc < 3) {
+      goto usage;
+    }
+    scanner_evict_free_target = argv[2].u * MB;
+    scanner_operation.fetch_or(kScannerOpEvict | kScannerFlagPrint);
+    scanner_request_event.Signal();
   } else {
     printf("unknown command\n");
     goto usage;
@@ -594,6 +594,7 @@ void VmAspace::Dump(bool verbose) const {
   Guard<fbl::Mutex> guard{&lock_};
 
   if (verbose) {
+    printf("  fault-around pages %zu\n", fault_around_pages_);
     root_vmar_->Dump(1, verbose);
   }
 }
@@ -639,6 +640,13 @@ size_t VmAspace::AllocatedPages() const {
   return root_vmar_->AllocatedPagesLocked();
 }
 
+size_t VmAspace::FaultAroundPages() const {
+  canary_.Assert();
+
+  Guard<fbl::Mutex> guard{&lock_};
+  return fault_around_pages_;
+}
+
 void VmAspace::InitializeAslr() {
   aslr_enabled_ = is_user() && !gCmdline.GetBool("aslr.disable", false);
 
@@ -6,11 +6,13 @@
 #include <assert.h>
 #include <err.h>
 #include <inttypes.h>
+#include <lib/counters.h>
 #include <trace.h>
 #include <zircon/types.h>
 
 #include <fbl/alloc_checker.h>
 #include <fbl/auto_call.h>
+#include <ktl/algorithm.h>
 #include <ktl/move.h>
 #include <vm/fault.h>
 #include <vm/vm.h>
@@ -22,6 +24,23 @@
 
 #define LOCAL_TRACE VM_GLOBAL_TRACE(0)
 
+namespace {
+
+// Size of the large pages that write faults on anonymous memory try to install.
+// Both x86 (PD level) and arm64 with 4KB granules (L2 block) support this size.
+constexpr size_t kLargePageSize = 512 * PAGE_SIZE;
+
+// Bounds of the fault-around window, in pages, including the faulting page. The window starts at
+// the minimum and doubles on every fault that continues a sequential scan.
+constexpr size_t kFaultAroundMinPages = 4;
+constexpr size_t kFaultAroundMaxPages = 64;
+
+KCOUNTER(vm_mapping_large_page_promoted, "vm.mapping.large_page.promoted")
+KCOUNTER(vm_mapping_large_page_demoted, "vm.mapping.large_page.demoted")
+KCOUNTER(vm_mapping_fault_around_pages, "vm.mapping.fault_around.pages")
+
+}  // namespace
+
 VmMapping::VmMapping(VmAddressRegion& parent, vaddr_t base, size_t size, uint32_t vmar_flags,
                      fbl::RefPtr<VmObject> vmo, uint64_t vmo_offset, uint arch_mmu_flags)
     : VmAddressRegionOrMapping(base, size, vmar_flags, parent.aspace_.get(), &parent),
@@ -100,9 +119,13 @@ zx_status_t VmMapping::Protect(vaddr_t base, size_t size, uint new_arch_mmu_flag
 namespace {
 
 // Implementation helper for ProtectLocked
+// |grant_write| says whether pages that are already mapped may be given write permission directly.
 zx_status_t ProtectOrUnmap(const fbl::RefPtr<VmAspace>& aspace, vaddr_t base, size_t size,
-                           uint new_arch_mmu_flags) {
+                           uint new_arch_mmu_flags, bool grant_write) {
   if (new_arch_mmu_flags & ARCH_MMU_FLAG_PERM_RWX_MASK) {
+    if (!grant_write) {
+      new_arch_mmu_flags &= ~ARCH_MMU_FLAG_PERM_WRITE;
+    }
     return aspace->arch_aspace().Protect(base, size / PAGE_SIZE, new_arch_mmu_flags);
   } else {
     return aspace->arch_aspace().Unmap(base, size / PAGE_SIZE, nullptr);
@@ -125,6 +148,11 @@ zx_status_t VmMapping::ProtectLocked(vaddr_t base, size_t size, uint new_arch_mm
   }
 
   DEBUG_ASSERT(object_);
+  // A paged VMO may have the zero page or copy-on-write pages mapped read-only even in a writable
+  // mapping, and its pager-backed pages only become writable once a write fault has marked them
+  // dirty, so write permission for those has to be granted through the fault path.
+  const bool grant_write = !object_->is_paged();
+
   // grab the lock for the vmo
   Guard<fbl::Mutex> guard{object_->lock()};
 
@@ -140,7 +168,8 @@ zx_status_t VmMapping::ProtectLocked(vaddr_t base, size_t size, uint new_arch_mm
 
   // If we're changing the whole mapping, just make the change.
   if (base_ == base && size_ == size) {
-    zx_status_t status = ProtectOrUnmap(aspace_, base, size, new_arch_mmu_flags);
+    CountLargePageDemotions(base, size);
+    zx_status_t status = ProtectOrUnmap(aspace_, base, size, new_arch_mmu_flags, grant_write);
     LTRACEF("arch_mmu_protect returns %d\n", status);
     arch_mmu_flags_ = new_arch_mmu_flags;
     return ZX_OK;
@@ -157,7 +186,8 @@ zx_status_t VmMapping::ProtectLocked(vaddr_t base, size_t size, uint new_arch_mm
       return ZX_ERR_NO_MEMORY;
     }
 
-    zx_status_t status = ProtectOrUnmap(aspace_, base, size, new_arch_mmu_flags);
+    CountLargePageDemotions(base, size);
+    zx_status_t status = ProtectOrUnmap(aspace_, base, size, new_arch_mmu_flags, grant_write);
     LTRACEF("arch_mmu_protect returns %d\n", status);
     arch_mmu_flags_ = new_arch_mmu_flags;
 
@@ -177,7 +207,8 @@ zx_status_t VmMapping::ProtectLocked(vaddr_t base, size_t size, uint new_arch_mm
       return ZX_ERR_NO_MEMORY;
     }
 
-    zx_status_t status = ProtectOrUnmap(aspace_, base, size, new_arch_mmu_flags);
+    CountLargePageDemotions(base, size);
+    zx_status_t status = ProtectOrUnmap(aspace_, base, size, new_arch_mmu_flags, grant_write);
     LTRACEF("arch_mmu_protect returns %d\n", status);
 
     size_ -= size;
@@ -203,7 +234,8 @@ zx_status_t VmMapping::ProtectLocked(vaddr_t base, size_t size, uint new_arch_mm
     return ZX_ERR_NO_MEMORY;
   }
 
-  zx_status_t status = ProtectOrUnmap(aspace_, base, size, new_arch_mmu_flags);
+  CountLargePageDemotions(base, size);
+  zx_status_t status = ProtectOrUnmap(aspace_, base, size, new_arch_mmu_flags, grant_write);
   LTRACEF("arch_mmu_protect returns %d\n", status);
 
   // Turn us into the left half
@@ -269,6 +301,7 @@ zx_status_t VmMapping::UnmapLocked(vaddr_t base, size_t size) {
   // Check if unmapping from one of the ends
   if (base_ == base || base + size == base_ + size_) {
     LTRACEF("unmapping base %#lx size %#zx\n", base, size);
+    CountLargePageDemotions(base, size);
     zx_status_t status = aspace_->arch_aspace().Unmap(base, size / PAGE_SIZE, nullptr);
     if (status != ZX_OK) {
       return status;
@@ -303,6 +336,7 @@ zx_status_t VmMapping::UnmapLocked(vaddr_t base, size_t size) {
 
   // Unmap the middle segment
   LTRACEF("unmapping base %#lx size %#zx\n", base, size);
+  CountLargePageDemotions(base, size);
   zx_status_t status = aspace_->arch_aspace().Unmap(base, size / PAGE_SIZE, nullptr);
   if (status != ZX_OK) {
     return status;
@@ -387,6 +421,7 @@ zx_status_t VmMapping::UnmapVmoRangeLocked(uint64_t offset, uint64_t len) const
     return ZX_OK;
   }
 
+  CountLargePageDemotions(base, new_len);
   return aspace_->arch_aspace().Unmap(base, new_len / PAGE_SIZE, nullptr);
 }
 
@@ -423,14 +458,29 @@ zx_status_t VmMapping::RemoveWriteVmoRangeLocked(uint64_t offset, uint64_t len)
   // Build new mmu flags without writing.
   uint mmu_flags = arch_mmu_flags() & ~(ARCH_MMU_FLAG_PERM_WRITE);
 
-  return ProtectOrUnmap(aspace_, base, new_len, mmu_flags);
+  CountLargePageDemotions(base, new_len);
+  return ProtectOrUnmap(aspace_, base, new_len, mmu_flags, false);
+}
+
+void VmMapping::HarvestAccessedBitsLocked(const ArchVmAspace::HarvestCallback& accessed_fn) const {
+  canary_.Assert();
+
+  // Same locking requirements as UnmapVmoRangeLocked.
+  DEBUG_ASSERT(state_ == LifeCycleState::ALIVE);
+  DEBUG_ASSERT(object_->lock()->lock().IsHeld());
+
+  zx_status_t status =
+      aspace_->arch_aspace().HarvestAccessed(base_, size_ / PAGE_SIZE, accessed_fn);
+  if (status != ZX_OK) {
+    LTRACEF("failed to harvest accessed bits of %p: %d\n", this, status);
+  }
 }
 
 namespace {
 
 class VmMappingCoalescer {
  public:
-  VmMappingCoalescer(VmMapping* mapping, vaddr_t base);
+  VmMappingCoalescer(VmMapping* mapping, vaddr_t base, uint mmu_flags);
   ~VmMappingCoalescer();
 
   // Add a page to the mapping run.  If this fails, the VmMappingCoalescer is
@@ -463,13 +513,14 @@ class VmMappingCoalescer {
 
   VmMapping* mapping_;
   vaddr_t base_;
+  uint mmu_flags_;
   paddr_t phys_[16];
   size_t count_;
   bool aborted_;
 };
 
-VmMappingCoalescer::VmMappingCoalescer(VmMapping* mapping, vaddr_t base)
-    : mapping_(mapping), base_(base), count_(0), aborted_(false) {}
+VmMappingCoalescer::VmMappingCoalescer(VmMapping* mapping, vaddr_t base, uint mmu_flags)
+    : mapping_(mapping), base_(base), mmu_flags_(mmu_flags), count_(0), aborted_(false) {}
 
 VmMappingCoalescer::~VmMappingCoalescer() {
   // Make sure we've flushed or aborted
@@ -481,10 +532,10 @@ zx_status_t VmMappingCoalescer::Flush() {
     return ZX_OK;
   }
 
-  uint flags = mapping_->arch_mmu_flags();
-  if (flags & ARCH_MMU_FLAG_PERM_RWX_MASK) {
+  if (mmu_flags_ & ARCH_MMU_FLAG_PERM_RWX_MASK) {
     size_t mapped;
-    zx_status_t ret = mapping_->aspace()->arch_aspace().Map(base_, phys_, count_, flags, &mapped);
+    zx_status_t ret =
+        mapping_->aspace()->arch_aspace().Map(base_, phys_, count_, mmu_flags_, &mapped);
     if (ret != ZX_OK) {
       TRACEF("error %d mapping %zu pages starting at va %#" PRIxPTR "\n", ret, count_, base_);
       aborted_ = true;
@@ -520,11 +571,17 @@ zx_status_t VmMapping::MapRange(size_t offset, size_t len, bool commit) {
   }
 
   // precompute the flags we'll pass GetPageLocked
+  // Pages of a pager-backed VMO are mapped read-only and without asking for write, so that they are
+  // only marked dirty by a real write fault. Everything else is looked up as if written to so that
+  // committing allocates real pages.
   // if committing, then tell it to soft fault in a page
-  uint pf_flags = VMM_PF_FLAG_WRITE;
+  const bool pager_backed = object_->is_pager_backed();
+  uint pf_flags = pager_backed ? 0 : VMM_PF_FLAG_WRITE;
   if (commit) {
     pf_flags |= VMM_PF_FLAG_SW_FAULT;
   }
+  const uint mmu_flags =
+      pager_backed ? (arch_mmu_flags_ & ~ARCH_MMU_FLAG_PERM_WRITE) : arch_mmu_flags_;
 
   // grab the lock for the vmo
   Guard<fbl::Mutex> object_guard{object_->lock()};
@@ -537,7 +594,7 @@ zx_status_t VmMapping::MapRange(size_t offset, size_t len, bool commit) {
   // iterate through the range, grabbing a page from the underlying object and
   // mapping it in
   size_t o;
-  VmMappingCoalescer coalescer(this, base_ + offset);
+  VmMappingCoalescer coalescer(this, base_ + offset, mmu_flags);
   for (o = offset; o < offset + len; o += PAGE_SIZE) {
     uint64_t vmo_offset = object_offset_ + o;
 
@@ -678,6 +735,43 @@ zx_status_t VmMapping::PageFault(vaddr_t va, const uint pf_flags, PageRequest* p
   currently_faulting_ = true;
   auto ac = fbl::MakeAutoCall([&]() { currently_faulting_ = false; });
 
+  // On a write fault, try to back the whole surrounding large page with a physically contiguous
+  // run and map it with a single entry. This only succeeds if the large page lies entirely within
+  // the mapping, is equally aligned in the vmo, and none of it is committed yet. Later COW,
+  // decommit, unmap or protect operations covering part of the range demote the entry back to
+  // small pages in the arch layer.
+  if (pf_flags & VMM_PF_FLAG_WRITE) {
+    const vaddr_t large_va = ROUNDDOWN(va, kLargePageSize);
+    const uint64_t large_offset = large_va - base_ + object_offset_;
+    if (large_va >= base_ && large_va + kLargePageSize - 1 <= base_ + size_ - 1 &&
+        IS_ALIGNED(large_offset, kLargePageSize)) {
+      const size_t count = kLargePageSize / PAGE_SIZE;
+      paddr_t large_pa;
+      if (object_->CommitContiguousRunLocked(large_offset, count, &large_pa) == ZX_OK) {
+        // The range had no committed pages, so at most read-only zero page mappings can be in the
+        // way. Clear them before installing the large page.
+        zx_status_t status = aspace_->arch_aspace().Unmap(large_va, count, nullptr);
+        size_t mapped = 0;
+        if (status == ZX_OK) {
+          status = aspace_->arch_aspace().MapContiguous(large_va, large_pa, count,
+                                                        arch_mmu_flags_, &mapped);
+        }
+        if (status == ZX_OK) {
+          DEBUG_ASSERT(mapped == count);
+          vm_mapping_large_page_promoted.Add(1);
+#if ARCH_ARM64
+          if (!(pf_flags & VMM_PF_FLAG_GUEST) && (arch_mmu_flags_ & ARCH_MMU_FLAG_PERM_EXECUTE)) {
+            arch_sync_cache_range(large_va, kLargePageSize);
+          }
+#endif
+          return ZX_OK;
+        }
+        // The pages are committed now, so the regular path below maps the faulting one.
+        LTRACEF("failed to map large page at va %#" PRIxPTR ": %d\n", large_va, status);
+      }
+    }
+  }
+
   // fault in or grab an existing page
   paddr_t new_pa;
   vm_page_t* page;
@@ -712,13 +806,15 @@ zx_status_t VmMapping::PageFault(vaddr_t va, const uint pf_flags, PageRequest* p
       // test that the page is already mapped with either the region's mmu flags
       // or the flags that we're about to try to switch it to, which may be read-only
       if (page_flags == arch_mmu_flags_ || page_flags == mmu_flags) {
-        return ZX_OK;
+        // This may have been an access flag fault on a page whose accessed state was harvested.
+        return aspace_->arch_aspace().MarkAccessed(va, 1);
       }
 
       // assert that we're not accidentally marking the zero page writable
       DEBUG_ASSERT((pa != vm_get_zero_page_paddr()) || !(mmu_flags & ARCH_MMU_FLAG_PERM_WRITE));
 
       // same page, different permission
+      CountLargePageDemotions(va, PAGE_SIZE);
       status = aspace_->arch_aspace().Protect(va, 1, mmu_flags);
       if (status != ZX_OK) {
         TRACEF("failed to modify permissions on existing mapping\n");
@@ -734,6 +830,7 @@ zx_status_t VmMapping::PageFault(vaddr_t va, const uint pf_flags, PageRequest* p
       DEBUG_ASSERT((new_pa != vm_get_zero_page_paddr()) || !(mmu_flags & ARCH_MMU_FLAG_PERM_WRITE));
 
       // unmap the old one and put the new one in place
+      CountLargePageDemotions(va, PAGE_SIZE);
       status = aspace_->arch_aspace().Unmap(va, 1, nullptr);
       if (status != ZX_OK) {
         TRACEF("failed to remove old mapping before replacing\n");
@@ -767,6 +864,10 @@ zx_status_t VmMapping::PageFault(vaddr_t va, const uint pf_flags, PageRequest* p
     DEBUG_ASSERT(mapped == 1);
   }
 
+  if (!(pf_flags & (VMM_PF_FLAG_WRITE | VMM_PF_FLAG_GUEST))) {
+    FaultAroundLocked(va);
+  }
+
 // TODO: figure out what to do with this
 #if ARCH_ARM64
   if (pf_flags & VMM_PF_FLAG_GUEST) {
@@ -778,6 +879,89 @@ zx_status_t VmMapping::PageFault(vaddr_t va, const uint pf_flags, PageRequest* p
   return ZX_OK;
 }
 
+void VmMapping::CountLargePageDemotions(vaddr_t base, size_t size) const {
+  DEBUG_ASSERT(size > 0);
+
+  // Only the large pages holding the first and last byte of the range can be partly covered.
+  const vaddr_t first = ROUNDDOWN(base, kLargePageSize);
+  const vaddr_t last = ROUNDDOWN(base + size - 1, kLargePageSize);
+  vaddr_t partial[2];
+  size_t num_partial = 0;
+  if (base != first || (first == last && !IS_ALIGNED(base + size, kLargePageSize))) {
+    partial[num_partial++] = first;
+  }
+  if (last != first && !IS_ALIGNED(base + size, kLargePageSize)) {
+    partial[num_partial++] = last;
+  }
+
+  for (size_t i = 0; i < num_partial; i++) {
+    // Large pages are only ever installed entirely within a mapping.
+    const vaddr_t large_va = partial[i];
+    if (large_va < base_ || large_va + kLargePageSize - 1 > base_ + size_ - 1) {
+      continue;
+    }
+    size_t entry_size;
+    if (aspace_->arch_aspace().QueryEntrySize(large_va, &entry_size) == ZX_OK &&
+        entry_size > PAGE_SIZE) {
+      vm_mapping_large_page_demoted.Add(1);
+    }
+  }
+}
+
+void VmMapping::FaultAroundLocked(vaddr_t va) {
+  DEBUG_ASSERT(aspace_->lock()->lock().IsHeld());
+
+#if ARCH_ARM64
+  // Executable pages need their caches synchronized through the new mapping, which is left to the
+  // regular fault path.
+  if (arch_mmu_flags_ & ARCH_MMU_FLAG_PERM_EXECUTE) {
+    return;
+  }
+#endif
+
+  if (va == fault_around_next_va_) {
+    fault_around_pages_ = ktl::min(fault_around_pages_ * 2, kFaultAroundMaxPages);
+  } else {
+    fault_around_pages_ = kFaultAroundMinPages;
+  }
+
+  const size_t pages_left = (base_ + size_ - va) / PAGE_SIZE;
+  const vaddr_t end = va + ktl::min(fault_around_pages_, pages_left) * PAGE_SIZE;
+  fault_around_next_va_ = end;
+
+  // Map read-only, the same as the faulting page, so that writes still go through the fault path.
+  const uint mmu_flags = arch_mmu_flags_ & ~ARCH_MMU_FLAG_PERM_WRITE;
+
+  size_t mapped = 0;
+  VmMappingCoalescer coalescer(this, va + PAGE_SIZE, mmu_flags);
+  for (vaddr_t v = va + PAGE_SIZE; v < end; v += PAGE_SIZE) {
+    paddr_t pa;
+    uint page_flags;
+    if (aspace_->arch_aspace().Query(v, &pa, &page_flags) == ZX_OK) {
+      continue;
+    }
+    // Only map pages that this object already holds. Anything else costs work the faulting thread
+    // may never need, and neighbors that are mapped but never touched must not look accessed.
+    zx_status_t status = object_->LookupResidentPageLocked(v - base_ + object_offset_, &pa);
+    if (status != ZX_OK) {
+      continue;
+    }
+    if (coalescer.Append(v, pa) != ZX_OK) {
+      return;
+    }
+    mapped++;
+  }
+  if (coalescer.Flush() != ZX_OK) {
+    return;
+  }
+
+  if (mapped > 0) {
+    LTRACEF("mapped %zu pages around va %#" PRIxPTR "\n", mapped, va);
+    aspace_->fault_around_pages_ += mapped;
+    vm_mapping_fault_around_pages.Add(mapped);
+  }
+}
+
 void VmMapping::ActivateLocked() {
   DEBUG_ASSERT(state_ == LifeCycleState::NOT_READY);
   DEBUG_ASSERT(aspace_->lock()->lock().IsHeld());
@@ -19,6 +19,7 @@
 #include <fbl/ref_ptr.h>
 #include <ktl/algorithm.h>
 #include <ktl/move.h>
+#include <vm/dedup_store.h>
 #include <vm/physmap.h>
 #include <vm/vm.h>
 #include <vm/vm_address_region.h>
@@ -55,6 +56,39 @@ uint32_t VmObject::ScanAllForZeroPages(bool reclaim) {
   return count;
 }
 
+void VmObject::HarvestAllAccessedBits() {
+  Guard<Mutex> guard{AllVmosLock::Get()};
+
+  for (auto& vmo : all_vmos_) {
+    vmo.HarvestAccessedBits();
+  }
+}
+
+uint64_t VmObject::CompressAllColdPages(uint64_t max_pages) {
+  uint64_t count = 0;
+  Guard<Mutex> guard{AllVmosLock::Get()};
+
+  for (auto& vmo : all_vmos_) {
+    if (count >= max_pages) {
+      break;
+    }
+    count += vmo.CompressColdPages(max_pages - count);
+  }
+  return count;
+}
+
+uint64_t VmObject::DedupAllPages() {
+  uint64_t count = 0;
+  Guard<Mutex> guard{AllVmosLock::Get()};
+
+  DedupStore* store = DedupStore::Get();
+  store->BeginScan();
+  for (auto& vmo : all_vmos_) {
+    count += vmo.DedupPages(store);
+  }
+  return count;
+}
+
 void VmObject::AddToGlobalList() {
   Guard<Mutex> guard{AllVmosLock::Get()};
   all_vmos_.push_back(this);
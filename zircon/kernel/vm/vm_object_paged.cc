@@ -9,6 +9,7 @@
 #include <err.h>
 #include <inttypes.h>
 #include <lib/console.h>
+#include <pow2.h>
 #include <stdlib.h>
 #include <string.h>
 #include <trace.h>
@@ -19,9 +20,12 @@
 #include <fbl/auto_call.h>
 #include <ktl/move.h>
 #include <vm/bootreserve.h>
+#include <vm/compressed_store.h>
+#include <vm/dedup_store.h>
 #include <vm/fault.h>
 #include <vm/page_source.h>
 #include <vm/physmap.h>
+#include <vm/pmm.h>
 #include <vm/vm.h>
 #include <vm/vm_address_region.h>
 
@@ -31,6 +35,12 @@
 
 namespace {
 
+// Number of CommitContiguousRunLocked() calls on an object that are skipped after one fails to
+// find a free run. Physical memory stays fragmented for a while, so retrying on every fault only
+// burns time searching the arenas under the pmm lock. The count is per object so that one object
+// faulting in a fragmented region does not keep the others from trying.
+constexpr uint32_t kContiguousRunBackoff = 64;
+
 void ZeroPage(paddr_t pa) {
   void* ptr = paddr_to_physmap(pa);
   DEBUG_ASSERT(ptr);
@@ -58,6 +68,9 @@ void InitializeVmPage(vm_page_t* p) {
   p->object.pin_count = 0;
   p->object.cow_left_split = 0;
   p->object.cow_right_split = 0;
+  p->object.dirty = 0;
+  p->object.accessed = 0;
+  p->object.dedup_accessed = 0;
 }
 
 // Allocates a new page and populates it with the data at |parent_paddr|.
@@ -176,6 +189,10 @@ VmObjectPaged::~VmObjectPaged() {
   list_initialize(&list);
 
   // free all of the pages attached to us
+  {
+    Guard<fbl::Mutex> guard{&lock_};
+    RemovePagesFromQueuesLocked(0, MAX_SIZE);
+  }
   page_list_.RemoveAllPages(&list);
 
   if (page_source_) {
@@ -231,6 +248,9 @@ uint32_t VmObjectPaged::ScanForZeroPages(bool reclaim) {
         // page.
         AssertHeld(this->lock_);
         RangeChangeUpdateLocked(off, PAGE_SIZE, RangeChangeOp::Unmap);
+        if (page_source_) {
+          pmm_page_queues()->Remove(p.Page());
+        }
         list_add_tail(&free_list, &p.ReleasePage()->queue_node);
         p = VmPageOrMarker::Marker();
       }
@@ -527,6 +547,11 @@ zx_status_t VmObjectPaged::CreateChildSlice(uint64_t offset, uint64_t size, bool
     if (cache_policy_ != ARCH_MMU_FLAG_CACHED && !is_contiguous()) {
       return ZX_ERR_BAD_STATE;
     }
+    // Children access our pages directly, which is not supported for compressed or shared pages.
+    status = UnpackForCloneLocked();
+    if (status != ZX_OK) {
+      return status;
+    }
     vmo->cache_policy_ = cache_policy_;
     vmo->parent_offset_ = offset;
     vmo->parent_limit_ = size;
@@ -637,6 +662,12 @@ zx_status_t VmObjectPaged::CreateClone(Resizability resizable, CloneType type, u
       return ZX_ERR_BAD_STATE;
     }
 
+    // Children access our pages directly, which is not supported for compressed or shared pages.
+    status = UnpackForCloneLocked();
+    if (status != ZX_OK) {
+      return status;
+    }
+
     // TODO: ZX-692 make sure that the accumulated parent offset of the entire
     // parent chain doesn't wrap 64bit space.
     vmo->parent_offset_ = offset;
@@ -995,9 +1026,15 @@ void VmObjectPaged::Dump(uint depth, bool verbose) {
   Guard<fbl::Mutex> guard{&lock_};
 
   size_t count = 0;
-  page_list_.ForEveryPage([&count](const auto& p, uint64_t) {
+  size_t compressed_count = 0;
+  size_t shared_count = 0;
+  page_list_.ForEveryPage([&count, &compressed_count, &shared_count](const auto& p, uint64_t) {
     if (p.IsPage()) {
       count++;
+    } else if (p.IsCompressed()) {
+      compressed_count++;
+    } else if (p.IsShared()) {
+      shared_count++;
     }
     return ZX_ERR_NEXT;
   });
@@ -1006,9 +1043,9 @@ void VmObjectPaged::Dump(uint depth, bool verbose) {
     printf("  ");
   }
   printf("vmo %p/k%" PRIu64 " size %#" PRIx64 " offset %#" PRIx64 " limit %#" PRIx64
-         " pages %zu ref %d parent %p/k%" PRIu64 "\n",
-         this, user_id_, size_, parent_offset_, parent_limit_, count, ref_count_debug(),
-         parent_.get(), parent_id);
+         " pages %zu compressed %zu shared %zu ref %d parent %p/k%" PRIu64 "\n",
+         this, user_id_, size_, parent_offset_, parent_limit_, count, compressed_count,
+         shared_count, ref_count_debug(), parent_.get(), parent_id);
 
   if (verbose) {
     auto f = [depth](const auto& p, uint64_t offset) {
@@ -1017,6 +1054,11 @@ void VmObjectPaged::Dump(uint depth, bool verbose) {
       }
       if (p.IsMarker()) {
         printf("offset %#" PRIx64 " zero page marker\n", offset);
+      } else if (p.IsCompressed()) {
+        printf("offset %#" PRIx64 " compressed %p\n", offset, p.Compressed());
+      } else if (p.IsShared()) {
+        printf("offset %#" PRIx64 " shared page %p paddr %#" PRIxPTR "\n", offset,
+               dedup_store_page(p.Shared()), dedup_store_page(p.Shared())->paddr());
       } else {
         printf("offset %#" PRIx64 " page %p paddr %#" PRIxPTR "\n", offset, p.Page(),
                p.Page()->paddr());
@@ -1046,7 +1088,9 @@ size_t VmObjectPaged::AttributedPagesInRangeLocked(uint64_t offset, uint64_t len
   // TODO: Decide who pages should actually be attribtued to.
   page_list_.ForEveryPageAndGapInRange(
       [&count](const auto& p, uint64_t off) {
-        if (p.IsPage()) {
+        // Compressed and shared pages are still committed content of this object, even though they
+        // currently occupy less than a page of their own.
+        if (p.IsPage() || p.IsCompressed() || p.IsShared()) {
           count++;
         }
         return ZX_ERR_NEXT;
@@ -1679,10 +1723,44 @@ zx_status_t VmObjectPaged::GetPageLocked(uint64_t offset, uint pf_flags, list_no
   {
     // see if we already have a page at that offset.
     VmPageOrMarker* p = page_list_.Lookup(offset);
+    if (p && p->IsCompressed()) {
+      zx_status_t status = DecompressPageLocked(p, free_list);
+      if (status != ZX_OK) {
+        return status;
+      }
+    }
+    if (p && p->IsShared()) {
+      if (pf_flags & VMM_PF_FLAG_WRITE) {
+        zx_status_t status = UnsharePageLocked(p, offset, free_list);
+        if (status != ZX_OK) {
+          return status;
+        }
+      } else {
+        // Like the zero page, the shared page is only ever handed out for reading.
+        vm_page_t* shared = dedup_store_page(p->Shared());
+        if (page_out) {
+          *page_out = shared;
+        }
+        if (pa_out) {
+          *pa_out = shared->paddr();
+        }
+        return ZX_OK;
+      }
+    }
     if (p) {
       if (p->IsMarker()) {
         is_marker = true;
       } else if (p->IsPage()) {
+        if (page_source_) {
+          if ((pf_flags & VMM_PF_FLAG_WRITE) && !p->Page()->object.dirty) {
+            MarkPageDirtyLocked(p->Page());
+          } else if (pf_flags & VMM_PF_FLAG_FAULT_MASK) {
+            pmm_page_queues()->MarkAccessed(p->Page());
+          }
+        } else if (pf_flags & VMM_PF_FLAG_FAULT_MASK) {
+          p->Page()->object.accessed = 1;
+          p->Page()->object.dedup_accessed = 1;
+        }
         if (page_out) {
           *page_out = p->Page();
         }
@@ -1800,6 +1878,108 @@ zx_status_t VmObjectPaged::GetPageLocked(uint64_t offset, uint pf_flags, list_no
   return ZX_OK;
 }
 
+zx_status_t VmObjectPaged::LookupResidentPageLocked(uint64_t offset, paddr_t* pa_out) {
+  canary_.Assert();
+  DEBUG_ASSERT(!is_hidden());
+
+  if (offset >= size_) {
+    return ZX_ERR_OUT_OF_RANGE;
+  }
+
+  offset = ROUNDDOWN(offset, PAGE_SIZE);
+
+  if (is_slice()) {
+    uint64_t parent_offset;
+    VmObjectPaged* parent = PagedParentOfSliceLocked(&parent_offset);
+    AssertHeld(parent->lock_);
+    return parent->LookupResidentPageLocked(offset + parent_offset, pa_out);
+  }
+
+  // Compressed and deduplicated slots need work before they can be mapped, and empty slots and
+  // markers have their content in a parent or not produced yet.
+  const VmPageOrMarker* p = page_list_.Lookup(offset);
+  if (!p || !p->IsPage()) {
+    return ZX_ERR_NOT_FOUND;
+  }
+  *pa_out = p->Page()->paddr();
+  return ZX_OK;
+}
+
+zx_status_t VmObjectPaged::CommitContiguousRunLocked(uint64_t offset, size_t count,
+                                                    paddr_t* pa_out) {
+  canary_.Assert();
+  DEBUG_ASSERT(count > 0 && ispow2(static_cast<uint>(count)));
+
+  const uint64_t len = count * PAGE_SIZE;
+  DEBUG_ASSERT(IS_ALIGNED(offset, len));
+
+  // Only anonymous, cached, unshared objects can have their pages allocated as a
+  // run. Anything with a parent or page source needs per-page content, and pages
+  // of contiguous objects were allocated at creation time.
+  if (is_slice() || is_hidden() || is_contiguous() || parent_ || page_source_ ||
+      cache_policy_ != ARCH_MMU_FLAG_CACHED) {
+    return ZX_ERR_NOT_SUPPORTED;
+  }
+  if (offset + len < offset || offset + len > size_) {
+    return ZX_ERR_OUT_OF_RANGE;
+  }
+
+  // Bail if anything, including markers, is already present in the range.
+  bool occupied = false;
+  page_list_.ForEveryPageInRange(
+      [&occupied](const auto&, uint64_t) {
+        occupied = true;
+        return ZX_ERR_STOP;
+      },
+      offset, offset + len);
+  if (occupied) {
+    return ZX_ERR_ALREADY_EXISTS;
+  }
+
+  if (contiguous_run_skip_ > 0) {
+    contiguous_run_skip_--;
+    return ZX_ERR_NO_RESOURCES;
+  }
+
+  // Large pages are only an optimization, so don't drain the per-cpu page caches to find a run.
+  list_node page_list = LIST_INITIAL_VALUE(page_list);
+  paddr_t pa;
+  zx_status_t status = pmm_alloc_contiguous(count, pmm_alloc_flags_ | PMM_ALLOC_FLAG_NO_RECLAIM,
+                                            static_cast<uint8_t>(log2_ulong_floor(len)), &pa,
+                                            &page_list);
+  if (status != ZX_OK) {
+    contiguous_run_skip_ = kContiguousRunBackoff;
+    return status;
+  }
+
+  // Make sure all the slots can be allocated before committing any pages.
+  for (uint64_t off = offset; off < offset + len; off += PAGE_SIZE) {
+    if (!page_list_.LookupOrAllocate(off)) {
+      pmm_free(&page_list);
+      return ZX_ERR_NO_MEMORY;
+    }
+  }
+
+  for (uint64_t off = offset; off < offset + len; off += PAGE_SIZE) {
+    vm_page_t* p = list_remove_head_type(&page_list, vm_page_t, queue_node);
+    DEBUG_ASSERT(p);
+
+    InitializeVmPage(p);
+    ZeroPage(p);
+
+    VmPageOrMarker* slot = page_list_.Lookup(off);
+    DEBUG_ASSERT(slot && slot->IsEmpty());
+    *slot = VmPageOrMarker::Page(p);
+  }
+  DEBUG_ASSERT(list_is_empty(&page_list));
+
+  // Other mappings may have the zero page mapped over this range.
+  RangeChangeUpdateLocked(offset, len, RangeChangeOp::Unmap);
+
+  *pa_out = pa;
+  return ZX_OK;
+}
+
 zx_status_t VmObjectPaged::CommitRange(uint64_t offset, uint64_t len) {
   canary_.Assert();
   LTRACEF("offset %#" PRIx64 ", len %#" PRIx64 "\n", offset, len);
@@ -2035,7 +2215,7 @@ zx_status_t VmObjectPaged::ZeroPartialPage(uint64_t page_base_offset, uint64_t z
     return ZX_OK;
   }
   // If we don't have a committed page we need to check our parent.
-  if (!slot || !slot->IsPage()) {
+  if (!slot || (!slot->IsPage() && !slot->IsCompressed() && !slot->IsShared())) {
     VmObject* page_owner;
     uint64_t owner_offset;
     if (!FindInitialPageContentLocked(page_base_offset, VMM_PF_FLAG_WRITE, &page_owner,
@@ -2211,7 +2391,14 @@ zx_status_t VmObjectPaged::ZeroRangeLocked(uint64_t offset, uint64_t len, list_n
     if (!SlotHasPinnedPage(slot) &&
         (!can_see_parent || (parent_immutable() && !parent_has_content()))) {
       if (slot && slot->IsPage()) {
+        if (page_source_) {
+          pmm_page_queues()->Remove(slot->Page());
+        }
         list_add_tail(free_list, &page_list_.RemovePage(offset).ReleasePage()->queue_node);
+      } else if (slot && slot->IsCompressed()) {
+        compressed_store_free(page_list_.RemovePage(offset).ReleaseCompressed());
+      } else if (slot && slot->IsShared()) {
+        dedup_store_release(page_list_.RemovePage(offset).ReleaseShared());
       }
       continue;
     }
@@ -2300,9 +2487,15 @@ zx_status_t VmObjectPaged::PinLocked(uint64_t offset, uint64_t len) {
   const uint64_t start_page_offset = ROUNDDOWN(offset, PAGE_SIZE);
   const uint64_t end_page_offset = ROUNDUP(offset + len, PAGE_SIZE);
 
+  zx_status_t status = UnpackRangeLocked(start_page_offset, end_page_offset - start_page_offset);
+  if (status != ZX_OK) {
+    return status;
+  }
+
+  const bool pager_backed = page_source_ != nullptr;
   uint64_t pin_range_end = start_page_offset;
-  zx_status_t status = page_list_.ForEveryPageAndGapInRange(
-      [&pin_range_end](const auto& page, uint64_t off) {
+  status = page_list_.ForEveryPageAndGapInRange(
+      [&pin_range_end, pager_backed](const auto& page, uint64_t off) {
         if (page.IsMarker()) {
           return ZX_ERR_NOT_FOUND;
         }
@@ -2313,6 +2506,12 @@ zx_status_t VmObjectPaged::PinLocked(uint64_t offset, uint64_t len) {
         }
 
         p->object.pin_count++;
+        if (pager_backed && p->object.pin_count == 1) {
+          // A device may write to the page while it is pinned, so it can never be handed back to
+          // the pager afterwards.
+          p->object.dirty = 1;
+          pmm_page_queues()->MoveToWired(p);
+        }
         pin_range_end = off + PAGE_SIZE;
         return ZX_ERR_NEXT;
       },
@@ -2357,8 +2556,9 @@ void VmObjectPaged::UnpinLocked(uint64_t offset, uint64_t len) {
   const uint64_t start_page_offset = ROUNDDOWN(offset, PAGE_SIZE);
   const uint64_t end_page_offset = ROUNDUP(offset + len, PAGE_SIZE);
 
+  const bool pager_backed = page_source_ != nullptr;
   zx_status_t status = page_list_.ForEveryPageAndGapInRange(
-      [](const auto& page, uint64_t off) {
+      [pager_backed](const auto& page, uint64_t off) {
         if (page.IsMarker()) {
           return ZX_ERR_NOT_FOUND;
         }
@@ -2366,6 +2566,10 @@ void VmObjectPaged::UnpinLocked(uint64_t offset, uint64_t len) {
         DEBUG_ASSERT(p->state() == VM_PAGE_STATE_OBJECT);
         ASSERT(p->object.pin_count > 0);
         p->object.pin_count--;
+        if (pager_backed && p->object.pin_count == 0) {
+          DEBUG_ASSERT(p->object.dirty);
+          pmm_page_queues()->MoveToUnswappable(p);
+        }
         return ZX_ERR_NEXT;
       },
       [](uint64_t gap_start, uint64_t gap_end) { return ZX_ERR_NOT_FOUND; }, start_page_offset,
@@ -2379,6 +2583,30 @@ void VmObjectPaged::UnpinLocked(uint64_t offset, uint64_t len) {
   return;
 }
 
+void VmObjectPaged::MarkPageDirtyLocked(vm_page_t* page) {
+  DEBUG_ASSERT(page_source_);
+  DEBUG_ASSERT(page->object.pin_count == 0);
+  if (page->object.dirty) {
+    return;
+  }
+  page->object.dirty = 1;
+  pmm_page_queues()->MoveToUnswappable(page);
+}
+
+void VmObjectPaged::RemovePagesFromQueuesLocked(uint64_t start, uint64_t end) {
+  if (!page_source_) {
+    return;
+  }
+  page_list_.ForEveryPageInRange(
+      [](const auto& p, uint64_t) {
+        if (p.IsPage()) {
+          pmm_page_queues()->Remove(p.Page());
+        }
+        return ZX_ERR_NEXT;
+      },
+      start, end);
+}
+
 bool VmObjectPaged::AnyPagesPinnedLocked(uint64_t offset, size_t len) {
   canary_.Assert();
   DEBUG_ASSERT(lock_.lock().IsHeld());
@@ -2658,6 +2886,7 @@ zx_status_t VmObjectPaged::Resize(uint64_t s) {
     // again, even if the parent is later reenlarged. So update the child parent limits.
     UpdateChildParentLimitsLocked(s);
 
+    RemovePagesFromQueuesLocked(start, end);
     page_list_.RemovePages(start, end, &free_list);
   } else if (s > size_) {
     // expanding
@@ -2844,7 +3073,12 @@ zx_status_t VmObjectPaged::Lookup(uint64_t offset, uint64_t len, vmo_lookup_fn_t
   const uint64_t start_page_offset = ROUNDDOWN(offset, PAGE_SIZE);
   const uint64_t end_page_offset = ROUNDUP(offset + len, PAGE_SIZE);
 
-  zx_status_t status = page_list_.ForEveryPageAndGapInRange(
+  zx_status_t status = UnpackRangeLocked(start_page_offset, end_page_offset - start_page_offset);
+  if (status != ZX_OK) {
+    return status;
+  }
+
+  status = page_list_.ForEveryPageAndGapInRange(
       [lookup_fn, context, start_page_offset](const auto& p, uint64_t off) {
         if (p.IsMarker()) {
           return ZX_ERR_NO_MEMORY;
@@ -2961,6 +3195,11 @@ zx_status_t VmObjectPaged::TakePages(uint64_t offset, uint64_t len, VmPageSplice
     return ZX_ERR_BAD_STATE;
   }
 
+  zx_status_t status = UnpackRangeLocked(offset, len);
+  if (status != ZX_OK) {
+    return status;
+  }
+
   *pages = page_list_.TakePages(offset, len);
 
   return ZX_OK;
@@ -2985,9 +3224,14 @@ zx_status_t VmObjectPaged::SupplyPages(uint64_t offset, uint64_t len, VmPageSpli
   zx_status_t status = ZX_OK;
   while (!pages->IsDone()) {
     VmPageOrMarker src_page = pages->Pop();
+    vm_page_t* new_page = src_page.IsPage() ? src_page.Page() : nullptr;
 
     status = AddPageLocked(&src_page, offset);
     if (status == ZX_OK) {
+      if (new_page) {
+        new_page->object.dirty = 0;
+        pmm_page_queues()->SetPagerBacked(new_page, this, offset);
+      }
       new_pages_len += PAGE_SIZE;
     } else if (src_page.IsPage()) {
       list_add_tail(&free_list, &src_page.ReleasePage()->queue_node);
@@ -3021,6 +3265,260 @@ zx_status_t VmObjectPaged::SupplyPages(uint64_t offset, uint64_t len, VmPageSpli
   return status;
 }
 
+void VmObjectPaged::DetachSource() {
+  DEBUG_ASSERT(page_source_);
+
+  // The pager can no longer recreate any of our pages, so none of them may be evicted. Hold the
+  // lock across the detach so that EvictPage cannot run in between.
+  Guard<fbl::Mutex> guard{&lock_};
+  page_source_->Detach();
+  page_list_.ForEveryPage([this](const auto& p, uint64_t) {
+    if (p.IsPage() && p.Page()->object.pin_count == 0) {
+      AssertHeld(this->lock_);
+      MarkPageDirtyLocked(p.Page());
+    }
+    return ZX_ERR_NEXT;
+  });
+}
+
+void VmObjectPaged::HarvestAccessedBits() {
+  Guard<fbl::Mutex> guard{&lock_};
+  // Only pages of pager backed objects are aged. Clones of them can have their parent's pages
+  // mapped, so they are harvested as well.
+  if (!GetRootPageSourceLocked()) {
+    return;
+  }
+  for (auto& m : mapping_list_) {
+    AssertHeld(*m.object_lock());
+    m.HarvestAccessedBitsLocked([](paddr_t pa, vaddr_t) {
+      vm_page_t* page = paddr_to_vm_page(pa);
+      if (page) {
+        pmm_page_queues()->MarkAccessed(page);
+      }
+    });
+  }
+}
+
+bool VmObjectPaged::EvictPage(vm_page_t* page, uint64_t offset) {
+  canary_.Assert();
+
+  Guard<fbl::Mutex> guard{&lock_};
+  if (!page_source_) {
+    return false;
+  }
+  // The back reference was read without our lock, so make sure the page is still ours and still
+  // something the pager could supply again.
+  VmPageOrMarker* slot = page_list_.Lookup(offset);
+  if (!slot || !slot->IsPage() || slot->Page() != page || page->object.pin_count > 0 ||
+      page->object.dirty) {
+    return false;
+  }
+
+  // This also removes the page from the mappings of any clones that were reading through to it.
+  RangeChangeUpdateLocked(offset, PAGE_SIZE, RangeChangeOp::Unmap);
+
+  pmm_page_queues()->Remove(page);
+  vm_page_t* removed = page_list_.RemovePage(offset).ReleasePage();
+  DEBUG_ASSERT(removed == page);
+
+  guard.Release();
+  pmm_free_page(removed);
+  return true;
+}
+
+bool VmObjectPaged::CanTransformPagesLocked() const {
+  // Any object that is part of a clone tree is skipped, including a plain snapshot or
+  // copy-on-write child of an otherwise eligible object and the hidden parents holding their
+  // shared pages. Supporting them would need the hidden parent's pages to be transformable, with
+  // every child that can see a slot decompressing or unsharing it on access, and the page
+  // splitting logic of clone trees taught about both. Until then copy-on-write memory, such as the
+  // data segments loaded from executables, is never compressed or de-duped.
+  if (is_hidden() || is_contiguous() || parent_ || children_list_len_ > 0 || page_source_ ||
+      cache_policy_ != ARCH_MMU_FLAG_CACHED) {
+    return false;
+  }
+  // Kernel mappings may be accessed in contexts that cannot take a page fault, so leave any VMO
+  // that has them alone.
+  for (auto& m : mapping_list_) {
+    if (!m.aspace()->is_user()) {
+      return false;
+    }
+  }
+  return true;
+}
+
+zx_status_t VmObjectPaged::DecompressPageLocked(VmPageOrMarker* slot, list_node_t* free_list) {
+  DEBUG_ASSERT(slot->IsCompressed());
+  vm_page_t* p;
+  if (!AllocateCopyPage(pmm_alloc_flags_, vm_get_zero_page_paddr(), free_list, &p)) {
+    return ZX_ERR_NO_MEMORY;
+  }
+  compressed_store_decompress(slot->ReleaseCompressed(), p);
+  *slot = VmPageOrMarker::Page(p);
+  // Compressed pages were unmapped when they were compressed, so there are no mappings to update.
+  return ZX_OK;
+}
+
+zx_status_t VmObjectPaged::UnsharePageLocked(VmPageOrMarker* slot, uint64_t offset,
+                                             list_node_t* free_list) {
+  DEBUG_ASSERT(slot->IsShared());
+  vm_page_t* p = dedup_store_take(slot->Shared());
+  if (!p) {
+    if (!AllocateCopyPage(pmm_alloc_flags_, dedup_store_page(slot->Shared())->paddr(), free_list,
+                          &p)) {
+      return ZX_ERR_NO_MEMORY;
+    }
+    dedup_store_release(slot->Shared());
+  }
+  slot->ReleaseShared();
+  *slot = VmPageOrMarker::Page(p);
+  // Mappings of this offset may still refer to the shared page.
+  RangeChangeUpdateLocked(offset, PAGE_SIZE, RangeChangeOp::Unmap);
+  return ZX_OK;
+}
+
+zx_status_t VmObjectPaged::UnpackForCloneLocked() {
+  // Pages are only compressed or shared while we have neither a parent nor children (see
+  // CanTransformPagesLocked), so once we are part of a clone tree there is nothing to unpack and
+  // walking the whole page list again on every clone is wasted work.
+  if (parent_ || children_list_len_ > 0) {
+    return ZX_OK;
+  }
+  return UnpackRangeLocked(0, size_);
+}
+
+zx_status_t VmObjectPaged::UnpackRangeLocked(uint64_t offset, uint64_t len) {
+  return page_list_.ForEveryPageInRange(
+      [this](auto& p, uint64_t off) {
+        AssertHeld(lock_);
+        zx_status_t status = ZX_OK;
+        if (p.IsCompressed()) {
+          status = DecompressPageLocked(&p, nullptr);
+        } else if (p.IsShared()) {
+          status = UnsharePageLocked(&p, off, nullptr);
+        }
+        return status == ZX_OK ? ZX_ERR_NEXT : status;
+      },
+      offset, offset + len);
+}
+
+void VmObjectPaged::HarvestAnonymousAccessedBitsLocked() {
+  // Anything accessed through a mapping since the last scan is considered hot. Accesses through
+  // GetPageLocked set the accessed bits directly.
+  for (auto& m : mapping_list_) {
+    AssertHeld(*m.object_lock());
+    m.HarvestAccessedBitsLocked([](paddr_t pa, vaddr_t) {
+      vm_page_t* page = paddr_to_vm_page(pa);
+      // Our mappings may also contain the shared zero page, which must be left alone.
+      if (page && page->state() == VM_PAGE_STATE_OBJECT) {
+        page->object.accessed = 1;
+        page->object.dedup_accessed = 1;
+      }
+    });
+  }
+}
+
+uint64_t VmObjectPaged::CompressColdPages(uint64_t max_pages) {
+  canary_.Assert();
+
+  list_node_t free_list;
+  list_initialize(&free_list);
+  Guard<fbl::Mutex> guard{&lock_};
+
+  if (!CanTransformPagesLocked()) {
+    return 0;
+  }
+
+  HarvestAnonymousAccessedBitsLocked();
+
+  uint64_t count = 0;
+  page_list_.ForEveryPage([&count, &free_list, max_pages, this](auto& p, uint64_t off) {
+    if (count == max_pages) {
+      return ZX_ERR_STOP;
+    }
+    if (!p.IsPage()) {
+      return ZX_ERR_NEXT;
+    }
+    vm_page_t* page = p.Page();
+    if (page->object.accessed) {
+      page->object.accessed = 0;
+      return ZX_ERR_NEXT;
+    }
+    if (page->object.pin_count > 0) {
+      return ZX_ERR_NEXT;
+    }
+    // Unmap before compressing so the content cannot change underneath us.
+    AssertHeld(lock_);
+    RangeChangeUpdateLocked(off, PAGE_SIZE, RangeChangeOp::Unmap);
+    VmCompressedPage* compressed = compressed_store_compress(page);
+    if (!compressed) {
+      // Keep going past incompressible pages, but not once the store is full.
+      return compressed_store_has_budget() ? ZX_ERR_NEXT : ZX_ERR_STOP;
+    }
+    list_add_tail(&free_list, &p.ReleasePage()->queue_node);
+    p = VmPageOrMarker::Compressed(compressed);
+    count++;
+    return ZX_ERR_NEXT;
+  });
+
+  // Release the guard so we can free any pages.
+  guard.Release();
+  pmm_free(&free_list);
+  return count;
+}
+
+uint64_t VmObjectPaged::DedupPages(DedupStore* store) {
+  canary_.Assert();
+
+  list_node_t free_list;
+  list_initialize(&free_list);
+  Guard<fbl::Mutex> guard{&lock_};
+
+  if (!CanTransformPagesLocked()) {
+    return 0;
+  }
+
+  HarvestAnonymousAccessedBitsLocked();
+
+  uint64_t count = 0;
+  page_list_.ForEveryPage([&count, &free_list, store, this](auto& p, uint64_t off) {
+    if (!p.IsPage() || p.Page()->object.pin_count > 0) {
+      return ZX_ERR_NEXT;
+    }
+    // Breaking the sharing of a page that is still being written costs a fault and a copy, so only
+    // pages that have gone untouched for a whole pass are shared.
+    vm_page_t* page = p.Page();
+    if (page->object.dedup_accessed) {
+      page->object.dedup_accessed = 0;
+      return ZX_ERR_NEXT;
+    }
+    if (!store->IsCandidate(dedup_hash_page(page))) {
+      return ZX_ERR_NEXT;
+    }
+    // Unmap before merging so the content cannot change underneath us, and hash again since it
+    // may already have.
+    AssertHeld(lock_);
+    RangeChangeUpdateLocked(off, PAGE_SIZE, RangeChangeOp::Unmap);
+    bool took_page;
+    VmSharedPage* shared = store->Merge(page, dedup_hash_page(page), &took_page);
+    if (!shared) {
+      return ZX_ERR_NEXT;
+    }
+    p.ReleasePage();
+    if (!took_page) {
+      list_add_tail(&free_list, &page->queue_node);
+      count++;
+    }
+    p = VmPageOrMarker::Shared(shared);
+    return ZX_ERR_NEXT;
+  });
+
+  // Release the guard so we can free any pages.
+  guard.Release();
+  pmm_free(&free_list);
+  return count;
+}
+
 uint32_t VmObjectPaged::GetMappingCachePolicy() const {
   Guard<fbl::Mutex> guard{&lock_};
 
@@ -149,7 +149,7 @@ VmPageOrMarker VmPageList::RemovePage(uint64_t offset) {
 
   // free this page
   VmPageOrMarker page = ktl::move(pln->Lookup(index));
-  if (page.IsPage() && pln->IsEmpty()) {
+  if ((page.IsPage() || page.IsCompressed() || page.IsShared()) && pln->IsEmpty()) {
     // if it was the last page in the node, remove the node from the tree
     LTRACEF_LEVEL(2, "%p freeing the list node\n", this);
     list_.erase(*pln);
@@ -176,6 +176,10 @@ size_t VmPageList::RemoveAllPages(list_node_t* removed_pages) {
       // add the page to our list and null out the inner node
       list_add_tail(removed_pages, &p.ReleasePage()->queue_node);
       count++;
+    } else if (p.IsCompressed()) {
+      compressed_store_free(p.ReleaseCompressed());
+    } else if (p.IsShared()) {
+      dedup_store_release(p.ReleaseShared());
     }
     return ZX_ERR_NEXT;
   };
@@ -194,7 +198,7 @@ bool VmPageList::IsEmpty() const { return list_.is_empty(); }
 bool VmPageList::HasNoPages() const {
   bool no_pages = true;
   ForEveryPage([&no_pages](auto& p, uint64_t) {
-    if (p.IsPage()) {
+    if (p.IsPage() || p.IsCompressed() || p.IsShared()) {
       no_pages = false;
       return ZX_ERR_STOP;
     } else {
@@ -383,6 +387,10 @@ void VmPageSpliceList::FreeAllPages() {
     VmPageOrMarker page = Pop();
     if (page.IsPage()) {
       pmm_free_page(page.ReleasePage());
+    } else if (page.IsCompressed()) {
+      compressed_store_free(page.ReleaseCompressed());
+    } else if (page.IsShared()) {
+      dedup_store_release(page.ReleaseShared());
     }
   }
 }
@@ -16,9 +16,12 @@
 #include <fbl/auto_call.h>
 #include <kernel/semaphore.h>
 #include <ktl/move.h>
+#include <vm/compressed_store.h>
+#include <vm/dedup_store.h>
 #include <vm/fault.h>
 #include <vm/physmap.h>
 #include <vm/pmm_checker.h>
+#include <vm/scanner.h>
 #include <vm/vm.h>
 #include <vm/vm_address_region.h>
 #include <vm/vm_aspace.h>
@@ -578,6 +581,51 @@ static bool pmm_node_delayed_alloc_clear_late_test() {
   return pmm_node_delayed_alloc_clear_test_helper(false);
 }
 
+// Checks that pages moving through the per-cpu page caches stay accounted for.
+static bool pmm_node_page_cache_test() {
+  BEGIN_TEST;
+  ManagedPmmNode node;
+  static constexpr size_t kCacheSize = 8;
+  ASSERT_EQ(ZX_OK, node.node().InitPageCaches(kCacheSize));
+
+  // A single page allocation refills the cache, but cached pages still count as free.
+  vm_page_t* page;
+  zx_status_t status = node.node().AllocPage(0, &page, nullptr);
+  ASSERT_EQ(ZX_OK, status);
+  EXPECT_EQ(VM_PAGE_STATE_ALLOC, page->state());
+  EXPECT_EQ(ManagedPmmNode::kNumPages - 1, node.node().CountFreePages());
+
+  node.node().FreePage(page);
+  EXPECT_EQ(ManagedPmmNode::kNumPages, node.node().CountFreePages());
+
+  // Small bulk allocations are served by the cache as well.
+  list_node list = LIST_INITIAL_VALUE(list);
+  status = node.node().AllocPages(kCacheSize / 2, 0, &list);
+  EXPECT_EQ(ZX_OK, status);
+  EXPECT_EQ(kCacheSize / 2, list_length(&list));
+  EXPECT_EQ(ManagedPmmNode::kNumPages - kCacheSize / 2, node.node().CountFreePages());
+  node.node().FreeList(&list);
+  EXPECT_EQ(ManagedPmmNode::kNumPages, node.node().CountFreePages());
+
+  // Allocating every page requires pulling the cached pages back out of the caches.
+  status = node.node().AllocPages(ManagedPmmNode::kNumPages, 0, &list);
+  EXPECT_EQ(ZX_OK, status);
+  EXPECT_EQ(ManagedPmmNode::kNumPages, list_length(&list));
+  EXPECT_EQ(0ul, node.node().CountFreePages());
+  EXPECT_EQ(node.cur_level(), 0);
+
+  // Freeing more pages than a cache holds overflows into the free list.
+  node.node().FreeList(&list);
+  EXPECT_TRUE(list_is_empty(&list));
+  EXPECT_EQ(ManagedPmmNode::kNumPages, node.node().CountFreePages());
+  EXPECT_EQ(node.cur_level(), 1);
+
+  node.node().ReclaimPageCaches();
+  EXPECT_EQ(ManagedPmmNode::kNumPages, node.node().CountFreePages());
+
+  END_TEST;
+}
+
 static bool pmm_checker_test() {
   BEGIN_TEST;
 
@@ -1727,6 +1775,133 @@ static bool vmo_zero_scan_test() {
   END_TEST;
 }
 
+static bool vmo_fault_around_test() {
+  BEGIN_TEST;
+
+  static const size_t kNumPages = 16;
+  fbl::RefPtr<VmObject> vmo;
+  zx_status_t status = VmObjectPaged::Create(PMM_ALLOC_FLAG_ANY, 0u, kNumPages * PAGE_SIZE, &vmo);
+  EXPECT_EQ(ZX_OK, status);
+
+  fbl::RefPtr<VmAspace> user_aspace =
+      fbl::RefPtr(vmm_aspace_to_obj(Thread::Current::Get()->aspace_));
+  fbl::RefPtr<VmAddressRegion> root_user_vmar = user_aspace->RootVmar();
+  fbl::RefPtr<VmMapping> mapping;
+  status = root_user_vmar->CreateVmMapping(
+      0, kNumPages * PAGE_SIZE, 0, VMAR_FLAG_CAN_MAP_READ | VMAR_FLAG_CAN_MAP_WRITE, vmo, 0,
+      ARCH_MMU_FLAG_PERM_READ | ARCH_MMU_FLAG_PERM_WRITE, "unittest", &mapping);
+  EXPECT_EQ(ZX_OK, status);
+  auto unmap_user = fbl::MakeAutoCall([&]() {
+    if (mapping) {
+      mapping->Unmap(mapping->base(), mapping->size());
+    }
+  });
+  // Commit everything except one page, which fault-around has to skip since it would have to
+  // map the zero page for it.
+  EXPECT_EQ(ZX_OK, vmo->CommitRange(0, kNumPages * PAGE_SIZE));
+  EXPECT_EQ(ZX_OK, vmo->DecommitRange(2 * PAGE_SIZE, PAGE_SIZE));
+  const size_t initial_pages = user_aspace->FaultAroundPages();
+
+  // A first read fault maps the resident pages of the minimum window, read-only.
+  EXPECT_EQ(ZX_OK, user_aspace->SoftFault(mapping->base(), 0u));
+  paddr_t pa;
+  uint mmu_flags;
+  status = user_aspace->arch_aspace().Query(mapping->base() + PAGE_SIZE, &pa, &mmu_flags);
+  EXPECT_EQ(ZX_OK, status);
+  EXPECT_NE(vm_get_zero_page_paddr(), pa);
+  EXPECT_FALSE(mmu_flags & ARCH_MMU_FLAG_PERM_WRITE);
+  status = user_aspace->arch_aspace().Query(mapping->base() + 2 * PAGE_SIZE, &pa, &mmu_flags);
+  EXPECT_NE(ZX_OK, status);
+  status = user_aspace->arch_aspace().Query(mapping->base() + 4 * PAGE_SIZE, &pa, &mmu_flags);
+  EXPECT_NE(ZX_OK, status);
+  EXPECT_EQ(initial_pages + 2, user_aspace->FaultAroundPages());
+
+  // Pages mapped around the fault are not marked accessed.
+  vm_page_t* page;
+  status = vmo->GetPage(PAGE_SIZE, 0, nullptr, nullptr, &page, nullptr);
+  EXPECT_EQ(ZX_OK, status);
+  EXPECT_EQ(0u, page->object.accessed);
+
+  // Continuing the scan at the end of the window doubles it.
+  EXPECT_EQ(ZX_OK, user_aspace->SoftFault(mapping->base() + 4 * PAGE_SIZE, 0u));
+  status = user_aspace->arch_aspace().Query(mapping->base() + 11 * PAGE_SIZE, &pa, &mmu_flags);
+  EXPECT_EQ(ZX_OK, status);
+  status = user_aspace->arch_aspace().Query(mapping->base() + 12 * PAGE_SIZE, &pa, &mmu_flags);
+  EXPECT_NE(ZX_OK, status);
+  EXPECT_EQ(initial_pages + 9, user_aspace->FaultAroundPages());
+
+  // Reading has not committed anything.
+  EXPECT_EQ(kNumPages - 1, vmo->AttributedPages());
+
+  END_TEST;
+}
+
+static bool vmo_large_page_test() {
+  BEGIN_TEST;
+
+  static const size_t kLargePageSize = 512 * PAGE_SIZE;
+  static const uint8_t kLargePageShift = PAGE_SIZE_SHIFT + 9;
+  fbl::RefPtr<VmObject> vmo;
+  zx_status_t status = VmObjectPaged::Create(PMM_ALLOC_FLAG_ANY, 0u, 2 * kLargePageSize, &vmo);
+  ASSERT_EQ(ZX_OK, status);
+
+  fbl::RefPtr<VmAspace> user_aspace =
+      fbl::RefPtr(vmm_aspace_to_obj(Thread::Current::Get()->aspace_));
+  fbl::RefPtr<VmAddressRegion> root_user_vmar = user_aspace->RootVmar();
+  fbl::RefPtr<VmMapping> mapping;
+  status = root_user_vmar->CreateVmMapping(
+      0, 2 * kLargePageSize, kLargePageShift, VMAR_FLAG_CAN_MAP_READ | VMAR_FLAG_CAN_MAP_WRITE,
+      vmo, 0, ARCH_MMU_FLAG_PERM_READ | ARCH_MMU_FLAG_PERM_WRITE, "unittest", &mapping);
+  ASSERT_EQ(ZX_OK, status);
+  const vaddr_t base = mapping->base();
+  auto unmap_user = fbl::MakeAutoCall([&]() { root_user_vmar->Unmap(base, 2 * kLargePageSize); });
+  ASSERT_TRUE(IS_ALIGNED(base, kLargePageSize));
+
+  // A write fault on untouched anonymous memory commits and maps the whole large page around it.
+  ArchVmAspace& arch_aspace = user_aspace->arch_aspace();
+  for (size_t i = 0; i < 2; i++) {
+    EXPECT_EQ(ZX_OK, user_aspace->SoftFault(base + i * kLargePageSize + PAGE_SIZE,
+                                            VMM_PF_FLAG_WRITE));
+  }
+  size_t entry_size;
+  ASSERT_EQ(ZX_OK, arch_aspace.QueryEntrySize(base, &entry_size));
+  if (entry_size != kLargePageSize) {
+    unittest_printf("no contiguous run available, skipping\n");
+    END_TEST;
+  }
+  EXPECT_EQ(2 * kLargePageSize / PAGE_SIZE, vmo->AttributedPages());
+  paddr_t large_pa;
+  uint mmu_flags;
+  ASSERT_EQ(ZX_OK, arch_aspace.Query(base, &large_pa, &mmu_flags));
+  EXPECT_TRUE(IS_ALIGNED(large_pa, kLargePageSize));
+  EXPECT_TRUE(mmu_flags & ARCH_MMU_FLAG_PERM_WRITE);
+
+  // Protecting part of the first large page demotes it to small pages that keep their frames.
+  EXPECT_EQ(ZX_OK, root_user_vmar->Protect(base + PAGE_SIZE, PAGE_SIZE, ARCH_MMU_FLAG_PERM_READ));
+  ASSERT_EQ(ZX_OK, arch_aspace.QueryEntrySize(base, &entry_size));
+  EXPECT_EQ(PAGE_SIZE, entry_size);
+  paddr_t pa;
+  ASSERT_EQ(ZX_OK, arch_aspace.Query(base + PAGE_SIZE, &pa, &mmu_flags));
+  EXPECT_EQ(large_pa + PAGE_SIZE, pa);
+  EXPECT_FALSE(mmu_flags & ARCH_MMU_FLAG_PERM_WRITE);
+  ASSERT_EQ(ZX_OK, arch_aspace.Query(base + 2 * PAGE_SIZE, &pa, &mmu_flags));
+  EXPECT_EQ(large_pa + 2 * PAGE_SIZE, pa);
+  EXPECT_TRUE(mmu_flags & ARCH_MMU_FLAG_PERM_WRITE);
+
+  // Decommitting part of the second large page demotes it and unmaps only the decommitted page.
+  ASSERT_EQ(ZX_OK, arch_aspace.QueryEntrySize(base + kLargePageSize, &entry_size));
+  if (entry_size == kLargePageSize) {
+    EXPECT_EQ(ZX_OK, vmo->DecommitRange(kLargePageSize + PAGE_SIZE, PAGE_SIZE));
+    ASSERT_EQ(ZX_OK, arch_aspace.QueryEntrySize(base + kLargePageSize, &entry_size));
+    EXPECT_EQ(PAGE_SIZE, entry_size);
+    EXPECT_EQ(ZX_ERR_NOT_FOUND, arch_aspace.Query(base + kLargePageSize + PAGE_SIZE, &pa, nullptr));
+    EXPECT_EQ(ZX_OK, arch_aspace.Query(base + kLargePageSize + 2 * PAGE_SIZE, &pa, nullptr));
+    EXPECT_EQ(2 * kLargePageSize / PAGE_SIZE - 1, vmo->AttributedPages());
+  }
+
+  END_TEST;
+}
+
 // TODO(ZX-1431): The ARM code's error codes are always ZX_ERR_INTERNAL, so
 // special case that.
 #if ARCH_ARM64
@@ -2733,6 +2908,270 @@ static bool pq_move_self_queue() {
   END_TEST;
 }
 
+static bool pq_rotate_pager_backed() {
+  BEGIN_TEST;
+
+  PageQueues pq;
+
+  // Pretend we have two allocated pages
+  vm_page_t old_page = {};
+  old_page.set_state(VM_PAGE_STATE_OBJECT);
+  vm_page_t new_page = {};
+  new_page.set_state(VM_PAGE_STATE_OBJECT);
+
+  // Need a VMO to claim our pager backed pages are in
+  fbl::RefPtr<VmObject> vmo;
+  zx_status_t status = VmObjectPaged::Create(0, 0, PAGE_SIZE * 2, &vmo);
+  ASSERT_EQ(ZX_OK, status);
+  VmObjectPaged* vmop = VmObjectPaged::AsVmObjectPaged(vmo);
+  ASSERT_NONNULL(vmop);
+
+  // Pages start in the newest generation, which is never offered for eviction.
+  pq.SetPagerBacked(&old_page, vmop, 0);
+  PageQueues::VmoBacklink backlink;
+  EXPECT_FALSE(pq.PeekPagerBacked(1, &backlink));
+  EXPECT_TRUE(pq.PeekPagerBacked(0, &backlink));
+  EXPECT_EQ(&old_page, backlink.page);
+  backlink = {};
+
+  // Once aged the page becomes a candidate, and stays the oldest after a newer page is added.
+  pq.RotatePagerBackedQueues();
+  pq.SetPagerBacked(&new_page, vmop, PAGE_SIZE);
+  EXPECT_TRUE(pq.DebugQueueCounts() == ((PageQueues::Counts){2, 0, 0}));
+  EXPECT_TRUE(pq.PeekPagerBacked(1, &backlink));
+  EXPECT_EQ(&old_page, backlink.page);
+  EXPECT_EQ(0u, backlink.offset);
+  EXPECT_EQ(vmop, backlink.vmo.get());
+  backlink = {};
+
+  // Accessing the old page moves it back to the newest generation.
+  pq.MarkAccessed(&old_page);
+  EXPECT_FALSE(pq.PeekPagerBacked(1, &backlink));
+  pq.RotatePagerBackedQueues();
+  EXPECT_TRUE(pq.PeekPagerBacked(1, &backlink));
+  EXPECT_EQ(&old_page, backlink.page);
+  backlink = {};
+
+  // Rotating more times than there are generations leaves everything in the oldest one.
+  for (size_t i = 0; i < PageQueues::kNumPagerBacked * 2; i++) {
+    pq.RotatePagerBackedQueues();
+  }
+  EXPECT_TRUE(pq.DebugPageIsPagerBacked(&old_page));
+  EXPECT_TRUE(pq.DebugPageIsPagerBacked(&new_page));
+  EXPECT_TRUE(pq.PeekPagerBacked(PageQueues::kNumPagerBacked - 1, &backlink));
+  backlink = {};
+
+  pq.Remove(&old_page);
+  pq.Remove(&new_page);
+  EXPECT_TRUE(pq.DebugQueueCounts() == ((PageQueues::Counts){0, 0, 0}));
+
+  END_TEST;
+}
+
+// Check that cold pages are moved into the compressed store and read back intact.
+static bool vmo_compress_cold_pages_test() {
+  BEGIN_TEST;
+
+  if (!compressed_store_has_budget()) {
+    unittest_printf("page compression is disabled, skipping\n");
+    END_TEST;
+  }
+
+  static const size_t kNumPages = 4;
+  fbl::RefPtr<VmObject> vmo;
+  zx_status_t status = VmObjectPaged::Create(PMM_ALLOC_FLAG_ANY, 0u, kNumPages * PAGE_SIZE, &vmo);
+  ASSERT_EQ(ZX_OK, status);
+
+  // Fill the pages with something compressible that is still distinct per page.
+  fbl::AllocChecker ac;
+  fbl::Array<uint8_t> buf(new (&ac) uint8_t[kNumPages * PAGE_SIZE], kNumPages * PAGE_SIZE);
+  ASSERT_TRUE(ac.check());
+  for (size_t i = 0; i < buf.size(); i++) {
+    buf[i] = static_cast<uint8_t>((i / PAGE_SIZE) * 16 + (i % 13));
+  }
+  EXPECT_EQ(ZX_OK, vmo->Write(buf.get(), 0, buf.size()));
+
+  // The write counts as an access, so the first scan only clears the accessed bits.
+  EXPECT_EQ(0u, vmo->CompressColdPages(kNumPages));
+  EXPECT_EQ(kNumPages - 1, vmo->CompressColdPages(kNumPages - 1));
+  EXPECT_EQ(1u, vmo->CompressColdPages(kNumPages));
+  // Compressed pages are still attributed to the VMO.
+  EXPECT_EQ(kNumPages, vmo->AttributedPages());
+
+  fbl::Array<uint8_t> read(new (&ac) uint8_t[kNumPages * PAGE_SIZE], kNumPages * PAGE_SIZE);
+  ASSERT_TRUE(ac.check());
+  EXPECT_EQ(ZX_OK, vmo->Read(read.get(), 0, read.size()));
+  EXPECT_EQ(0, memcmp(buf.get(), read.get(), buf.size()));
+
+  // Reading decompressed everything and marked it accessed again.
+  EXPECT_EQ(0u, vmo->CompressColdPages(kNumPages));
+  EXPECT_EQ(kNumPages, vmo->AttributedPages());
+
+  END_TEST;
+}
+
+static bool vmo_dedup_pages_test() {
+  BEGIN_TEST;
+
+  // Keep the scanner from de-duping the pages into the global store behind our back.
+  scanner_push_disable_count();
+  auto pop_count = fbl::MakeAutoCall([] { scanner_pop_disable_count(); });
+
+  // Use a store of our own so that its candidates are not forgotten by a concurrent scan. It is
+  // declared before the VMOs so that they drop their references to it before it is destroyed.
+  DedupStore store;
+
+  fbl::RefPtr<VmObject> vmo1;
+  zx_status_t status = VmObjectPaged::Create(PMM_ALLOC_FLAG_ANY, 0u, PAGE_SIZE, &vmo1);
+  ASSERT_EQ(ZX_OK, status);
+  fbl::RefPtr<VmObject> vmo2;
+  status = VmObjectPaged::Create(PMM_ALLOC_FLAG_ANY, 0u, PAGE_SIZE, &vmo2);
+  ASSERT_EQ(ZX_OK, status);
+
+  // Give both pages the same content, which is unlikely to exist anywhere else in the system.
+  fbl::AllocChecker ac;
+  fbl::Array<uint8_t> buf(new (&ac) uint8_t[PAGE_SIZE], PAGE_SIZE);
+  ASSERT_TRUE(ac.check());
+  fill_region(reinterpret_cast<uintptr_t>(vmo1.get()), buf.get(), PAGE_SIZE);
+  EXPECT_EQ(ZX_OK, vmo1->Write(buf.get(), 0, PAGE_SIZE));
+  EXPECT_EQ(ZX_OK, vmo2->Write(buf.get(), 0, PAGE_SIZE));
+
+  // The writes count as accesses, so the first pass only clears the accessed bits.
+  store.BeginScan();
+  EXPECT_EQ(0u, vmo1->DedupPages(&store));
+  EXPECT_EQ(0u, vmo2->DedupPages(&store));
+  EXPECT_EQ(0u, store.GetStats().shared_pages);
+
+  // The first sighting of the content is only remembered, the second moves the page into the
+  // store and the first page is merged with it when it is seen again.
+  store.BeginScan();
+  EXPECT_EQ(0u, vmo1->DedupPages(&store));
+  EXPECT_EQ(0u, vmo2->DedupPages(&store));
+  EXPECT_EQ(1u, vmo1->DedupPages(&store));
+  EXPECT_EQ(0u, vmo2->DedupPages(&store));
+  EXPECT_EQ(1u, store.GetStats().shared_pages);
+  EXPECT_EQ(2u, store.GetStats().references);
+  // Shared pages are still attributed to every VMO referencing them.
+  EXPECT_EQ(1u, vmo1->AttributedPages());
+  EXPECT_EQ(1u, vmo2->AttributedPages());
+
+  fbl::Array<uint8_t> read(new (&ac) uint8_t[PAGE_SIZE], PAGE_SIZE);
+  ASSERT_TRUE(ac.check());
+  EXPECT_EQ(ZX_OK, vmo1->Read(read.get(), 0, PAGE_SIZE));
+  EXPECT_EQ(0, memcmp(buf.get(), read.get(), PAGE_SIZE));
+
+  // Writing to one VMO gives it a private copy and leaves the other one alone.
+  uint8_t val = static_cast<uint8_t>(~buf[0]);
+  EXPECT_EQ(ZX_OK, vmo1->Write(&val, 0, sizeof(val)));
+  EXPECT_EQ(ZX_OK, vmo2->Read(read.get(), 0, PAGE_SIZE));
+  EXPECT_EQ(0, memcmp(buf.get(), read.get(), PAGE_SIZE));
+  EXPECT_EQ(ZX_OK, vmo1->Read(read.get(), 0, PAGE_SIZE));
+  EXPECT_EQ(val, read[0]);
+  EXPECT_EQ(0, memcmp(buf.get() + 1, read.get() + 1, PAGE_SIZE - 1));
+
+  // The last reference takes the shared page back on write.
+  EXPECT_EQ(ZX_OK, vmo2->Write(&val, 0, sizeof(val)));
+  EXPECT_EQ(ZX_OK, vmo2->Read(read.get(), 0, PAGE_SIZE));
+  EXPECT_EQ(val, read[0]);
+  EXPECT_EQ(1u, vmo2->AttributedPages());
+  EXPECT_EQ(0u, store.GetStats().shared_pages);
+
+  END_TEST;
+}
+
+// Page source that never provides pages itself, for tests that supply pages up front.
+class StubPageSource : public PageSource {
+ public:
+  StubPageSource() = default;
+  ~StubPageSource() override = default;
+
+ protected:
+  bool GetPage(uint64_t offset, vm_page_t** const page_out, paddr_t* const pa_out) override {
+    return false;
+  }
+  void GetPageAsync(page_request_t* request) override {}
+  void ClearAsyncRequest(page_request_t* request) override {}
+  void SwapRequest(page_request_t* old, page_request_t* new_req) override {}
+  void OnDetach() override {}
+  void OnClose() override {}
+  zx_status_t WaitOnEvent(event_t* event) override { return ZX_ERR_NOT_SUPPORTED; }
+};
+
+// Check that clean pager backed pages can be evicted, even when mapped, and dirty ones cannot.
+static bool vmo_evict_pager_backed_test() {
+  BEGIN_TEST;
+
+  // Keep the scanner from evicting the pages behind our back.
+  scanner_push_disable_count();
+  auto pop_count = fbl::MakeAutoCall([] { scanner_pop_disable_count(); });
+
+  static const size_t kNumPages = 2;
+  fbl::AllocChecker ac;
+  fbl::RefPtr<PageSource> source = fbl::AdoptRef<PageSource>(new (&ac) StubPageSource());
+  ASSERT_TRUE(ac.check());
+  fbl::RefPtr<VmObject> vmo;
+  zx_status_t status = VmObjectPaged::CreateExternal(source, 0u, kNumPages * PAGE_SIZE, &vmo);
+  ASSERT_EQ(ZX_OK, status);
+  VmObjectPaged* vmop = VmObjectPaged::AsVmObjectPaged(vmo);
+  ASSERT_NONNULL(vmop);
+
+  // Supply the pages the way a pager would, by moving them over from an anonymous VMO.
+  fbl::RefPtr<VmObject> aux;
+  status = VmObjectPaged::Create(PMM_ALLOC_FLAG_ANY, 0u, kNumPages * PAGE_SIZE, &aux);
+  ASSERT_EQ(ZX_OK, status);
+  EXPECT_EQ(ZX_OK, aux->CommitRange(0, kNumPages * PAGE_SIZE));
+  VmPageSpliceList splice;
+  EXPECT_EQ(ZX_OK, aux->TakePages(0, kNumPages * PAGE_SIZE, &splice));
+  EXPECT_EQ(ZX_OK, vmo->SupplyPages(0, kNumPages * PAGE_SIZE, &splice));
+
+  vm_page_t* pages[kNumPages];
+  for (size_t i = 0; i < kNumPages; i++) {
+    status = vmo->GetPage(i * PAGE_SIZE, 0, nullptr, nullptr, &pages[i], nullptr);
+    ASSERT_EQ(ZX_OK, status);
+    EXPECT_TRUE(pmm_page_queues()->DebugPageIsPagerBacked(pages[i]));
+  }
+
+  // Mapping the pages, even writable, must not mark them dirty.
+  fbl::RefPtr<VmAspace> user_aspace =
+      fbl::RefPtr(vmm_aspace_to_obj(Thread::Current::Get()->aspace_));
+  fbl::RefPtr<VmMapping> mapping;
+  status = user_aspace->RootVmar()->CreateVmMapping(
+      0, kNumPages * PAGE_SIZE, 0, VMAR_FLAG_CAN_MAP_READ | VMAR_FLAG_CAN_MAP_WRITE, vmo, 0,
+      ARCH_MMU_FLAG_PERM_READ | ARCH_MMU_FLAG_PERM_WRITE, "unittest", &mapping);
+  ASSERT_EQ(ZX_OK, status);
+  auto unmap_user = fbl::MakeAutoCall([&]() { mapping->Unmap(mapping->base(), mapping->size()); });
+  EXPECT_EQ(ZX_OK, mapping->MapRange(0, kNumPages * PAGE_SIZE, false));
+  paddr_t pa;
+  uint mmu_flags;
+  status = user_aspace->arch_aspace().Query(mapping->base(), &pa, &mmu_flags);
+  EXPECT_EQ(ZX_OK, status);
+  EXPECT_EQ(pages[0]->paddr(), pa);
+  EXPECT_FALSE(mmu_flags & ARCH_MMU_FLAG_PERM_WRITE);
+  for (size_t i = 0; i < kNumPages; i++) {
+    EXPECT_FALSE(pages[i]->object.dirty);
+    EXPECT_TRUE(pmm_page_queues()->DebugPageIsPagerBacked(pages[i]));
+  }
+
+  // A stale back reference is rejected.
+  EXPECT_FALSE(vmop->EvictPage(pages[0], PAGE_SIZE));
+
+  // Evicting a clean page frees it and removes it from the mapping.
+  EXPECT_TRUE(vmop->EvictPage(pages[0], 0));
+  status = user_aspace->arch_aspace().Query(mapping->base(), &pa, &mmu_flags);
+  EXPECT_NE(ZX_OK, status);
+  EXPECT_EQ(kNumPages - 1, vmo->AttributedPages());
+
+  // Once written the pager can no longer recreate the page, so it is kept.
+  uint8_t val = 42;
+  EXPECT_EQ(ZX_OK, vmo->Write(&val, PAGE_SIZE, sizeof(val)));
+  EXPECT_TRUE(pages[1]->object.dirty);
+  EXPECT_TRUE(pmm_page_queues()->DebugPageIsUnswappable(pages[1]));
+  EXPECT_FALSE(vmop->EvictPage(pages[1], PAGE_SIZE));
+  EXPECT_EQ(kNumPages - 1, vmo->AttributedPages());
+
+  END_TEST;
+}
+
 // Use the function name as the test name
 #define VM_UNITTEST(fname) UNITTEST(#fname, fname)
 
@@ -2766,6 +3205,11 @@ VM_UNITTEST(vmo_lookup_test)
 VM_UNITTEST(vmo_lookup_clone_test)
 VM_UNITTEST(vmo_clone_removes_write_test)
 VM_UNITTEST(vmo_zero_scan_test)
+VM_UNITTEST(vmo_fault_around_test)
+VM_UNITTEST(vmo_large_page_test)
+VM_UNITTEST(vmo_compress_cold_pages_test)
+VM_UNITTEST(vmo_dedup_pages_test)
+VM_UNITTEST(vmo_evict_pager_backed_test)
 VM_UNITTEST(arch_noncontiguous_map)
 VM_UNITTEST(vm_kernel_region_test)
 VM_UNITTEST(region_list_get_alloc_spot_test)
@@ -2794,6 +3238,7 @@ VM_UNITTEST(pmm_node_delayed_alloc_swap_early_test)
 VM_UNITTEST(pmm_node_delayed_alloc_swap_late_test)
 VM_UNITTEST(pmm_node_delayed_alloc_clear_early_test)
 VM_UNITTEST(pmm_node_delayed_alloc_clear_late_test)
+VM_UNITTEST(pmm_node_page_cache_test)
 VM_UNITTEST(pmm_checker_test)
 VM_UNITTEST(pmm_get_arena_info_test)
 UNITTEST_END_TESTCASE(pmm_tests, "pmm", "Physical memory manager tests")
@@ -2821,4 +3266,5 @@ UNITTEST_START_TESTCASE(page_queues_tests)
 VM_UNITTEST(pq_add_remove)
 VM_UNITTEST(pq_move_queues)
 VM_UNITTEST(pq_move_self_queue)
+VM_UNITTEST(pq_rotate_pager_backed)
 UNITTEST_END_TESTCASE(page_queues_tests, "pq", "PageQueues tests")
@@ -120,4 +120,6 @@ typedef uint32_t zx_rights_t;
 
 #define ZX_DEFAULT_CLOCK_RIGHTS (ZX_RIGHTS_BASIC | ZX_RIGHTS_IO)
 
+#define ZX_DEFAULT_WAITSET_RIGHTS ((ZX_RIGHTS_BASIC & (~ZX_RIGHT_WAIT)) | ZX_RIGHTS_IO)
+
 #endif  // SYSROOT_ZIRCON_RIGHTS_H_
@@ -174,6 +174,13 @@ typedef struct zx_wait_item {
     zx_signals_t pending;
 } zx_wait_item_t;
 
+// Structure for zx_waitset_wait():
+typedef struct zx_waitset_result {
+    uint64_t cookie;
+    zx_status_t status;
+    zx_signals_t observed;
+} zx_waitset_result_t;
+
 // VM Object creation options
 #define ZX_VMO_RESIZABLE                 ((uint32_t)1u << 1)
 
@@ -386,6 +393,7 @@ typedef uint32_t zx_obj_type_t;
 #define ZX_OBJ_TYPE_STREAM          ((zx_obj_type_t)31u)
 #define ZX_OBJ_TYPE_MSI_ALLOCATION  ((zx_obj_type_t)32u)
 #define ZX_OBJ_TYPE_MSI_INTERRUPT   ((zx_obj_type_t)33u)
+#define ZX_OBJ_TYPE_WAITSET         ((zx_obj_type_t)34u)
 
 // System ABI commits to having no more than 64 object types.
 //
@@ -435,6 +443,18 @@ typedef struct zx_channel_call_args {
     uint32_t rd_num_handles;
 } zx_channel_call_args_t;
 
+// Used in channel_write_many and channel_read_many. For channel_read_many,
+// |num_bytes| and |num_handles| give the size of the buffers on input and the
+// size of the message that was read on output.
+typedef struct zx_channel_message {
+    void* bytes;
+    zx_handle_t* handles;
+    uint32_t num_bytes;
+    uint32_t num_handles;
+    zx_status_t status;
+    uint32_t reserved;
+} zx_channel_message_t;
+
 // The ZX_VM_FLAG_* constants are to be deprecated in favor of the ZX_VM_*
 // versions.
 #define ZX_VM_FLAG_PERM_READ              ((uint32_t)1u << 0)
@@ -4,20 +4,44 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <inttypes.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <map>
+#include <vector>
+
 #include <fbl/string.h>
 #include <fbl/unique_fd.h>
 #include <fuchsia/tracing/kernel/c/fidl.h>
 #include <lib/fdio/fdio.h>
+#include <lib/zircon-internal/ktrace.h>
 #include <lib/zx/channel.h>
 #include <zircon/status.h>
 
 static const char kDevicePath[] = "/dev/misc/ktrace";
 
+// Returns whether records of |event| are name records, which carry no timestamp.
+static bool IsNameEvent(uint32_t event) {
+#define KTRACE_IS_NAME_16B false
+#define KTRACE_IS_NAME_32B false
+#define KTRACE_IS_NAME_NAME true
+#define KTRACE_DEF(num, type, name, group) \
+  case num:                                \
+    return KTRACE_IS_NAME_##type;
+  switch (event) {
+#include <lib/zircon-internal/ktrace-def.h>
+    default:
+      return false;
+  }
+#undef KTRACE_IS_NAME_16B
+#undef KTRACE_IS_NAME_32B
+#undef KTRACE_IS_NAME_NAME
+}
+
 static const char kUsage[] =
     "\
 Usage: ktrace [options] <control>\n\
@@ -29,6 +53,9 @@ Where <control> is one of:\n\
     Note: This value doesn't reset on \"rewind\". Instead, the rewind\n\
     takes effect on the next \"start\".\n\
   save <path>         - save contents of trace buffer to <path>\n\
+    Note: Each cpu traces into its own buffer; the records of all cpus\n\
+    are merged by timestamp into a single stream. In streaming mode the\n\
+    saved records are consumed from the buffers.\n\
 \n\
 Options:\n\
   --help  - Duh.\n\
@@ -130,6 +157,96 @@ static int DoWritten() {
   return EXIT_SUCCESS;
 }
 
+// Returns the length of the whole record at |offset| in |data|, or 0 if there is none before
+// |limit|.
+static size_t RecordLengthAt(const std::vector<uint8_t>& data, size_t offset, size_t limit) {
+  uint32_t tag;
+  if (limit - offset < sizeof(tag)) {
+    return 0;
+  }
+  memcpy(&tag, data.data() + offset, sizeof(tag));
+  const size_t len = KTRACE_LEN(tag);
+  return len <= limit - offset ? len : 0;
+}
+
+// Returns the timestamp of the record at |offset| in |data|, or |last_ts| if it has none.
+static uint64_t RecordTimestamp(const std::vector<uint8_t>& data, size_t offset,
+                                uint64_t last_ts) {
+  ktrace_header_t hdr;
+  if (RecordLengthAt(data, offset, data.size()) < sizeof(hdr)) {
+    return last_ts;
+  }
+  memcpy(&hdr, data.data() + offset, sizeof(hdr));
+  if (IsNameEvent(KTRACE_EVENT(hdr.tag))) {
+    return last_ts;
+  }
+  return hdr.ts;
+}
+
+// The records of one cpu, gathered from the CPU_BUFFER sections in the order they appear.
+struct CpuRecords {
+  std::vector<size_t> offsets;
+  size_t next = 0;
+  // Name records carry no timestamp and are ordered as if they had the one before them.
+  uint64_t last_ts = 0;
+};
+
+// Rewrites |in|, as read from the device, into a single stream of records. Records outside of
+// any CPU_BUFFER section, such as the metadata, come first. Each cpu's records are then merged
+// in timestamp order, dropping the section headers and padding.
+static void MergeCpuRecords(const std::vector<uint8_t>& in, std::vector<uint8_t>* out,
+                            uint64_t* dropped) {
+  std::map<uint32_t, CpuRecords> cpus;
+  size_t offset = 0;
+  size_t len;
+  while ((len = RecordLengthAt(in, offset, in.size())) != 0) {
+    ktrace_rec_32b_t rec = {};
+    memcpy(&rec, in.data() + offset, std::min(len, sizeof(rec)));
+    const uint32_t event = KTRACE_EVENT(rec.tag);
+    if (event == KTRACE_EVENT(TAG_CPU_BUFFER)) {
+      const size_t limit = std::min(in.size(), offset + len + rec.b);
+      CpuRecords& cpu = cpus[rec.a];
+      *dropped += rec.c;
+      offset += len;
+      while ((len = RecordLengthAt(in, offset, limit)) != 0) {
+        memcpy(&rec.tag, in.data() + offset, sizeof(rec.tag));
+        if (KTRACE_EVENT(rec.tag) != KTRACE_EVENT(TAG_PADDING)) {
+          cpu.offsets.push_back(offset);
+        }
+        offset += len;
+      }
+      offset = limit;
+      continue;
+    }
+    if (event != KTRACE_EVENT(TAG_PADDING)) {
+      out->insert(out->end(), in.begin() + offset, in.begin() + offset + len);
+    }
+    offset += len;
+  }
+
+  while (true) {
+    CpuRecords* best = nullptr;
+    uint64_t best_ts = 0;
+    for (auto& [num, cpu] : cpus) {
+      if (cpu.next == cpu.offsets.size()) {
+        continue;
+      }
+      const uint64_t ts = RecordTimestamp(in, cpu.offsets[cpu.next], cpu.last_ts);
+      if (best == nullptr || ts < best_ts) {
+        best = &cpu;
+        best_ts = ts;
+      }
+    }
+    if (best == nullptr) {
+      return;
+    }
+    best->last_ts = best_ts;
+    const size_t start = best->offsets[best->next++];
+    len = RecordLengthAt(in, start, in.size());
+    out->insert(out->end(), in.begin() + start, in.begin() + start + len);
+  }
+}
+
 static int DoSave(const char* path) {
   fbl::unique_fd in_fd{OpenKtraceDeviceAsFd()};
   fbl::unique_fd out_fd(open(path, O_CREAT | O_TRUNC | O_WRONLY, 0666));
@@ -138,19 +255,34 @@ static int DoSave(const char* path) {
     return EXIT_FAILURE;
   }
 
-  // Read/write this many bytes at a time.
+  // Each cpu's section has to be complete before the records can be merged, so read everything
+  // first. Read this many bytes at a time.
+  std::vector<uint8_t> trace;
   char buf[4096];
   ssize_t bytes_read;
   while ((bytes_read = read(in_fd.get(), buf, sizeof(buf))) > 0) {
-    ssize_t bytes_written = write(out_fd.get(), buf, bytes_read);
-    if (bytes_written < 0) {
-      fprintf(stderr, "I/O error saving buffer: %s\n", strerror(errno));
-      return EXIT_FAILURE;
-    }
-    if (bytes_written != bytes_read) {
-      fprintf(stderr, "Short write saving buffer: %zd vs %zd\n", bytes_written, bytes_read);
-      return EXIT_FAILURE;
-    }
+    trace.insert(trace.end(), buf, buf + bytes_read);
+  }
+  if (bytes_read < 0) {
+    fprintf(stderr, "I/O error reading buffer: %s\n", strerror(errno));
+    return EXIT_FAILURE;
+  }
+
+  std::vector<uint8_t> merged;
+  uint64_t dropped = 0;
+  MergeCpuRecords(trace, &merged, &dropped);
+  if (dropped != 0) {
+    fprintf(stderr, "Warning: %" PRIu64 " records were dropped while tracing\n", dropped);
+  }
+
+  ssize_t bytes_written = write(out_fd.get(), merged.data(), merged.size());
+  if (bytes_written < 0) {
+    fprintf(stderr, "I/O error saving buffer: %s\n", strerror(errno));
+    return EXIT_FAILURE;
+  }
+  if (static_cast<size_t>(bytes_written) != merged.size()) {
+    fprintf(stderr, "Short write saving buffer: %zd vs %zu\n", bytes_written, merged.size());
+    return EXIT_FAILURE;
   }
 
   return EXIT_SUCCESS;
@@ -121,6 +121,7 @@ int usage(const std::vector<Command>& commands) {
           "    -r|--readonly                 Mount filesystem read-only (after repair)\n"
           "    -j|--journal                  Enable journaling for writeback\n"
           "    -m|--metrics                  Collect filesystem metrics\n"
+          "    -e|--extents                  When mkfs, map file blocks with extent trees\n"
           "    -s|--fvm_data_slices SLICES   When mkfs on top of FVM,\n"
           "                                  preallocate |SLICES| slices of data. \n"
           "    -h|--help                     Display this message\n"
@@ -179,12 +180,13 @@ int main(int argc, char** argv) {
         {"metrics", no_argument, nullptr, 'm'},
         {"journal", no_argument, nullptr, 'j'},
         {"verbose", no_argument, nullptr, 'v'},
+        {"extents", no_argument, nullptr, 'e'},
         {"fvm_data_slices", required_argument, nullptr, 's'},
         {"help", no_argument, nullptr, 'h'},
         {nullptr, 0, nullptr, 0},
     };
     int opt_index;
-    int c = getopt_long(argc, argv, "rmjvsh:", opts, &opt_index);
+    int c = getopt_long(argc, argv, "rmjvesh:", opts, &opt_index);
     if (c < 0) {
       break;
     }
@@ -201,6 +203,9 @@ int main(int argc, char** argv) {
       case 'v':
         options.verbose = true;
         break;
+      case 'e':
+        options.extents = true;
+        break;
       case 's':
         options.fvm_data_slices = static_cast<uint32_t>(strtoul(optarg, nullptr, 0));
         break;
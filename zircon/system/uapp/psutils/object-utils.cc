@@ -62,6 +62,8 @@ const char* obj_type_get_name(zx_obj_type_t type) {
       return "clock";
     case ZX_OBJ_TYPE_STREAM:
       return "stream";
+    case ZX_OBJ_TYPE_WAITSET:
+      return "waitset";
     default:
       return "unknown";
   }
@@ -15,6 +15,7 @@
 #include <lib/async/wait.h>
 #include <stdatomic.h>
 #include <stdlib.h>
+#include <string.h>
 #include <zircon/assert.h>
 #include <zircon/listnode.h>
 #include <zircon/syscalls.h>
@@ -23,6 +24,9 @@
 // The port wait key associated with the dispatcher's control messages.
 #define KEY_CONTROL (0u)
 
+// The maximum number of packets dequeued by a single |zx_port_wait_many| call.
+#define PACKET_BATCH_SIZE (16u)
+
 static zx_time_t async_loop_now(async_dispatcher_t* dispatcher);
 static zx_status_t async_loop_begin_wait(async_dispatcher_t* dispatcher, async_wait_t* wait);
 static zx_status_t async_loop_cancel_wait(async_dispatcher_t* dispatcher, async_wait_t* wait);
@@ -90,9 +94,18 @@ typedef struct async_loop {
   list_node_t irq_list;        // list of IRQs
   list_node_t paged_vmo_list;  // most recently added first
   bool timer_armed;            // true if timer has been set and has not fired yet
+
+  // Packets dequeued from the port in a batch but not yet dispatched.
+  // The valid entries are |pending[pending_head, pending_head + pending_count)|.
+  zx_port_packet_t pending[PACKET_BATCH_SIZE];
+  uint32_t pending_head;
+  uint32_t pending_count;
 } async_loop_t;
 
 static zx_status_t async_loop_run_once(async_loop_t* loop, zx_time_t deadline);
+static zx_status_t async_loop_next_packet(async_loop_t* loop, zx_time_t deadline,
+                                          zx_port_packet_t* packet);
+static bool async_loop_drop_pending_locked(async_loop_t* loop, uint64_t key, uint32_t type);
 static zx_status_t async_loop_dispatch_wait(async_loop_t* loop, async_wait_t* wait,
                                             zx_status_t status, const zx_packet_signal_t* signal);
 static zx_status_t async_loop_dispatch_irq(async_loop_t* loop, async_irq_t* irq, zx_status_t status,
@@ -238,6 +251,10 @@ void async_loop_shutdown(async_loop_t* loop) {
     async_loop_dispatch_paged_vmo(loop, paged_vmo, ZX_ERR_CANCELED, NULL);
   }
 
+  // Any packets left over from a batch belong to objects that were just canceled.
+  loop->pending_head = 0u;
+  loop->pending_count = 0u;
+
   if (loop->config.make_default_for_current_thread) {
     ZX_DEBUG_ASSERT(loop->config.default_accessors.getter() == &loop->dispatcher);
     loop->config.default_accessors.setter(NULL);
@@ -272,7 +289,7 @@ static zx_status_t async_loop_run_once(async_loop_t* loop, zx_time_t deadline) {
     return ZX_ERR_CANCELED;
 
   zx_port_packet_t packet;
-  zx_status_t status = zx_port_wait(loop->port, deadline, &packet);
+  zx_status_t status = async_loop_next_packet(loop, deadline, &packet);
   if (status != ZX_OK)
     return status;
 
@@ -323,6 +340,63 @@ static zx_status_t async_loop_run_once(async_loop_t* loop, zx_time_t deadline) {
   return ZX_ERR_INTERNAL;
 }
 
+static zx_status_t async_loop_next_packet(async_loop_t* loop, zx_time_t deadline,
+                                          zx_port_packet_t* packet) {
+  // Hand out any packets left over from a previous batch first so that
+  // packets are still dispatched in the order in which the port queued them.
+  mtx_lock(&loop->lock);
+  if (loop->pending_count != 0u) {
+    *packet = loop->pending[loop->pending_head];
+    loop->pending_head++;
+    loop->pending_count--;
+    mtx_unlock(&loop->lock);
+    return ZX_OK;
+  }
+  mtx_unlock(&loop->lock);
+
+  // When several threads are servicing the loop, dequeue one packet at a time
+  // so that the other threads can dispatch the remaining packets concurrently.
+  uint32_t n = atomic_load_explicit(&loop->active_threads, memory_order_acquire);
+  if (n > 1u)
+    return zx_port_wait(loop->port, deadline, packet);
+
+  zx_port_packet_t packets[PACKET_BATCH_SIZE];
+  size_t actual = 0u;
+  zx_status_t status =
+      zx_port_wait_many(loop->port, deadline, packets, PACKET_BATCH_SIZE, &actual);
+  if (status != ZX_OK)
+    return status;
+  ZX_DEBUG_ASSERT(actual > 0u && actual <= PACKET_BATCH_SIZE);
+
+  *packet = packets[0];
+  if (actual > 1u) {
+    // Only a thread which observed itself as the sole active thread gets here
+    // and the buffer was empty when it checked, so nobody else can have
+    // refilled it while we were blocked.
+    mtx_lock(&loop->lock);
+    ZX_DEBUG_ASSERT(loop->pending_count == 0u);
+    memcpy(loop->pending, packets + 1, (actual - 1u) * sizeof(zx_port_packet_t));
+    loop->pending_head = 0u;
+    loop->pending_count = (uint32_t)(actual - 1u);
+    mtx_unlock(&loop->lock);
+  }
+  return ZX_OK;
+}
+
+// Removes the first undispatched packet with the given |key| and |type| from
+// the pending batch.  Returns true if such a packet was found.
+static bool async_loop_drop_pending_locked(async_loop_t* loop, uint64_t key, uint32_t type) {
+  uint32_t end = loop->pending_head + loop->pending_count;
+  for (uint32_t i = loop->pending_head; i < end; i++) {
+    if (loop->pending[i].key == key && loop->pending[i].type == type) {
+      memmove(loop->pending + i, loop->pending + i + 1, (end - i - 1) * sizeof(zx_port_packet_t));
+      loop->pending_count--;
+      return true;
+    }
+  }
+  return false;
+}
+
 async_dispatcher_t* async_loop_get_dispatcher(async_loop_t* loop) {
   // Note: The loop's implementation inherits from async_t so we can upcast to it.
   return (async_dispatcher_t*)loop;
@@ -536,8 +610,13 @@ static zx_status_t async_loop_cancel_wait(async_dispatcher_t* async, async_wait_
 
   // Next, cancel the wait.  This may be racing with another thread that
   // has read the wait's packet but not yet dispatched it.  So if we fail
-  // to cancel then we assume we lost the race.
+  // to cancel then we assume we lost the race, unless the packet is still
+  // sitting undispatched in the loop's pending batch.
   zx_status_t status = zx_port_cancel(loop->port, wait->object, (uintptr_t)wait);
+  if (status == ZX_ERR_NOT_FOUND &&
+      async_loop_drop_pending_locked(loop, (uintptr_t)wait, ZX_PKT_TYPE_SIGNAL_ONE)) {
+    status = ZX_OK;
+  }
   if (status == ZX_OK) {
     list_delete(node);
   } else {
@@ -721,6 +800,8 @@ static void async_loop_restart_timer_locked(async_loop_t* loop) {
       status = zx_port_cancel(loop->port, loop->timer, KEY_CONTROL);
       ZX_ASSERT_MSG(status == ZX_OK || status == ZX_ERR_NOT_FOUND, "zx_port_cancel: status=%d",
                     status);
+      if (status == ZX_ERR_NOT_FOUND)
+        async_loop_drop_pending_locked(loop, KEY_CONTROL, ZX_PKT_TYPE_SIGNAL_ONE);
       loop->timer_armed = false;
     }
 
@@ -784,6 +865,10 @@ static zx_status_t async_loop_unbind_irq(async_dispatcher_t* dispatcher, async_i
       zx_interrupt_bind(irq->object, loop->port, (uintptr_t)irq, ZX_INTERRUPT_UNBIND);
   if (status == ZX_OK) {
     list_delete(irq_to_node(irq));
+    // Unbinding removes queued interrupt packets from the port; do the same
+    // for any which were already dequeued as part of a batch.
+    while (async_loop_drop_pending_locked(loop, (uintptr_t)irq, ZX_PKT_TYPE_INTERRUPT)) {
+    }
   } else {
     ZX_ASSERT_MSG(status == ZX_ERR_ACCESS_DENIED, "zx_object_wait_async: status=%d", status);
   }
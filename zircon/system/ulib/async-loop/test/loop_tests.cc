@@ -149,6 +149,24 @@ class SelfCancelingWait : public TestWait {
   }
 };
 
+class CancelOtherWait : public TestWait {
+ public:
+  CancelOtherWait(zx_handle_t object, zx_signals_t trigger, TestWait* other)
+      : TestWait(object, trigger), other_(other) {}
+
+  zx_status_t cancel_result = ZX_ERR_INTERNAL;
+
+ protected:
+  void Handle(async_dispatcher_t* dispatcher, zx_status_t status,
+              const zx_packet_signal_t* signal) override {
+    TestWait::Handle(dispatcher, status, signal);
+    cancel_result = other_->Cancel(dispatcher);
+  }
+
+ private:
+  TestWait* other_;
+};
+
 class TestTask : public async_task_t {
  public:
   TestTask() : async_task_t{{ASYNC_STATE_INIT}, &TestTask::CallHandler, ZX_TIME_INFINITE} {}
@@ -540,6 +558,35 @@ bool wait_test() {
   END_TEST;
 }
 
+bool wait_cancel_dequeued_test() {
+  BEGIN_TEST;
+
+  async::Loop loop(&kAsyncLoopConfigNoAttachToCurrentThread);
+  zx::event event1, event2;
+  EXPECT_EQ(ZX_OK, zx::event::create(0u, &event1), "create event 1");
+  EXPECT_EQ(ZX_OK, zx::event::create(0u, &event2), "create event 2");
+
+  // Both packets are queued before the loop runs so they are dequeued
+  // together; canceling |wait2| from |wait1|'s handler must still succeed
+  // and suppress |wait2|'s handler.
+  TestWait wait2(event2.get(), ZX_USER_SIGNAL_0);
+  CancelOtherWait wait1(event1.get(), ZX_USER_SIGNAL_0, &wait2);
+  EXPECT_EQ(ZX_OK, wait1.Begin(loop.dispatcher()), "wait 1");
+  EXPECT_EQ(ZX_OK, wait2.Begin(loop.dispatcher()), "wait 2");
+  EXPECT_EQ(ZX_OK, event1.signal(0u, ZX_USER_SIGNAL_0), "signal 1");
+  EXPECT_EQ(ZX_OK, event2.signal(0u, ZX_USER_SIGNAL_0), "signal 2");
+
+  EXPECT_EQ(ZX_OK, loop.RunUntilIdle(), "run loop");
+  EXPECT_EQ(1u, wait1.run_count, "run count 1");
+  EXPECT_EQ(ZX_OK, wait1.cancel_result, "cancel result");
+  EXPECT_EQ(0u, wait2.run_count, "run count 2");
+
+  loop.Shutdown();
+  EXPECT_EQ(0u, wait2.run_count, "run count 2");
+
+  END_TEST;
+}
+
 bool irq_test() {
   BEGIN_TEST;
   async_loop_config_t config = kAsyncLoopConfigNoAttachToCurrentThread;
@@ -1298,6 +1345,7 @@ RUN_TEST(make_default_true_test)
 RUN_TEST(quit_test)
 RUN_TEST(time_test)
 RUN_TEST(wait_test)
+RUN_TEST(wait_cancel_dequeued_test)
 RUN_TEST(irq_test)
 RUN_TEST(wait_timestamp_test)
 RUN_TEST(wait_timestamp_integration_test)
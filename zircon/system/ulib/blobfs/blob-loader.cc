@@ -20,6 +20,7 @@
 #include "blob-verifier.h"
 #include "compression/algorithm.h"
 #include "compression/decompressor.h"
+#include "compression/zstd-seekable-blob.h"
 #include "iterator/block-iterator.h"
 
 namespace blobfs {
@@ -116,11 +117,24 @@ zx_status_t BlobLoader::LoadBlobPaged(uint32_t node_index,
     return status;
   }
 
+  std::unique_ptr<ZSTDSeekableBlob> zstd_seekable_blob;
+  if (inode->IsCompressed()) {
+    if (!(inode->header.flags & kBlobFlagZSTDSeekableCompressed)) {
+      FS_TRACE_ERROR("blobfs: Only zstd seekable blobs can be paged\n");
+      return ZX_ERR_NOT_SUPPORTED;
+    }
+    if ((status = InitZSTDSeekableBlob(node_index, *inode, &zstd_seekable_blob)) != ZX_OK) {
+      return status;
+    }
+  }
+
   UserPagerInfo userpager_info;
   userpager_info.identifier = node_index;
   userpager_info.data_start_bytes = ComputeNumMerkleTreeBlocks(*inode) * kBlobfsBlockSize;
   userpager_info.data_length_bytes = inode->blob_size;
   userpager_info.verifier = std::move(verifier);
+  userpager_info.zstd_seekable_blob = std::move(zstd_seekable_blob);
+  userpager_info.max_read_ahead_bytes = pager_->MaxReadAheadBytes();
   auto page_watcher = std::make_unique<PageWatcher>(pager_, std::move(userpager_info));
 
   fbl::StringBuffer<ZX_MAX_NAME_LEN> data_vmo_name;
@@ -195,6 +209,97 @@ zx_status_t BlobLoader::InitMerkleVerifier(uint32_t node_index, const Inode& ino
   return ZX_OK;
 }
 
+zx_status_t BlobLoader::InitZSTDSeekableBlob(uint32_t node_index, const Inode& inode,
+                                             std::unique_ptr<ZSTDSeekableBlob>* out) const {
+  TRACE_DURATION("blobfs", "BlobLoader::InitZSTDSeekableBlob");
+
+  // Only the header at the start of the stored data and the seek table at its end are read in
+  // here. The seek table's size is recorded in its footer, so that is read first.
+  fzl::OwnedVmoMapper header_mapper;
+  const uint8_t* header_buf;
+  zx_status_t status =
+      LoadDataRange(node_index, inode, 0, kZSTDSeekableHeaderSize, &header_mapper, &header_buf);
+  if (status != ZX_OK) {
+    return status;
+  }
+  ZSTDSeekableHeader header;
+  uint64_t footer_offset, footer_length;
+  if ((status = ZSTDSeekableBlob::FooterRange(header_buf, kZSTDSeekableHeaderSize, &header,
+                                              &footer_offset, &footer_length)) != ZX_OK) {
+    return status;
+  }
+
+  fzl::OwnedVmoMapper footer_mapper;
+  const uint8_t* footer_buf;
+  if ((status = LoadDataRange(node_index, inode, footer_offset, footer_length, &footer_mapper,
+                              &footer_buf)) != ZX_OK) {
+    return status;
+  }
+  uint64_t seek_table_offset, seek_table_length;
+  if ((status = ZSTDSeekableBlob::SeekTableRange(header, footer_buf, footer_length,
+                                                 &seek_table_offset, &seek_table_length)) !=
+      ZX_OK) {
+    return status;
+  }
+
+  fzl::OwnedVmoMapper seek_table_mapper;
+  const uint8_t* seek_table_buf;
+  if ((status = LoadDataRange(node_index, inode, seek_table_offset, seek_table_length,
+                              &seek_table_mapper, &seek_table_buf)) != ZX_OK) {
+    return status;
+  }
+  std::unique_ptr<ZSTDSeekableBlob> blob;
+  if ((status = ZSTDSeekableBlob::Create(header, seek_table_buf, seek_table_length, &blob)) !=
+      ZX_OK) {
+    return status;
+  }
+  if (blob->DecompressedSize() != inode.blob_size) {
+    FS_TRACE_ERROR("blobfs: Seek table covers %zu bytes, blob has %zu\n",
+                   blob->DecompressedSize(), inode.blob_size);
+    return ZX_ERR_IO_DATA_INTEGRITY;
+  }
+
+  *out = std::move(blob);
+  return ZX_OK;
+}
+
+zx_status_t BlobLoader::LoadDataRange(uint32_t node_index, const Inode& inode, uint64_t offset,
+                                      uint64_t length, fzl::OwnedVmoMapper* mapper_out,
+                                      const uint8_t** data_out) const {
+  const uint32_t num_merkle_blocks = ComputeNumMerkleTreeBlocks(inode);
+  const uint64_t num_data_blocks = inode.block_count - num_merkle_blocks;
+  uint64_t end;
+  if (add_overflow(offset, length, &end) || end > num_data_blocks * kBlobfsBlockSize) {
+    FS_TRACE_ERROR("blobfs: Range past the end of the blob's data\n");
+    return ZX_ERR_IO_DATA_INTEGRITY;
+  }
+
+  const uint64_t start_block = offset / kBlobfsBlockSize;
+  const uint64_t block_count =
+      fbl::round_up(end, kBlobfsBlockSize) / kBlobfsBlockSize - start_block;
+
+  fbl::StringBuffer<ZX_MAX_NAME_LEN> vmo_name;
+  FormatBlobCompressedVmoName(node_index, &vmo_name);
+  fzl::OwnedVmoMapper mapper;
+  zx_status_t status = mapper.CreateAndMap(block_count * kBlobfsBlockSize, vmo_name.c_str());
+  if (status != ZX_OK) {
+    FS_TRACE_ERROR("blobfs: Failed to initialize vmo; error: %s\n", zx_status_get_string(status));
+    return status;
+  }
+
+  fs::Duration read_duration;
+  if ((status = LoadDataBlocks(node_index, inode, start_block, block_count, mapper,
+                               &read_duration)) != ZX_OK) {
+    return status;
+  }
+  blobfs_->Metrics()->UpdateMerkleDiskRead(block_count * kBlobfsBlockSize, read_duration);
+
+  *data_out =
+      static_cast<const uint8_t*>(mapper.start()) + (offset - start_block * kBlobfsBlockSize);
+  *mapper_out = std::move(mapper);
+  return ZX_OK;
+}
+
 zx_status_t BlobLoader::LoadMerkle(uint32_t node_index, const Inode& inode,
                                    const fzl::OwnedVmoMapper& vmo) const {
   storage::OwnedVmoid vmoid(blobfs_);
@@ -323,6 +428,21 @@ zx_status_t BlobLoader::LoadDataInternal(uint32_t node_index, const Inode& inode
                                          fs::Duration* out_duration,
                                          uint64_t* out_bytes_read) const {
   TRACE_DURATION("blobfs", "BlobLoader::LoadDataInternal");
+
+  uint32_t merkle_blocks = ComputeNumMerkleTreeBlocks(inode);
+  uint32_t data_blocks = inode.block_count - merkle_blocks;
+  zx_status_t status;
+  if ((status = LoadDataBlocks(node_index, inode, 0, data_blocks, vmo, out_duration)) != ZX_OK) {
+    return status;
+  }
+  *out_bytes_read = data_blocks * kBlobfsBlockSize;
+  return ZX_OK;
+}
+
+zx_status_t BlobLoader::LoadDataBlocks(uint32_t node_index, const Inode& inode,
+                                       uint64_t start_block, uint64_t block_count,
+                                       const fzl::OwnedVmoMapper& vmo,
+                                       fs::Duration* out_duration) const {
   fs::Ticker ticker(blobfs_->Metrics()->Collecting());
 
   zx_status_t status;
@@ -337,18 +457,18 @@ zx_status_t BlobLoader::LoadDataInternal(uint32_t node_index, const Inode& inode
   fs::ReadTxn txn(blobfs_);
 
   // Stream the blocks, skipping the first |merkle_blocks| which contain the merkle tree.
-  uint32_t merkle_blocks = ComputeNumMerkleTreeBlocks(inode);
-  uint32_t data_blocks = inode.block_count - merkle_blocks;
+  const uint64_t first_block = ComputeNumMerkleTreeBlocks(inode) + start_block;
   const uint64_t kDataStart = DataStartBlock(blobfs_->Info());
   BlockIterator block_iter = blobfs_->BlockIteratorByNodeIndex(node_index);
-  if ((status = IterateToBlock(&block_iter, merkle_blocks)) != ZX_OK) {
-    FS_TRACE_ERROR("blobfs: Failed to seek past merkle blocks: %s\n", zx_status_get_string(status));
+  if ((status = IterateToBlock(&block_iter, static_cast<uint32_t>(first_block))) != ZX_OK) {
+    FS_TRACE_ERROR("blobfs: Failed to seek to data block %zu: %s\n", start_block,
+                   zx_status_get_string(status));
     return status;
   }
 
-  status = StreamBlocks(&block_iter, data_blocks,
+  status = StreamBlocks(&block_iter, static_cast<uint32_t>(block_count),
                         [&](uint64_t vmo_offset, uint64_t dev_offset, uint32_t length) {
-                          txn.Enqueue(vmoid.vmoid(), vmo_offset - merkle_blocks,
+                          txn.Enqueue(vmoid.vmoid(), vmo_offset - first_block,
                                       kDataStart + dev_offset, length);
                           return ZX_OK;
                         });
@@ -361,8 +481,6 @@ zx_status_t BlobLoader::LoadDataInternal(uint32_t node_index, const Inode& inode
   }
 
   *out_duration = ticker.End();
-  *out_bytes_read = data_blocks * kBlobfsBlockSize;
-
   return ZX_OK;
 }
 
@@ -16,6 +16,7 @@
 #include <fbl/macros.h>
 
 #include "blobfs.h"
+#include "compression/zstd-seekable-blob.h"
 #include "pager/page-watcher.h"
 
 namespace blobfs {
@@ -73,6 +74,20 @@ class BlobLoader {
   zx_status_t LoadDataInternal(uint32_t node_index, const Inode& inode,
                                const fzl::OwnedVmoMapper& vmo, fs::Duration* out_duration,
                                uint64_t *out_bytes_read) const;
+  // Reads |block_count| blocks of the blob's stored data, starting at data block |start_block|,
+  // into the start of |vmo|.
+  zx_status_t LoadDataBlocks(uint32_t node_index, const Inode& inode, uint64_t start_block,
+                             uint64_t block_count, const fzl::OwnedVmoMapper& vmo,
+                             fs::Duration* out_duration) const;
+  // Reads the blocks holding bytes [|offset|, |offset| + |length|) of the blob's stored data into
+  // a new VMO |mapper_out|, and points |data_out| at the first requested byte.
+  zx_status_t LoadDataRange(uint32_t node_index, const Inode& inode, uint64_t offset,
+                            uint64_t length, fzl::OwnedVmoMapper* mapper_out,
+                            const uint8_t** data_out) const;
+  // Reads in the header and seek table of a zstd seekable blob, so that the pager can later
+  // decompress just the frames covering each fault.
+  zx_status_t InitZSTDSeekableBlob(uint32_t node_index, const Inode& inode,
+                                   std::unique_ptr<ZSTDSeekableBlob>* out) const;
 
   Blobfs* const blobfs_;
   UserPager* const pager_;
@@ -49,8 +49,9 @@ using digest::Digest;
 using digest::MerkleTreeCreator;
 
 bool SupportsPaging(const Inode& inode) {
-  // Currently only uncompressed blobs can be paged.
-  return !inode.IsCompressed();
+  // Uncompressed blobs can be paged, and so can compressed ones whose format allows decompressing
+  // only the part of the blob covering a fault.
+  return !inode.IsCompressed() || (inode.header.flags & kBlobFlagZSTDSeekableCompressed);
 }
 
 }  // namespace
@@ -176,7 +177,10 @@ zx_status_t Blob::SpaceAllocate(uint64_t size_data) {
 
   if (blobfs_->ShouldCompress() && inode_.blob_size >= kCompressionMinBytesSaved) {
     // TODO(markdittmer): Lookup stored choice of compression algorithm here.
-    write_info->compressor = BlobCompressor::Create(CompressionAlgorithm::ZSTD, inode_.blob_size);
+    // With paging enabled, use the seekable format so the blob can be paged in a frame at a time.
+    const CompressionAlgorithm algorithm =
+        blobfs_->PagingEnabled() ? CompressionAlgorithm::ZSTD_SEEKABLE : CompressionAlgorithm::ZSTD;
+    write_info->compressor = BlobCompressor::Create(algorithm, inode_.blob_size);
     if (!write_info->compressor) {
       FS_TRACE_ERROR("blobfs: Failed to initialize compressor: %d\n", status);
       return status;
@@ -423,7 +427,8 @@ zx_status_t Blob::WriteInternal(const void* data, size_t len, size_t* actual) {
 
     inode_.block_count = blocks;
     // TODO(markdittmer): Use flag of chosen algorithm here.
-    inode_.header.flags |= kBlobFlagZSTDCompressed;
+    inode_.header.flags |=
+        blobfs_->PagingEnabled() ? kBlobFlagZSTDSeekableCompressed : kBlobFlagZSTDCompressed;
   } else {
     uint64_t blocks64 = fbl::round_up(inode_.blob_size, kBlobfsBlockSize) / kBlobfsBlockSize;
     ZX_DEBUG_ASSERT(blocks64 <= std::numeric_limits<uint32_t>::max());
@@ -153,7 +153,14 @@ zx_status_t Blobfs::Create(async_dispatcher_t* dispatcher, std::unique_ptr<Block
   fs->block_info_ = std::move(block_info);
 
   if (options->pager) {
-    status = fs->InitPager();
+    UserPagerOptions pager_options;
+    if (options->pager_threads != 0) {
+      pager_options.num_threads = options->pager_threads;
+    }
+    if (options->pager_max_read_ahead_bytes) {
+      pager_options.max_read_ahead_bytes = *options->pager_max_read_ahead_bytes;
+    }
+    status = fs->InitPager(pager_options);
     if (status != ZX_OK) {
       FS_TRACE_ERROR("blobfs: Could not initialize user pager\n");
       return status;
@@ -289,7 +296,12 @@ std::unique_ptr<BlockDevice> Blobfs::Destroy(std::unique_ptr<Blobfs> blobfs) {
   return blobfs->Reset();
 }
 
-Blobfs::~Blobfs() { Reset(); }
+Blobfs::~Blobfs() {
+  if (paging_enabled_ && metrics_.Collecting()) {
+    PagerMetrics()->Dump();
+  }
+  Reset();
+}
 
 zx_status_t Blobfs::LoadAndVerifyBlob(uint32_t node_index) {
   return Blob::LoadAndVerifyBlob(this, node_index);
@@ -811,17 +823,106 @@ zx_status_t Blobfs::OpenRootNode(fbl::RefPtr<fs::Vnode>* out) {
 Journal* Blobfs::journal() { return journal_.get(); }
 
 zx_status_t Blobfs::AttachTransferVmo(const zx::vmo& transfer_vmo) {
-  return AttachVmo(transfer_vmo, &transfer_vmoid_);
+  vmoid_t vmoid;
+  zx_status_t status = AttachVmo(transfer_vmo, &vmoid);
+  if (status != ZX_OK) {
+    return status;
+  }
+  transfer_vmoids_[transfer_vmo.get()] = vmoid;
+  return ZX_OK;
 }
 
-zx_status_t Blobfs::PopulateTransferVmo(uint64_t offset, uint64_t length, UserPagerInfo* info) {
+zx_status_t Blobfs::PopulateTransferVmo(uint64_t offset, uint64_t length,
+                                        const zx::vmo& transfer_vmo, UserPagerInfo* info) {
+  auto vmoid = transfer_vmoids_.find(transfer_vmo.get());
+  if (vmoid == transfer_vmoids_.end()) {
+    return ZX_ERR_INVALID_ARGS;
+  }
+
+  if (info->zstd_seekable_blob) {
+    return PopulateAndDecompressTransferVmo(offset, length, transfer_vmo, vmoid->second, info);
+  }
+
   fs::Ticker ticker(metrics_.Collecting());
+  zx_status_t status = ReadTransferBlocks(vmoid->second, *info, offset, length, 0);
+  if (status != ZX_OK) {
+    return status;
+  }
+  metrics_.UpdateMerkleDiskRead(fbl::round_up(length, kBlobfsBlockSize), ticker.End());
+  return ZX_OK;
+}
+
+zx_status_t Blobfs::PopulateAndDecompressTransferVmo(uint64_t offset, uint64_t length,
+                                                     const zx::vmo& transfer_vmo, vmoid_t vmoid,
+                                                     UserPagerInfo* info) {
+  TRACE_DURATION("blobfs", "Blobfs::PopulateAndDecompressTransferVmo", "offset", offset, "length",
+                 length);
+  ZSTDSeekableBlob* blob = info->zstd_seekable_blob.get();
+
+  uint64_t compressed_offset, compressed_length;
+  zx_status_t status =
+      blob->CompressedRange(offset, length, &compressed_offset, &compressed_length);
+  if (status != ZX_OK) {
+    FS_TRACE_ERROR("blobfs: Failed to find compressed frames: %s\n", zx_status_get_string(status));
+    return status;
+  }
+
+  // The compressed frames are read in right after the space their decompressed contents will take
+  // up in the transfer buffer, and dropped again once they have been decompressed.
+  const uint64_t compressed_start = fbl::round_down(compressed_offset, kBlobfsBlockSize);
+  const uint64_t compressed_buffer_length =
+      fbl::round_up(compressed_offset + compressed_length, kBlobfsBlockSize) - compressed_start;
+  const uint64_t compressed_buffer_offset = fbl::round_up(length, kBlobfsBlockSize);
+  const uint64_t mapping_length = compressed_buffer_offset + compressed_buffer_length;
+  if (mapping_length > kTransferBufferSize) {
+    return ZX_ERR_OUT_OF_RANGE;
+  }
+  auto decommit = fbl::MakeAutoCall([&]() {
+    transfer_vmo.op_range(ZX_VMO_OP_DECOMMIT, compressed_buffer_offset, compressed_buffer_length,
+                          nullptr, 0);
+  });
+
+  fs::Ticker read_ticker(metrics_.Collecting());
+  status = ReadTransferBlocks(vmoid, *info, compressed_offset, compressed_length,
+                              compressed_buffer_offset / kBlobfsBlockSize);
+  if (status != ZX_OK) {
+    return status;
+  }
+  const fs::Duration read_duration = read_ticker.End();
+
+  fs::Ticker decompress_ticker(metrics_.Collecting());
+  fzl::VmoMapper mapping;
+  // The transfer VMO has to be unmapped before its pages can be supplied.
+  auto unmap = fbl::MakeAutoCall([&]() { mapping.Unmap(); });
+  status = mapping.Map(transfer_vmo, 0, mapping_length, ZX_VM_PERM_READ | ZX_VM_PERM_WRITE);
+  if (status != ZX_OK) {
+    FS_TRACE_ERROR("blobfs: Failed to map transfer buffer: %s\n", zx_status_get_string(status));
+    return status;
+  }
+  const uint8_t* compressed_buffer =
+      static_cast<const uint8_t*>(mapping.start()) + compressed_buffer_offset;
+  status = blob->DecompressRange(offset, length, compressed_buffer, compressed_start,
+                                 compressed_buffer_length, mapping.start());
+  if (status != ZX_OK) {
+    FS_TRACE_ERROR("blobfs: Failed to decompress frames: %s\n", zx_status_get_string(status));
+    return status;
+  }
+
+  metrics_.UpdateMerkleDecompress(compressed_length, length, read_duration,
+                                  decompress_ticker.End());
+  return ZX_OK;
+}
+
+zx_status_t Blobfs::ReadTransferBlocks(vmoid_t vmoid, const UserPagerInfo& info,
+                                       uint64_t data_offset, uint64_t length,
+                                       uint64_t vmo_block_offset) {
   fs::ReadTxn txn(this);
-  BlockIterator block_iter = BlockIteratorByNodeIndex(info->identifier);
+  BlockIterator block_iter = BlockIteratorByNodeIndex(info.identifier);
 
-  auto start_block = static_cast<uint32_t>((offset + info->data_start_bytes) / kBlobfsBlockSize);
-  auto block_count =
-      static_cast<uint32_t>(fbl::round_up(length, kBlobfsBlockSize) / kBlobfsBlockSize);
+  const uint64_t start = info.data_start_bytes + data_offset;
+  auto start_block = static_cast<uint32_t>(start / kBlobfsBlockSize);
+  auto block_count = static_cast<uint32_t>(
+      fbl::round_up(start + length, kBlobfsBlockSize) / kBlobfsBlockSize - start_block);
 
   // Navigate to the start block.
   zx_status_t status = IterateToBlock(&block_iter, start_block);
@@ -835,7 +936,8 @@ zx_status_t Blobfs::PopulateTransferVmo(uint64_t offset, uint64_t length, UserPa
   const uint64_t data_start = DataStartBlock(Info());
   status = StreamBlocks(
       &block_iter, block_count, [&](uint64_t vmo_offset, uint64_t dev_offset, uint32_t length) {
-        txn.Enqueue(transfer_vmoid_, vmo_offset - start_block, dev_offset + data_start, length);
+        txn.Enqueue(vmoid, vmo_offset - start_block + vmo_block_offset, dev_offset + data_start,
+                    length);
         return ZX_OK;
       });
   if (status != ZX_OK) {
@@ -850,7 +952,6 @@ zx_status_t Blobfs::PopulateTransferVmo(uint64_t offset, uint64_t length, UserPa
                    zx_status_get_string(status));
     return status;
   }
-  metrics_.UpdateMerkleDiskRead(block_count * kBlobfsBlockSize, ticker.End());
   return ZX_OK;
 }
 
@@ -884,7 +985,18 @@ zx_status_t Blobfs::AlignForVerification(uint64_t* offset, uint64_t* length, Use
   uint64_t data_offset = *offset;
   uint64_t data_length = fbl::min(*length, info->data_length_bytes - data_offset);
 
-  zx_status_t status = info->verifier->Align(&data_offset, &data_length);
+  zx_status_t status;
+  if (info->zstd_seekable_blob) {
+    // Frames are decompressed whole, so all of their pages might as well be supplied.
+    status = info->zstd_seekable_blob->AlignToFrames(&data_offset, &data_length);
+    if (status != ZX_OK) {
+      FS_TRACE_ERROR("blobfs: Could not align offsets to compressed frames: %s\n",
+                     zx_status_get_string(status));
+      return status;
+    }
+  }
+
+  status = info->verifier->Align(&data_offset, &data_length);
   if (status != ZX_OK) {
     FS_TRACE_ERROR("blobfs: Could not align offsets for verification: %s\n",
                    zx_status_get_string(status));
@@ -17,6 +17,7 @@
 #include <lib/fzl/resizeable-vmo-mapper.h>
 #include <lib/zx/vmo.h>
 
+#include <map>
 #include <memory>
 
 #include <bitmap/raw-bitmap.h>
@@ -190,14 +191,26 @@ class Blobfs : public TransactionManager, public UserPager, public BlockIterator
   ////////////////
   // UserPager interface.
   //
-  // Allows populating (and verifying) the pager transfer buffer with a blob's blocks
+  // Allows populating (and verifying) the pager transfer buffers with a blob's blocks
   // from the block device.
   zx_status_t AttachTransferVmo(const zx::vmo& transfer_vmo) final;
-  zx_status_t PopulateTransferVmo(uint64_t offset, uint64_t length, UserPagerInfo* info) final;
+  zx_status_t PopulateTransferVmo(uint64_t offset, uint64_t length, const zx::vmo& transfer_vmo,
+                                  UserPagerInfo* info) final;
   zx_status_t VerifyTransferVmo(uint64_t offset, uint64_t length, const zx::vmo& transfer_vmo,
                                 UserPagerInfo* info) final;
   zx_status_t AlignForVerification(uint64_t* offset, uint64_t* length, UserPagerInfo* info) final;
 
+  // Reads the frames of a zstd seekable blob covering the uncompressed range
+  // [|offset|, |offset| + |length|) and decompresses them to the start of |transfer_vmo|.
+  zx_status_t PopulateAndDecompressTransferVmo(uint64_t offset, uint64_t length,
+                                               const zx::vmo& transfer_vmo, vmoid_t vmoid,
+                                               UserPagerInfo* info);
+
+  // Reads the blocks holding bytes [|data_offset|, |data_offset| + |length|) of a blob's stored
+  // data into the transfer buffer attached as |vmoid|, starting at block |vmo_block_offset|.
+  zx_status_t ReadTransferBlocks(vmoid_t vmoid, const UserPagerInfo& info, uint64_t data_offset,
+                                 uint64_t length, uint64_t vmo_block_offset);
+
   Blobfs(async_dispatcher_t* dispatcher, std::unique_ptr<BlockDevice> device,
          const Superblock* info, Writability writable);
 
@@ -276,7 +289,9 @@ class Blobfs : public TransactionManager, public UserPager, public BlockIterator
 
   BlobfsMetrics metrics_ = {};
 
-  vmoid_t transfer_vmoid_ = {};
+  // Vmoids of the pager transfer buffers, keyed by VMO handle. Filled in before the pager threads
+  // start and read-only afterwards.
+  std::map<zx_handle_t, vmoid_t> transfer_vmoids_;
   bool paging_enabled_ = false;
 
   // Compression is enabled by default. Use the kernel commandline "blobfs.uncompressed"
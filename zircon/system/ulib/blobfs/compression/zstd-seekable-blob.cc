@@ -0,0 +1,269 @@
+// Copyright 2020 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "zstd-seekable-blob.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <zircon/compiler.h>
+#include <zircon/errors.h>
+
+#include <algorithm>
+
+#include <fs/trace.h>
+#include <zstd/zstd.h>
+
+namespace blobfs {
+namespace {
+
+// Layout of the seek table, per the zstd seekable format specification in
+// //third_party/zstd/contrib/seekable_format/zstd_seekable_compression_format.md.
+constexpr uint64_t kSkippableFrameHeaderSize = 8;
+constexpr uint64_t kSeekTableEntrySize = 8;
+constexpr uint64_t kSeekTableChecksumSize = 4;
+constexpr uint8_t kSeekTableChecksumFlag = 1 << 7;
+
+uint32_t ReadLE32(const uint8_t* buf) {
+  return static_cast<uint32_t>(buf[0]) | static_cast<uint32_t>(buf[1]) << 8 |
+         static_cast<uint32_t>(buf[2]) << 16 | static_cast<uint32_t>(buf[3]) << 24;
+}
+
+}  // namespace
+
+ZSTDSeekableBlob::ZSTDSeekableBlob(uint64_t archive_size) : archive_size_(archive_size) {}
+
+ZSTDSeekableBlob::~ZSTDSeekableBlob() { ZSTD_seekable_free(stream_); }
+
+zx_status_t ZSTDSeekableBlob::FooterRange(const void* buf, size_t buf_size,
+                                          ZSTDSeekableHeader* header, uint64_t* footer_offset,
+                                          uint64_t* footer_length) {
+  if (buf_size < kZSTDSeekableHeaderSize) {
+    return ZX_ERR_BUFFER_TOO_SMALL;
+  }
+  memcpy(header, buf, sizeof(*header));
+  if (header->archive_size < ZSTD_seekTableFooterSize) {
+    FS_TRACE_ERROR("[blobfs][zstd-seekable] Archive too small for a seek table: %" PRIu64 "\n",
+                   header->archive_size);
+    return ZX_ERR_IO_DATA_INTEGRITY;
+  }
+  *footer_offset = kZSTDSeekableHeaderSize + header->archive_size - ZSTD_seekTableFooterSize;
+  *footer_length = ZSTD_seekTableFooterSize;
+  return ZX_OK;
+}
+
+zx_status_t ZSTDSeekableBlob::SeekTableRange(const ZSTDSeekableHeader& header, const void* footer,
+                                             size_t footer_length, uint64_t* seek_table_offset,
+                                             uint64_t* seek_table_length) {
+  if (footer_length < ZSTD_seekTableFooterSize) {
+    return ZX_ERR_BUFFER_TOO_SMALL;
+  }
+  // The footer is Number_Of_Frames (4 bytes), Seek_Table_Descriptor (1 byte) and
+  // Seekable_Magic_Number (4 bytes), all little-endian.
+  const uint8_t* bytes = static_cast<const uint8_t*>(footer);
+  const uint32_t num_frames = ReadLE32(bytes);
+  const uint8_t descriptor = bytes[4];
+  if (ReadLE32(bytes + 5) != ZSTD_SEEKABLE_MAGICNUMBER || num_frames > ZSTD_SEEKABLE_MAXFRAMES) {
+    FS_TRACE_ERROR("[blobfs][zstd-seekable] Invalid seek table footer\n");
+    return ZX_ERR_IO_DATA_INTEGRITY;
+  }
+
+  const uint64_t entry_size =
+      kSeekTableEntrySize + ((descriptor & kSeekTableChecksumFlag) ? kSeekTableChecksumSize : 0);
+  const uint64_t table_size =
+      kSkippableFrameHeaderSize + num_frames * entry_size + ZSTD_seekTableFooterSize;
+  if (table_size > header.archive_size) {
+    FS_TRACE_ERROR("[blobfs][zstd-seekable] Seek table larger than archive\n");
+    return ZX_ERR_IO_DATA_INTEGRITY;
+  }
+  *seek_table_offset = kZSTDSeekableHeaderSize + header.archive_size - table_size;
+  *seek_table_length = table_size;
+  return ZX_OK;
+}
+
+zx_status_t ZSTDSeekableBlob::Create(const ZSTDSeekableHeader& header, const void* seek_table,
+                                     size_t seek_table_length,
+                                     std::unique_ptr<ZSTDSeekableBlob>* out) {
+  if (seek_table_length > header.archive_size) {
+    return ZX_ERR_INVALID_ARGS;
+  }
+
+  std::unique_ptr<ZSTDSeekableBlob> blob(new ZSTDSeekableBlob(header.archive_size));
+  blob->stream_ = ZSTD_seekable_create();
+  if (blob->stream_ == nullptr) {
+    return ZX_ERR_NO_MEMORY;
+  }
+
+  // The library reads the seek table from the end of the archive while initializing.
+  blob->SetWindow(seek_table, kZSTDSeekableHeaderSize + header.archive_size - seek_table_length,
+                  seek_table_length);
+  ZSTD_seekable_customFile file = {
+      .opaque = blob.get(),
+      .read = &ZSTDSeekableBlob::Read,
+      .seek = &ZSTDSeekableBlob::Seek,
+  };
+  size_t zstd_return = ZSTD_seekable_initAdvanced(blob->stream_, file);
+  blob->SetWindow(nullptr, kZSTDSeekableHeaderSize, 0);
+  if (ZSTD_isError(zstd_return)) {
+    FS_TRACE_ERROR("[blobfs][zstd-seekable] Failed to load seek table: %s\n",
+                   ZSTD_getErrorName(zstd_return));
+    return ZX_ERR_IO_DATA_INTEGRITY;
+  }
+
+  const unsigned num_frames = ZSTD_seekable_getNumFrames(blob->stream_);
+  if (num_frames > 0) {
+    blob->decompressed_size_ =
+        ZSTD_seekable_getFrameDecompressedOffset(blob->stream_, num_frames - 1) +
+        ZSTD_seekable_getFrameDecompressedSize(blob->stream_, num_frames - 1);
+  }
+
+  *out = std::move(blob);
+  return ZX_OK;
+}
+
+zx_status_t ZSTDSeekableBlob::AlignToFrames(uint64_t* offset, uint64_t* length) {
+  unsigned first, last;
+  zx_status_t status = FrameRange(*offset, *length, &first, &last);
+  if (status != ZX_OK) {
+    return status;
+  }
+  *offset = ZSTD_seekable_getFrameDecompressedOffset(stream_, first);
+  *length = ZSTD_seekable_getFrameDecompressedOffset(stream_, last) +
+            ZSTD_seekable_getFrameDecompressedSize(stream_, last) - *offset;
+  return ZX_OK;
+}
+
+zx_status_t ZSTDSeekableBlob::CompressedRange(uint64_t offset, uint64_t length,
+                                              uint64_t* compressed_offset,
+                                              uint64_t* compressed_length) {
+  unsigned first, last;
+  zx_status_t status = FrameRange(offset, length, &first, &last);
+  if (status != ZX_OK) {
+    return status;
+  }
+  const uint64_t start = ZSTD_seekable_getFrameCompressedOffset(stream_, first);
+  const uint64_t end = ZSTD_seekable_getFrameCompressedOffset(stream_, last) +
+                       ZSTD_seekable_getFrameCompressedSize(stream_, last);
+  if (end > archive_size_) {
+    return ZX_ERR_IO_DATA_INTEGRITY;
+  }
+  *compressed_offset = kZSTDSeekableHeaderSize + start;
+  *compressed_length = end - start;
+  return ZX_OK;
+}
+
+zx_status_t ZSTDSeekableBlob::DecompressRange(uint64_t offset, uint64_t length,
+                                              const void* compressed_buf,
+                                              uint64_t compressed_offset,
+                                              uint64_t compressed_length, void* uncompressed_buf) {
+  TRACE_DURATION("blobfs", "ZSTDSeekableBlob::DecompressRange", "offset", offset, "length",
+                 length);
+
+  unsigned first, last;
+  zx_status_t status = FrameRange(offset, length, &first, &last);
+  if (status != ZX_OK) {
+    return status;
+  }
+  if (ZSTD_seekable_getFrameDecompressedOffset(stream_, first) != offset) {
+    return ZX_ERR_INVALID_ARGS;
+  }
+
+  SetWindow(compressed_buf, compressed_offset, compressed_length);
+  uint8_t* out = static_cast<uint8_t*>(uncompressed_buf);
+  uint64_t decompressed = 0;
+  for (unsigned frame = first; frame <= last; frame++) {
+    const size_t frame_size = ZSTD_seekable_getFrameDecompressedSize(stream_, frame);
+    if (decompressed + frame_size > length) {
+      status = ZX_ERR_INVALID_ARGS;
+      break;
+    }
+    size_t zstd_return = ZSTD_seekable_decompressFrame(stream_, out + decompressed, frame_size,
+                                                       frame);
+    if (ZSTD_isError(zstd_return)) {
+      FS_TRACE_ERROR("[blobfs][zstd-seekable] Failed to decompress frame %u: %s\n", frame,
+                     ZSTD_getErrorName(zstd_return));
+      status = ZX_ERR_IO_DATA_INTEGRITY;
+      break;
+    }
+    if (zstd_return != frame_size) {
+      status = ZX_ERR_IO_DATA_INTEGRITY;
+      break;
+    }
+    decompressed += frame_size;
+  }
+  SetWindow(nullptr, kZSTDSeekableHeaderSize, 0);
+
+  if (status == ZX_OK && decompressed != length) {
+    status = ZX_ERR_INVALID_ARGS;
+  }
+  return status;
+}
+
+int ZSTDSeekableBlob::Read(void* opaque, void* buf, size_t n) {
+  auto* blob = static_cast<ZSTDSeekableBlob*>(opaque);
+  if (blob->position_ < blob->window_start_ ||
+      blob->position_ - blob->window_start_ > blob->window_length_ ||
+      n > blob->window_length_ - (blob->position_ - blob->window_start_)) {
+    // The caller did not read in the part of the archive the library is asking for.
+    return -1;
+  }
+  memcpy(buf, blob->window_ + (blob->position_ - blob->window_start_), n);
+  blob->position_ += n;
+  return 0;
+}
+
+int ZSTDSeekableBlob::Seek(void* opaque, long long offset, int origin) {
+  auto* blob = static_cast<ZSTDSeekableBlob*>(opaque);
+  uint64_t base;
+  switch (origin) {
+    case SEEK_SET:
+      base = 0;
+      break;
+    case SEEK_CUR:
+      base = blob->position_;
+      break;
+    case SEEK_END:
+      base = blob->archive_size_;
+      break;
+    default:
+      return -1;
+  }
+  const uint64_t distance =
+      offset < 0 ? -static_cast<uint64_t>(offset) : static_cast<uint64_t>(offset);
+  if (offset < 0 ? distance > base : distance > blob->archive_size_ - base) {
+    return -1;
+  }
+  blob->position_ = offset < 0 ? base - distance : base + distance;
+  return 0;
+}
+
+void ZSTDSeekableBlob::SetWindow(const void* buf, uint64_t offset, uint64_t length) {
+  const uint8_t* bytes = static_cast<const uint8_t*>(buf);
+  // The header in front of the archive is not part of it.
+  if (offset < kZSTDSeekableHeaderSize) {
+    const uint64_t skip = std::min(kZSTDSeekableHeaderSize - offset, length);
+    bytes += skip;
+    length -= skip;
+    offset = kZSTDSeekableHeaderSize;
+  }
+  window_ = bytes;
+  window_start_ = offset - kZSTDSeekableHeaderSize;
+  window_length_ = length;
+}
+
+zx_status_t ZSTDSeekableBlob::FrameRange(uint64_t offset, uint64_t length, unsigned* first,
+                                         unsigned* last) {
+  uint64_t end;
+  if (length == 0 || add_overflow(offset, length, &end) || end > decompressed_size_) {
+    return ZX_ERR_OUT_OF_RANGE;
+  }
+  *first = ZSTD_seekable_offsetToFrameIndex(stream_, offset);
+  *last = ZSTD_seekable_offsetToFrameIndex(stream_, end - 1);
+  if (*last >= ZSTD_seekable_getNumFrames(stream_)) {
+    return ZX_ERR_OUT_OF_RANGE;
+  }
+  return ZX_OK;
+}
+
+}  // namespace blobfs
@@ -0,0 +1,99 @@
+// Copyright 2020 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef ZIRCON_SYSTEM_ULIB_BLOBFS_COMPRESSION_ZSTD_SEEKABLE_BLOB_H_
+#define ZIRCON_SYSTEM_ULIB_BLOBFS_COMPRESSION_ZSTD_SEEKABLE_BLOB_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <zircon/types.h>
+
+#include <memory>
+
+#include <fbl/macros.h>
+#include <zstd/zstd_seekable.h>
+
+#include "zstd-seekable.h"
+
+namespace blobfs {
+
+// Random access to a blob stored in the zstd seekable format, without keeping its compressed
+// contents in memory.
+//
+// Only the archive header and seek table are read up front. After that, callers map an
+// uncompressed range to the compressed bytes holding it with |CompressedRange|, read in just those
+// bytes, and pass them to |DecompressRange|. This lets the pager decompress only the frames that
+// cover a page fault.
+//
+// Byte offsets into the blob's stored data include the |ZSTDSeekableHeader| that precedes the
+// archive.
+//
+// This class is not thread-safe.
+class ZSTDSeekableBlob {
+ public:
+  ~ZSTDSeekableBlob();
+  DISALLOW_COPY_ASSIGN_AND_MOVE(ZSTDSeekableBlob);
+
+  // Reads the header from the first |buf_size| bytes of the blob's stored data, and returns the
+  // range of stored data holding the footer of the archive's seek table.
+  static zx_status_t FooterRange(const void* buf, size_t buf_size, ZSTDSeekableHeader* header,
+                                 uint64_t* footer_offset, uint64_t* footer_length);
+
+  // Given the footer at |footer|, returns the range of stored data holding the whole seek table,
+  // footer included.
+  static zx_status_t SeekTableRange(const ZSTDSeekableHeader& header, const void* footer,
+                                    size_t footer_length, uint64_t* seek_table_offset,
+                                    uint64_t* seek_table_length);
+
+  // Creates a blob from its |header| and the seek table returned by |SeekTableRange|.
+  static zx_status_t Create(const ZSTDSeekableHeader& header, const void* seek_table,
+                            size_t seek_table_length, std::unique_ptr<ZSTDSeekableBlob>* out);
+
+  // Returns the size of the blob's uncompressed contents.
+  uint64_t DecompressedSize() const { return decompressed_size_; }
+
+  // Rounds the uncompressed range [|*offset|, |*offset| + |*length|) out to frame boundaries.
+  zx_status_t AlignToFrames(uint64_t* offset, uint64_t* length);
+
+  // Returns the range of stored data holding the frames for the frame-aligned uncompressed range
+  // [|offset|, |offset| + |length|).
+  zx_status_t CompressedRange(uint64_t offset, uint64_t length, uint64_t* compressed_offset,
+                              uint64_t* compressed_length);
+
+  // Decompresses the frame-aligned uncompressed range [|offset|, |offset| + |length|) into
+  // |uncompressed_buf|. |compressed_buf| holds |compressed_length| bytes of stored data starting at
+  // |compressed_offset|, which must cover the range returned by |CompressedRange|.
+  zx_status_t DecompressRange(uint64_t offset, uint64_t length, const void* compressed_buf,
+                              uint64_t compressed_offset, uint64_t compressed_length,
+                              void* uncompressed_buf);
+
+ private:
+  explicit ZSTDSeekableBlob(uint64_t archive_size);
+
+  // ZSTD_seekable_customFile callbacks. The seekable library reads the archive through these,
+  // and they serve reads from whatever part of the archive was last handed to |SetWindow|.
+  static int Read(void* opaque, void* buf, size_t n);
+  static int Seek(void* opaque, long long offset, int origin);
+
+  // Makes |length| bytes of stored data at |offset|, held in |buf|, available to the library.
+  void SetWindow(const void* buf, uint64_t offset, uint64_t length);
+
+  // Returns the frames covering the uncompressed range [|offset|, |offset| + |length|).
+  zx_status_t FrameRange(uint64_t offset, uint64_t length, unsigned* first, unsigned* last);
+
+  ZSTD_seekable* stream_ = nullptr;
+  const uint64_t archive_size_;
+  uint64_t decompressed_size_ = 0;
+
+  // The archive bytes currently readable through |Read|, in archive offsets.
+  const uint8_t* window_ = nullptr;
+  uint64_t window_start_ = 0;
+  uint64_t window_length_ = 0;
+  // The library's current read position, in archive offsets.
+  uint64_t position_ = 0;
+};
+
+}  // namespace blobfs
+
+#endif  // ZIRCON_SYSTEM_ULIB_BLOBFS_COMPRESSION_ZSTD_SEEKABLE_BLOB_H_
@@ -8,6 +8,8 @@
 #include <lib/async-loop/default.h>
 #include <lib/zx/channel.h>
 
+#include <optional>
+
 #include <blobfs/cache-policy.h>
 #include <block-client/cpp/block-device.h>
 #include <fbl/function.h>
@@ -45,6 +47,10 @@ struct MountOptions {
   bool metrics = false;
   bool journal = false;
   bool pager = false;
+  // Number of threads servicing page requests when |pager| is set. Zero picks the default.
+  uint32_t pager_threads = 0;
+  // Per-blob read-ahead cap when |pager| is set. Unset picks the default; zero disables read-ahead.
+  std::optional<uint64_t> pager_max_read_ahead_bytes;
   bool write_uncompressed = false;
   CachePolicy cache_policy = CachePolicy::EvictImmediately;
 };
@@ -10,6 +10,7 @@
 #include <lib/fzl/time.h>
 #include <lib/zx/time.h>
 
+#include <fbl/auto_lock.h>
 #include <fs/trace.h>
 
 namespace blobfs {
@@ -43,6 +44,7 @@ void BlobfsMetrics::Dump() const {
                 total_writeback_bytes_written_ / mb, TicksToMs(total_writeback_time_ticks_));
   FS_TRACE_INFO("Lookup Info:\n");
   FS_TRACE_INFO("  Opened %zu blobs (%zu MB)\n", blobs_opened_, blobs_opened_total_size_ / mb);
+  fbl::AutoLock guard(&pager_stats_lock_);
   FS_TRACE_INFO("  Verified %zu blobs (%zu MB data, %zu MB merkle)\n", blobs_verified_,
                 blobs_verified_total_size_data_ / mb, blobs_verified_total_size_merkle_ / mb);
   FS_TRACE_INFO("  Spent %zu ms reading %zu MB from disk, %zu ms verifying\n",
@@ -103,6 +105,7 @@ void BlobfsMetrics::UpdateWriteback(uint64_t size, const fs::Duration& duration)
 
 void BlobfsMetrics::UpdateMerkleDiskRead(uint64_t size, const fs::Duration& duration) {
   if (Collecting()) {
+    fbl::AutoLock guard(&pager_stats_lock_);
     total_read_from_disk_time_ticks_ += duration;
     bytes_read_from_disk_ += size;
   }
@@ -112,6 +115,7 @@ void BlobfsMetrics::UpdateMerkleDecompress(uint64_t size_compressed, uint64_t si
                                            const fs::Duration& read_duration,
                                            const fs::Duration& decompress_duration) {
   if (Collecting()) {
+    fbl::AutoLock guard(&pager_stats_lock_);
     bytes_compressed_read_from_disk_ += size_compressed;
     bytes_decompressed_from_disk_ += size_uncompressed;
     total_read_compressed_time_ticks_ += read_duration;
@@ -122,6 +126,7 @@ void BlobfsMetrics::UpdateMerkleDecompress(uint64_t size_compressed, uint64_t si
 void BlobfsMetrics::UpdateMerkleVerify(uint64_t size_data, uint64_t size_merkle,
                                        const fs::Duration& duration) {
   if (Collecting()) {
+    fbl::AutoLock guard(&pager_stats_lock_);
     blobs_verified_++;
     blobs_verified_total_size_data_ += size_data;
     blobs_verified_total_size_merkle_ += size_merkle;
@@ -17,6 +17,7 @@
 #include <lib/zx/time.h>
 
 #include <cobalt-client/cpp/collector.h>
+#include <fbl/mutex.h>
 #include <fs/metrics/cobalt_metrics.h>
 #include <fs/metrics/composite_latency_event.h>
 #include <fs/metrics/events.h>
@@ -62,17 +63,17 @@ class BlobfsMetrics {
   void UpdateWriteback(uint64_t size, const fs::Duration& duration);
 
   // Updates aggregate information about reading blobs from storage
-  // since mounting.
+  // since mounting. May be called from the pager threads.
   void UpdateMerkleDiskRead(uint64_t size, const fs::Duration& duration);
 
   // Updates aggregate information about decompressing blobs from storage
-  // since mounting.
+  // since mounting. May be called from the pager threads.
   void UpdateMerkleDecompress(uint64_t size_compressed, uint64_t size_uncompressed,
                               const fs::Duration& read_duration,
                               const fs::Duration& decompress_duration);
 
   // Updates aggregate information about general verification info
-  // since mounting.
+  // since mounting. May be called from the pager threads.
   void UpdateMerkleVerify(uint64_t size_data, uint64_t size_merkle, const fs::Duration& duration);
 
   // Returns a new Latency event for the given event. This requires the event to be backed up by
@@ -111,23 +112,26 @@ class BlobfsMetrics {
 
   // LOOKUP STATS
 
+  // Guards the stats that are also updated by the pager threads.
+  mutable fbl::Mutex pager_stats_lock_;
+
   // Total time waiting for reads from disk.
-  zx::ticks total_read_from_disk_time_ticks_ = {};
-  uint64_t bytes_read_from_disk_ = 0;
+  zx::ticks total_read_from_disk_time_ticks_ __TA_GUARDED(pager_stats_lock_) = {};
+  uint64_t bytes_read_from_disk_ __TA_GUARDED(pager_stats_lock_) = 0;
 
-  zx::ticks total_read_compressed_time_ticks_ = {};
-  zx::ticks total_decompress_time_ticks_ = {};
-  uint64_t bytes_compressed_read_from_disk_ = 0;
-  uint64_t bytes_decompressed_from_disk_ = 0;
+  zx::ticks total_read_compressed_time_ticks_ __TA_GUARDED(pager_stats_lock_) = {};
+  zx::ticks total_decompress_time_ticks_ __TA_GUARDED(pager_stats_lock_) = {};
+  uint64_t bytes_compressed_read_from_disk_ __TA_GUARDED(pager_stats_lock_) = 0;
+  uint64_t bytes_decompressed_from_disk_ __TA_GUARDED(pager_stats_lock_) = 0;
 
   // Opened via "LookupBlob".
   uint64_t blobs_opened_ = 0;
   uint64_t blobs_opened_total_size_ = 0;
   // Verified blob data (includes both blobs read and written).
-  uint64_t blobs_verified_ = 0;
-  uint64_t blobs_verified_total_size_data_ = 0;
-  uint64_t blobs_verified_total_size_merkle_ = 0;
-  zx::ticks total_verification_time_ticks_ = {};
+  uint64_t blobs_verified_ __TA_GUARDED(pager_stats_lock_) = 0;
+  uint64_t blobs_verified_total_size_data_ __TA_GUARDED(pager_stats_lock_) = 0;
+  uint64_t blobs_verified_total_size_merkle_ __TA_GUARDED(pager_stats_lock_) = 0;
+  zx::ticks total_verification_time_ticks_ __TA_GUARDED(pager_stats_lock_) = {};
 
   // FVM STATS
   // TODO(smklein)
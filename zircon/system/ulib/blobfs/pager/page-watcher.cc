@@ -7,6 +7,7 @@
 #include <zircon/status.h>
 
 #include <blobfs/format.h>
+#include <fbl/algorithm.h>
 #include <fbl/auto_lock.h>
 #include <fs/trace.h>
 
@@ -32,7 +33,10 @@ zx_status_t PageWatcher::CreatePagedVmo(size_t vmo_size, zx::vmo* vmo_out) {
     fbl::AutoLock guard(&vmo_attached_mutex_);
     vmo_attached_to_pager_ = true;
   }
-  vmo_ = zx::unowned_vmo(vmo);
+  {
+    fbl::AutoLock guard(&transfer_mutex_);
+    vmo_ = zx::unowned_vmo(vmo);
+  }
   *vmo_out = std::move(vmo);
   return ZX_OK;
 }
@@ -41,7 +45,9 @@ void PageWatcher::DetachPagedVmoSync() {
   TRACE_DURATION("blobfs", "PageWatcher::DetachPagedVmoSync");
 
   page_request_handler_.Detach();
-  // wait on signal from the page request handler
+  // Wait on signal from the page request handler. Requests for this VMO are dispatched in order on
+  // a single pager thread, so no read request can still be running, or be dispatched, once the
+  // ZX_PAGER_VMO_COMPLETE packet has been handled.
   fbl::AutoLock guard(&vmo_attached_mutex_);
   while (vmo_attached_to_pager_) {
     vmo_attached_condvar_.Wait(&vmo_attached_mutex_);
@@ -86,14 +92,30 @@ void PageWatcher::GetPrefetchRangeInBytes(const uint64_t requested_offset,
                                           uint64_t* prefetch_offset, uint64_t* prefetch_length) {
   TRACE_DURATION("blobfs", "PageWatcher::GetPrefetchRangeInBytes", "requested_offset",
                  requested_offset, "requested_length", requested_length);
-  // TODO(rashaeqbal): Make the cluster size dynamic once we have prefetched read efficiency
-  // metrics from the kernel - what percentage of prefetched pages are actually used.
-  //
-  // For now read read in at least 128KB (if the blob is larger than 128KB). 128KB is completely
-  // arbitrary. Tune this for optimal performance (until we can support dynamic prefetch sizing).
-  constexpr uint64_t kPrefetchClusterSize = (128 * (1 << 10));
-
-  uint64_t end_offset = requested_offset + fbl::max(kPrefetchClusterSize, requested_length);
+  const uint64_t max_read_ahead = userpager_info_.max_read_ahead_bytes;
+  const uint64_t initial_read_ahead = fbl::min(kInitialReadAheadBytes, max_read_ahead);
+  UserPagerMetrics* metrics = user_pager_->PagerMetrics();
+
+  *prefetch_offset = requested_offset;
+  *prefetch_length = requested_length;
+
+  if (requested_offset >= window_start_ && requested_offset < window_end_) {
+    // Pages of the last window that were faulted on while it was being read in. Only read what was
+    // asked for; the window is still in use, so leave it alone.
+    return;
+  }
+
+  if (window_end_ != 0 && requested_offset == window_end_) {
+    // The previous window was consumed sequentially; read further ahead this time.
+    metrics->UpdateReadAheadHit(window_read_ahead_pages_);
+    read_ahead_bytes_ =
+        fbl::min(fbl::max(read_ahead_bytes_ * 2, initial_read_ahead), max_read_ahead);
+  } else {
+    metrics->UpdateReadAheadWaste(window_read_ahead_pages_);
+    read_ahead_bytes_ = initial_read_ahead;
+  }
+
+  uint64_t end_offset = requested_offset + fbl::max(read_ahead_bytes_, requested_length);
   uint64_t total_length;
   vmo_->get_size(&total_length);
   if (end_offset > total_length) {
@@ -102,8 +124,14 @@ void PageWatcher::GetPrefetchRangeInBytes(const uint64_t requested_offset,
 
   // TODO(rashaeqbal): Consider extending the range backwards as well. Will need some way to track
   // populated ranges.
-  *prefetch_offset = requested_offset;
-  *prefetch_length = end_offset - *prefetch_offset;
+  *prefetch_length = end_offset - requested_offset;
+
+  window_start_ = requested_offset;
+  window_end_ = end_offset;
+  window_read_ahead_pages_ =
+      (fbl::round_up(end_offset, PAGE_SIZE) -
+       fbl::round_up(requested_offset + requested_length, PAGE_SIZE)) /
+      PAGE_SIZE;
 }
 
 // TODO(rashaeqbal): fxb/40207
@@ -119,17 +147,19 @@ void PageWatcher::PopulateAndVerifyPagesInRange(uint64_t offset, uint64_t length
   TRACE_DURATION("blobfs", "PageWatcher::PopulateAndVerifyPagesInRange", "offset", offset, "length",
                  length);
 
-  if (!vmo_->is_valid()) {
-    FS_TRACE_ERROR("blobfs pager: VMO is not valid.\n");
-    return;
-  }
-
   uint64_t end;
   if (add_overflow(offset, length, &end)) {
     FS_TRACE_ERROR("blobfs pager: Invalid range, addition overflow.\n");
     return;
   }
 
+  fbl::AutoLock guard(&transfer_mutex_);
+
+  if (!vmo_->is_valid()) {
+    FS_TRACE_ERROR("blobfs pager: VMO is not valid.\n");
+    return;
+  }
+
   // Extend the range being read in to also speculatively prefetch pages.
   uint64_t prefetch_offset, prefetch_length;
   GetPrefetchRangeInBytes(offset, length, &prefetch_offset, &prefetch_length);
@@ -139,20 +169,28 @@ void PageWatcher::PopulateAndVerifyPagesInRange(uint64_t offset, uint64_t length
   if (status != ZX_OK) {
     FS_TRACE_ERROR("blobfs pager: Failed to transfer pages to the blob, error: %s\n",
                    zx_status_get_string(status));
+    // Don't count pages that were never supplied as read ahead.
+    window_start_ = window_end_ = 0;
+    window_read_ahead_pages_ = 0;
     return;
   }
+  if (prefetch_length > length) {
+    user_pager_->PagerMetrics()->UpdateReadAhead(window_read_ahead_pages_);
+  }
 }
 
 void PageWatcher::SignalPagerDetach() {
   TRACE_DURATION("blobfs", "PageWatcher::SignalPagerDetach");
-  // Reset the mapping so that future read requests on this VMO will be ignored.
-  vmo_ = zx::unowned_vmo(ZX_HANDLE_INVALID);
+  {
+    // Reset the mapping so that future read requests on this VMO will be ignored.
+    fbl::AutoLock guard(&transfer_mutex_);
+    vmo_ = zx::unowned_vmo(ZX_HANDLE_INVALID);
+  }
 
-  // Complete the paged vmo detach. Any in-flight read requests that arrive after this will be
-  // ignored.
+  // Complete the paged vmo detach. Any read requests that arrive after this will be ignored.
   fbl::AutoLock guard(&vmo_attached_mutex_);
   vmo_attached_to_pager_ = false;
-  vmo_attached_condvar_.Signal();
+  vmo_attached_condvar_.Broadcast();
 }
 
 }  // namespace blobfs
@@ -21,6 +21,9 @@
 
 namespace blobfs {
 
+// The read-ahead window used for the first fault on a blob, and after a non-sequential fault.
+constexpr uint64_t kInitialReadAheadBytes = 128 * (1 << 10);
+
 // Responsible for attaching a paged VMO to a user pager, populating pages of the VMO on demand, and
 // detaching the VMO from the pager when done.
 class PageWatcher {
@@ -51,9 +54,13 @@ class PageWatcher {
   void HandlePageRequest(async_dispatcher_t* dispatcher, async::PagedVmoBase* paged_vmo,
                          zx_status_t status, const zx_packet_page_request_t* request);
 
-  // Extends the requested read range to also include pre-fetched pages.
+  // Extends the requested read range to also include read-ahead pages, and updates the read-ahead
+  // window for the next request. The window starts at |kInitialReadAheadBytes|, doubles (up to
+  // |UserPagerInfo::max_read_ahead_bytes|) each time a fault lands right past the end of the
+  // previous window, and shrinks back on any other fault.
   void GetPrefetchRangeInBytes(const uint64_t requested_offset, const uint64_t requested_length,
-                               uint64_t* prefetch_offset, uint64_t* prefetch_length);
+                               uint64_t* prefetch_offset, uint64_t* prefetch_length)
+      __TA_REQUIRES(transfer_mutex_);
 
   // Fulfills page read requests for a certain range in the paged VMO. Also verifies the range after
   // it is read in from disk. Called by |HandlePageRequest| for a ZX_PAGER_VMO_READ packet. |offset|
@@ -76,11 +83,22 @@ class PageWatcher {
   // as the VMO is attached, causing potential use-after-frees.
   bool vmo_attached_to_pager_ __TA_GUARDED(vmo_attached_mutex_) = false;
 
+  // Page requests for this blob are all dispatched on one pager thread (see
+  // |UserPager::Dispatcher|). This guards the state they share with |CreatePagedVmo|.
+  fbl::Mutex transfer_mutex_;
+  // The range covered by the last read-ahead window, and how many pages past the faulting range it
+  // read in. A fault at |window_end_| means the window was consumed sequentially.
+  uint64_t window_start_ __TA_GUARDED(transfer_mutex_) = 0;
+  uint64_t window_end_ __TA_GUARDED(transfer_mutex_) = 0;
+  uint64_t window_read_ahead_pages_ __TA_GUARDED(transfer_mutex_) = 0;
+  // Read-ahead size for the next sequential fault.
+  uint64_t read_ahead_bytes_ __TA_GUARDED(transfer_mutex_) = 0;
+
   // Pointer to the user pager. Required to create the paged VMO and populate its pages.
   UserPager* const user_pager_;
 
   // Unowned VMO corresponding to the paged VMO. Used by |page_request_handler_| to populate pages.
-  zx::unowned_vmo vmo_;
+  zx::unowned_vmo vmo_ __TA_GUARDED(transfer_mutex_);
 
   // Various bits of information passed on to the user pager, not used directly by the page watcher.
   // Set at time of creation.
@@ -11,47 +11,91 @@
 
 #include <blobfs/format.h>
 #include <fbl/auto_call.h>
+#include <fbl/auto_lock.h>
 #include <fs/trace.h>
 
 namespace blobfs {
 
-zx_status_t UserPager::InitPager() {
-  TRACE_DURATION("blobfs", "UserPager::InitPager");
+void UserPagerMetrics::Dump() const {
+  FS_TRACE_INFO("Pager Info:\n");
+  FS_TRACE_INFO("  Supplied %zu pages, %zu of them read ahead\n", pages_supplied(),
+                read_ahead_pages());
+  FS_TRACE_INFO("  Read-ahead: %zu pages consumed, up to %zu pages wasted\n",
+                read_ahead_hit_pages(), read_ahead_wasted_pages());
+}
+
+zx_status_t UserPager::InitPager(const UserPagerOptions& options) {
+  TRACE_DURATION("blobfs", "UserPager::InitPager", "num_threads", options.num_threads);
 
   // Make sure blocks are page-aligned.
   static_assert(kBlobfsBlockSize % PAGE_SIZE == 0);
   // Make sure the pager transfer buffer is block-aligned.
   static_assert(kTransferBufferSize % kBlobfsBlockSize == 0);
 
-  // Set up the pager transfer buffer.
-  zx_status_t status = zx::vmo::create(kTransferBufferSize, 0, &transfer_buffer_);
-  if (status != ZX_OK) {
-    FS_TRACE_ERROR("blobfs: Cannot create transfer buffer: %s\n", zx_status_get_string(status));
-    return status;
+  if (options.num_threads == 0 || options.max_read_ahead_bytes > kTransferBufferSize) {
+    return ZX_ERR_INVALID_ARGS;
   }
-  status = AttachTransferVmo(transfer_buffer_);
-  if (status != ZX_OK) {
-    FS_TRACE_ERROR("blobfs: Failed to attach transfer vmo: %s\n", zx_status_get_string(status));
-    return status;
+  max_read_ahead_bytes_ = fbl::round_up(options.max_read_ahead_bytes, kBlobfsBlockSize);
+
+  // Set up a transfer buffer for each pager thread.
+  for (uint32_t i = 0; i < options.num_threads; i++) {
+    auto buffer = std::make_unique<zx::vmo>();
+    zx_status_t status = zx::vmo::create(kTransferBufferSize, 0, buffer.get());
+    if (status != ZX_OK) {
+      FS_TRACE_ERROR("blobfs: Cannot create transfer buffer: %s\n", zx_status_get_string(status));
+      return status;
+    }
+    status = AttachTransferVmo(*buffer);
+    if (status != ZX_OK) {
+      FS_TRACE_ERROR("blobfs: Failed to attach transfer vmo: %s\n", zx_status_get_string(status));
+      return status;
+    }
+    {
+      fbl::AutoLock guard(&transfer_buffers_lock_);
+      free_transfer_buffers_.push_back(buffer.get());
+    }
+    transfer_buffers_.push_back(std::move(buffer));
   }
 
   // Create the pager.
-  status = zx::pager::create(0, &pager_);
+  zx_status_t status = zx::pager::create(0, &pager_);
   if (status != ZX_OK) {
     FS_TRACE_ERROR("blobfs: Cannot initialize pager\n");
     return status;
   }
 
-  // Start the pager thread.
-  status = pager_loop_.StartThread("blobfs-pager-thread");
-  if (status != ZX_OK) {
-    FS_TRACE_ERROR("blobfs: Could not start pager thread\n");
-    return status;
+  // Start the pager threads. Each one runs its own loop, so requests for blobs attached to different
+  // loops are handled in parallel, while requests for any one blob are handled in order.
+  for (uint32_t i = 0; i < options.num_threads; i++) {
+    auto loop = std::make_unique<async::Loop>(&kAsyncLoopConfigNoAttachToCurrentThread);
+    status = loop->StartThread("blobfs-pager-thread");
+    if (status != ZX_OK) {
+      FS_TRACE_ERROR("blobfs: Could not start pager thread\n");
+      return status;
+    }
+    pager_loops_.push_back(std::move(loop));
   }
 
   return ZX_OK;
 }
 
+zx::vmo* UserPager::AcquireTransferBuffer() {
+  fbl::AutoLock guard(&transfer_buffers_lock_);
+  // There is a buffer per pager thread, so in practice this never waits.
+  while (free_transfer_buffers_.empty()) {
+    transfer_buffers_cvar_.Wait(&transfer_buffers_lock_);
+  }
+  zx::vmo* buffer = free_transfer_buffers_.back();
+  free_transfer_buffers_.pop_back();
+  return buffer;
+}
+
+void UserPager::ReleaseTransferBuffer(zx::vmo* buffer) {
+  fbl::AutoLock guard(&transfer_buffers_lock_);
+  free_transfer_buffers_.push_back(buffer);
+  transfer_buffers_cvar_.Signal();
+}
+
 zx_status_t UserPager::TransferPagesToVmo(uint64_t offset, uint64_t length, const zx::vmo& vmo,
                                           UserPagerInfo* info) {
   TRACE_DURATION("blobfs", "UserPager::TransferPagesToVmo", "offset", offset, "length", length);
@@ -64,22 +108,24 @@ zx_status_t UserPager::TransferPagesToVmo(uint64_t offset, uint64_t length, cons
     return status;
   }
 
-  auto decommit = fbl::MakeAutoCall([this, length]() {
+  zx::vmo* transfer_buffer = AcquireTransferBuffer();
+  auto release = fbl::MakeAutoCall([this, transfer_buffer, length]() {
     // Decommit pages in the transfer buffer that might have been populated. All blobs share the
-    // same transfer buffer - this prevents data leaks between different blobs.
-    transfer_buffer_.op_range(ZX_VMO_OP_DECOMMIT, 0, fbl::round_up(length, kBlobfsBlockSize),
+    // same transfer buffers - this prevents data leaks between different blobs.
+    transfer_buffer->op_range(ZX_VMO_OP_DECOMMIT, 0, fbl::round_up(length, kBlobfsBlockSize),
                               nullptr, 0);
+    ReleaseTransferBuffer(transfer_buffer);
   });
 
   // Read from storage into the transfer buffer.
-  status = PopulateTransferVmo(offset, length, info);
+  status = PopulateTransferVmo(offset, length, *transfer_buffer, info);
   if (status != ZX_OK) {
     FS_TRACE_ERROR("blobfs: Failed to populate transfer vmo: %s\n", zx_status_get_string(status));
     return status;
   }
 
   // Verify the pages read in.
-  status = VerifyTransferVmo(offset, length, transfer_buffer_, info);
+  status = VerifyTransferVmo(offset, length, *transfer_buffer, info);
   if (status != ZX_OK) {
     FS_TRACE_ERROR("blobfs: Failed to verify transfer vmo: %s\n", zx_status_get_string(status));
     return status;
@@ -87,14 +133,15 @@ zx_status_t UserPager::TransferPagesToVmo(uint64_t offset, uint64_t length, cons
 
   ZX_DEBUG_ASSERT(offset % PAGE_SIZE == 0);
   // Move the pages from the transfer buffer to the destination VMO.
-  status = pager_.supply_pages(vmo, offset, fbl::round_up<uint64_t, uint64_t>(length, PAGE_SIZE),
-                               transfer_buffer_, 0);
+  const uint64_t supply_length = fbl::round_up<uint64_t, uint64_t>(length, PAGE_SIZE);
+  status = pager_.supply_pages(vmo, offset, supply_length, *transfer_buffer, 0);
   if (status != ZX_OK) {
     FS_TRACE_ERROR("blobfs: Failed to supply pages to paged VMO: %s\n",
                    zx_status_get_string(status));
     return status;
   }
 
+  pager_metrics_.UpdateSupply(supply_length / PAGE_SIZE);
   return ZX_OK;
 }
 
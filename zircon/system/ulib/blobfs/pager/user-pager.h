@@ -14,7 +14,15 @@
 #include <lib/async/dispatcher.h>
 #include <lib/zx/pager.h>
 
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include <fbl/condition_variable.h>
+#include <fbl/mutex.h>
+
 #include "../blob-verifier.h"
+#include "../compression/zstd-seekable-blob.h"
 
 namespace blobfs {
 
@@ -32,20 +40,83 @@ struct UserPagerInfo {
   // Used to verify the pages as they are read in.
   // TODO(44742): Make BlobVerifier movable, unwrap from unique_ptr.
   std::unique_ptr<BlobVerifier> verifier;
+  // Set for blobs stored in the zstd seekable format, in which case |data_start_bytes| locates the
+  // compressed data, and |data_length_bytes| is the uncompressed length. Used to find and
+  // decompress the frames covering a request.
+  std::unique_ptr<ZSTDSeekableBlob> zstd_seekable_blob;
+  // Upper bound on how far past a faulting range the page watcher may read ahead for this blob.
+  // Zero disables read-ahead, so that only the (verification-aligned) faulting range is read.
+  uint64_t max_read_ahead_bytes = 0;
 };
 
-// The size of a transfer buffer for reading from storage.
-//
-// The decision to use a single global transfer buffer is arbitrary; a pool of them could also be
-// available in the future for more fine-grained access. Moreover, the blobfs pager uses a single
-// thread at the moment, so a global buffer should be sufficient.
+// The size of a transfer buffer for reading from storage. Each pager thread has its own.
 //
 // 256 MB; but the size is arbitrary, since pages will become decommitted as they are moved to
 // destination VMOS.
 constexpr uint64_t kTransferBufferSize = 256 * (1 << 20);
 
-// Abstract class that encapsulates a user pager, its associated thread and transfer buffer. The
-// child class will need to define the interface required to populate the transfer buffer with
+// The default number of threads servicing page requests.
+constexpr uint32_t kDefaultPagerThreads = 4;
+
+// The default cap on read-ahead for a single blob. 2 MB is large enough to cover the sequential
+// reads done while loading most binaries and libraries with a handful of requests.
+constexpr uint64_t kDefaultMaxReadAheadBytes = 2 * (1 << 20);
+
+static_assert(kDefaultMaxReadAheadBytes <= kTransferBufferSize);
+
+// Tunables for the user pager, set once at initialization.
+struct UserPagerOptions {
+  // Number of threads servicing page requests. Each thread gets its own transfer buffer.
+  uint32_t num_threads = kDefaultPagerThreads;
+  // Default for |UserPagerInfo::max_read_ahead_bytes| for blobs paged in by this pager.
+  uint64_t max_read_ahead_bytes = kDefaultMaxReadAheadBytes;
+};
+
+// Counters describing the work done by the pager threads. These are updated concurrently from all
+// pager threads, so unlike |BlobfsMetrics| they are atomic and always collected.
+class UserPagerMetrics {
+ public:
+  // Print information about the counters to stdout.
+  void Dump() const;
+
+  // Records |pages| supplied to a paged VMO in response to a single page request.
+  void UpdateSupply(uint64_t pages) { pages_supplied_.fetch_add(pages, std::memory_order_relaxed); }
+
+  // Records |pages| read in ahead of a faulting range.
+  void UpdateReadAhead(uint64_t pages) {
+    read_ahead_pages_.fetch_add(pages, std::memory_order_relaxed);
+  }
+
+  // Records a read-ahead window of |pages| that was consumed, i.e. the next fault on the blob
+  // landed right past its end.
+  void UpdateReadAheadHit(uint64_t pages) {
+    read_ahead_hit_pages_.fetch_add(pages, std::memory_order_relaxed);
+  }
+
+  // Records a read-ahead window of |pages| that was abandoned by a fault elsewhere in the blob.
+  // Some of those pages may still have been used, so this is an upper bound on the waste.
+  void UpdateReadAheadWaste(uint64_t pages) {
+    read_ahead_wasted_pages_.fetch_add(pages, std::memory_order_relaxed);
+  }
+
+  uint64_t pages_supplied() const { return pages_supplied_.load(std::memory_order_relaxed); }
+  uint64_t read_ahead_pages() const { return read_ahead_pages_.load(std::memory_order_relaxed); }
+  uint64_t read_ahead_hit_pages() const {
+    return read_ahead_hit_pages_.load(std::memory_order_relaxed);
+  }
+  uint64_t read_ahead_wasted_pages() const {
+    return read_ahead_wasted_pages_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  std::atomic<uint64_t> pages_supplied_ = 0;
+  std::atomic<uint64_t> read_ahead_pages_ = 0;
+  std::atomic<uint64_t> read_ahead_hit_pages_ = 0;
+  std::atomic<uint64_t> read_ahead_wasted_pages_ = 0;
+};
+
+// Abstract class that encapsulates a user pager, its associated threads and their transfer buffers.
+// The child class will need to define the interface required to populate the transfer buffer with
 // blocks read from storage.
 class UserPager {
  public:
@@ -55,32 +126,48 @@ class UserPager {
   // Returns the pager handle.
   const zx::pager& Pager() const { return pager_; }
 
-  // Returns the pager dispatcher.
-  async_dispatcher_t* Dispatcher() const { return pager_loop_.dispatcher(); }
+  // Returns the dispatcher a new paged VMO should be attached to. Each pager thread runs its own
+  // loop, and VMOs are spread across them round-robin. All requests for one VMO are therefore
+  // dispatched in order on a single thread, which means the ZX_PAGER_VMO_COMPLETE packet is only
+  // handled after every read request queued before it has returned.
+  async_dispatcher_t* Dispatcher() {
+    size_t index = next_loop_.fetch_add(1, std::memory_order_relaxed) % pager_loops_.size();
+    return pager_loops_[index]->dispatcher();
+  }
+
+  // Returns the read-ahead cap new blobs should be paged in with.
+  uint64_t MaxReadAheadBytes() const { return max_read_ahead_bytes_; }
+
+  // Returns the counters updated by the pager threads.
+  UserPagerMetrics* PagerMetrics() { return &pager_metrics_; }
 
   // Invoked by the |PageWatcher| on a read request. Reads in the requested byte range
-  // [|offset|, |offset| + |length|) for the inode associated with |map_index| into the
-  // |transfer_buffer_|, and then moves those pages to the destination |vmo|. If |verifier_info| is
-  // not null, uses it to verify the pages prior to transferring them to the destination vmo.
+  // [|offset|, |offset| + |length|) for the inode associated with |map_index| into a free transfer
+  // buffer, and then moves those pages to the destination |vmo|. If |verifier_info| is not null,
+  // uses it to verify the pages prior to transferring them to the destination vmo.
+  //
+  // May be called concurrently from all the pager threads.
   zx_status_t TransferPagesToVmo(uint64_t offset, uint64_t length, const zx::vmo& vmo,
                                  UserPagerInfo* info);
 
  protected:
-  // Sets up the transfer buffer, creates the pager and starts the pager thread.
-  zx_status_t InitPager();
+  // Sets up the transfer buffers, creates the pager and starts the pager threads.
+  zx_status_t InitPager(const UserPagerOptions& options = {});
 
   // Protected for unit test access
   zx::pager pager_;
 
  private:
-  // Virtual function to attach the transfer buffer to the underlying block device, so that blocks
-  // can be read into it from storage.
+  // Virtual function to attach a transfer buffer to the underlying block device, so that blocks
+  // can be read into it from storage. Called once per pager thread, before any thread is started.
   virtual zx_status_t AttachTransferVmo(const zx::vmo& transfer_vmo) = 0;
 
-  // Virtual function to read data for the inode corresponding to |map_index| into the
-  // transfer buffer for the byte range specified by [|offset|, |offset| + |length|).
+  // Virtual function to read data for the inode corresponding to |map_index| into
+  // |transfer_vmo| (one of the attached transfer buffers) for the byte range specified by
+  // [|offset|, |offset| + |length|). For compressed blobs the range is in uncompressed bytes, and
+  // the decompressed data is what ends up at the start of |transfer_vmo|.
   virtual zx_status_t PopulateTransferVmo(uint64_t offset, uint64_t length,
-                                          UserPagerInfo* info) = 0;
+                                          const zx::vmo& transfer_vmo, UserPagerInfo* info) = 0;
 
   // Virtual function to verify the data read in to |transfer_vmo| (i.e. the transfer buffer) via
   // |PopulateTransferVmo|. Data in the range [|offset|, |offset| + |length|) is verified using the
@@ -89,20 +176,36 @@ class UserPager {
                                         const zx::vmo& transfer_vmo, UserPagerInfo* info) = 0;
 
   // Virtual function for aligning the requested read range to include the minimum number of nodes
-  // (per the Merkle tree) required to verify the range. The range needs to be determined before
-  // calling the user pager to populate the pages, as absent pages will cause page faults during
-  // verification on the pager thread, causing it to block against itself indefinitely.
+  // (per the Merkle tree) required to verify the range, and for compressed blobs, whole frames. The
+  // range needs to be determined before calling the user pager to populate the pages, as absent
+  // pages will cause page faults during verification on the pager thread, causing it to block
+  // against itself indefinitely.
   virtual zx_status_t AlignForVerification(uint64_t* offset, uint64_t* length,
                                            UserPagerInfo* info) = 0;
 
-  // Scratch buffer for pager transfers.
-  // NOTE: Per the constraints imposed by |zx_pager_supply_pages|, this needs to be unmapped before
-  // calling |zx_pager_supply_pages|. Map this only when an explicit address is required, e.g. for
+  // Takes a transfer buffer off |free_transfer_buffers_|, waiting for one to be returned if
+  // necessary, and puts it back.
+  zx::vmo* AcquireTransferBuffer();
+  void ReleaseTransferBuffer(zx::vmo* buffer);
+
+  // Scratch buffers for pager transfers, one per pager thread.
+  // NOTE: Per the constraints imposed by |zx_pager_supply_pages|, these need to be unmapped before
+  // calling |zx_pager_supply_pages|. Map one only when an explicit address is required, e.g. for
   // verification, and unmap it immediately after.
-  zx::vmo transfer_buffer_;
+  std::vector<std::unique_ptr<zx::vmo>> transfer_buffers_;
+
+  fbl::Mutex transfer_buffers_lock_;
+  fbl::ConditionVariable transfer_buffers_cvar_;
+  std::vector<zx::vmo*> free_transfer_buffers_ __TA_GUARDED(transfer_buffers_lock_);
+
+  uint64_t max_read_ahead_bytes_ = 0;
+
+  UserPagerMetrics pager_metrics_;
 
-  // Async loop for pager requests.
-  async::Loop pager_loop_ = async::Loop(&kAsyncLoopConfigNoAttachToCurrentThread);
+  // Async loops for pager requests, one per pager thread.
+  std::vector<std::unique_ptr<async::Loop>> pager_loops_;
+  // The loop the next paged VMO is attached to, modulo the number of loops.
+  std::atomic<size_t> next_loop_ = 0;
 };
 
 }  // namespace blobfs
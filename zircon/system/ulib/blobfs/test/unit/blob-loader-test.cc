@@ -43,11 +43,11 @@ std::set<uint64_t> AddressRange(uint64_t start, uint64_t len) {
 // data source (rather than a block device).
 class FakeUserPager : public UserPager {
  public:
-  FakeUserPager() { InitPager(); }
+  FakeUserPager() { InitPager(Options()); }
   FakeUserPager(const char *data, size_t len)
       : data_(new uint8_t[len], len) {
     memcpy(data_.get(), data, len);
-    InitPager();
+    InitPager(Options());
   }
 
   // HACK: We don't have a good interface for propagating failure to satisfy a page request back
@@ -71,22 +71,27 @@ class FakeUserPager : public UserPager {
   }
 
  private:
+  // A single pager thread, so that the address sets below are only ever touched by one thread.
+  static UserPagerOptions Options() {
+    UserPagerOptions options;
+    options.num_threads = 1;
+    return options;
+  }
+
   void AbortMainThread() {
     zx_pager_detach_vmo(pager_.get(), handle_to_close_on_failure_);
   }
 
-  zx_status_t AttachTransferVmo(const zx::vmo& transfer_vmo) override {
-    vmo_ = zx::unowned_vmo(transfer_vmo);
-    return ZX_OK;
-  }
+  zx_status_t AttachTransferVmo(const zx::vmo& transfer_vmo) override { return ZX_OK; }
 
-  zx_status_t PopulateTransferVmo(uint64_t offset, uint64_t length, UserPagerInfo* info) override {
+  zx_status_t PopulateTransferVmo(uint64_t offset, uint64_t length, const zx::vmo& transfer_vmo,
+                                  UserPagerInfo* info) override {
     if (offset + length > data_.size()) {
       AbortMainThread();
       return ZX_ERR_OUT_OF_RANGE;
     }
     zx_status_t status;
-    if ((status = vmo_->write(data_.get() + offset, 0, length)) != ZX_OK) {
+    if ((status = transfer_vmo.write(data_.get() + offset, 0, length)) != ZX_OK) {
       AbortMainThread();
       return status;
     }
@@ -138,7 +143,6 @@ class FakeUserPager : public UserPager {
   fbl::Array<uint8_t> data_;
   std::set<uint64_t> mapped_addresses_;
   std::set<uint64_t> verified_addresses_;
-  zx::unowned_vmo vmo_;
   zx_handle_t handle_to_close_on_failure_;
 };
 
@@ -220,6 +224,8 @@ class CompressedBlobLoaderTest : public BlobLoaderTest {
  public:
   void SetUp() final {
     MountOptions options;
+    // Paging makes blobfs write compressed blobs in the seekable format, which can be paged.
+    options.pager = true;
     Init(options);
   }
 };
@@ -294,8 +300,7 @@ void DoTest_Paged_SmallBlob(BlobLoaderTest* test) {
   EXPECT_EQ(info->size_merkle, 0);
 }
 
-// TODO(44820): Enable when compressed, pageable blobs are supported.
-// TEST_F(CompressedBlobLoaderTest, Paged_SmallBlob) { DoTest_Paged_SmallBlob(this); }
+TEST_F(CompressedBlobLoaderTest, Paged_SmallBlob) { DoTest_Paged_SmallBlob(this); }
 TEST_F(UncompressedBlobLoaderTest, Paged_SmallBlob) { DoTest_Paged_SmallBlob(this); }
 
 void DoTest_LargeBlob(BlobLoaderTest* test) {
@@ -375,8 +380,7 @@ void DoTest_Paged_LargeBlob(BlobLoaderTest* test) {
   EXPECT_BYTES_EQ(merkle.start(), info->merkle.get(), info->size_merkle);
 }
 
-// TODO(44820): Enable when compressed, pageable blobs are supported.
-// TEST_F(CompressedBlobLoaderTest, Paged_LargeBlob) { DoTest_Paged_LargeBlob(this); }
+TEST_F(CompressedBlobLoaderTest, Paged_LargeBlob) { DoTest_Paged_LargeBlob(this); }
 TEST_F(UncompressedBlobLoaderTest, Paged_LargeBlob) { DoTest_Paged_LargeBlob(this); }
 
 void DoTest_Paged_LargeBlob_NonAlignedLength(BlobLoaderTest* test) {
@@ -406,10 +410,9 @@ void DoTest_Paged_LargeBlob_NonAlignedLength(BlobLoaderTest* test) {
   EXPECT_BYTES_EQ(merkle.start(), info->merkle.get(), info->size_merkle);
 }
 
-// TODO(44820): Enable when compressed, pageable blobs are supported.
-// TEST_F(CompressedBlobLoaderTest, Paged_LargeBlob_NonAlignedLength) {
-//   DoTest_Paged_LargeBlob_NonAlignedLength(this);
-// }
+TEST_F(CompressedBlobLoaderTest, Paged_LargeBlob_NonAlignedLength) {
+  DoTest_Paged_LargeBlob_NonAlignedLength(this);
+}
 TEST_F(UncompressedBlobLoaderTest, Paged_LargeBlob_NonAlignedLength) {
   DoTest_Paged_LargeBlob_NonAlignedLength(this);
 }
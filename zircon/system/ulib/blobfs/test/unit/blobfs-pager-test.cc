@@ -27,37 +27,42 @@ namespace blobfs {
 namespace {
 
 constexpr uint64_t kPagedVmoSize = 10 * PAGE_SIZE;
+// Large enough for the read-ahead window to grow a few times.
+constexpr uint64_t kLargeBlobSize = 1 << 20;
 constexpr uint64_t kNumReadRequests = 100;
 constexpr uint64_t kNumThreads = 10;
 
 // Like a Blob w.r.t. the pager - creates a VMO linked to the pager and issues reads on it.
 class MockBlob {
  public:
-  MockBlob(char identifier, UserPager* pager, BlobfsMetrics* metrics) : identifier_(identifier) {
-    char data[kPagedVmoSize];
-    memset(data, identifier, kPagedVmoSize);
+  MockBlob(char identifier, UserPager* pager, BlobfsMetrics* metrics, uint64_t size,
+           uint64_t max_read_ahead_bytes)
+      : identifier_(identifier) {
+    auto data = std::make_unique<char[]>(size);
+    memset(data.get(), identifier, size);
 
     size_t tree_len;
     ASSERT_OK(
-        digest::MerkleTreeCreator::Create(data, kPagedVmoSize, &merkle_tree_, &tree_len, &root_));
+        digest::MerkleTreeCreator::Create(data.get(), size, &merkle_tree_, &tree_len, &root_));
 
     std::unique_ptr<BlobVerifier> verifier;
     ASSERT_OK(BlobVerifier::Create(digest::Digest(root_.get()), metrics, merkle_tree_.get(),
-                                   tree_len, kPagedVmoSize, &verifier));
+                                   tree_len, size, &verifier));
 
     UserPagerInfo pager_info;
     pager_info.verifier = std::move(verifier);
     pager_info.identifier = identifier_;
+    pager_info.max_read_ahead_bytes = max_read_ahead_bytes;
 
     page_watcher_ = std::make_unique<PageWatcher>(pager, std::move(pager_info));
 
-    ASSERT_OK(page_watcher_->CreatePagedVmo(kPagedVmoSize, &vmo_));
+    ASSERT_OK(page_watcher_->CreatePagedVmo(size, &vmo_));
 
     // Make sure the vmo is valid and of the desired size.
     ASSERT_TRUE(vmo_.is_valid());
     uint64_t vmo_size;
     ASSERT_OK(vmo_.get_size(&vmo_size));
-    ASSERT_EQ(vmo_size, kPagedVmoSize);
+    ASSERT_EQ(vmo_size, size);
 
     // Make sure the vmo is pager-backed.
     zx_info_vmo_t info;
@@ -91,21 +96,19 @@ class MockBlob {
 // mock blobs can be verified.
 class MockPager : public UserPager {
  public:
-  MockPager() { InitPager(); }
+  explicit MockPager(const UserPagerOptions& options) { EXPECT_OK(InitPager(options)); }
 
  private:
-  zx_status_t AttachTransferVmo(const zx::vmo& transfer_vmo) override {
-    vmo_ = zx::unowned_vmo(transfer_vmo);
-    return ZX_OK;
-  }
+  zx_status_t AttachTransferVmo(const zx::vmo& transfer_vmo) override { return ZX_OK; }
 
-  zx_status_t PopulateTransferVmo(uint64_t offset, uint64_t length, UserPagerInfo* info) override {
+  zx_status_t PopulateTransferVmo(uint64_t offset, uint64_t length, const zx::vmo& transfer_vmo,
+                                  UserPagerInfo* info) override {
     // Fill the transfer buffer with the blob's identifier character, to service page requests. The
     // identifier helps us distinguish between blobs.
     char text[kBlobfsBlockSize];
     memset(text, static_cast<char>(info->identifier), kBlobfsBlockSize);
     for (uint32_t i = 0; i < length; i += kBlobfsBlockSize) {
-      zx_status_t status = vmo_->write(text, i, kBlobfsBlockSize);
+      zx_status_t status = transfer_vmo.write(text, i, kBlobfsBlockSize);
       if (status != ZX_OK) {
         return status;
       }
@@ -130,18 +133,22 @@ class MockPager : public UserPager {
     }
     return info->verifier->VerifyPartial(mapping.start(), length, offset);
   }
-
-  zx::unowned_vmo vmo_;
 };
 
 class BlobfsPagerTest : public zxtest::Test {
  public:
-  void SetUp() override { pager_ = std::make_unique<MockPager>(); }
+  void SetUp() override { InitPager(UserPagerOptions()); }
 
-  std::unique_ptr<MockBlob> CreateBlob(char identifier = 'z') {
-    return std::make_unique<MockBlob>(identifier, pager_.get(), &metrics_);
+  void InitPager(const UserPagerOptions& options) { pager_ = std::make_unique<MockPager>(options); }
+
+  std::unique_ptr<MockBlob> CreateBlob(char identifier = 'z', uint64_t size = kPagedVmoSize,
+                                       uint64_t max_read_ahead_bytes = kDefaultMaxReadAheadBytes) {
+    return std::make_unique<MockBlob>(identifier, pager_.get(), &metrics_, size,
+                                      max_read_ahead_bytes);
   }
 
+  const UserPagerMetrics& PagerMetrics() { return *pager_->PagerMetrics(); }
+
   void ResetPager() { pager_.reset(); }
 
  private:
@@ -247,6 +254,66 @@ TEST_F(BlobfsPagerTest, ReadRandomMultipleBlobsMultithreaded) {
   }
 }
 
+TEST_F(BlobfsPagerTest, ReadRandomMultipleBlobsSinglePagerThread) {
+  UserPagerOptions options;
+  options.num_threads = 1;
+  InitPager(options);
+
+  constexpr uint64_t kNumBlobs = 3;
+  std::unique_ptr<MockBlob> blobs[kNumBlobs] = {CreateBlob('x'), CreateBlob('y'), CreateBlob('z')};
+  std::array<thrd_t, kNumBlobs> threads;
+  std::array<ReadBlobFnArgs, kNumBlobs> args;
+
+  for (uint64_t i = 0; i < kNumBlobs; i++) {
+    args[i].blob = blobs[i].get();
+    args[i].seed = static_cast<unsigned int>(i);
+    ASSERT_EQ(thrd_create(&threads[i], ReadBlobFn, &args[i]), thrd_success);
+  }
+
+  for (uint64_t i = 0; i < kNumBlobs; i++) {
+    int res;
+    ASSERT_EQ(thrd_join(threads[i], &res), thrd_success);
+    ASSERT_EQ(res, 0);
+  }
+}
+
+TEST_F(BlobfsPagerTest, ReadAheadGrowsOnSequentialFaults) {
+  auto blob = CreateBlob('z', kLargeBlobSize);
+  // Touch every page in order. Each fault should land right past the previous read-ahead window.
+  for (uint64_t offset = 0; offset < kLargeBlobSize; offset += PAGE_SIZE) {
+    blob->Read(offset, PAGE_SIZE);
+  }
+
+  EXPECT_EQ(PagerMetrics().pages_supplied(), kLargeBlobSize / PAGE_SIZE);
+  EXPECT_GT(PagerMetrics().read_ahead_pages(), 0);
+  EXPECT_GT(PagerMetrics().read_ahead_hit_pages(), 0);
+  EXPECT_EQ(PagerMetrics().read_ahead_wasted_pages(), 0);
+  // The window grows past its initial size, so that the blob is paged in with a few requests.
+  EXPECT_GT(PagerMetrics().read_ahead_hit_pages(), kInitialReadAheadBytes / PAGE_SIZE);
+}
+
+TEST_F(BlobfsPagerTest, ReadAheadResetOnRandomFault) {
+  auto blob = CreateBlob('z', kLargeBlobSize);
+  blob->Read(0, PAGE_SIZE);
+  const uint64_t read_ahead_pages = PagerMetrics().read_ahead_pages();
+  EXPECT_GT(read_ahead_pages, 0);
+
+  // Jump well past the first window; its read-ahead is counted as wasted.
+  blob->Read(kLargeBlobSize / 2, PAGE_SIZE);
+  EXPECT_EQ(PagerMetrics().read_ahead_hit_pages(), 0);
+  EXPECT_EQ(PagerMetrics().read_ahead_wasted_pages(), read_ahead_pages);
+}
+
+TEST_F(BlobfsPagerTest, ReadAheadDisabled) {
+  auto blob = CreateBlob('z', kLargeBlobSize, 0);
+  blob->Read(0, PAGE_SIZE);
+  blob->Read(kLargeBlobSize - PAGE_SIZE, PAGE_SIZE);
+
+  // Only the blocks needed to verify the faulting pages are read in.
+  EXPECT_EQ(PagerMetrics().pages_supplied(), 2 * kBlobfsBlockSize / PAGE_SIZE);
+  EXPECT_EQ(PagerMetrics().read_ahead_pages(), 0);
+}
+
 TEST_F(BlobfsPagerTest, AsyncLoopShutdown) {
   auto blob = CreateBlob();
   // Verify that we can exit cleanly if the UserPager (and its member async loop) is destroyed.
@@ -17,6 +17,7 @@
 #include "compression/decompressor.h"
 #include "compression/lz4.h"
 #include "compression/zstd-plain.h"
+#include "compression/zstd-seekable-blob.h"
 #include "compression/zstd-seekable.h"
 #include "zircon/errors.h"
 
@@ -320,6 +321,78 @@ TEST(CompressorTests, CompressRoundDecompressZSTDSeekableRandom4) {
                                  1 << 10);
 }
 
+// Tests decompressing a range from the middle of a seekable archive, given only the seek table and
+// the frames covering the range, the way the pager does.
+void RunSeekableDecompressRangeTest(DataType data_type, size_t size, uint64_t offset,
+                                    uint64_t length) {
+  std::unique_ptr<char[]> input(GenerateInput(data_type, 0, size));
+  std::optional<BlobCompressor> compressor;
+  ASSERT_NO_FAILURES(CompressionHelper(CompressionAlgorithm::ZSTD_SEEKABLE, input.get(), size,
+                                       size, &compressor));
+  ASSERT_TRUE(compressor);
+  const uint8_t* stored = static_cast<const uint8_t*>(compressor->Data());
+
+  ZSTDSeekableHeader header;
+  uint64_t footer_offset, footer_length;
+  ASSERT_OK(ZSTDSeekableBlob::FooterRange(stored, compressor->Size(), &header, &footer_offset,
+                                          &footer_length));
+  ASSERT_LE(footer_offset + footer_length, compressor->Size());
+  uint64_t table_offset, table_length;
+  ASSERT_OK(ZSTDSeekableBlob::SeekTableRange(header, stored + footer_offset, footer_length,
+                                             &table_offset, &table_length));
+  std::unique_ptr<ZSTDSeekableBlob> blob;
+  ASSERT_OK(ZSTDSeekableBlob::Create(header, stored + table_offset, table_length, &blob));
+  EXPECT_EQ(size, blob->DecompressedSize());
+
+  ASSERT_OK(blob->AlignToFrames(&offset, &length));
+  uint64_t compressed_offset, compressed_length;
+  ASSERT_OK(blob->CompressedRange(offset, length, &compressed_offset, &compressed_length));
+  ASSERT_LE(compressed_offset + compressed_length, compressor->Size());
+
+  // Hand over a copy of just the covering frames, so that reads outside of them would fail.
+  std::unique_ptr<uint8_t[]> compressed(new uint8_t[compressed_length]);
+  memcpy(compressed.get(), stored + compressed_offset, compressed_length);
+  std::unique_ptr<char[]> uncompressed(new char[length]);
+  ASSERT_OK(blob->DecompressRange(offset, length, compressed.get(), compressed_offset,
+                                  compressed_length, uncompressed.get()));
+  EXPECT_BYTES_EQ(input.get() + offset, uncompressed.get(), length);
+}
+
+TEST(CompressorTests, SeekableDecompressRangeFirstFrame) {
+  RunSeekableDecompressRangeTest(DataType::Random, 1 << 18, 0, 1);
+}
+
+TEST(CompressorTests, SeekableDecompressRangeMiddleFrames) {
+  RunSeekableDecompressRangeTest(DataType::Random, 1 << 18, (1 << 16) + 100, 1 << 16);
+}
+
+TEST(CompressorTests, SeekableDecompressRangeLastFrame) {
+  RunSeekableDecompressRangeTest(DataType::Compressible, (1 << 18) + 10, 1 << 18, 10);
+}
+
+TEST(CompressorTests, SeekableDecompressRangeOutOfRange) {
+  std::unique_ptr<char[]> input(GenerateInput(DataType::Random, 0, 1 << 16));
+  std::optional<BlobCompressor> compressor;
+  ASSERT_NO_FAILURES(CompressionHelper(CompressionAlgorithm::ZSTD_SEEKABLE, input.get(), 1 << 16,
+                                       1 << 16, &compressor));
+  const uint8_t* stored = static_cast<const uint8_t*>(compressor->Data());
+  ZSTDSeekableHeader header;
+  uint64_t footer_offset, footer_length, table_offset, table_length;
+  ASSERT_OK(ZSTDSeekableBlob::FooterRange(stored, compressor->Size(), &header, &footer_offset,
+                                          &footer_length));
+  ASSERT_OK(ZSTDSeekableBlob::SeekTableRange(header, stored + footer_offset, footer_length,
+                                             &table_offset, &table_length));
+  std::unique_ptr<ZSTDSeekableBlob> blob;
+  ASSERT_OK(ZSTDSeekableBlob::Create(header, stored + table_offset, table_length, &blob));
+
+  uint64_t offset = (1 << 16) - 1;
+  uint64_t length = 2;
+  EXPECT_EQ(ZX_ERR_OUT_OF_RANGE, blob->AlignToFrames(&offset, &length));
+  offset = 0;
+  length = 0;
+  EXPECT_EQ(ZX_ERR_OUT_OF_RANGE, blob->AlignToFrames(&offset, &length));
+}
+
 // Regression test class: Ensure that decompression that is not advancing buffers terminates, even
 // if the "size of next recommended input" hint from zstd is a non-zero, non-error value. It turns
 // out, this hint is not intended to be authoritative, in the sense that it can be a non-zero,
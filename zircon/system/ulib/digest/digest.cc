@@ -53,10 +53,13 @@ Digest& Digest::operator=(const uint8_t* rhs) {
 }
 
 zx_status_t Digest::Init() {
-  fbl::AllocChecker ac;
-  ctx_.reset(new (&ac) Context());
-  if (!ac.check()) {
-    return ZX_ERR_NO_MEMORY;
+  // Reuse the context across hashes; Merkle trees re-initialize a digest for every node.
+  if (ctx_ == nullptr) {
+    fbl::AllocChecker ac;
+    ctx_.reset(new (&ac) Context());
+    if (!ac.check()) {
+      return ZX_ERR_NO_MEMORY;
+    }
   }
   SHA256_Init(&ctx_->impl);
   return ZX_OK;
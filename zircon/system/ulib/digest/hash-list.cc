@@ -6,8 +6,13 @@
 #include <zircon/errors.h>
 #include <zircon/types.h>
 
+#include <memory>
+#include <thread>
+#include <vector>
+
 #include <digest/digest.h>
 #include <digest/hash-list.h>
+#include <fbl/alloc_checker.h>
 
 namespace digest {
 namespace internal {
@@ -62,6 +67,21 @@ zx_status_t HashListBase::ProcessData(const uint8_t *buf, size_t buf_len, size_t
   data_off_ = data_off;
   list_off_ = GetListOffset(data_off);
   while (buf_len != 0) {
+    // Hand long runs of whole nodes to |ProcessNodesInParallel|.
+    size_t nodes_len = fbl::round_down(buf_len, GetNodeSize());
+    if (data_off_ + buf_len == data_len_) {
+      nodes_len = buf_len;
+    }
+    if (max_threads_ > 1 && node_digest_.IsAligned(data_off_) &&
+        nodes_len >= 2 * kMinNodesPerThread * GetNodeSize()) {
+      if ((rc = ProcessNodesInParallel(buf, nodes_len)) != ZX_OK) {
+        return rc;
+      }
+      buf += nodes_len;
+      buf_len -= nodes_len;
+      data_off_ += nodes_len;
+      continue;
+    }
     if (node_digest_.IsAligned(data_off_) &&
         (rc = node_digest_.Reset(data_off_, data_len_)) != ZX_OK) {
       return rc;
@@ -77,6 +97,63 @@ zx_status_t HashListBase::ProcessData(const uint8_t *buf, size_t buf_len, size_t
   return ZX_OK;
 }
 
+zx_status_t HashListBase::ProcessNodesInParallel(const uint8_t *buf, size_t buf_len) {
+  const size_t node_size = GetNodeSize();
+  const size_t digest_size = GetDigestSize();
+  const size_t num_nodes = node_digest_.NextAligned(buf_len) / node_size;
+  const size_t num_threads = fbl::min(max_threads_, num_nodes / kMinNodesPerThread);
+  const size_t nodes_per_thread = (num_nodes + num_threads - 1) / num_threads;
+
+  fbl::AllocChecker ac;
+  std::unique_ptr<uint8_t[]> digests(new (&ac) uint8_t[num_nodes * digest_size]);
+  if (!ac.check()) {
+    return ZX_ERR_NO_MEMORY;
+  }
+  std::unique_ptr<zx_status_t[]> results(new (&ac) zx_status_t[num_threads]);
+  if (!ac.check()) {
+    return ZX_ERR_NO_MEMORY;
+  }
+
+  // Each thread hashes a contiguous share of the nodes with its own NodeDigest, and stores the
+  // digests by node index.
+  auto hash_nodes = [&](size_t thread) {
+    const size_t first = thread * nodes_per_thread;
+    const size_t last = fbl::min(first + nodes_per_thread, num_nodes);
+    NodeDigest node_digest;
+    node_digest.set_id(GetNodeId());
+    zx_status_t rc = node_digest.SetNodeSize(node_size);
+    for (size_t i = first; i < last && rc == ZX_OK; ++i) {
+      const size_t node_off = i * node_size;
+      if ((rc = node_digest.Reset(data_off_ + node_off, data_len_)) == ZX_OK) {
+        node_digest.Append(buf + node_off, fbl::min(node_size, buf_len - node_off));
+        rc = node_digest.get().CopyTo(&digests[i * digest_size], digest_size);
+      }
+    }
+    results[thread] = rc;
+  };
+  std::vector<std::thread> threads;
+  threads.reserve(num_threads - 1);
+  for (size_t thread = 1; thread < num_threads; ++thread) {
+    threads.emplace_back(hash_nodes, thread);
+  }
+  hash_nodes(0);
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  for (size_t thread = 0; thread < num_threads; ++thread) {
+    if (results[thread] != ZX_OK) {
+      return results[thread];
+    }
+  }
+
+  // Handle the digests in order, exactly as if they had been calculated one at a time.
+  for (size_t i = 0; i < num_nodes; ++i) {
+    HandleOne(Digest(&digests[i * digest_size]));
+    list_off_ += digest_size;
+  }
+  return ZX_OK;
+}
+
 void HashListBase::HandleOne() {
   HandleOne(node_digest_.get());
   list_off_ += GetDigestSize();
@@ -13,6 +13,11 @@
 #include <digest/node-digest.h>
 
 namespace digest {
+
+// The fewest nodes a thread is given to hash when hashing in parallel. Below this, the cost of
+// starting a thread outweighs the hashing it takes over.
+const size_t kMinNodesPerThread = 64;
+
 namespace internal {
 
 // |digest::internal::HashListBase| contains common hash list code. Callers MUST NOT use this class
@@ -35,6 +40,12 @@ class HashListBase {
   void SetNodeId(uint64_t id) { node_digest_.set_id(id); }
   zx_status_t SetNodeSize(size_t node_size) { return node_digest_.SetNodeSize(node_size); }
 
+  // Gets or sets the maximum number of threads used to hash the data passed to a single call. Long
+  // runs of whole nodes are split across up to this many threads, with each thread hashing at least
+  // |kMinNodesPerThread| nodes. The default of 1 hashes everything on the calling thread.
+  size_t GetMaxThreads() const { return max_threads_; }
+  void SetMaxThreads(size_t max_threads) { max_threads_ = fbl::max(max_threads, size_t(1)); }
+
   // Returns true if |data_off| is aligned to a node boundary.
   bool IsAligned(size_t data_off) const { return node_digest_.IsAligned(data_off); }
 
@@ -74,6 +85,11 @@ class HashListBase {
  private:
   zx_status_t Check(size_t off, size_t len, size_t max, size_t *out = nullptr) const;
 
+  // Hashes the nodes in the first |buf_len| bytes of |buf| on up to |max_threads_| threads, then
+  // hands their digests to |HandleOne| in order. |data_off_| must be node-aligned, and |buf_len|
+  // must be node-aligned or reach the end of the data.
+  zx_status_t ProcessNodesInParallel(const uint8_t *buf, size_t buf_len);
+
   // Digest object used to create hashes to store or check.
   NodeDigest node_digest_;
 
@@ -84,6 +100,9 @@ class HashListBase {
   // Contents, offset, and length of the hash list.
   size_t list_off_ = 0;
   size_t list_len_ = 0;
+
+  // Upper bound on the number of threads used by |ProcessData|.
+  size_t max_threads_ = 1;
 };
 
 // |digest::internal::HashList| contains code templated on the list type. Callers MUST NOT use this
@@ -33,6 +33,11 @@ class MerkleTree {
   size_t GetNodeSize() const { return hash_list_.GetNodeSize(); }
   void SetNodeSize(size_t node_size) { hash_list_.SetNodeSize(); }
 
+  // Sets the maximum number of threads used to hash the data, as with
+  // |HashListBase::SetMaxThreads|. Only the lowest level of the tree is hashed in parallel; the
+  // levels above it hold a small fraction of the data.
+  void SetMaxThreads(size_t max_threads) { hash_list_.SetMaxThreads(max_threads); }
+
   // Returns true if |data_off| is aligned to a node boundary.
   bool IsAligned(size_t data_off) const { return hash_list_.IsAligned(data_off); }
 
@@ -80,9 +85,9 @@ class MerkleTreeCreator
     : public internal::MerkleTree<uint8_t, void *, MerkleTreeCreator, HashListCreator> {
  public:
   // Convenience method to create and return a Merkle tree for the given |data| via |out_tree| and
-  // |out_root|.
+  // |out_root|, hashing on up to |max_threads| threads.
   static zx_status_t Create(const void *data, size_t data_len, std::unique_ptr<uint8_t[]> *out_tree,
-                            size_t *out_tree_len, Digest *out_root);
+                            size_t *out_tree_len, Digest *out_root, size_t max_threads = 1);
 
   // Reads |buf_len| bytes of data from |buf| and appends digests to the hash |list|.
   zx_status_t Append(const void *buf, size_t buf_len);
@@ -82,12 +82,13 @@ template zx_status_t internal::MerkleTree<uint8_t, void *, MerkleTreeCreator,
 // static
 zx_status_t MerkleTreeCreator::Create(const void *data, size_t data_len,
                                       std::unique_ptr<uint8_t[]> *out_tree, size_t *out_tree_len,
-                                      Digest *out_root) {
+                                      Digest *out_root, size_t max_threads) {
   if (out_tree == nullptr || out_tree_len == nullptr || out_root == nullptr) {
     return ZX_ERR_INVALID_ARGS;
   }
   uint8_t root[kSha256Length];
   MerkleTreeCreator creator;
+  creator.SetMaxThreads(max_threads);
   zx_status_t rc = creator.SetDataLength(data_len);
   if (rc != ZX_OK) {
     return rc;
@@ -0,0 +1,90 @@
+// Copyright 2020 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <stdlib.h>
+#include <zircon/assert.h>
+
+#include <memory>
+
+#include <digest/digest.h>
+#include <digest/merkle-tree.h>
+#include <fbl/string_printf.h>
+#include <perftest/perftest.h>
+
+namespace digest {
+namespace {
+
+std::unique_ptr<uint8_t[]> MakeData(size_t data_len) {
+  std::unique_ptr<uint8_t[]> data(new uint8_t[data_len]);
+  unsigned seed = 0;
+  for (size_t i = 0; i < data_len; ++i) {
+    data[i] = static_cast<uint8_t>(rand_r(&seed));
+  }
+  return data;
+}
+
+// Measure the time taken to create the Merkle tree for |data_len| bytes of data, hashing on up to
+// |max_threads| threads.
+bool MerkleTreeCreateTest(perftest::RepeatState* state, size_t data_len, size_t max_threads) {
+  state->SetBytesProcessedPerRun(data_len);
+  std::unique_ptr<uint8_t[]> data = MakeData(data_len);
+  while (state->KeepRunning()) {
+    std::unique_ptr<uint8_t[]> tree;
+    size_t tree_len;
+    Digest root;
+    ZX_ASSERT(MerkleTreeCreator::Create(data.get(), data_len, &tree, &tree_len, &root,
+                                        max_threads) == ZX_OK);
+    perftest::DoNotOptimize(root.get());
+  }
+  return true;
+}
+
+// Measure the time taken to verify |data_len| bytes of data against their Merkle tree, hashing on
+// up to |max_threads| threads.
+bool MerkleTreeVerifyTest(perftest::RepeatState* state, size_t data_len, size_t max_threads) {
+  state->SetBytesProcessedPerRun(data_len);
+  std::unique_ptr<uint8_t[]> data = MakeData(data_len);
+  std::unique_ptr<uint8_t[]> tree;
+  size_t tree_len;
+  Digest root;
+  ZX_ASSERT(MerkleTreeCreator::Create(data.get(), data_len, &tree, &tree_len, &root) == ZX_OK);
+
+  MerkleTreeVerifier verifier;
+  verifier.SetMaxThreads(max_threads);
+  ZX_ASSERT(verifier.SetDataLength(data_len) == ZX_OK);
+  ZX_ASSERT(verifier.SetTree(tree.get(), tree_len, root.get(), root.len()) == ZX_OK);
+  while (state->KeepRunning()) {
+    ZX_ASSERT(verifier.Verify(data.get(), data_len, 0) == ZX_OK);
+  }
+  return true;
+}
+
+void RegisterTests() {
+  static const size_t kDataLens[] = {
+      kDefaultNodeSize,
+      128 * 1024,
+      1024 * 1024,
+      16 * 1024 * 1024,
+  };
+  // A single thread is the serial implementation.
+  static const size_t kMaxThreads[] = {1, 2, 4, 8};
+  for (size_t data_len : kDataLens) {
+    for (size_t max_threads : kMaxThreads) {
+      auto create_name =
+          fbl::StringPrintf("MerkleTree/Create/%zubytes/%zuthreads", data_len, max_threads);
+      perftest::RegisterTest(create_name.c_str(), MerkleTreeCreateTest, data_len, max_threads);
+      auto verify_name =
+          fbl::StringPrintf("MerkleTree/Verify/%zubytes/%zuthreads", data_len, max_threads);
+      perftest::RegisterTest(verify_name.c_str(), MerkleTreeVerifyTest, data_len, max_threads);
+    }
+  }
+}
+PERFTEST_CTOR(RegisterTests)
+
+}  // namespace
+}  // namespace digest
+
+int main(int argc, char** argv) {
+  return perftest::PerfTestMain(argc, argv, "fuchsia.digest");
+}
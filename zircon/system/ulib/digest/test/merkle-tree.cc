@@ -212,5 +212,80 @@ TEST(MerkleTree, Verify) {
   }
 }
 
+// Enough whole nodes for the leaves to be split across several threads, plus a partial node.
+const size_t kParallelDataLen = kNodeSize * kMinNodesPerThread * 8 + kNodeSize / 2;
+const size_t kParallelThreads = 4;
+
+void RandomData(size_t data_len, std::unique_ptr<uint8_t[]> *out_data) {
+  srand(zxtest::Runner::GetInstance()->random_seed());
+  fbl::AllocChecker ac;
+  std::unique_ptr<uint8_t[]> data(new (&ac) uint8_t[data_len]);
+  ASSERT_TRUE(ac.check());
+  for (size_t i = 0; i < data_len; ++i) {
+    data[i] = static_cast<uint8_t>(rand());
+  }
+  *out_data = std::move(data);
+}
+
+TEST(MerkleTree, CreateParallel) {
+  std::unique_ptr<uint8_t[]> data;
+  ASSERT_NO_FATAL_FAILURES(RandomData(kParallelDataLen, &data));
+  std::unique_ptr<uint8_t[]> serial_tree;
+  size_t serial_tree_len;
+  Digest serial_root;
+  ASSERT_OK(MerkleTreeCreator::Create(data.get(), kParallelDataLen, &serial_tree, &serial_tree_len,
+                                      &serial_root));
+
+  // All at once.
+  std::unique_ptr<uint8_t[]> tree;
+  size_t tree_len;
+  Digest root;
+  ASSERT_OK(MerkleTreeCreator::Create(data.get(), kParallelDataLen, &tree, &tree_len, &root,
+                                      kParallelThreads));
+  ASSERT_EQ(tree_len, serial_tree_len);
+  EXPECT_BYTES_EQ(tree.get(), serial_tree.get(), tree_len);
+  EXPECT_BYTES_EQ(root.get(), serial_root.get(), root.len());
+
+  // In unaligned pieces, so that runs of whole nodes start and end mid-buffer.
+  MerkleTreeCreator creator;
+  creator.SetMaxThreads(kParallelThreads);
+  ASSERT_OK(creator.SetDataLength(kParallelDataLen));
+  memset(tree.get(), 0, tree_len);
+  uint8_t root_buf[kSha256Length];
+  ASSERT_OK(creator.SetTree(tree.get(), tree_len, root_buf, sizeof(root_buf)));
+  const size_t first_len = kNodeSize / 3;
+  const size_t second_len = kNodeSize * kMinNodesPerThread * 4;
+  EXPECT_OK(creator.Append(data.get(), first_len));
+  EXPECT_OK(creator.Append(&data[first_len], second_len));
+  EXPECT_OK(creator.Append(&data[first_len + second_len],
+                           kParallelDataLen - first_len - second_len));
+  EXPECT_BYTES_EQ(tree.get(), serial_tree.get(), tree_len);
+  EXPECT_BYTES_EQ(root_buf, serial_root.get(), sizeof(root_buf));
+}
+
+TEST(MerkleTree, VerifyParallel) {
+  std::unique_ptr<uint8_t[]> data;
+  ASSERT_NO_FATAL_FAILURES(RandomData(kParallelDataLen, &data));
+  std::unique_ptr<uint8_t[]> tree;
+  size_t tree_len;
+  Digest root;
+  ASSERT_OK(MerkleTreeCreator::Create(data.get(), kParallelDataLen, &tree, &tree_len, &root));
+
+  MerkleTreeVerifier verifier;
+  verifier.SetMaxThreads(kParallelThreads);
+  ASSERT_OK(verifier.SetDataLength(kParallelDataLen));
+  ASSERT_OK(verifier.SetTree(tree.get(), tree_len, root.get(), root.len()));
+  EXPECT_OK(verifier.Verify(data.get(), kParallelDataLen, 0));
+
+  // A flipped byte in any thread's share of the nodes is caught.
+  for (size_t i = 0; i < kParallelThreads; ++i) {
+    size_t flip = (kParallelDataLen / kParallelThreads) * i + rand() % kNodeSize;
+    data[flip] ^= 0xff;
+    EXPECT_STATUS(verifier.Verify(data.get(), kParallelDataLen, 0), ZX_ERR_IO_DATA_INTEGRITY);
+    data[flip] ^= 0xff;
+  }
+  EXPECT_OK(verifier.Verify(data.get(), kParallelDataLen, 0));
+}
+
 }  // namespace testing
 }  // namespace digest
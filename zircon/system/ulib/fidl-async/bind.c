@@ -9,12 +9,29 @@
 #include <zircon/assert.h>
 #include <zircon/syscalls.h>
 
+#define FIDL_REPLY_QUEUE_MESSAGES 8u
+#define FIDL_REPLY_QUEUE_BYTES 8192u
+#define FIDL_REPLY_QUEUE_HANDLES 64u
+
+// Replies produced while draining the channel in |fidl_message_handler|,
+// written back with a single |zx_channel_write_many| call.
+typedef struct fidl_reply_queue {
+  zx_channel_message_t messages[FIDL_REPLY_QUEUE_MESSAGES];
+  uint32_t num_messages;
+  uint32_t num_bytes;
+  uint32_t num_handles;
+  zx_handle_t handles[FIDL_REPLY_QUEUE_HANDLES];
+  FIDL_ALIGNDECL uint8_t bytes[FIDL_REPLY_QUEUE_BYTES];
+} fidl_reply_queue_t;
+
 typedef struct fidl_binding {
   async_wait_t wait;
   fidl_dispatch_t* dispatch;
   async_dispatcher_t* dispatcher;
   void* ctx;
   const void* ops;
+  // Non-null only for bindings created with |fidl_bind_batched|.
+  fidl_reply_queue_t* replies;
 } fidl_binding_t;
 
 typedef struct fidl_connection {
@@ -22,8 +39,46 @@ typedef struct fidl_connection {
   zx_handle_t channel;
   zx_txid_t txid;
   fidl_binding_t* binding;
+  // Where to queue the reply, or null to write it immediately.
+  fidl_reply_queue_t* replies;
 } fidl_connection_t;
 
+// Writes out every queued reply. Handles of replies that were not written
+// have been closed by the kernel.
+static zx_status_t fidl_reply_queue_flush(fidl_reply_queue_t* queue, zx_handle_t channel) {
+  if (queue->num_messages == 0u)
+    return ZX_OK;
+  size_t actual = 0u;
+  zx_status_t status =
+      zx_channel_write_many(channel, 0, queue->messages, queue->num_messages, &actual);
+  queue->num_messages = 0u;
+  queue->num_bytes = 0u;
+  queue->num_handles = 0u;
+  return status;
+}
+
+// Copies |msg| into |queue|. Returns false, leaving |queue| untouched, if it
+// does not fit.
+static bool fidl_reply_queue_push(fidl_reply_queue_t* queue, const fidl_msg_t* msg) {
+  uint32_t aligned_bytes = FIDL_ALIGN(msg->num_bytes);
+  if (queue->num_messages == FIDL_REPLY_QUEUE_MESSAGES ||
+      aligned_bytes > FIDL_REPLY_QUEUE_BYTES - queue->num_bytes ||
+      msg->num_handles > FIDL_REPLY_QUEUE_HANDLES - queue->num_handles)
+    return false;
+  zx_channel_message_t* entry = &queue->messages[queue->num_messages++];
+  entry->bytes = &queue->bytes[queue->num_bytes];
+  entry->handles = &queue->handles[queue->num_handles];
+  entry->num_bytes = msg->num_bytes;
+  entry->num_handles = msg->num_handles;
+  entry->status = ZX_OK;
+  entry->reserved = 0u;
+  memcpy(entry->bytes, msg->bytes, msg->num_bytes);
+  memcpy(entry->handles, msg->handles, msg->num_handles * sizeof(zx_handle_t));
+  queue->num_bytes += aligned_bytes;
+  queue->num_handles += msg->num_handles;
+  return true;
+}
+
 static zx_status_t fidl_reply(fidl_txn_t* txn, const fidl_msg_t* msg) {
   fidl_connection_t* conn = (fidl_connection_t*)txn;
   if (conn->txid == 0u)
@@ -33,11 +88,25 @@ static zx_status_t fidl_reply(fidl_txn_t* txn, const fidl_msg_t* msg) {
   fidl_message_header_t* hdr = (fidl_message_header_t*)msg->bytes;
   hdr->txid = conn->txid;
   conn->txid = 0u;
+  if (conn->replies != NULL) {
+    if (fidl_reply_queue_push(conn->replies, msg))
+      return ZX_OK;
+    // Keep replies in order: drain the queue before writing this one directly.
+    zx_status_t status = fidl_reply_queue_flush(conn->replies, conn->channel);
+    if (status != ZX_OK) {
+      zx_handle_close_many(msg->handles, msg->num_handles);
+      return status;
+    }
+  }
   return zx_channel_write(conn->channel, 0, msg->bytes, msg->num_bytes, msg->handles,
                           msg->num_handles);
 }
 
 static void fidl_binding_destroy(fidl_binding_t* binding) {
+  if (binding->replies != NULL) {
+    fidl_reply_queue_flush(binding->replies, binding->wait.object);
+    free(binding->replies);
+  }
   zx_handle_close(binding->wait.object);
   free(binding);
 }
@@ -74,18 +143,28 @@ static void fidl_message_handler(async_dispatcher_t* dispatcher, async_wait_t* w
           .channel = wait->object,
           .txid = hdr->txid,
           .binding = binding,
+          .replies = binding->replies,
       };
       status = binding->dispatch(binding->ctx, &conn.txn, &msg, binding->ops);
       switch (status) {
         case ZX_OK:
           continue;
         case ZX_ERR_ASYNC:
+          // |fidl_async_txn_create| flushed the queue, and the binding may
+          // already have been rebound or destroyed by another thread.
           return;
         default:
           goto shutdown;
       }
     }
 
+    if (binding->replies != NULL) {
+      status = fidl_reply_queue_flush(binding->replies, wait->object);
+      if (status != ZX_OK) {
+        goto shutdown;
+      }
+    }
+
     // Only |status| == ZX_OK will lead here
     if (async_begin_wait(dispatcher, wait) == ZX_OK) {
       return;
@@ -100,9 +179,13 @@ shutdown:
   fidl_binding_destroy(binding);
 }
 
-zx_status_t fidl_bind(async_dispatcher_t* dispatcher, zx_handle_t channel,
-                      fidl_dispatch_t* dispatch, void* ctx, const void* ops) {
+static zx_status_t fidl_bind_common(async_dispatcher_t* dispatcher, zx_handle_t channel,
+                                    fidl_dispatch_t* dispatch, void* ctx, const void* ops,
+                                    bool batched) {
   fidl_binding_t* binding = calloc(1, sizeof(fidl_binding_t));
+  if (batched) {
+    binding->replies = calloc(1, sizeof(fidl_reply_queue_t));
+  }
   binding->wait.handler = fidl_message_handler;
   binding->wait.object = channel;
   binding->wait.trigger = ZX_CHANNEL_READABLE | ZX_CHANNEL_PEER_CLOSED;
@@ -118,6 +201,16 @@ zx_status_t fidl_bind(async_dispatcher_t* dispatcher, zx_handle_t channel,
   return status;
 }
 
+zx_status_t fidl_bind(async_dispatcher_t* dispatcher, zx_handle_t channel,
+                      fidl_dispatch_t* dispatch, void* ctx, const void* ops) {
+  return fidl_bind_common(dispatcher, channel, dispatch, ctx, ops, false);
+}
+
+zx_status_t fidl_bind_batched(async_dispatcher_t* dispatcher, zx_handle_t channel,
+                              fidl_dispatch_t* dispatch, void* ctx, const void* ops) {
+  return fidl_bind_common(dispatcher, channel, dispatch, ctx, ops, true);
+}
+
 typedef struct fidl_async_txn {
   fidl_connection_t connection;
 } fidl_async_txn_t;
@@ -125,8 +218,17 @@ typedef struct fidl_async_txn {
 fidl_async_txn_t* fidl_async_txn_create(fidl_txn_t* txn) {
   fidl_connection_t* connection = (fidl_connection_t*)txn;
 
+  // The binding belongs to whoever completes the txn from here on, so write
+  // out the replies queued so far while still on the dispatching thread. A
+  // failed flush means the channel is unusable, which the txn will find out
+  // on its own.
+  if (connection->replies != NULL) {
+    fidl_reply_queue_flush(connection->replies, connection->channel);
+  }
+
   fidl_async_txn_t* async_txn = calloc(1, sizeof(fidl_async_txn_t));
   memcpy(&async_txn->connection, connection, sizeof(*connection));
+  async_txn->connection.replies = NULL;
 
   return async_txn;
 }
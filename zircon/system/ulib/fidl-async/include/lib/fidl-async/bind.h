@@ -59,6 +59,18 @@ typedef zx_status_t(fidl_dispatch_t)(void* ctx, fidl_txn_t* txn, fidl_msg_t* msg
 zx_status_t fidl_bind(async_dispatcher_t* dispatcher, zx_handle_t channel,
                       fidl_dispatch_t* dispatch, void* ctx, const void* ops);
 
+// Like |fidl_bind|, but synchronous replies are queued rather than written
+// immediately.
+//
+// All messages that are readable when the handler runs are dispatched first,
+// then the queued replies are written back with one |zx_channel_write_many|
+// call. This helps servers whose clients pipeline many small requests.
+//
+// Creating a |fidl_async_txn_t| writes out the replies queued so far, and
+// replies made through it are written immediately.
+zx_status_t fidl_bind_batched(async_dispatcher_t* dispatcher, zx_handle_t channel,
+                              fidl_dispatch_t* dispatch, void* ctx, const void* ops);
+
 // An asynchronous FIDL txn.
 //
 // This is an opaque wrapper around |fidl_txn_t| which can extend the lifetime
@@ -106,19 +106,38 @@ bool Allocator::CheckAllocated(size_t index) const {
   return map_.Get(index, index + 1);
 }
 
-size_t Allocator::Allocate(AllocatorReservationKey, PendingWork* transaction) {
+size_t Allocator::Allocate(AllocatorReservationKey, PendingWork* transaction, size_t hint) {
   AutoLock lock(&lock_);
   ZX_DEBUG_ASSERT(reserved_ > 0);
-  size_t bitoff_start = FindLocked();
+  size_t bitoff_start;
+  if (!FindNearLocked(hint, &bitoff_start)) {
+    bitoff_start = FindLocked();
+    first_free_ = bitoff_start + 1;
+  }
 
   ZX_ASSERT(map_.SetOne(bitoff_start) == ZX_OK);
   storage_->PersistRange(transaction, GetMapDataLocked(), bitoff_start, 1);
   reserved_ -= 1;
   storage_->PersistAllocate(transaction, 1);
-  first_free_ = bitoff_start + 1;
   return bitoff_start;
 }
 
+size_t Allocator::FindLocked() const {
+  ZX_DEBUG_ASSERT(reserved_ > 0);
+  size_t index;
+  ZX_ASSERT(FindFromLocked(first_free_, &index));
+  return index;
+}
+
+bool Allocator::FindNearLocked(size_t hint, size_t* out) const {
+  // Everything before |first_free_| is in use, so a hint at or before it is no better than no hint.
+  // Searching from the hint leaves |first_free_| behind the element found, so it is kept as is.
+  if (hint <= first_free_ || hint >= map_.size()) {
+    return false;
+  }
+  return FindFromLocked(hint, out);
+}
+
 void Allocator::Unreserve(AllocatorReservationKey, size_t count) {
   AutoLock lock(&lock_);
 #ifdef __Fuchsia__
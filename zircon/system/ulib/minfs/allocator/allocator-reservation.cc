@@ -34,19 +34,19 @@ zx_status_t AllocatorReservation::Initialize(PendingWork* transaction, size_t re
   return status;
 }
 
-size_t AllocatorReservation::Allocate(PendingWork* transaction) {
+size_t AllocatorReservation::Allocate(PendingWork* transaction, size_t hint) {
   ZX_DEBUG_ASSERT(allocator_ != nullptr);
   ZX_DEBUG_ASSERT(reserved_ > 0);
   reserved_--;
-  return allocator_->Allocate({}, transaction);
+  return allocator_->Allocate({}, transaction, hint);
 }
 
 #ifdef __Fuchsia__
-size_t AllocatorReservation::Swap(size_t old_index) {
+size_t AllocatorReservation::Swap(size_t old_index, size_t hint) {
   ZX_DEBUG_ASSERT(allocator_ != nullptr);
   ZX_DEBUG_ASSERT(reserved_ > 0);
   reserved_--;
-  return allocator_->Swap({}, old_index);
+  return allocator_->Swap({}, old_index, hint);
 }
 
 void AllocatorReservation::SwapCommit(PendingWork* transaction) {
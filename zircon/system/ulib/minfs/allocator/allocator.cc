@@ -63,14 +63,13 @@ size_t Allocator::GetAvailableLocked() const {
 
 WriteData Allocator::GetMapDataLocked() const { return map_.StorageUnsafe()->GetVmo().get(); }
 
-size_t Allocator::FindLocked() const {
-  ZX_DEBUG_ASSERT(reserved_ > 0);
-  size_t start = first_free_;
-
-  while (true) {
+bool Allocator::FindFromLocked(size_t start, size_t* out) const {
+  while (start < map_.size()) {
     // Search for first free element in the map.
     size_t index;
-    ZX_ASSERT(map_.Find(false, start, map_.size(), 1, &index) == ZX_OK);
+    if (map_.Find(false, start, map_.size(), 1, &index) != ZX_OK) {
+      return false;
+    }
 
     // Although this element is free in |map_|, it may be used by another in-flight transaction
     // in |swap_in_|. Ensure it does not collide before returning it.
@@ -83,22 +82,22 @@ size_t Allocator::FindLocked() const {
 
     // Check the reserved map to see if there are any free blocks from |index| to
     // |index + max_len|.
-    size_t out;
-    zx_status_t status = swap_in_.Find(false, index, upper_limit, 1, &out);
+    zx_status_t status = swap_in_.Find(false, index, upper_limit, 1, out);
 
     // If we found a valid range, return; otherwise start searching from upper_limit.
     if (status == ZX_OK) {
-      ZX_DEBUG_ASSERT(out < upper_limit);
-      ZX_DEBUG_ASSERT(!map_.GetOne(out));
-      ZX_DEBUG_ASSERT(!swap_in_.GetOne(out));
-      return out;
+      ZX_DEBUG_ASSERT(*out < upper_limit);
+      ZX_DEBUG_ASSERT(!map_.GetOne(*out));
+      ZX_DEBUG_ASSERT(!swap_in_.GetOne(*out));
+      return true;
     }
 
     start = upper_limit;
   }
+  return false;
 }
 
-size_t Allocator::Swap(AllocatorReservationKey, size_t old_index) {
+size_t Allocator::Swap(AllocatorReservationKey, size_t old_index, size_t hint) {
   AutoLock lock(&lock_);
   ZX_DEBUG_ASSERT(reserved_ > 0);
 
@@ -107,11 +106,14 @@ size_t Allocator::Swap(AllocatorReservationKey, size_t old_index) {
     ZX_ASSERT(swap_out_.SetOne(old_index) == ZX_OK);
   }
 
-  size_t new_index = FindLocked();
+  size_t new_index;
+  if (!FindNearLocked(hint, &new_index)) {
+    new_index = FindLocked();
+    first_free_ = new_index + 1;
+  }
   ZX_DEBUG_ASSERT(!swap_in_.GetOne(new_index));
   ZX_ASSERT(swap_in_.SetOne(new_index) == ZX_OK);
   reserved_--;
-  first_free_ = new_index + 1;
   ZX_DEBUG_ASSERT(swap_in_.num_bits() >= swap_out_.num_bits());
   return new_index;
 }
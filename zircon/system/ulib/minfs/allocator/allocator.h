@@ -92,8 +92,10 @@ class Allocator {
   // The following methods are restricted to AllocatorReservation via the passkey
   // idiom. They are public, but require an empty |AllocatorReservationKey|.
 
-  // Allocate a single element and return its newly allocated index.
-  size_t Allocate(AllocatorReservationKey, PendingWork* transaction) FS_TA_EXCLUDES(lock_);
+  // Allocate a single element and return its newly allocated index. The first free element at or
+  // after |hint| is preferred, if there is one; a |hint| of zero expresses no preference.
+  size_t Allocate(AllocatorReservationKey, PendingWork* transaction, size_t hint)
+      FS_TA_EXCLUDES(lock_);
 
   // Reserve |count| elements. This is required in order to later allocate them.
   // Outputs a |reservation| which contains reservation details.
@@ -108,12 +110,13 @@ class Allocator {
 
 #ifdef __Fuchsia__
   // Mark |index| for de-allocation by adding it to the swap_out map,
-  // and return the index of a new element to be swapped in.
+  // and return the index of a new element to be swapped in, preferring one at or after |hint| as
+  // |Allocate| does.
   // This is currently only used for the block allocator.
   //
   // PRECONDITION: |index| must be allocated in the internal map.
   // PRECONDITION: AllocatorReservation must have |reserved| > 0.
-  size_t Swap(AllocatorReservationKey, size_t index) FS_TA_EXCLUDES(lock_);
+  size_t Swap(AllocatorReservationKey, size_t index, size_t hint) FS_TA_EXCLUDES(lock_);
 
   // Allocate / de-allocate elements from the swap_in / swap_out maps (respectively).
   // This persists the results of |Swap|.
@@ -144,6 +147,14 @@ class Allocator {
   // ensuring that at least one free element must exist.
   size_t FindLocked() const FS_TA_REQUIRES(lock_);
 
+  // Find a free element at or after |hint|, which must lie beyond |first_free_|. Returns false if
+  // there is none, or if |hint| is not beyond |first_free_|, in which case |FindLocked| finds the
+  // same element.
+  bool FindNearLocked(size_t hint, size_t* out) const FS_TA_REQUIRES(lock_);
+
+  // Find a free element at or after |start|. Returns false if there is none.
+  bool FindFromLocked(size_t start, size_t* out) const FS_TA_REQUIRES(lock_);
+
   // Protects the allocator's metadata.
   // Does NOT guard the allocator |storage_|.
   mutable Mutex lock_;
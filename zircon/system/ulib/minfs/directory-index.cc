@@ -0,0 +1,125 @@
+// Copyright 2020 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "directory-index.h"
+
+#include <algorithm>
+
+namespace minfs {
+namespace {
+
+// Removes the entry mapping |key| to |value| from |map|, if present.
+template <typename Map>
+void EraseEntry(Map* map, uint32_t key, uint32_t value) {
+  auto range = map->equal_range(key);
+  for (auto it = range.first; it != range.second; ++it) {
+    if (it->second == value) {
+      map->erase(it);
+      return;
+    }
+  }
+}
+
+}  // namespace
+
+void DirectoryIndex::Insert(uint32_t off, const Dirent* de) {
+  Erase(off);
+
+  Record record;
+  record.size = MinfsReclen(const_cast<Dirent*>(de), off);
+  record.in_use = de->ino != 0;
+  record.unused = record.size - (record.in_use ? DirentSize(de->namelen) : 0);
+  record.name_hash = record.in_use ? HashName(fbl::StringPiece(de->name, de->namelen)) : 0;
+
+  records_.emplace(off, record);
+  by_unused_.emplace(record.unused, off);
+  if (record.in_use) {
+    by_name_.emplace(record.name_hash, off);
+  }
+
+  // Records written into the indexed part of the directory can swallow the next record, as unlink
+  // does when it coalesces with a free one.
+  next_unindexed_ = std::max(next_unindexed_, off + record.size);
+  if (de->reclen & kMinfsReclenLast) {
+    complete_ = true;
+  }
+}
+
+void DirectoryIndex::Erase(uint32_t off) {
+  auto it = records_.find(off);
+  if (it == records_.end()) {
+    return;
+  }
+  EraseEntry(&by_unused_, it->second.unused, off);
+  if (it->second.in_use) {
+    EraseEntry(&by_name_, it->second.name_hash, off);
+  }
+  records_.erase(it);
+}
+
+void DirectoryIndex::FindName(fbl::StringPiece name, std::vector<uint32_t>* offsets) const {
+  offsets->clear();
+  auto range = by_name_.equal_range(HashName(name));
+  for (auto it = range.first; it != range.second; ++it) {
+    offsets->push_back(it->second);
+  }
+  // Visit candidates in directory order, so that the result matches a walk of the directory even
+  // if it holds the same name twice.
+  std::sort(offsets->begin(), offsets->end());
+}
+
+uint32_t DirectoryIndex::PreviousRecord(uint32_t off) const {
+  auto it = records_.lower_bound(off);
+  if (it == records_.begin()) {
+    return off;
+  }
+  return (--it)->first;
+}
+
+bool DirectoryIndex::FindSpace(uint32_t reclen, uint32_t* off) const {
+  auto it = by_unused_.lower_bound(reclen);
+  if (it == by_unused_.end()) {
+    return false;
+  }
+  *off = it->second;
+  return true;
+}
+
+// 32-bit FNV-1a.
+uint32_t DirectoryIndex::HashName(fbl::StringPiece name) {
+  uint32_t hash = 2166136261u;
+  for (char c : name) {
+    hash ^= static_cast<uint8_t>(c);
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+void DirectoryIndexCache::Put(ino_t ino, uint32_t seq_num, std::unique_ptr<DirectoryIndex> index) {
+  Erase(ino);
+  entries_.push_front({ino, seq_num, std::move(index)});
+  if (entries_.size() > kDirectoryIndexCacheSize) {
+    entries_.pop_back();
+  }
+}
+
+std::unique_ptr<DirectoryIndex> DirectoryIndexCache::Take(ino_t ino, uint32_t seq_num) {
+  for (auto it = entries_.begin(); it != entries_.end(); ++it) {
+    if (it->ino == ino) {
+      std::unique_ptr<DirectoryIndex> index;
+      if (it->seq_num == seq_num) {
+        index = std::move(it->index);
+      }
+      entries_.erase(it);
+      return index;
+    }
+  }
+  return nullptr;
+}
+
+void DirectoryIndexCache::Erase(ino_t ino) {
+  entries_.remove_if([ino](const Entry& entry) { return entry.ino == ino; });
+}
+
+}  // namespace minfs
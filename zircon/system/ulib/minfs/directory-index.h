@@ -0,0 +1,129 @@
+// Copyright 2020 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef ZIRCON_SYSTEM_ULIB_MINFS_DIRECTORY_INDEX_H_
+#define ZIRCON_SYSTEM_ULIB_MINFS_DIRECTORY_INDEX_H_
+
+#include <stdint.h>
+
+#include <list>
+#include <map>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include <fbl/macros.h>
+#include <fbl/string_piece.h>
+#include <minfs/format.h>
+
+namespace minfs {
+
+// Directories smaller than this are walked record by record; larger ones are indexed.
+constexpr uint32_t kDirectoryIndexMinSize = 4 * kMinfsBlockSize;
+
+// How many indexes of directories that are no longer open |DirectoryIndexCache| keeps.
+constexpr size_t kDirectoryIndexCacheSize = 32;
+
+// An in-memory index of the records in a directory, which lets lookups, creates and unlinks find
+// the records they need without walking the whole directory.
+//
+// The index mirrors the on-disk linear format rather than replacing it. It is built incrementally:
+// a search that does not find what it needs in the records indexed so far indexes more of the
+// directory, in order, until it does. The directory keeps it up to date as it writes records. It
+// tracks, for every record:
+//  - its offset and length, so that the record before any other can be found for coalescing;
+//  - how many of its bytes are unused, so that a new entry can be placed without a walk;
+//  - a hash of its name, if it is in use, so that names can be looked up without a walk.
+//
+// This class is not thread-safe.
+class DirectoryIndex {
+ public:
+  DirectoryIndex() = default;
+  DISALLOW_COPY_ASSIGN_AND_MOVE(DirectoryIndex);
+
+  // Records |de|, found at |off|, replacing whatever record the index had at |off|.
+  void Insert(uint32_t off, const Dirent* de);
+
+  // Forgets the record at |off|, if any.
+  void Erase(uint32_t off);
+
+  // Returns, in increasing order, the offsets of the in-use records whose names might be |name|.
+  void FindName(fbl::StringPiece name, std::vector<uint32_t>* offsets) const;
+
+  // Returns the offset of the record before the one at |off|, or |off| itself for the first record.
+  uint32_t PreviousRecord(uint32_t off) const;
+
+  // Finds a record with at least |reclen| unused bytes, in which a new entry can be written.
+  // Returns false if there is none.
+  bool FindSpace(uint32_t reclen, uint32_t* off) const;
+
+  size_t RecordCount() const { return records_.size(); }
+
+  // Offset of the first record that has not been indexed yet.
+  uint32_t NextUnindexed() const { return next_unindexed_; }
+
+  // True once the last record of the directory has been indexed.
+  bool IsComplete() const { return complete_; }
+
+ private:
+  struct Record {
+    uint32_t size;
+    uint32_t unused;
+    uint32_t name_hash;
+    bool in_use;
+  };
+
+  static uint32_t HashName(fbl::StringPiece name);
+
+  // All records, by offset.
+  std::map<uint32_t, Record> records_;
+  // Offsets of the records, by how many bytes they have unused.
+  std::multimap<uint32_t, uint32_t> by_unused_;
+  // Offsets of the in-use records, by the hash of their name.
+  std::unordered_multimap<uint32_t, uint32_t> by_name_;
+  // Everything before |next_unindexed_| is in |records_|.
+  uint32_t next_unindexed_ = 0;
+  bool complete_ = false;
+};
+
+// Keeps the indexes of directories that are no longer open. Minfs does not cache vnodes, so
+// without this, a directory's index would be dropped with its last reference and rebuilt by the
+// next search.
+//
+// Each index is stored with the directory's sequence number, which changes on every update to its
+// records, and is only handed back for that same sequence number. The least recently stored index
+// is evicted first.
+//
+// This class is not thread-safe.
+class DirectoryIndexCache {
+ public:
+  DirectoryIndexCache() = default;
+  DISALLOW_COPY_ASSIGN_AND_MOVE(DirectoryIndexCache);
+
+  // Stores the index of directory |ino|, whose sequence number is |seq_num|.
+  void Put(ino_t ino, uint32_t seq_num, std::unique_ptr<DirectoryIndex> index);
+
+  // Removes and returns the index of directory |ino|. Returns null if there is none, or if it was
+  // stored for another sequence number.
+  std::unique_ptr<DirectoryIndex> Take(ino_t ino, uint32_t seq_num);
+
+  // Drops the index of directory |ino|, if any.
+  void Erase(ino_t ino);
+
+  size_t size() const { return entries_.size(); }
+
+ private:
+  struct Entry {
+    ino_t ino;
+    uint32_t seq_num;
+    std::unique_ptr<DirectoryIndex> index;
+  };
+
+  // Most recently stored first.
+  std::list<Entry> entries_;
+};
+
+}  // namespace minfs
+
+#endif  // ZIRCON_SYSTEM_ULIB_MINFS_DIRECTORY_INDEX_H_
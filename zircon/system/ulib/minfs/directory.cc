@@ -15,6 +15,7 @@
 #include <zircon/time.h>
 
 #include <memory>
+#include <vector>
 
 #include <fbl/algorithm.h>
 #include <fbl/auto_call.h>
@@ -73,7 +74,11 @@ zx_status_t NextDirent(Dirent* de, DirectoryOffset* offs) {
 
 Directory::Directory(Minfs* fs) : VnodeMinfs(fs) {}
 
-Directory::~Directory() = default;
+Directory::~Directory() {
+  if (index_ != nullptr && !IsUnlinked()) {
+    fs_->StashDirectoryIndex(GetIno(), inode_.seq_num, std::move(index_));
+  }
+}
 
 blk_t Directory::GetBlockCount() const { return inode_.block_count; }
 
@@ -85,7 +90,7 @@ void Directory::AcquireWritableBlock(Transaction* transaction, blk_t local_bno,
                                      blk_t* out_bno) {
   bool using_new_block = (old_bno == 0);
   if (using_new_block) {
-    fs_->BlockNew(transaction, out_bno);
+    fs_->BlockNew(transaction, next_block_hint_, out_bno);
     inode_.block_count++;
   }
 }
@@ -147,9 +152,13 @@ zx_status_t Directory::UnlinkChild(Transaction* transaction, fbl::RefPtr<VnodeMi
   size_t off_prev = offs->off_prev;
   size_t off = offs->off;
   size_t off_next = off + MinfsReclen(de, off);
+  bool merged_next = false;
   Dirent de_prev, de_next;
   zx_status_t status;
 
+  // If the records are left partly updated, rebuild the index from disk on the next search.
+  auto drop_index = fbl::MakeAutoCall([this]() { index_.reset(); });
+
   // Read the direntries we're considering merging with.
   // Verify they are free and small enough to merge.
   size_t coalesced_size = MinfsReclen(de, off);
@@ -166,6 +175,7 @@ zx_status_t Directory::UnlinkChild(Transaction* transaction, fbl::RefPtr<VnodeMi
     }
     if (de_next.ino == 0) {
       coalesced_size += MinfsReclen(&de_next, off_next);
+      merged_next = true;
       // If the next entry *was* last, then 'de' is now last.
       de->reclen |= (de_next.reclen & kMinfsReclenLast);
     }
@@ -197,6 +207,14 @@ zx_status_t Directory::UnlinkChild(Transaction* transaction, fbl::RefPtr<VnodeMi
   if ((status = WriteExactInternal(transaction, de, MINFS_DIRENT_SIZE, off)) != ZX_OK) {
     return status;
   }
+  if (index_ != nullptr) {
+    index_->Erase(static_cast<uint32_t>(offs->off));
+    if (merged_next) {
+      index_->Erase(static_cast<uint32_t>(off_next));
+    }
+    index_->Insert(static_cast<uint32_t>(off), de);
+  }
+  drop_index.cancel();
 
   if (de->reclen & kMinfsReclenLast) {
     // Truncating the directory merely removed unused space; if it fails,
@@ -349,6 +367,8 @@ zx_status_t Directory::AppendDirent(DirArgs* args) {
   char data[kMinfsMaxDirentSize];
   Dirent* de = reinterpret_cast<Dirent*>(data);
   size_t r;
+  // If the records are left partly updated, rebuild the index from disk on the next search.
+  auto drop_index = fbl::MakeAutoCall([this]() { index_.reset(); });
   zx_status_t status =
       ReadInternal(args->transaction, data, kMinfsMaxDirentSize, args->offs.off, &r);
   if (status != ZX_OK) {
@@ -381,6 +401,9 @@ zx_status_t Directory::AppendDirent(DirArgs* args) {
                                      args->offs.off)) != ZX_OK) {
       return status;
     }
+    if (index_ != nullptr) {
+      index_->Insert(static_cast<uint32_t>(args->offs.off), de);
+    }
 
     args->offs.off += size;
     // Overwrite dirent data to reflect the new dirent.
@@ -395,6 +418,10 @@ zx_status_t Directory::AppendDirent(DirArgs* args) {
                                    args->offs.off)) != ZX_OK) {
     return status;
   }
+  if (index_ != nullptr) {
+    index_->Insert(static_cast<uint32_t>(args->offs.off), de);
+  }
+  drop_index.cancel();
 
   if (args->type == kMinfsTypeDir) {
     // Child directory has '..' which will point to parent directory
@@ -453,6 +480,116 @@ zx_status_t Directory::ForEachDirent(DirArgs* args, const DirentCallback func) {
   return ZX_ERR_NOT_FOUND;
 }
 
+zx_status_t Directory::ForNamedDirent(DirArgs* args, const DirentCallback func) {
+  DirectoryIndex* index = GetIndex();
+  if (index == nullptr) {
+    return ForEachDirent(args, func);
+  }
+
+  zx_status_t status;
+  char data[kMinfsMaxDirentSize];
+  Dirent* de = reinterpret_cast<Dirent*>(data);
+  std::vector<uint32_t> candidates;
+  index->FindName(args->name, &candidates);
+  for (size_t i = 0;; ++i) {
+    uint32_t off;
+    if (i < candidates.size()) {
+      off = candidates[i];
+      size_t r;
+      if ((status = ReadInternal(args->transaction, data, kMinfsMaxDirentSize, off, &r)) !=
+          ZX_OK) {
+        return status;
+      } else if ((status = ValidateDirent(de, r, off)) != ZX_OK) {
+        return status;
+      }
+    } else if (index->IsComplete()) {
+      break;
+    } else {
+      // Not among the records indexed so far; index more of the directory, stopping at the first
+      // record with this name.
+      if ((status = IndexNextRecord(args->transaction, index, de, &off)) != ZX_OK) {
+        return status;
+      }
+      if (de->ino == 0 || fbl::StringPiece(de->name, de->namelen) != args->name) {
+        continue;
+      }
+    }
+    args->offs.off = off;
+    args->offs.off_prev = index->PreviousRecord(off);
+
+    switch ((status = func(fbl::RefPtr<Directory>(this), de, args))) {
+      case kDirIteratorNext:
+        // Another name with the same hash; try the next record that might match.
+        break;
+      case kDirIteratorSaveSync:
+        inode_.seq_num++;
+        InodeSync(args->transaction, kMxFsSyncMtime);
+        args->transaction->PinVnode(fbl::RefPtr(this));
+        return ZX_OK;
+      case kDirIteratorDone:
+      default:
+        return status;
+    }
+  }
+
+  return ZX_ERR_NOT_FOUND;
+}
+
+zx_status_t Directory::FindSpace(DirArgs* args) {
+  DirectoryIndex* index = GetIndex();
+  if (index == nullptr) {
+    return ForEachDirent(args, DirentCallbackFindSpace);
+  }
+
+  uint32_t off;
+  while (!index->FindSpace(args->reclen, &off)) {
+    if (index->IsComplete()) {
+      return ZX_ERR_NOT_FOUND;
+    }
+    char data[kMinfsMaxDirentSize];
+    zx_status_t status;
+    if ((status = IndexNextRecord(args->transaction, index, reinterpret_cast<Dirent*>(data),
+                                  &off)) != ZX_OK) {
+      return status;
+    }
+  }
+  args->offs.off = off;
+  args->offs.off_prev = index->PreviousRecord(off);
+  return ZX_OK;
+}
+
+DirectoryIndex* Directory::GetIndex() {
+  if (index_ == nullptr && GetSize() >= kDirectoryIndexMinSize) {
+    // Reuse the index from the last time this directory was open, if it has not changed since.
+    index_ = fs_->TakeDirectoryIndex(GetIno(), inode_.seq_num);
+    if (index_ == nullptr) {
+      index_ = std::make_unique<DirectoryIndex>();
+    }
+  }
+  return index_.get();
+}
+
+zx_status_t Directory::IndexNextRecord(PendingWork* transaction, DirectoryIndex* index,
+                                       Dirent* de, uint32_t* out_off) {
+  ZX_DEBUG_ASSERT(!index->IsComplete());
+  // Walk the records as |ForEachDirent| does.
+  uint32_t off = index->NextUnindexed();
+  if (off + MINFS_DIRENT_SIZE >= kMinfsMaxDirectorySize) {
+    FS_TRACE_ERROR("minfs: directory has no last record\n");
+    return ZX_ERR_IO;
+  }
+  size_t r;
+  zx_status_t status = ReadInternal(transaction, de, kMinfsMaxDirentSize, off, &r);
+  if (status != ZX_OK) {
+    return status;
+  } else if ((status = ValidateDirent(de, r, off)) != ZX_OK) {
+    return status;
+  }
+  index->Insert(off, de);
+  *out_off = off;
+  return ZX_OK;
+}
+
 fs::VnodeProtocolSet Directory::GetProtocols() const { return fs::VnodeProtocol::kDirectory; }
 
 zx_status_t Directory::Read(void* data, size_t len, size_t off, size_t* out_actual) {
@@ -482,7 +619,7 @@ zx_status_t Directory::LookupInternal(fbl::RefPtr<fs::Vnode>* out, fbl::StringPi
   fs::Ticker ticker(fs_->StartTicker());
   auto get_metrics = fbl::MakeAutoCall(
       [&ticker, &success, this]() { fs_->UpdateLookupMetrics(success, ticker.End()); });
-  if ((status = ForEachDirent(&args, DirentCallbackFind)) < 0) {
+  if ((status = ForNamedDirent(&args, DirentCallbackFind)) < 0) {
     return status;
   }
   fbl::RefPtr<VnodeMinfs> vn;
@@ -589,7 +726,7 @@ zx_status_t Directory::Create(fbl::RefPtr<fs::Vnode>* out, fbl::StringPiece name
   args.name = name;
   // ensure file does not exist
   zx_status_t status;
-  if ((status = ForEachDirent(&args, DirentCallbackFind)) != ZX_ERR_NOT_FOUND) {
+  if ((status = ForNamedDirent(&args, DirentCallbackFind)) != ZX_ERR_NOT_FOUND) {
     return ZX_ERR_ALREADY_EXISTS;
   }
 
@@ -600,7 +737,7 @@ zx_status_t Directory::Create(fbl::RefPtr<fs::Vnode>* out, fbl::StringPiece name
   // before updating any other metadata.
   args.type = type;
   args.reclen = static_cast<uint32_t>(DirentSize(static_cast<uint8_t>(name.length())));
-  status = ForEachDirent(&args, DirentCallbackFindSpace);
+  status = FindSpace(&args);
   if (status == ZX_ERR_NOT_FOUND) {
     return ZX_ERR_NO_SPACE;
   } else if (status != ZX_OK) {
@@ -610,7 +747,8 @@ zx_status_t Directory::Create(fbl::RefPtr<fs::Vnode>* out, fbl::StringPiece name
   // Calculate maximum blocks to reserve for the current directory, based on the size and offset
   // of the new direntry (Assuming that the offset is the current size of the directory).
   blk_t reserve_blocks = 0;
-  if ((status = GetRequiredBlockCount(GetSize(), args.reclen, &reserve_blocks)) != ZX_OK) {
+  if ((status = GetRequiredBlockCount(fs_->Info(), GetSize(), args.reclen, &reserve_blocks)) !=
+      ZX_OK) {
     return status;
   }
 
@@ -678,7 +816,7 @@ zx_status_t Directory::Unlink(fbl::StringPiece name, bool must_be_dir) {
   args.name = name;
   args.type = must_be_dir ? kMinfsTypeDir : 0;
   args.transaction = transaction.get();
-  status = ForEachDirent(&args, DirentCallbackUnlink);
+  status = ForNamedDirent(&args, DirentCallbackUnlink);
   if (status != ZX_OK) {
     return status;
   }
@@ -734,7 +872,7 @@ zx_status_t Directory::Rename(fbl::RefPtr<fs::Vnode> _newdir, fbl::StringPiece o
   // acquire the 'oldname' node (it must exist)
   DirArgs args = DirArgs();
   args.name = oldname;
-  if ((status = ForEachDirent(&args, DirentCallbackFind)) < 0) {
+  if ((status = ForNamedDirent(&args, DirentCallbackFind)) < 0) {
     return status;
   }
   if ((status = fs_->VnodeGet(&oldvn, args.ino)) < 0) {
@@ -763,7 +901,7 @@ zx_status_t Directory::Rename(fbl::RefPtr<fs::Vnode> _newdir, fbl::StringPiece o
   args.type = oldvn->IsDirectory() ? kMinfsTypeDir : kMinfsTypeFile;
   args.reclen = static_cast<uint32_t>(DirentSize(static_cast<uint8_t>(newname.length())));
 
-  status = newdir->ForEachDirent(&args, DirentCallbackFindSpace);
+  status = newdir->FindSpace(&args);
   if (status == ZX_ERR_NOT_FOUND) {
     return ZX_ERR_NO_SPACE;
   }
@@ -775,8 +913,8 @@ zx_status_t Directory::Rename(fbl::RefPtr<fs::Vnode> _newdir, fbl::StringPiece o
 
   // Reserve potential blocks to add a new direntry to newdir.
   blk_t reserved_blocks;
-  if ((status = GetRequiredBlockCount(newdir->GetInode()->size, args.reclen, &reserved_blocks)) !=
-      ZX_OK) {
+  if ((status = GetRequiredBlockCount(fs_->Info(), newdir->GetInode()->size, args.reclen,
+                                      &reserved_blocks)) != ZX_OK) {
     return status;
   }
 
@@ -790,7 +928,7 @@ zx_status_t Directory::Rename(fbl::RefPtr<fs::Vnode> _newdir, fbl::StringPiece o
   args.transaction = transaction.get();
   args.name = newname;
   args.ino = oldvn->GetIno();
-  status = newdir->ForEachDirent(&args, DirentCallbackAttemptRename);
+  status = newdir->ForNamedDirent(&args, DirentCallbackAttemptRename);
   if (status == ZX_ERR_NOT_FOUND) {
     // if 'newname' does not exist, create it
     args.offs = append_offs;
@@ -811,7 +949,7 @@ zx_status_t Directory::Rename(fbl::RefPtr<fs::Vnode> _newdir, fbl::StringPiece o
     auto vn = fbl::RefPtr<Directory>::Downcast(vn_fs);
     args.name = "..";
     args.ino = newdir->GetIno();
-    if ((status = vn->ForEachDirent(&args, DirentCallbackUpdateInode)) < 0) {
+    if ((status = vn->ForNamedDirent(&args, DirentCallbackUpdateInode)) < 0) {
       return status;
     }
   }
@@ -822,7 +960,7 @@ zx_status_t Directory::Rename(fbl::RefPtr<fs::Vnode> _newdir, fbl::StringPiece o
 
   // finally, remove oldname from its original position
   args.name = oldname;
-  if ((status = ForEachDirent(&args, DirentCallbackForceUnlink)) != ZX_OK) {
+  if ((status = ForNamedDirent(&args, DirentCallbackForceUnlink)) != ZX_OK) {
     return status;
   }
   transaction->PinVnode(oldvn);
@@ -850,7 +988,7 @@ zx_status_t Directory::Link(fbl::StringPiece name, fbl::RefPtr<fs::Vnode> _targe
   DirArgs args = DirArgs();
   args.name = name;
   zx_status_t status;
-  if ((status = ForEachDirent(&args, DirentCallbackFind)) != ZX_ERR_NOT_FOUND) {
+  if ((status = ForNamedDirent(&args, DirentCallbackFind)) != ZX_ERR_NOT_FOUND) {
     return (status == ZX_OK) ? ZX_ERR_ALREADY_EXISTS : status;
   }
 
@@ -858,7 +996,7 @@ zx_status_t Directory::Link(fbl::StringPiece name, fbl::RefPtr<fs::Vnode> _targe
   // before updating any other metadata.
   args.type = kMinfsTypeFile;  // We can't hard link directories
   args.reclen = static_cast<uint32_t>(DirentSize(static_cast<uint8_t>(name.length())));
-  status = ForEachDirent(&args, DirentCallbackFindSpace);
+  status = FindSpace(&args);
   if (status == ZX_ERR_NOT_FOUND) {
     return ZX_ERR_NO_SPACE;
   } else if (status != ZX_OK) {
@@ -867,7 +1005,8 @@ zx_status_t Directory::Link(fbl::StringPiece name, fbl::RefPtr<fs::Vnode> _targe
 
   // Reserve potential blocks to write a new direntry.
   blk_t reserved_blocks;
-  if ((status = GetRequiredBlockCount(GetInode()->size, args.reclen, &reserved_blocks)) != ZX_OK) {
+  if ((status = GetRequiredBlockCount(fs_->Info(), GetInode()->size, args.reclen,
+                                      &reserved_blocks)) != ZX_OK) {
     return status;
   }
 
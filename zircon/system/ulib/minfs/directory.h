@@ -5,6 +5,8 @@
 #ifndef ZIRCON_SYSTEM_ULIB_MINFS_DIRECTORY_H_
 #define ZIRCON_SYSTEM_ULIB_MINFS_DIRECTORY_H_
 
+#include <memory>
+
 #include <fbl/algorithm.h>
 #include <fbl/ref_ptr.h>
 #include <fs/trace.h>
@@ -15,6 +17,7 @@
 #include <minfs/transaction-limits.h>
 #include <minfs/writeback.h>
 
+#include "directory-index.h"
 #include "vnode.h"
 
 namespace minfs {
@@ -89,6 +92,25 @@ class Directory final : public VnodeMinfs, public fbl::Recyclable<Directory> {
   // Enumerates directories.
   zx_status_t ForEachDirent(DirArgs* args, const DirentCallback func);
 
+  // Like |ForEachDirent|, for callbacks that only act on the dirent named |args->name|. Indexed
+  // directories only visit the records that might hold that name.
+  zx_status_t ForNamedDirent(DirArgs* args, const DirentCallback func);
+
+  // Finds a record with room for a new dirent of |args->reclen| bytes, and sets |args->offs| to
+  // it. Equivalent to |ForEachDirent| with |DirentCallbackFindSpace|, without the walk in indexed
+  // directories.
+  zx_status_t FindSpace(DirArgs* args);
+
+  // Returns the directory's index, creating it if the directory has grown to
+  // |kDirectoryIndexMinSize|. Smaller directories have no index, and null is returned. A new index
+  // starts out empty, or as it was left the last time this directory was open.
+  DirectoryIndex* GetIndex();
+
+  // Reads the first record that |index| does not cover yet into |de|, adds it to |index|, and
+  // returns its offset in |out_off|. |de| must have room for |kMinfsMaxDirentSize| bytes.
+  zx_status_t IndexNextRecord(PendingWork* transaction, DirectoryIndex* index, Dirent* de,
+                              uint32_t* out_off);
+
   // Directory callback functions.
   //
   // The following functions are passable to |ForEachDirent|, which reads the parent directory,
@@ -108,6 +130,11 @@ class Directory final : public VnodeMinfs, public fbl::Recyclable<Directory> {
 
   zx_status_t UnlinkChild(Transaction* transaction, fbl::RefPtr<VnodeMinfs> child, Dirent* de,
                           DirectoryOffset* offs);
+
+  // Built on demand for large directories, and kept in step with every record written. Dropped
+  // whenever an update fails partway, to be rebuilt from the directory on the next search. Handed
+  // to the filesystem when the vnode is destroyed, so that it outlives the vnode.
+  std::unique_ptr<DirectoryIndex> index_;
 };
 
 }  // namespace minfs
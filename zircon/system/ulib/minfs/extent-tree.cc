@@ -0,0 +1,472 @@
+// Copyright 2020 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "extent-tree.h"
+
+#include <string.h>
+#include <zircon/assert.h>
+
+#include <algorithm>
+#include <limits>
+#include <utility>
+
+namespace minfs {
+namespace {
+
+constexpr uint32_t kEntrySize = sizeof(Extent);
+
+uint8_t* Entry(ExtentHeader* node, uint32_t i) {
+  return reinterpret_cast<uint8_t*>(node + 1) + i * kEntrySize;
+}
+
+Extent* Extents(ExtentHeader* node) { return reinterpret_cast<Extent*>(node + 1); }
+
+ExtentIndex* Indexes(ExtentHeader* node) { return reinterpret_cast<ExtentIndex*>(node + 1); }
+
+// Extents and indexes both start with the first file block they cover.
+blk_t EntryKey(ExtentHeader* node, uint32_t i) { return Extents(node)[i].file_block; }
+
+void InitNode(ExtentHeader* node, uint32_t capacity, uint16_t depth) {
+  node->magic = kMinfsExtentMagic;
+  node->count = 0;
+  node->capacity = static_cast<uint16_t>(capacity);
+  node->depth = depth;
+}
+
+zx_status_t CheckNode(const ExtentHeader* node, uint32_t capacity) {
+  if (node->magic != kMinfsExtentMagic || node->capacity != capacity ||
+      node->count > node->capacity || node->depth > kMinfsMaxExtentDepth) {
+    return ZX_ERR_IO_DATA_INTEGRITY;
+  }
+  return ZX_OK;
+}
+
+// Returns the number of entries of |node| which start at or before |file_block|.
+uint32_t UpperBound(ExtentHeader* node, blk_t file_block) {
+  uint32_t lo = 0;
+  uint32_t hi = node->count;
+  while (lo < hi) {
+    uint32_t mid = lo + (hi - lo) / 2;
+    if (EntryKey(node, mid) <= file_block) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+void InsertAt(ExtentHeader* node, uint32_t pos, const void* entry) {
+  ZX_DEBUG_ASSERT(node->count < node->capacity);
+  ZX_DEBUG_ASSERT(pos <= node->count);
+  memmove(Entry(node, pos + 1), Entry(node, pos), (node->count - pos) * kEntrySize);
+  memcpy(Entry(node, pos), entry, kEntrySize);
+  node->count++;
+}
+
+void RemoveAt(ExtentHeader* node, uint32_t pos) {
+  ZX_DEBUG_ASSERT(pos < node->count);
+  memmove(Entry(node, pos), Entry(node, pos + 1), (node->count - pos - 1) * kEntrySize);
+  node->count--;
+}
+
+}  // namespace
+
+void ExtentTree::InitRoot(ExtentHeader* root) {
+  memset(root, 0, kMinfsBlockMapSize);
+  InitNode(root, kMinfsExtentsPerInode, 0);
+}
+
+zx_status_t ExtentTree::Lookup(blk_t file_block, blk_t* out_bno) {
+  Path path;
+  zx_status_t status = Descend(file_block, &path);
+  if (status != ZX_OK) {
+    return status;
+  }
+
+  *out_bno = 0;
+  ExtentHeader* leaf = path.Leaf();
+  uint32_t i = UpperBound(leaf, file_block);
+  if (i > 0) {
+    const Extent& extent = Extents(leaf)[i - 1];
+    if (file_block - extent.file_block < extent.length) {
+      *out_bno = extent.start + (file_block - extent.file_block);
+    }
+  }
+  return ZX_OK;
+}
+
+zx_status_t ExtentTree::Map(blk_t file_block, blk_t bno) {
+  Path path;
+  zx_status_t status = Descend(file_block, &path);
+  if (status != ZX_OK) {
+    return status;
+  }
+
+  ExtentHeader* leaf = path.Leaf();
+  uint32_t i = UpperBound(leaf, file_block);
+  if (i > 0 && file_block - Extents(leaf)[i - 1].file_block < Extents(leaf)[i - 1].length) {
+    const Extent& extent = Extents(leaf)[i - 1];
+    if (extent.start + (file_block - extent.file_block) == bno) {
+      return ZX_OK;
+    }
+    if ((status = Unmap(&path, i - 1, file_block)) != ZX_OK) {
+      return status;
+    }
+    if (bno == 0) {
+      return CollapseRoot();
+    }
+    // Unmapping may have changed the shape of the tree.
+    if ((status = Descend(file_block, &path)) != ZX_OK) {
+      return status;
+    }
+  } else if (bno == 0) {
+    return ZX_OK;
+  }
+
+  if ((status = MapUnmapped(&path, file_block, bno)) != ZX_OK) {
+    return status;
+  }
+  return CollapseRoot();
+}
+
+zx_status_t ExtentTree::Truncate(blk_t start, BlockCallback callback) {
+  while (true) {
+    Path path;
+    zx_status_t status = Descend(std::numeric_limits<blk_t>::max(), &path);
+    if (status != ZX_OK) {
+      return status;
+    }
+
+    ExtentHeader* leaf = path.Leaf();
+    if (leaf->count == 0) {
+      break;
+    }
+    Extent& extent = Extents(leaf)[leaf->count - 1];
+    blk_t end = extent.file_block + extent.length;
+    if (end <= start) {
+      break;
+    }
+
+    blk_t first = std::max(start, extent.file_block);
+    for (blk_t file_block = first; file_block < end; file_block++) {
+      callback(file_block, extent.start + (file_block - extent.file_block));
+    }
+    if (first > extent.file_block) {
+      extent.length = first - extent.file_block;
+      storage_->DirtyNode(path.levels[path.size - 1].bno);
+      break;
+    }
+    RemoveEntry(&path, path.size - 1, leaf->count - 1);
+  }
+  return CollapseRoot();
+}
+
+zx_status_t ExtentTree::End(blk_t* out) {
+  Path path;
+  zx_status_t status = Descend(std::numeric_limits<blk_t>::max(), &path);
+  if (status != ZX_OK) {
+    return status;
+  }
+
+  ExtentHeader* leaf = path.Leaf();
+  if (leaf->count == 0) {
+    *out = 0;
+  } else {
+    const Extent& extent = Extents(leaf)[leaf->count - 1];
+    *out = extent.file_block + extent.length;
+  }
+  return ZX_OK;
+}
+
+zx_status_t ExtentTree::Walk(ExtentCallback extent_callback, NodeCallback node_callback) {
+  zx_status_t status = CheckNode(root_, kMinfsExtentsPerInode);
+  if (status != ZX_OK) {
+    return status;
+  }
+  // No file maps blocks past kMinfsMaxFileBlock, so callers may trust the bounds of every extent.
+  return WalkNode(root_, 0, kMinfsMaxFileBlock, &extent_callback, &node_callback);
+}
+
+zx_status_t ExtentTree::WalkNode(ExtentHeader* node, uint64_t lower, uint64_t upper,
+                                 ExtentCallback* extent_callback, NodeCallback* node_callback) {
+  if (node->depth == 0) {
+    uint64_t next = lower;
+    for (uint32_t i = 0; i < node->count; i++) {
+      const Extent& extent = Extents(node)[i];
+      if (extent.length == 0 || extent.start == 0 || extent.file_block < next ||
+          extent.file_block + uint64_t{extent.length} > upper) {
+        return ZX_ERR_IO_DATA_INTEGRITY;
+      }
+      next = extent.file_block + uint64_t{extent.length};
+      (*extent_callback)(extent);
+    }
+    return ZX_OK;
+  }
+
+  if (node->count == 0) {
+    return ZX_ERR_IO_DATA_INTEGRITY;
+  }
+  for (uint32_t i = 0; i < node->count; i++) {
+    const ExtentIndex& index = Indexes(node)[i];
+    uint64_t child_upper = i + 1 < node->count ? Indexes(node)[i + 1].file_block : upper;
+    if (index.file_block < lower || index.file_block >= child_upper || child_upper > upper) {
+      return ZX_ERR_IO_DATA_INTEGRITY;
+    }
+
+    (*node_callback)(index.node);
+    ExtentHeader* child;
+    zx_status_t status = GetChild(index.node, node->depth, &child);
+    if (status != ZX_OK) {
+      return status;
+    }
+    if ((status = WalkNode(child, index.file_block, child_upper, extent_callback,
+                           node_callback)) != ZX_OK) {
+      return status;
+    }
+  }
+  return ZX_OK;
+}
+
+zx_status_t ExtentTree::Descend(blk_t file_block, Path* path) {
+  zx_status_t status = CheckNode(root_, kMinfsExtentsPerInode);
+  if (status != ZX_OK) {
+    return status;
+  }
+
+  path->size = 0;
+  blk_t bno = kExtentRootNode;
+  ExtentHeader* node = root_;
+  while (true) {
+    PathEntry& level = path->levels[path->size++];
+    level.bno = bno;
+    level.node = node;
+    level.index = 0;
+    if (node->depth == 0) {
+      return ZX_OK;
+    }
+    if (node->count == 0) {
+      return ZX_ERR_IO_DATA_INTEGRITY;
+    }
+
+    // Follow the last index which starts at or before |file_block|. The first index of the root
+    // starts at block zero, so there always is one.
+    uint32_t i = UpperBound(node, file_block);
+    level.index = i == 0 ? 0 : i - 1;
+    bno = Indexes(node)[level.index].node;
+    if ((status = GetChild(bno, node->depth, &node)) != ZX_OK) {
+      return status;
+    }
+  }
+}
+
+zx_status_t ExtentTree::GetChild(blk_t bno, uint16_t parent_depth, ExtentHeader** out) {
+  if (bno == kExtentRootNode) {
+    return ZX_ERR_IO_DATA_INTEGRITY;
+  }
+  zx_status_t status = storage_->GetNode(bno, out);
+  if (status != ZX_OK) {
+    return status;
+  }
+  if ((status = CheckNode(*out, kMinfsExtentsPerBlock)) != ZX_OK) {
+    return status;
+  }
+  return (*out)->depth + 1 == parent_depth ? ZX_OK : ZX_ERR_IO_DATA_INTEGRITY;
+}
+
+bool ExtentTree::CanInsert(const Path& path) const {
+  // Splits stop at the first node on the way up which has room.
+  for (uint32_t level = 0; level < path.size; level++) {
+    if (path.levels[level].node->count < path.levels[level].node->capacity) {
+      return true;
+    }
+  }
+  return root_->depth < kMinfsMaxExtentDepth;
+}
+
+zx_status_t ExtentTree::Unmap(Path* path, uint32_t index, blk_t file_block) {
+  const uint32_t level = path->size - 1;
+  Extent& extent = Extents(path->Leaf())[index];
+  const blk_t last = extent.file_block + extent.length - 1;
+
+  if (extent.length == 1) {
+    RemoveEntry(path, level, index);
+  } else if (file_block == extent.file_block) {
+    extent.file_block++;
+    extent.start++;
+    extent.length--;
+    storage_->DirtyNode(path->levels[level].bno);
+  } else if (file_block == last) {
+    extent.length--;
+    storage_->DirtyNode(path->levels[level].bno);
+  } else {
+    // Punching a hole in the middle of the extent leaves two extents.
+    if (!CanInsert(*path)) {
+      return ZX_ERR_NO_SPACE;
+    }
+    Extent tail = {
+        .file_block = file_block + 1,
+        .start = extent.start + (file_block - extent.file_block) + 1,
+        .length = last - file_block,
+    };
+    extent.length = file_block - extent.file_block;
+    InsertEntry(path, level, index + 1, &tail);
+  }
+  return ZX_OK;
+}
+
+zx_status_t ExtentTree::MapUnmapped(Path* path, blk_t file_block, blk_t bno) {
+  const uint32_t level = path->size - 1;
+  ExtentHeader* leaf = path->Leaf();
+  uint32_t i = UpperBound(leaf, file_block);
+  Extent* prev = i > 0 ? &Extents(leaf)[i - 1] : nullptr;
+  Extent* next = i < leaf->count ? &Extents(leaf)[i] : nullptr;
+
+  bool join_prev = prev != nullptr && prev->file_block + prev->length == file_block &&
+                   prev->start + prev->length == bno;
+  bool join_next = next != nullptr && next->file_block == file_block + 1 && next->start == bno + 1;
+
+  if (join_prev && join_next) {
+    prev->length += 1 + next->length;
+    RemoveAt(leaf, i);
+  } else if (join_prev) {
+    prev->length++;
+  } else if (join_next) {
+    next->file_block--;
+    next->start--;
+    next->length++;
+  } else {
+    if (!CanInsert(*path)) {
+      return ZX_ERR_NO_SPACE;
+    }
+    Extent extent = {
+        .file_block = file_block,
+        .start = bno,
+        .length = 1,
+    };
+    InsertEntry(path, level, i, &extent);
+    return ZX_OK;
+  }
+  storage_->DirtyNode(path->levels[level].bno);
+  return ZX_OK;
+}
+
+void ExtentTree::InsertEntry(Path* path, uint32_t level, uint32_t pos, const void* entry) {
+  PathEntry& at = path->levels[level];
+  ExtentHeader* node = at.node;
+  if (node->count < node->capacity) {
+    InsertAt(node, pos, entry);
+    storage_->DirtyNode(at.bno);
+    return;
+  }
+
+  if (level == 0) {
+    GrowRoot(path);
+    InsertEntry(path, 1, pos, entry);
+    return;
+  }
+
+  // Split the node. Appending past its last entry is the common case for files written
+  // sequentially, so start an empty node then rather than leaving two half-full ones behind.
+  blk_t right_bno;
+  ExtentHeader* right;
+  storage_->AllocateNode(&right_bno, &right);
+  InitNode(right, kMinfsExtentsPerBlock, node->depth);
+
+  uint32_t split = pos == node->count ? pos : node->count / 2;
+  right->count = static_cast<uint16_t>(node->count - split);
+  memcpy(Entry(right, 0), Entry(node, split), right->count * kEntrySize);
+  node->count = static_cast<uint16_t>(split);
+  if (pos < split) {
+    InsertAt(node, pos, entry);
+  } else {
+    InsertAt(right, pos - split, entry);
+  }
+  storage_->DirtyNode(at.bno);
+  storage_->DirtyNode(right_bno);
+
+  ExtentIndex index = {
+      .file_block = EntryKey(right, 0),
+      .node = right_bno,
+      .reserved = 0,
+  };
+  InsertEntry(path, level - 1, path->levels[level - 1].index + 1, &index);
+}
+
+void ExtentTree::RemoveEntry(Path* path, uint32_t level, uint32_t pos) {
+  PathEntry& at = path->levels[level];
+  ExtentHeader* node = at.node;
+  const blk_t first_key = EntryKey(node, 0);
+  RemoveAt(node, pos);
+
+  if (node->count == 0) {
+    if (level > 0) {
+      storage_->FreeNode(at.bno);
+      RemoveEntry(path, level - 1, path->levels[level - 1].index);
+      return;
+    }
+    InitNode(root_, kMinfsExtentsPerInode, 0);
+  } else if (node->depth > 0 && pos == 0) {
+    // The next child takes over the range of the one removed.
+    Indexes(node)[0].file_block = first_key;
+  }
+  storage_->DirtyNode(at.bno);
+}
+
+void ExtentTree::GrowRoot(Path* path) {
+  ZX_DEBUG_ASSERT(root_->depth < kMinfsMaxExtentDepth);
+  blk_t child_bno;
+  ExtentHeader* child;
+  storage_->AllocateNode(&child_bno, &child);
+  InitNode(child, kMinfsExtentsPerBlock, root_->depth);
+  child->count = root_->count;
+  memcpy(Entry(child, 0), Entry(root_, 0), root_->count * kEntrySize);
+
+  const uint16_t depth = static_cast<uint16_t>(root_->depth + 1);
+  InitNode(root_, kMinfsExtentsPerInode, depth);
+  ExtentIndex index = {
+      .file_block = 0,
+      .node = child_bno,
+      .reserved = 0,
+  };
+  InsertAt(root_, 0, &index);
+  storage_->DirtyNode(child_bno);
+  storage_->DirtyNode(kExtentRootNode);
+
+  // The old root is now one level down.
+  memmove(&path->levels[2], &path->levels[1], (path->size - 1) * sizeof(PathEntry));
+  path->levels[1] = {
+      .bno = child_bno,
+      .node = child,
+      .index = path->levels[0].index,
+  };
+  path->levels[0].index = 0;
+  path->size++;
+}
+
+zx_status_t ExtentTree::CollapseRoot() {
+  while (root_->depth > 0 && root_->count == 1) {
+    blk_t child_bno = Indexes(root_)[0].node;
+    ExtentHeader* child;
+    zx_status_t status = GetChild(child_bno, root_->depth, &child);
+    if (status != ZX_OK) {
+      return status;
+    }
+    if (child->count > kMinfsExtentsPerInode) {
+      break;
+    }
+
+    InitNode(root_, kMinfsExtentsPerInode, child->depth);
+    root_->count = child->count;
+    memcpy(Entry(root_, 0), Entry(child, 0), child->count * kEntrySize);
+    if (root_->depth > 0) {
+      Indexes(root_)[0].file_block = 0;
+    }
+    storage_->FreeNode(child_bno);
+    storage_->DirtyNode(kExtentRootNode);
+  }
+  return ZX_OK;
+}
+
+}  // namespace minfs
@@ -0,0 +1,137 @@
+// Copyright 2020 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef ZIRCON_SYSTEM_ULIB_MINFS_EXTENT_TREE_H_
+#define ZIRCON_SYSTEM_ULIB_MINFS_EXTENT_TREE_H_
+
+#include <stdint.h>
+#include <zircon/types.h>
+
+#include <fbl/function.h>
+#include <fbl/macros.h>
+#include <minfs/format.h>
+
+namespace minfs {
+
+// Identifies the root of an extent tree, which lives in the inode rather than in a data block.
+// Data block zero is never allocated to files, so it cannot name any other node.
+constexpr blk_t kExtentRootNode = 0;
+
+// Gives an ExtentTree access to the nodes below its root.
+class ExtentNodeStorage {
+ public:
+  virtual ~ExtentNodeStorage() = default;
+
+  // Returns the node held by data block |bno|, reading it if necessary. The node must stay at the
+  // same address until it is freed.
+  virtual zx_status_t GetNode(blk_t bno, ExtentHeader** out) = 0;
+
+  // Allocates a data block for a new node, returning the block and the zeroed node.
+  virtual void AllocateNode(blk_t* out_bno, ExtentHeader** out) = 0;
+
+  // Releases the node held by |bno|, which the tree no longer references.
+  virtual void FreeNode(blk_t bno) = 0;
+
+  // Records that the node held by |bno| (or the root, for kExtentRootNode) has been modified, and
+  // must be written back.
+  virtual void DirtyNode(blk_t bno) = 0;
+};
+
+// Maps the blocks of a file to data blocks through the extent tree rooted in its inode. See the
+// description of ExtentHeader in format.h for the layout of the tree.
+//
+// Adjacent blocks which are also adjacent on disk are kept in a single extent, as long as they
+// fall within the same leaf. Full nodes are split in two (or, when appending past the last entry,
+// a new node is started), and the root grows by one level when it is full. Nodes which become empty
+// are freed, and the root absorbs its only child when it fits. Nodes are never rebalanced.
+//
+// Every operation checks the nodes it visits, failing with ZX_ERR_IO_DATA_INTEGRITY on a malformed
+// tree.
+//
+// This class is not thread-safe.
+class ExtentTree {
+ public:
+  using ExtentCallback = fbl::Function<void(const Extent& extent)>;
+  using NodeCallback = fbl::Function<void(blk_t bno)>;
+  using BlockCallback = fbl::Function<void(blk_t file_block, blk_t bno)>;
+
+  ExtentTree(ExtentHeader* root, ExtentNodeStorage* storage) : root_(root), storage_(storage) {}
+  DISALLOW_COPY_ASSIGN_AND_MOVE(ExtentTree);
+
+  // Initializes |root| as the root of a tree which maps no blocks.
+  static void InitRoot(ExtentHeader* root);
+
+  // Returns the data block mapped to |file_block|, or zero if there is none.
+  zx_status_t Lookup(blk_t file_block, blk_t* out_bno);
+
+  // Maps |file_block| to the data block |bno|, or unmaps it if |bno| is zero.
+  //
+  // Returns ZX_ERR_NO_SPACE if the mapping needs another extent and the tree is already as deep as
+  // it may grow, which files within kMinfsMaxFileBlock never reach.
+  zx_status_t Map(blk_t file_block, blk_t bno);
+
+  // Unmaps every block at or after |start|, passing each one to |callback| with the data block it
+  // was mapped to. |callback| must not access the tree.
+  zx_status_t Truncate(blk_t start, BlockCallback callback);
+
+  // Returns one past the last mapped file block, or zero if no blocks are mapped.
+  zx_status_t End(blk_t* out);
+
+  // Walks the whole tree, calling |node_callback| on every node below the root and
+  // |extent_callback| on every extent, in order. Fails on the first malformed node.
+  zx_status_t Walk(ExtentCallback extent_callback, NodeCallback node_callback);
+
+ private:
+  struct PathEntry {
+    blk_t bno;
+    ExtentHeader* node;
+    // For index nodes, the entry which was followed to the next level.
+    uint32_t index;
+  };
+
+  // The nodes from the root (at level zero) down to a leaf.
+  struct Path {
+    ExtentHeader* Leaf() const { return levels[size - 1].node; }
+
+    PathEntry levels[kMinfsMaxExtentDepth + 1];
+    uint32_t size;
+  };
+
+  // Fills |path| with the nodes leading to the leaf which holds, or would hold, |file_block|.
+  zx_status_t Descend(blk_t file_block, Path* path);
+
+  // Returns the node one level below a node of depth |parent_depth|.
+  zx_status_t GetChild(blk_t bno, uint16_t parent_depth, ExtentHeader** out);
+
+  // Returns whether an entry can be inserted into the leaf of |path|, splitting nodes as needed.
+  bool CanInsert(const Path& path) const;
+
+  // Removes |file_block| from the extent at |index| in the leaf of |path|.
+  zx_status_t Unmap(Path* path, uint32_t index, blk_t file_block);
+
+  // Maps |file_block|, which the leaf of |path| covers but does not map, to |bno|.
+  zx_status_t MapUnmapped(Path* path, blk_t file_block, blk_t bno);
+
+  // Inserts |entry| at |pos| in the node at |level| of |path|, splitting it if it is full.
+  void InsertEntry(Path* path, uint32_t level, uint32_t pos, const void* entry);
+
+  // Removes the entry at |pos| in the node at |level| of |path|, freeing the node if it empties.
+  void RemoveEntry(Path* path, uint32_t level, uint32_t pos);
+
+  // Moves the contents of the root into a new node, one level down.
+  void GrowRoot(Path* path);
+
+  // Pulls the only child of the root into the root, for as long as it fits.
+  zx_status_t CollapseRoot();
+
+  zx_status_t WalkNode(ExtentHeader* node, uint64_t lower, uint64_t upper,
+                       ExtentCallback* extent_callback, NodeCallback* node_callback);
+
+  ExtentHeader* const root_;
+  ExtentNodeStorage* const storage_;
+};
+
+}  // namespace minfs
+
+#endif  // ZIRCON_SYSTEM_ULIB_MINFS_EXTENT_TREE_H_
@@ -97,15 +97,20 @@ void File::AllocateAndCommitData(std::unique_ptr<Transaction> transaction) {
     // Since we reserved enough space ahead of time, this should not fail.
     ZX_ASSERT(BlocksSwap(transaction.get(), bno_start, bno_count, &allocated_blocks[0]) == ZX_OK);
 
-    // Enqueue each data block one at a time, as they may not be contiguous on disk.
-    for (blk_t i = 0; i < bno_count; i++) {
+    // Enqueue the data blocks, one operation for each run of blocks which are contiguous on disk.
+    for (blk_t i = 0; i < bno_count;) {
+      blk_t run = 1;
+      while (i + run < bno_count && allocated_blocks[i + run] == allocated_blocks[i] + run) {
+        run++;
+      }
       storage::Operation op = {
           .type = storage::OperationType::kWrite,
           .vmo_offset = bno_start + i,
           .dev_offset = allocated_blocks[i] + fs_->Info().dat_block,
-          .length = 1,
+          .length = run,
       };
       transaction->EnqueueData(vmo_.get(), std::move(op));
+      i += run;
     }
 
     // Since we are updating the file in "chunks", only update the on-disk inode size
@@ -146,7 +151,7 @@ zx_status_t File::BlocksSwap(Transaction* transaction, blk_t start, blk_t count,
       inode_.block_count++;
     }
     // For copy-on-write, swap the block out if it's a data block.
-    fs_->BlockSwap(transaction, old_bno, out_bno);
+    fs_->BlockSwap(transaction, old_bno, next_block_hint_, out_bno);
     bool cleared = allocation_state_.ClearPending(local_bno, old_bno != 0);
     ZX_DEBUG_ASSERT(cleared);
   };
@@ -187,7 +192,7 @@ void File::AcquireWritableBlock(Transaction* transaction, blk_t local_bno, blk_t
   allocation_state_.SetPending(local_bno, !using_new_block);
 #else
   if (using_new_block) {
-    fs_->BlockNew(transaction, out_bno);
+    fs_->BlockNew(transaction, next_block_hint_, out_bno);
     inode_.block_count++;
   } else {
     *out_bno = old_bno;
@@ -257,7 +262,7 @@ zx_status_t File::Write(const void* data, size_t len, size_t offset, size_t* out
 
   blk_t reserve_blocks;
   // Calculate maximum number of blocks to reserve for this write operation.
-  zx_status_t status = GetRequiredBlockCount(offset, len, &reserve_blocks);
+  zx_status_t status = GetRequiredBlockCount(fs_->Info(), offset, len, &reserve_blocks);
   if (status != ZX_OK) {
     return status;
   }
@@ -303,6 +308,10 @@ zx_status_t File::Truncate(size_t len) {
   std::unique_ptr<Transaction> transaction;
   // Due to file copy-on-write, up to 1 new (data) block may be required.
   size_t reserve_blocks = 1;
+  if (GetMinfsFlagExtents(fs_->Info())) {
+    // Remapping that block may split an extent.
+    reserve_blocks += kExtentTreeReserveBlocks;
+  }
   zx_status_t status;
 
   if ((status = fs_->BeginTransaction(0, reserve_blocks, &transaction)) != ZX_OK) {
@@ -65,8 +65,9 @@ class File final : public VnodeMinfs, public fbl::Recyclable<File> {
   void AllocateAndCommitData(std::unique_ptr<Transaction> transaction);
 
   // For all data blocks in the range |start| to |start + count|, reserve specific blocks in
-  // the allocator to be swapped in at the time the old blocks are swapped out. Metadata blocks
-  // are expected to have been allocated previously.
+  // the allocator to be swapped in at the time the old blocks are swapped out. Indirect blocks
+  // are expected to have been allocated previously; extent tree nodes are allocated here, from the
+  // blocks which the write reserved for them.
   zx_status_t BlocksSwap(Transaction* state, blk_t start, blk_t count, blk_t* bno);
 
   // Describes pending allocation data for the vnode. This should only be accessed while a valid
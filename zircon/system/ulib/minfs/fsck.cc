@@ -11,12 +11,15 @@
 #include <map>
 #include <memory>
 #include <optional>
+#include <set>
+#include <string>
 #include <utility>
 
 #include <fs/journal/format.h>
 #include <minfs/format.h>
 #include <minfs/fsck.h>
 
+#include "extent-tree.h"
 #include "lib/fit/string_view.h"
 #include "minfs-private.h"
 
@@ -30,7 +33,7 @@ using RawBitmap = bitmap::RawBitmapGeneric<bitmap::VmoStorage>;
 using RawBitmap = bitmap::RawBitmapGeneric<bitmap::DefaultStorage>;
 #endif
 
-enum class BlockType { DirectBlock = 0, IndirectBlock, DoubleIndirectBlock };
+enum class BlockType { DirectBlock = 0, IndirectBlock, DoubleIndirectBlock, ExtentNode };
 
 struct BlockInfo {
   ino_t owner;     // Inode number that maps this block.
@@ -41,6 +44,7 @@ struct BlockInfo {
 const std::string kBlockInfoDirectStr("direct");
 const std::string kBlockInfoIndirectStr("indirect");
 const std::string kBlockInfoDoubleIndirectStr("double indirect");
+const std::string kBlockInfoExtentNodeStr("extent node");
 
 // Given a type of block, returns human readable c-string for the block type.
 std::string BlockTypeToString(BlockType type) {
@@ -51,6 +55,8 @@ std::string BlockTypeToString(BlockType type) {
       return kBlockInfoIndirectStr;
     case BlockType::DoubleIndirectBlock:
       return kBlockInfoDoubleIndirectStr;
+    case BlockType::ExtentNode:
+      return kBlockInfoExtentNodeStr;
     default:
       ZX_ASSERT(false);
   }
@@ -76,6 +82,37 @@ blk_t LogicalBlockDoublyIndirect(blk_t doubly_indirect, blk_t indirect = 0, blk_
          (indirect * kMinfsDirectPerIndirect) + direct;
 }
 
+// Reads the nodes of an extent tree for checking. The tree is never modified.
+class CheckerExtentNodes final : public ExtentNodeStorage {
+ public:
+  explicit CheckerExtentNodes(Minfs* fs) : fs_(fs) {}
+
+  zx_status_t GetNode(blk_t bno, ExtentHeader** out) final {
+    auto iter = nodes_.find(bno);
+    if (iter == nodes_.end()) {
+      if (bno >= fs_->Info().block_count) {
+        return ZX_ERR_IO_DATA_INTEGRITY;
+      }
+      std::unique_ptr<uint8_t[]> data(new uint8_t[kMinfsBlockSize]);
+      zx_status_t status = fs_->ReadDat(bno, data.get());
+      if (status != ZX_OK) {
+        return status;
+      }
+      iter = nodes_.emplace(bno, std::move(data)).first;
+    }
+    *out = reinterpret_cast<ExtentHeader*>(iter->second.get());
+    return ZX_OK;
+  }
+
+  void AllocateNode(blk_t* out_bno, ExtentHeader** out) final { ZX_ASSERT(false); }
+  void FreeNode(blk_t bno) final { ZX_ASSERT(false); }
+  void DirtyNode(blk_t bno) final { ZX_ASSERT(false); }
+
+ private:
+  Minfs* const fs_;
+  std::map<blk_t, std::unique_ptr<uint8_t[]>> nodes_;
+};
+
 }  // namespace
 
 class MinfsChecker {
@@ -115,6 +152,10 @@ class MinfsChecker {
   zx_status_t CheckDirectory(Inode* inode, ino_t ino, ino_t parent, uint32_t flags);
   std::optional<std::string> CheckDataBlock(blk_t bno, BlockInfo block_info);
   zx_status_t CheckFile(Inode* inode, ino_t ino);
+  // Checks the blocks of |inode| on an extent-mapped filesystem, returning the number in use and
+  // one past the last block of the file which is mapped.
+  zx_status_t CheckExtents(Inode* inode, ino_t ino, uint32_t* out_block_count,
+                           blk_t* out_next_blk);
 
   std::unique_ptr<Minfs> fs_;
   RawBitmap checked_inodes_;
@@ -239,6 +280,7 @@ zx_status_t MinfsChecker::CheckDirectory(Inode* inode, ino_t ino, ino_t parent,
   bool dot = false;
   bool dotdot = false;
   uint32_t dirent_count = 0;
+  std::set<std::string> names;
 
   zx_status_t status;
   fbl::RefPtr<VnodeMinfs> vn;
@@ -308,6 +350,12 @@ zx_status_t MinfsChecker::CheckDirectory(Inode* inode, ino_t ino, ino_t parent,
                          de->ino, parent);
         }
       }
+      if (!names.emplace(de->name, de->namelen).second) {
+        // Lookups through the directory index stop at the first entry with a name.
+        FS_TRACE_ERROR("check: ino#%u: de[%u]: duplicate entry '%.*s'\n", ino, eno, de->namelen,
+                       de->name);
+        return ZX_ERR_IO_DATA_INTEGRITY;
+      }
       // TODO: check for cycles (non-dot/dotdot dir ref already in checked bitmap)
       if (flags & CD_DUMP) {
         FS_TRACE_DEBUG("ino#%u: de[%u]: ino=%u type=%u '%.*s' %s\n", ino, eno, de->ino, de->type,
@@ -373,7 +421,72 @@ std::optional<std::string> MinfsChecker::CheckDataBlock(blk_t bno, BlockInfo blo
   return std::nullopt;
 }
 
+zx_status_t MinfsChecker::CheckExtents(Inode* inode, ino_t ino, uint32_t* out_block_count,
+                                       blk_t* out_next_blk) {
+  uint32_t block_count = 0;
+  blk_t next_blk = 0;
+  CheckerExtentNodes nodes(fs_.get());
+  ExtentTree tree(InodeExtentRoot(inode), &nodes);
+  zx_status_t status = tree.Walk(
+      [this, ino, &block_count, &next_blk](const Extent& extent) {
+        FS_TRACE_DEBUG("ino#%u: extent [%u, %u) @%u\n", ino, extent.file_block,
+                       extent.file_block + extent.length, extent.start);
+        if (extent.start + uint64_t{extent.length} > fs_->Info().block_count) {
+          FS_TRACE_WARN("check: ino#%u: extent at block %u(@%u): out of range\n", ino,
+                        extent.file_block, extent.start);
+          conforming_ = false;
+          return;
+        }
+        for (blk_t i = 0; i < extent.length; i++) {
+          BlockInfo block_info = {ino, extent.file_block + i, BlockType::DirectBlock};
+          auto msg = CheckDataBlock(extent.start + i, block_info);
+          if (msg) {
+            FS_TRACE_WARN("check: ino#%u: block %u(@%u): %s\n", ino, extent.file_block + i,
+                          extent.start + i, msg.value().c_str());
+            conforming_ = false;
+          }
+        }
+        block_count += extent.length;
+        next_blk = extent.file_block + extent.length;
+      },
+      [this, ino, &block_count](blk_t bno) {
+        BlockInfo block_info = {ino, 0, BlockType::ExtentNode};
+        auto msg = CheckDataBlock(bno, block_info);
+        if (msg) {
+          FS_TRACE_WARN("check: ino#%u: extent node (@%u): %s\n", ino, bno, msg.value().c_str());
+          conforming_ = false;
+        }
+        block_count++;
+      });
+  if (status != ZX_OK) {
+    FS_TRACE_ERROR("check: ino#%u: bad extent tree: %d\n", ino, status);
+    return status;
+  }
+  *out_block_count = block_count;
+  *out_next_blk = next_blk;
+  return ZX_OK;
+}
+
 zx_status_t MinfsChecker::CheckFile(Inode* inode, ino_t ino) {
+  if (GetMinfsFlagExtents(fs_->Info())) {
+    uint32_t block_count;
+    blk_t next_blk;
+    zx_status_t status = CheckExtents(inode, ino, &block_count, &next_blk);
+    if (status != ZX_OK) {
+      return status;
+    }
+    if (next_blk > fbl::round_up(inode->size, kMinfsBlockSize) / kMinfsBlockSize) {
+      FS_TRACE_WARN("check: ino#%u: filesize too small\n", ino);
+      conforming_ = false;
+    }
+    if (block_count != inode->block_count) {
+      FS_TRACE_WARN("check: ino#%u: block count %u, actual blocks %u\n", ino, inode->block_count,
+                    block_count);
+      conforming_ = false;
+    }
+    return ZX_OK;
+  }
+
   FS_TRACE_DEBUG("Direct blocks: \n");
   for (unsigned n = 0; n < kMinfsDirect; n++) {
     FS_TRACE_DEBUG(" %d,", inode->dnum[n]);
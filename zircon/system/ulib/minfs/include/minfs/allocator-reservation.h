@@ -47,7 +47,10 @@ class AllocatorReservation {
   // A call to Allocate() is effectively the same as a call to Swap(0) + SwapCommit(), but under
   // the hood completes these operations more efficiently as additional state doesn't need to be
   // stored between the two.
-  size_t Allocate(PendingWork* transaction);
+  //
+  // If |hint| is non-zero, the first free item at or after |hint| is preferred, so that items
+  // which are used together can be allocated next to each other.
+  size_t Allocate(PendingWork* transaction, size_t hint = 0);
 
   // Unreserve all currently reserved items.
   void Cancel();
@@ -55,8 +58,9 @@ class AllocatorReservation {
 #ifdef __Fuchsia__
   // Swap the element currently allocated at |old_index| for a new index.
   // If |old_index| is 0, a new block will still be allocated, but no blocks will be de-allocated.
+  // The new index is chosen as by Allocate(), preferring one at or after |hint|.
   // The swap will not be persisted until a call to SwapCommit is made.
-  size_t Swap(size_t old_index);
+  size_t Swap(size_t old_index, size_t hint = 0);
 
   // Commit any pending swaps, allocating new indices and de-allocating old indices.
   void SwapCommit(PendingWork* transaction);
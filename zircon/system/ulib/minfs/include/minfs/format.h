@@ -10,6 +10,7 @@
 #include <assert.h>
 #include <limits.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <zircon/types.h>
 
@@ -35,10 +36,14 @@ constexpr uint64_t kMinfsMagic0         = (0x002153466e694d21ULL);
 constexpr uint64_t kMinfsMagic1         = (0x385000d3d3d3d304ULL);
 constexpr uint32_t kMinfsMajorVersion      = 0x00000009;
 constexpr uint32_t kMinfsMinorVersion      = 0x00000000;
+// Minor version of filesystems formatted with kMinfsFlagExtents, which older
+// drivers must refuse to mount.
+constexpr uint32_t kMinfsMinorVersionExtents = 0x00000001;
 
 constexpr ino_t    kMinfsRootIno        = 1;
 constexpr uint32_t kMinfsFlagClean      = 0x00000001; // Currently unused
 constexpr uint32_t kMinfsFlagFVM        = 0x00000002; // Mounted on FVM
+constexpr uint32_t kMinfsFlagExtents    = 0x00000004; // Inodes map data through extent trees
 constexpr uint32_t kMinfsBlockSize      = 8192;
 constexpr uint32_t kMinfsBlockBits      = (kMinfsBlockSize * 8);
 constexpr uint32_t kMinfsInodeSize      = 256;
@@ -169,6 +174,67 @@ struct Inode {
 static_assert(sizeof(Inode) == kMinfsInodeSize,
               "minfs inode size is wrong");
 
+// Number of bytes of the inode which map its data: the direct, indirect and
+// doubly indirect block numbers, or the root of its extent tree.
+constexpr uint32_t kMinfsBlockMapSize = sizeof(blk_t) * (kMinfsDirect + kMinfsIndirect +
+                                                         kMinfsDoublyIndirect);
+
+static_assert(offsetof(Inode, inum) == offsetof(Inode, dnum) + sizeof(blk_t) * kMinfsDirect &&
+              offsetof(Inode, dinum) == offsetof(Inode, inum) + sizeof(blk_t) * kMinfsIndirect &&
+              sizeof(Inode) == offsetof(Inode, dnum) + kMinfsBlockMapSize,
+              "minfs block map must fill the end of the inode");
+
+// On filesystems with kMinfsFlagExtents, the block map of every inode holds
+// the root of an extent tree instead of block numbers. Each node of the tree,
+// including the root, starts with an ExtentHeader followed by |count| entries
+// sorted by file block: Extents in leaves (depth zero), and ExtentIndexes in
+// the nodes above them. Nodes other than the root fill a data block of their
+// own, and are counted in the inode's |block_count|.
+//
+// An ExtentIndex covers the file blocks from its own |file_block| up to the
+// |file_block| of the next index in the same node; the first index in the root
+// always starts at file block zero.
+constexpr uint16_t kMinfsExtentMagic = 0xE87E;
+
+struct ExtentHeader {
+    uint16_t magic;                 // kMinfsExtentMagic
+    uint16_t count;                 // number of entries in use
+    uint16_t capacity;              // number of entries which fit in this node
+    uint16_t depth;                 // zero for leaves
+};
+
+// Maps |length| blocks of a file, starting at |file_block|, to as many
+// consecutive data blocks starting at |start|.
+struct Extent {
+    blk_t file_block;
+    blk_t start;
+    uint32_t length;
+};
+
+// Points at the node, one level down, holding the extents of a range of the file.
+struct ExtentIndex {
+    blk_t file_block;
+    blk_t node;                     // data block holding the node
+    uint32_t reserved;
+};
+
+static_assert(sizeof(ExtentHeader) == 8, "minfs extent header size is wrong");
+static_assert(sizeof(Extent) == 12 && sizeof(ExtentIndex) == sizeof(Extent),
+              "minfs extent size is wrong");
+
+constexpr uint32_t kMinfsExtentsPerInode = (kMinfsBlockMapSize - sizeof(ExtentHeader)) /
+                                           sizeof(Extent);
+constexpr uint32_t kMinfsExtentsPerBlock = (kMinfsBlockSize - sizeof(ExtentHeader)) /
+                                           sizeof(Extent);
+// Even with a single block per extent, three levels of nodes below the root
+// map far more than kMinfsMaxFileBlock blocks.
+constexpr uint32_t kMinfsMaxExtentDepth = 3;
+
+// Returns the root of the extent tree of |inode|.
+inline ExtentHeader* InodeExtentRoot(Inode* inode) {
+    return reinterpret_cast<ExtentHeader*>(inode->dnum);
+}
+
 struct Dirent {
     ino_t ino;                      // inode number
     uint32_t reclen;                // Low 28 bits: Length of record
@@ -235,6 +301,11 @@ constexpr bool GetMinfsFlagFvm(Superblock& info) {
     return (info.flags & kMinfsFlagFVM) == kMinfsFlagFVM;
 }
 
+// Returns true if kMinfsFlagExtents is set for given superblock
+constexpr bool GetMinfsFlagExtents(const Superblock& info) {
+    return (info.flags & kMinfsFlagExtents) == kMinfsFlagExtents;
+}
+
 constexpr uint64_t InodeBitmapBlocks(const Superblock& info) {
     if ((info.flags & kMinfsFlagFVM) == kMinfsFlagFVM) {
         auto blocks_per_slice = static_cast<blk_t>(info.slice_size / kMinfsBlockSize);
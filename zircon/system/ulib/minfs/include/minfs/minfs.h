@@ -77,6 +77,9 @@ struct MountOptions {
 
   // Number of slices to preallocate for data when the filesystem is created.
   uint32_t fvm_data_slices = 1;
+  // Determines if the filesystem is created with extent trees, rather than block pointers, mapping
+  // the blocks of every file.
+  bool extents = false;
 };
 
 // Format the partition backed by |bc| as MinFS.
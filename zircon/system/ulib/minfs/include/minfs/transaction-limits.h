@@ -19,6 +19,15 @@ blk_t GetBlockBitmapBlocks(const Superblock& info);
 // and |length|.
 zx_status_t GetRequiredBlockCount(size_t offset, size_t length, uint32_t* num_req_blocks);
 
+// The number of extent tree nodes which may be allocated (or rewritten) while mapping the blocks
+// of one write: every level of the tree may split once, and the root may grow by a level.
+constexpr blk_t kExtentTreeReserveBlocks = 2 * (kMinfsMaxExtentDepth + 1);
+
+// As above, for the filesystem described by |info|, which may map blocks with extent trees rather
+// than indirect blocks.
+zx_status_t GetRequiredBlockCount(const Superblock& info, size_t offset, size_t length,
+                                  uint32_t* num_req_blocks);
+
 // Calculates and tracks the number of Minfs metadata / data blocks that can be modified within one
 // transaction, as well as the corresponding Journal sizes.
 // Once we can grow the block bitmap, we will need to be able to recalculate these limits.
@@ -88,7 +97,7 @@ class TransactionLimits {
  private:
   // Calculates the maximum number of data and metadata blocks that can be updated during a
   // single transaction.
-  void CalculateDataBlocks();
+  void CalculateDataBlocks(const Superblock& info);
 
   // Calculates the maximum journal entry size and the minimum size required for the integrity
   // section of Minfs (journal + backup superblock).
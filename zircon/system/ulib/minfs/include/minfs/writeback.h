@@ -75,9 +75,10 @@ class Transaction final : public PendingWork {
     return inode_reservation_.Allocate(this);
   }
 
-  size_t AllocateBlock() {
+  // Allocates a data block, preferring the first free one at or after |hint|, if non-zero.
+  size_t AllocateBlock(size_t hint = 0) {
     ZX_DEBUG_ASSERT(block_reservation_.IsInitialized());
-    return block_reservation_.Allocate(this);
+    return block_reservation_.Allocate(this, hint);
   }
 
   void PinVnode(fbl::RefPtr<VnodeMinfs> vnode);
@@ -93,9 +94,9 @@ class Transaction final : public PendingWork {
     return data_operations_.TakeOperations();
   }
 
-  size_t SwapBlock(size_t old_bno) {
+  size_t SwapBlock(size_t old_bno, size_t hint = 0) {
     ZX_DEBUG_ASSERT(block_reservation_.IsInitialized());
-    return block_reservation_.Swap(old_bno);
+    return block_reservation_.Swap(old_bno, hint);
   }
 
   void Resolve() {
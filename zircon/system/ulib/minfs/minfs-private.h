@@ -54,6 +54,7 @@
 
 #include "allocator/allocator.h"
 #include "allocator/inode-manager.h"
+#include "directory-index.h"
 #include "vnode.h"
 
 constexpr uint32_t kExtentCount = 6;
@@ -219,15 +220,24 @@ class Minfs :
   fbl::RefPtr<VnodeMinfs> VnodeLookup(uint32_t ino) FS_TA_EXCLUDES(hash_lock_);
   void VnodeRelease(VnodeMinfs* vn) FS_TA_EXCLUDES(hash_lock_);
 
-  // Allocate a new data block.
-  void BlockNew(Transaction* transaction, blk_t* out_bno);
+  // Keep the index of directory |ino| after its vnode goes away, and hand it back to the next
+  // vnode for that directory. See |DirectoryIndexCache|.
+  void StashDirectoryIndex(ino_t ino, uint32_t seq_num, std::unique_ptr<DirectoryIndex> index)
+      FS_TA_EXCLUDES(directory_index_lock_);
+  std::unique_ptr<DirectoryIndex> TakeDirectoryIndex(ino_t ino, uint32_t seq_num)
+      FS_TA_EXCLUDES(directory_index_lock_);
+
+  // Allocate a new data block, preferring the first free one at or after |hint| (if non-zero), so
+  // that blocks which are read together stay contiguous.
+  void BlockNew(Transaction* transaction, blk_t hint, blk_t* out_bno);
 
   // Set/Unset the flags.
   void UpdateFlags(PendingWork* transaction, uint32_t flags, bool set);
 
-  // Mark |in_bno| for de-allocation (if it is > 0), and return a new block |*out_bno|.
+  // Mark |in_bno| for de-allocation (if it is > 0), and return a new block |*out_bno|, chosen as by
+  // |BlockNew|.
   // The swap will not be persisted until the transaction is commited.
-  void BlockSwap(Transaction* transaction, blk_t in_bno, blk_t* out_bno);
+  void BlockSwap(Transaction* transaction, blk_t in_bno, blk_t hint, blk_t* out_bno);
 
   // Free a data block.
   void BlockFree(PendingWork* transaction, blk_t bno);
@@ -431,10 +441,14 @@ class Minfs :
 #ifdef __Fuchsia__
   mutable fbl::Mutex txn_lock_;  // Lock required to start a new Transaction.
   fbl::Mutex hash_lock_;         // Lock required to access the vnode_hash_.
+  // Lock required to access the directory_indexes_.
+  fbl::Mutex directory_index_lock_;
 #endif
   // Vnodes exist in the hash table as long as one or more reference exists;
   // when the Vnode is deleted, it is immediately removed from the map.
   HashTable vnode_hash_ FS_TA_GUARDED(hash_lock_){};
+  // Indexes of large directories whose vnodes have been released.
+  DirectoryIndexCache directory_indexes_ FS_TA_GUARDED(directory_index_lock_);
 
 #ifdef __Fuchsia__
   fbl::Closure on_unmount_{};
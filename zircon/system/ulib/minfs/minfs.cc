@@ -42,6 +42,7 @@
 #include <fs/journal/format.h>
 #include <minfs/fsck.h>
 
+#include "extent-tree.h"
 #include "file.h"
 #include "minfs-private.h"
 
@@ -393,9 +394,12 @@ zx_status_t CheckSuperblock(const Superblock* info, uint32_t max_blocks) {
                    info->version_major, kMinfsMajorVersion);
     return ZX_ERR_NOT_SUPPORTED;
   }
-  if (info->version_minor != kMinfsMinorVersion) {
+  // Extent-mapped filesystems carry their own minor version, so that older drivers refuse them.
+  const uint32_t minor_version =
+      GetMinfsFlagExtents(*info) ? kMinfsMinorVersionExtents : kMinfsMinorVersion;
+  if (info->version_minor != minor_version) {
     FS_TRACE_ERROR("minfs: FS minor version: %08x. Driver minor version: %08x\n",
-                   info->version_minor, kMinfsMinorVersion);
+                   info->version_minor, minor_version);
     return ZX_ERR_NOT_SUPPORTED;
   }
   if ((info->block_size != kMinfsBlockSize) || (info->inode_size != kMinfsInodeSize)) {
@@ -588,6 +592,36 @@ zx_status_t Minfs::InoFree(PendingWork* transaction, VnodeMinfs* vn) {
 
   inodes_->Free(transaction, vn->GetIno());
   uint32_t block_count = vn->GetInode()->block_count;
+  {
+#ifdef __Fuchsia__
+    fbl::AutoLock lock(&directory_index_lock_);
+#endif
+    // The inode number may be reused by another directory.
+    directory_indexes_.Erase(vn->GetIno());
+  }
+
+  if (GetMinfsFlagExtents(Info())) {
+    // release the data blocks of every extent, and the blocks holding the tree itself
+    zx_status_t status = vn->WalkExtents(
+        [this, transaction, &block_count](const Extent& extent) {
+          for (blk_t i = 0; i < extent.length; i++) {
+            ValidateBno(extent.start + i);
+            block_count--;
+            block_allocator_->Free(transaction, extent.start + i);
+          }
+        },
+        [this, transaction, &block_count](blk_t bno) {
+          ValidateBno(bno);
+          block_count--;
+          block_allocator_->Free(transaction, bno);
+        });
+    if (status != ZX_OK) {
+      return status;
+    }
+    ZX_DEBUG_ASSERT(block_count == 0);
+    ZX_DEBUG_ASSERT(vn->IsUnlinked());
+    return ZX_OK;
+  }
 
   // release all direct blocks
   for (unsigned n = 0; n < kMinfsDirect; n++) {
@@ -930,6 +964,21 @@ void Minfs::VnodeRelease(VnodeMinfs* vn) {
   vnode_hash_.erase(*vn);
 }
 
+void Minfs::StashDirectoryIndex(ino_t ino, uint32_t seq_num,
+                                std::unique_ptr<DirectoryIndex> index) {
+#ifdef __Fuchsia__
+  fbl::AutoLock lock(&directory_index_lock_);
+#endif
+  directory_indexes_.Put(ino, seq_num, std::move(index));
+}
+
+std::unique_ptr<DirectoryIndex> Minfs::TakeDirectoryIndex(ino_t ino, uint32_t seq_num) {
+#ifdef __Fuchsia__
+  fbl::AutoLock lock(&directory_index_lock_);
+#endif
+  return directory_indexes_.Take(ino, seq_num);
+}
+
 zx_status_t Minfs::VnodeGet(fbl::RefPtr<VnodeMinfs>* out, ino_t ino) {
   TRACE_DURATION("minfs", "Minfs::VnodeGet", "ino", ino);
   if ((ino < 1) || (ino >= Info().inode_count)) {
@@ -962,8 +1011,8 @@ zx_status_t Minfs::VnodeGet(fbl::RefPtr<VnodeMinfs>* out, ino_t ino) {
 }
 
 // Allocate a new data block from the block bitmap.
-void Minfs::BlockNew(Transaction* transaction, blk_t* out_bno) {
-  size_t allocated_bno = transaction->AllocateBlock();
+void Minfs::BlockNew(Transaction* transaction, blk_t hint, blk_t* out_bno) {
+  size_t allocated_bno = transaction->AllocateBlock(hint);
   *out_bno = static_cast<blk_t>(allocated_bno);
   ValidateBno(*out_bno);
 }
@@ -985,12 +1034,12 @@ void Minfs::UpdateFlags(PendingWork* transaction, uint32_t flags, bool set) {
 }
 
 #ifdef __Fuchsia__
-void Minfs::BlockSwap(Transaction* transaction, blk_t in_bno, blk_t* out_bno) {
+void Minfs::BlockSwap(Transaction* transaction, blk_t in_bno, blk_t hint, blk_t* out_bno) {
   if (in_bno > 0) {
     ValidateBno(in_bno);
   }
 
-  size_t allocated_bno = transaction->SwapBlock(in_bno);
+  size_t allocated_bno = transaction->SwapBlock(in_bno, hint);
   *out_bno = static_cast<blk_t>(allocated_bno);
   ValidateBno(*out_bno);
 }
@@ -1489,6 +1538,10 @@ zx_status_t Mkfs(const MountOptions& options, Bcache* bc) {
   info.version_major = kMinfsMajorVersion;
   info.version_minor = kMinfsMinorVersion;
   info.flags = kMinfsFlagClean;
+  if (options.extents) {
+    info.version_minor = kMinfsMinorVersionExtents;
+    info.flags |= kMinfsFlagExtents;
+  }
   info.block_size = kMinfsBlockSize;
   info.inode_size = kMinfsInodeSize;
 
@@ -1657,7 +1710,15 @@ zx_status_t Mkfs(const MountOptions& options, Bcache* bc) {
   ino[kMinfsRootIno].block_count = 1;
   ino[kMinfsRootIno].link_count = 2;
   ino[kMinfsRootIno].dirent_count = 2;
-  ino[kMinfsRootIno].dnum[0] = 1;
+  if (GetMinfsFlagExtents(info)) {
+    ExtentHeader* root = InodeExtentRoot(&ino[kMinfsRootIno]);
+    ExtentTree::InitRoot(root);
+    Extent* extent = reinterpret_cast<Extent*>(root + 1);
+    *extent = {.file_block = 0, .start = 1, .length = 1};
+    root->count = 1;
+  } else {
+    ino[kMinfsRootIno].dnum[0] = 1;
+  }
   ino[kMinfsRootIno].create_time = GetTimeUTC();
   bc->Writeblk(info.ino_block, blk);
 
@@ -0,0 +1,182 @@
+// Copyright 2020 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// Tests the in-memory index of large directories.
+
+#include "directory-index.h"
+
+#include <string.h>
+
+#include <memory>
+#include <vector>
+
+#include <zxtest/zxtest.h>
+
+namespace minfs {
+namespace {
+
+// Holds a single dirent, with room for the longest name.
+struct DirentBuffer {
+  DirentBuffer(ino_t ino, const char* name, uint32_t reclen) {
+    memset(data, 0, sizeof(data));
+    Dirent* de = get();
+    de->ino = ino;
+    de->reclen = reclen;
+    de->namelen = static_cast<uint8_t>(strlen(name));
+    de->type = kMinfsTypeFile;
+    memcpy(de->name, name, de->namelen);
+  }
+
+  Dirent* get() { return reinterpret_cast<Dirent*>(data); }
+
+  uint8_t data[kMinfsMaxDirentSize];
+};
+
+TEST(DirectoryIndexTest, FindNameReturnsMatchingRecord) {
+  DirectoryIndex index;
+  DirentBuffer dot(1, ".", DirentSize(1));
+  DirentBuffer dotdot(1, "..", DirentSize(2));
+  DirentBuffer foo(2, "foo", DirentSize(3));
+  DirentBuffer bar(3, "bar", DirentSize(3) | kMinfsReclenLast);
+
+  uint32_t off = 0;
+  index.Insert(off, dot.get());
+  off += DirentSize(1);
+  index.Insert(off, dotdot.get());
+  off += DirentSize(2);
+  const uint32_t foo_off = off;
+  index.Insert(off, foo.get());
+  off += DirentSize(3);
+  const uint32_t bar_off = off;
+  index.Insert(off, bar.get());
+  EXPECT_EQ(4, index.RecordCount());
+
+  std::vector<uint32_t> offsets;
+  index.FindName("foo", &offsets);
+  ASSERT_EQ(1, offsets.size());
+  EXPECT_EQ(foo_off, offsets[0]);
+  index.FindName("bar", &offsets);
+  ASSERT_EQ(1, offsets.size());
+  EXPECT_EQ(bar_off, offsets[0]);
+  index.FindName("baz", &offsets);
+  EXPECT_EQ(0, offsets.size());
+}
+
+TEST(DirectoryIndexTest, PreviousRecord) {
+  DirectoryIndex index;
+  DirentBuffer a(2, "a", DirentSize(1));
+  DirentBuffer b(3, "b", DirentSize(1));
+  DirentBuffer c(4, "c", DirentSize(1) | kMinfsReclenLast);
+  index.Insert(0, a.get());
+  index.Insert(DirentSize(1), b.get());
+  index.Insert(2 * DirentSize(1), c.get());
+
+  EXPECT_EQ(0, index.PreviousRecord(0));
+  EXPECT_EQ(0, index.PreviousRecord(DirentSize(1)));
+  EXPECT_EQ(DirentSize(1), index.PreviousRecord(2 * DirentSize(1)));
+}
+
+TEST(DirectoryIndexTest, FindSpacePrefersSmallestFit) {
+  DirectoryIndex index;
+  // A used record with 64 bytes of slack, a free record of 32 bytes, and the last record.
+  DirentBuffer slack(2, "slack", DirentSize(5) + 64);
+  DirentBuffer hole(0, "", 32);
+  DirentBuffer last(3, "last", DirentSize(4) | kMinfsReclenLast);
+  const uint32_t slack_off = 0;
+  const uint32_t hole_off = slack_off + DirentSize(5) + 64;
+  const uint32_t last_off = hole_off + 32;
+  index.Insert(slack_off, slack.get());
+  index.Insert(hole_off, hole.get());
+  index.Insert(last_off, last.get());
+
+  uint32_t off;
+  ASSERT_TRUE(index.FindSpace(32, &off));
+  EXPECT_EQ(hole_off, off);
+  ASSERT_TRUE(index.FindSpace(48, &off));
+  EXPECT_EQ(slack_off, off);
+  // Only the last record, which extends to the end of the largest directory, fits this.
+  ASSERT_TRUE(index.FindSpace(kMinfsMaxDirentSize, &off));
+  EXPECT_EQ(last_off, off);
+  EXPECT_FALSE(index.FindSpace(kMinfsMaxDirectorySize, &off));
+}
+
+TEST(DirectoryIndexTest, InsertReplacesAndEraseForgets) {
+  DirectoryIndex index;
+  DirentBuffer foo(2, "foo", DirentSize(3) | kMinfsReclenLast);
+  index.Insert(0, foo.get());
+
+  // Unlinking frees the record in place.
+  DirentBuffer freed(0, "", DirentSize(3) | kMinfsReclenLast);
+  index.Insert(0, freed.get());
+  EXPECT_EQ(1, index.RecordCount());
+  std::vector<uint32_t> offsets;
+  index.FindName("foo", &offsets);
+  EXPECT_EQ(0, offsets.size());
+
+  index.Erase(0);
+  EXPECT_EQ(0, index.RecordCount());
+  uint32_t off;
+  EXPECT_FALSE(index.FindSpace(MINFS_DIRENT_SIZE, &off));
+}
+
+TEST(DirectoryIndexTest, TracksIndexedPrefix) {
+  DirectoryIndex index;
+  DirentBuffer a(2, "a", DirentSize(1));
+  DirentBuffer b(0, "", 2 * DirentSize(1));
+  DirentBuffer c(4, "c", DirentSize(1) | kMinfsReclenLast);
+  EXPECT_EQ(0, index.NextUnindexed());
+  EXPECT_FALSE(index.IsComplete());
+
+  index.Insert(0, a.get());
+  EXPECT_EQ(DirentSize(1), index.NextUnindexed());
+  EXPECT_FALSE(index.IsComplete());
+
+  // Coalescing "a" with the free record after it covers that record too.
+  DirentBuffer merged(0, "", 3 * DirentSize(1));
+  index.Insert(0, merged.get());
+  EXPECT_EQ(3 * DirentSize(1), index.NextUnindexed());
+  EXPECT_FALSE(index.IsComplete());
+
+  index.Insert(3 * DirentSize(1), c.get());
+  EXPECT_TRUE(index.IsComplete());
+}
+
+TEST(DirectoryIndexCacheTest, TakeReturnsIndexForSameSequenceNumber) {
+  DirectoryIndexCache cache;
+  auto index = std::make_unique<DirectoryIndex>();
+  DirectoryIndex* stored = index.get();
+  cache.Put(5, 10, std::move(index));
+  EXPECT_EQ(1, cache.size());
+
+  EXPECT_NULL(cache.Take(6, 10));
+  EXPECT_EQ(stored, cache.Take(5, 10).get());
+  EXPECT_EQ(0, cache.size());
+}
+
+TEST(DirectoryIndexCacheTest, TakeDropsIndexForOtherSequenceNumber) {
+  DirectoryIndexCache cache;
+  cache.Put(5, 10, std::make_unique<DirectoryIndex>());
+  EXPECT_NULL(cache.Take(5, 11));
+  EXPECT_EQ(0, cache.size());
+}
+
+TEST(DirectoryIndexCacheTest, EraseDropsIndex) {
+  DirectoryIndexCache cache;
+  cache.Put(5, 10, std::make_unique<DirectoryIndex>());
+  cache.Erase(5);
+  EXPECT_NULL(cache.Take(5, 10));
+}
+
+TEST(DirectoryIndexCacheTest, EvictsLeastRecentlyStored) {
+  DirectoryIndexCache cache;
+  for (ino_t ino = 1; ino <= kDirectoryIndexCacheSize + 1; ++ino) {
+    cache.Put(ino, 0, std::make_unique<DirectoryIndex>());
+  }
+  EXPECT_EQ(kDirectoryIndexCacheSize, cache.size());
+  EXPECT_NULL(cache.Take(1, 0));
+  EXPECT_NOT_NULL(cache.Take(kDirectoryIndexCacheSize + 1, 0));
+}
+
+}  // namespace
+}  // namespace minfs
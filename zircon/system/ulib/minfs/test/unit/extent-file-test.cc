@@ -0,0 +1,192 @@
+// Copyright 2020 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// Tests files of an extent-mapped filesystem end to end, from the vnode interface down to fsck.
+
+#include <lib/sync/completion.h>
+#include <lib/zx/time.h>
+#include <string.h>
+
+#include <memory>
+
+#include <block-client/cpp/fake-device.h>
+#include <fbl/algorithm.h>
+#include <minfs/format.h>
+#include <minfs/fsck.h>
+#include <zxtest/zxtest.h>
+
+#include "minfs-private.h"
+
+namespace minfs {
+namespace {
+
+using block_client::FakeBlockDevice;
+
+constexpr uint64_t kBlockCount = 1 << 20;
+constexpr uint32_t kBlockSize = 512;
+
+// One more single-block extent than a node block holds, so that the tree of each file needs two
+// leaves below the root in the inode.
+constexpr uint32_t kFileBlocks = kMinfsExtentsPerBlock + 1;
+
+constexpr const char* kFileNames[] = {"a", "b"};
+constexpr size_t kFileCount = fbl::count_of(kFileNames);
+
+class ExtentFileTest : public zxtest::Test {
+ public:
+  void SetUp() override {
+    auto device = std::make_unique<FakeBlockDevice>(kBlockCount, kBlockSize);
+    std::unique_ptr<Bcache> bcache;
+    ASSERT_OK(Bcache::Create(std::move(device), kBlockCount, &bcache));
+    options_.extents = true;
+    ASSERT_OK(Mkfs(options_, bcache.get()));
+    ASSERT_OK(Minfs::Create(std::move(bcache), options_, &fs_));
+    ASSERT_TRUE(GetMinfsFlagExtents(fs_->Info()));
+  }
+
+  void TearDown() override {
+    if (fs_ != nullptr) {
+      Minfs::Destroy(std::move(fs_));
+    }
+  }
+
+  // Flushes everything to disk, unmounts, checks the filesystem without repairing it and mounts it
+  // again.
+  void RemountAndCheck() {
+    sync_completion_t completion;
+    fs_->Sync([&completion](zx_status_t status) { sync_completion_signal(&completion); });
+    ASSERT_OK(sync_completion_wait(&completion, zx::duration::infinite().get()));
+
+    std::unique_ptr<Bcache> bcache = Minfs::Destroy(std::move(fs_));
+    ASSERT_OK(Fsck(std::move(bcache), Repair::kDisabled, &bcache));
+    ASSERT_OK(Minfs::Create(std::move(bcache), options_, &fs_));
+  }
+
+  fbl::RefPtr<VnodeMinfs> Root() {
+    fbl::RefPtr<VnodeMinfs> root;
+    EXPECT_OK(fs_->VnodeGet(&root, kMinfsRootIno));
+    return root;
+  }
+
+  fbl::RefPtr<VnodeMinfs> Lookup(const char* name) {
+    fbl::RefPtr<fs::Vnode> vn;
+    EXPECT_OK(Root()->Lookup(&vn, name));
+    return fbl::RefPtr<VnodeMinfs>::Downcast(std::move(vn));
+  }
+
+  Minfs* fs() { return fs_.get(); }
+
+ private:
+  MountOptions options_ = {};
+  std::unique_ptr<Minfs> fs_;
+};
+
+// Fills |data| with the contents of block |block| of file |file|.
+void FillBlock(size_t file, uint32_t block, uint8_t* data) {
+  memset(data, static_cast<uint8_t>(file * 131 + block), kMinfsBlockSize);
+}
+
+void WriteBlock(fs::Vnode* vn, size_t file, uint32_t block) {
+  uint8_t data[kMinfsBlockSize];
+  FillBlock(file, block, data);
+  size_t actual;
+  ASSERT_OK(vn->Write(data, kMinfsBlockSize, static_cast<size_t>(block) * kMinfsBlockSize,
+                      &actual));
+  ASSERT_EQ(kMinfsBlockSize, actual);
+}
+
+void CheckContents(fs::Vnode* vn, size_t file, uint32_t blocks) {
+  fs::VnodeAttributes attributes;
+  ASSERT_OK(vn->GetAttributes(&attributes));
+  ASSERT_EQ(static_cast<uint64_t>(blocks) * kMinfsBlockSize, attributes.content_size);
+
+  uint8_t expected[kMinfsBlockSize];
+  uint8_t data[kMinfsBlockSize];
+  for (uint32_t block = 0; block < blocks; block++) {
+    FillBlock(file, block, expected);
+    size_t actual;
+    ASSERT_OK(vn->Read(data, kMinfsBlockSize, static_cast<size_t>(block) * kMinfsBlockSize,
+                       &actual));
+    ASSERT_EQ(kMinfsBlockSize, actual);
+    ASSERT_BYTES_EQ(expected, data, kMinfsBlockSize, "file %zu block %u", file, block);
+  }
+}
+
+uint16_t TreeDepth(const VnodeMinfs* vn) {
+  const auto* root = reinterpret_cast<const ExtentHeader*>(vn->GetInode()->dnum);
+  EXPECT_EQ(kMinfsExtentMagic, root->magic);
+  return root->depth;
+}
+
+TEST_F(ExtentFileTest, FragmentedFilesSurviveOverwriteTruncateAndUnlink) {
+  const uint32_t initial_blocks = fs()->Info().alloc_block_count;
+  const uint32_t initial_inodes = fs()->Info().alloc_inode_count;
+
+  // Interleave single block writes to two files. Each write is allocated on its own, so neither
+  // file gets a run of more than one block and every block needs an extent of its own.
+  {
+    fbl::RefPtr<VnodeMinfs> root = Root();
+    fbl::RefPtr<fs::Vnode> files[kFileCount];
+    for (size_t file = 0; file < kFileCount; file++) {
+      ASSERT_OK(root->Create(&files[file], kFileNames[file], 0));
+    }
+    for (uint32_t block = 0; block < kFileBlocks; block++) {
+      for (size_t file = 0; file < kFileCount; file++) {
+        ASSERT_NO_FAILURES(WriteBlock(files[file].get(), file, block));
+      }
+    }
+    for (size_t file = 0; file < kFileCount; file++) {
+      auto vn = fbl::RefPtr<VnodeMinfs>::Downcast(files[file]);
+      EXPECT_EQ(1, TreeDepth(vn.get()));
+      // Both leaves are counted along with the data blocks.
+      EXPECT_EQ(kFileBlocks + 2, vn->GetInode()->block_count);
+      EXPECT_OK(files[file]->Close());
+    }
+  }
+  ASSERT_NO_FAILURES(RemountAndCheck());
+
+  // Reading pages each file in with one read per extent.
+  for (size_t file = 0; file < kFileCount; file++) {
+    ASSERT_NO_FAILURES(CheckContents(Lookup(kFileNames[file]).get(), file, kFileBlocks));
+  }
+
+  // Overwriting a block moves it to a new data block, which rewrites the leaf that maps it.
+  {
+    fbl::RefPtr<VnodeMinfs> vn = Lookup(kFileNames[1]);
+    ASSERT_NO_FAILURES(WriteBlock(vn.get(), 1, kFileBlocks / 2));
+    EXPECT_EQ(1, TreeDepth(vn.get()));
+  }
+  ASSERT_NO_FAILURES(RemountAndCheck());
+  ASSERT_NO_FAILURES(CheckContents(Lookup(kFileNames[1]).get(), 1, kFileBlocks));
+
+  // Truncating the first file to a few blocks frees both leaves and folds the tree back into the
+  // inode. Truncating the second to fit one leaf frees only the second leaf.
+  constexpr uint32_t kShortBlocks = 4;
+  constexpr uint32_t kOneLeafBlocks = kMinfsExtentsPerBlock - 1;
+  {
+    fbl::RefPtr<VnodeMinfs> short_file = Lookup(kFileNames[0]);
+    ASSERT_OK(short_file->Truncate(kShortBlocks * kMinfsBlockSize));
+    EXPECT_EQ(0, TreeDepth(short_file.get()));
+    EXPECT_EQ(kShortBlocks, short_file->GetInode()->block_count);
+
+    fbl::RefPtr<VnodeMinfs> one_leaf_file = Lookup(kFileNames[1]);
+    ASSERT_OK(one_leaf_file->Truncate(kOneLeafBlocks * kMinfsBlockSize));
+    EXPECT_EQ(1, TreeDepth(one_leaf_file.get()));
+    EXPECT_EQ(kOneLeafBlocks + 1, one_leaf_file->GetInode()->block_count);
+  }
+  ASSERT_NO_FAILURES(RemountAndCheck());
+  ASSERT_NO_FAILURES(CheckContents(Lookup(kFileNames[0]).get(), 0, kShortBlocks));
+  ASSERT_NO_FAILURES(CheckContents(Lookup(kFileNames[1]).get(), 1, kOneLeafBlocks));
+
+  // Unlinking frees the inodes along with every data and node block of their trees.
+  for (size_t file = 0; file < kFileCount; file++) {
+    ASSERT_OK(Root()->Unlink(kFileNames[file], false));
+  }
+  ASSERT_NO_FAILURES(RemountAndCheck());
+  EXPECT_EQ(initial_blocks, fs()->Info().alloc_block_count);
+  EXPECT_EQ(initial_inodes, fs()->Info().alloc_inode_count);
+}
+
+}  // namespace
+}  // namespace minfs
@@ -0,0 +1,224 @@
+// Copyright 2020 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// Tests the extent trees which map the blocks of files on extent-mapped filesystems.
+
+#include "extent-tree.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <map>
+#include <memory>
+#include <set>
+
+#include <zxtest/zxtest.h>
+
+namespace minfs {
+namespace {
+
+// Keeps the nodes of a tree in memory.
+class FakeNodeStorage : public ExtentNodeStorage {
+ public:
+  zx_status_t GetNode(blk_t bno, ExtentHeader** out) final {
+    auto it = nodes_.find(bno);
+    if (it == nodes_.end()) {
+      return ZX_ERR_NOT_FOUND;
+    }
+    *out = reinterpret_cast<ExtentHeader*>(it->second.get());
+    return ZX_OK;
+  }
+
+  void AllocateNode(blk_t* out_bno, ExtentHeader** out) final {
+    *out_bno = next_bno_++;
+    std::unique_ptr<uint8_t[]> data(new uint8_t[kMinfsBlockSize]);
+    memset(data.get(), 0, kMinfsBlockSize);
+    *out = reinterpret_cast<ExtentHeader*>(data.get());
+    nodes_.emplace(*out_bno, std::move(data));
+  }
+
+  void FreeNode(blk_t bno) final {
+    ASSERT_EQ(1, nodes_.erase(bno));
+    dirty_.erase(bno);
+  }
+
+  void DirtyNode(blk_t bno) final { dirty_.insert(bno); }
+
+  size_t NodeCount() const { return nodes_.size(); }
+  const std::set<blk_t>& Dirty() const { return dirty_; }
+
+ private:
+  // Node blocks are far above the data blocks used by these tests.
+  blk_t next_bno_ = 1 << 30;
+  std::map<blk_t, std::unique_ptr<uint8_t[]>> nodes_;
+  std::set<blk_t> dirty_;
+};
+
+class ExtentTreeTest : public zxtest::Test {
+ public:
+  ExtentTreeTest() : tree_(root(), &storage_) { ExtentTree::InitRoot(root()); }
+
+ protected:
+  ExtentHeader* root() { return InodeExtentRoot(&inode_); }
+
+  // Checks that the tree maps exactly the blocks in |expected|.
+  void Verify(const std::map<blk_t, blk_t>& expected) {
+    size_t mapped = 0;
+    ASSERT_OK(tree_.Walk([&mapped](const Extent& extent) { mapped += extent.length; },
+                         [](blk_t) {}));
+    EXPECT_EQ(expected.size(), mapped);
+    for (const auto& [file_block, bno] : expected) {
+      blk_t found;
+      ASSERT_OK(tree_.Lookup(file_block, &found));
+      EXPECT_EQ(bno, found, "file block %u", file_block);
+    }
+  }
+
+  size_t ExtentCount() {
+    size_t count = 0;
+    EXPECT_OK(tree_.Walk([&count](const Extent&) { count++; }, [](blk_t) {}));
+    return count;
+  }
+
+  Inode inode_ = {};
+  FakeNodeStorage storage_;
+  ExtentTree tree_;
+};
+
+TEST_F(ExtentTreeTest, EmptyTreeMapsNothing) {
+  blk_t bno;
+  ASSERT_OK(tree_.Lookup(0, &bno));
+  EXPECT_EQ(0, bno);
+  blk_t end;
+  ASSERT_OK(tree_.End(&end));
+  EXPECT_EQ(0, end);
+  EXPECT_EQ(0, ExtentCount());
+}
+
+TEST_F(ExtentTreeTest, AdjacentBlocksShareAnExtent) {
+  std::map<blk_t, blk_t> expected;
+  // Map the blocks out of order; they still end up in one extent.
+  for (blk_t file_block : {0, 2, 1, 4, 3}) {
+    ASSERT_OK(tree_.Map(file_block, 100 + file_block));
+    expected[file_block] = 100 + file_block;
+  }
+  ASSERT_NO_FATAL_FAILURES(Verify(expected));
+  EXPECT_EQ(1, ExtentCount());
+  EXPECT_EQ(1, storage_.Dirty().count(kExtentRootNode));
+
+  blk_t end;
+  ASSERT_OK(tree_.End(&end));
+  EXPECT_EQ(5, end);
+}
+
+TEST_F(ExtentTreeTest, RemappingSplitsAnExtent) {
+  std::map<blk_t, blk_t> expected;
+  for (blk_t file_block = 0; file_block < 10; file_block++) {
+    ASSERT_OK(tree_.Map(file_block, 100 + file_block));
+    expected[file_block] = 100 + file_block;
+  }
+
+  ASSERT_OK(tree_.Map(5, 500));
+  expected[5] = 500;
+  ASSERT_NO_FATAL_FAILURES(Verify(expected));
+  EXPECT_EQ(3, ExtentCount());
+
+  // Mapping the block back rejoins the extent.
+  ASSERT_OK(tree_.Map(5, 105));
+  expected[5] = 105;
+  ASSERT_NO_FATAL_FAILURES(Verify(expected));
+  EXPECT_EQ(1, ExtentCount());
+
+  ASSERT_OK(tree_.Map(5, 0));
+  expected.erase(5);
+  ASSERT_NO_FATAL_FAILURES(Verify(expected));
+  EXPECT_EQ(2, ExtentCount());
+}
+
+TEST_F(ExtentTreeTest, TruncateTrimsTheLastExtent) {
+  for (blk_t file_block = 0; file_block < 10; file_block++) {
+    ASSERT_OK(tree_.Map(file_block, 100 + file_block));
+  }
+  ASSERT_OK(tree_.Map(20, 300));
+
+  std::map<blk_t, blk_t> removed;
+  ASSERT_OK(tree_.Truncate(4, [&removed](blk_t file_block, blk_t bno) {
+    removed[file_block] = bno;
+  }));
+  EXPECT_EQ(7, removed.size());
+  EXPECT_EQ(104, removed[4]);
+  EXPECT_EQ(300, removed[20]);
+
+  blk_t end;
+  ASSERT_OK(tree_.End(&end));
+  EXPECT_EQ(4, end);
+}
+
+TEST_F(ExtentTreeTest, GrowsAndShrinksWithFragmentedFiles) {
+  // No two blocks are adjacent on disk, so every block needs its own extent.
+  constexpr blk_t kBlocks = 3 * kMinfsExtentsPerBlock;
+  std::map<blk_t, blk_t> expected;
+  for (blk_t file_block = 0; file_block < kBlocks; file_block++) {
+    ASSERT_OK(tree_.Map(file_block, 2 * file_block + 100));
+    expected[file_block] = 2 * file_block + 100;
+  }
+  ASSERT_NO_FATAL_FAILURES(Verify(expected));
+  EXPECT_EQ(kBlocks, ExtentCount());
+  EXPECT_EQ(1, root()->depth);
+
+  // Appending fills nodes rather than leaving them half-full.
+  size_t nodes = 0;
+  ASSERT_OK(tree_.Walk([](const Extent&) {}, [&nodes](blk_t) { nodes++; }));
+  EXPECT_EQ(3, nodes);
+  EXPECT_EQ(3, storage_.NodeCount());
+
+  size_t removed = 0;
+  ASSERT_OK(tree_.Truncate(0, [&removed](blk_t, blk_t) { removed++; }));
+  EXPECT_EQ(kBlocks, removed);
+  EXPECT_EQ(0, storage_.NodeCount());
+  EXPECT_EQ(0, root()->depth);
+  EXPECT_EQ(0, ExtentCount());
+}
+
+TEST_F(ExtentTreeTest, RandomUpdatesMatchReference) {
+  std::map<blk_t, blk_t> expected;
+  unsigned seed = 0;
+  for (int i = 0; i < 20000; i++) {
+    blk_t file_block = rand_r(&seed) % 4096;
+    // Mostly contiguous mappings, with some holes punched into them.
+    blk_t bno = (rand_r(&seed) % 4 == 0) ? 0 : 1000 + file_block + (rand_r(&seed) % 2) * 10000;
+    ASSERT_OK(tree_.Map(file_block, bno));
+    if (bno == 0) {
+      expected.erase(file_block);
+    } else {
+      expected[file_block] = bno;
+    }
+  }
+  ASSERT_NO_FATAL_FAILURES(Verify(expected));
+
+  // Every node still referenced by the tree is live, and no others are.
+  size_t nodes = 0;
+  ASSERT_OK(tree_.Walk([](const Extent&) {}, [&nodes](blk_t) { nodes++; }));
+  EXPECT_EQ(storage_.NodeCount(), nodes);
+
+  ASSERT_OK(tree_.Truncate(2048, [&expected](blk_t file_block, blk_t bno) {
+    EXPECT_EQ(expected[file_block], bno);
+    expected.erase(file_block);
+  }));
+  for (const auto& entry : expected) {
+    EXPECT_LT(entry.first, 2048);
+  }
+  ASSERT_NO_FATAL_FAILURES(Verify(expected));
+}
+
+TEST_F(ExtentTreeTest, RejectsCorruptRoot) {
+  ASSERT_OK(tree_.Map(0, 100));
+  root()->magic = 0;
+  blk_t bno;
+  EXPECT_EQ(ZX_ERR_IO_DATA_INTEGRITY, tree_.Lookup(0, &bno));
+  EXPECT_EQ(ZX_ERR_IO_DATA_INTEGRITY, tree_.Map(1, 101));
+}
+
+}  // namespace
+}  // namespace minfs
@@ -4,6 +4,7 @@
 
 #include <fcntl.h>
 #include <lib/sync/completion.h>
+#include <string.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 
@@ -65,6 +66,21 @@ TEST_F(ConsistencyCheckerTest, NewlyFormattedFilesystemCheckAfterMount) {
   ASSERT_OK(Fsck(std::move(bcache), Repair::kEnabled));
 }
 
+TEST_F(ConsistencyCheckerTest, NewlyFormattedExtentFilesystemCheckAfterMount) {
+  auto device = take_device();
+  std::unique_ptr<Bcache> bcache;
+  ASSERT_OK(Bcache::Create(std::move(device), kBlockCount, &bcache));
+  MountOptions options = {};
+  options.extents = true;
+  ASSERT_OK(Mkfs(options, bcache.get()));
+
+  std::unique_ptr<Minfs> fs;
+  ASSERT_OK(Minfs::Create(std::move(bcache), options, &fs));
+  EXPECT_TRUE(GetMinfsFlagExtents(fs->Info()));
+  bcache = Minfs::Destroy(std::move(fs));
+  ASSERT_OK(Fsck(std::move(bcache), Repair::kDisabled));
+}
+
 class ConsistencyCheckerFixtureVerbose : public zxtest::Test {
  public:
   void SetUp() override {
@@ -221,5 +237,44 @@ TEST_F(ConsistencyCheckerFixtureVerbose, IndirectBlocksShared) {
   ASSERT_NOT_OK(Fsck(std::move(bcache), Repair::kEnabled, &bcache));
 }
 
+TEST_F(ConsistencyCheckerFixtureVerbose, DuplicateDirectoryEntry) {
+  CreateAndWrite("file1", 0, 0, 0);
+  CreateAndWrite("file2", 0, 0, 0);
+
+  std::unique_ptr<Bcache> bcache;
+  destroy_fs(&bcache);
+
+  Superblock sb;
+  EXPECT_OK(bcache->Readblk(0, &sb));
+
+  Inode inodes[kMinfsInodesPerBlock];
+  blk_t inode_block =
+      safemath::checked_cast<uint32_t>(sb.ino_block + (kMinfsRootIno / kMinfsInodesPerBlock));
+  EXPECT_OK(bcache->Readblk(inode_block, &inodes));
+  const Inode& root = inodes[kMinfsRootIno % kMinfsInodesPerBlock];
+  ASSERT_GT(root.dnum[0], 0);
+
+  // Rename "file2" to "file1" in place.
+  uint8_t data[kMinfsBlockSize];
+  const blk_t data_block = sb.dat_block + root.dnum[0];
+  EXPECT_OK(bcache->Readblk(data_block, data));
+  bool renamed = false;
+  for (uint32_t off = 0; !renamed && off < kMinfsBlockSize;) {
+    Dirent* de = reinterpret_cast<Dirent*>(data + off);
+    if (de->ino != 0 && de->namelen == 5 && memcmp(de->name, "file2", 5) == 0) {
+      de->name[4] = '1';
+      renamed = true;
+    }
+    if (de->reclen & kMinfsReclenLast) {
+      break;
+    }
+    off += de->reclen & kMinfsReclenMask;
+  }
+  ASSERT_TRUE(renamed);
+  EXPECT_OK(bcache->Writeblk(data_block, data));
+
+  ASSERT_NOT_OK(Fsck(std::move(bcache), Repair::kEnabled, &bcache));
+}
+
 }  // namespace
 }  // namespace minfs
@@ -67,12 +67,32 @@ zx_status_t GetRequiredBlockCount(size_t offset, size_t length, blk_t* num_req_b
   return ZX_OK;
 }
 
+zx_status_t GetRequiredBlockCount(const Superblock& info, size_t offset, size_t length,
+                                  blk_t* num_req_blocks) {
+  if (!GetMinfsFlagExtents(info)) {
+    return GetRequiredBlockCount(offset, length, num_req_blocks);
+  }
+
+  if (length == 0) {
+    *num_req_blocks = 0;
+    return ZX_OK;
+  }
+
+  blk_t first_block = static_cast<blk_t>(offset / kMinfsBlockSize);
+  blk_t last_block = static_cast<blk_t>((offset + length - 1) / kMinfsBlockSize);
+  if (last_block >= kMinfsMaxFileBlock) {
+    return ZX_ERR_OUT_OF_RANGE;
+  }
+  *num_req_blocks = last_block - first_block + 1 + kExtentTreeReserveBlocks;
+  return ZX_OK;
+}
+
 TransactionLimits::TransactionLimits(const Superblock& info) {
-  CalculateDataBlocks();
+  CalculateDataBlocks(info);
   CalculateIntegrityBlocks(GetBlockBitmapBlocks(info));
 }
 
-void TransactionLimits::CalculateDataBlocks() {
+void TransactionLimits::CalculateDataBlocks(const Superblock& info) {
   // If we ever increase the number of doubly indirect blocks, we will need to update this offset
   // to be 1 byte before the end of the first doubly indirect block.
   constexpr blk_t kOffset =
@@ -83,8 +103,9 @@ void TransactionLimits::CalculateDataBlocks() {
   // significant cross-block write would be. This means we may overestimate the maximum number of
   // directory blocks by some amount, but this is better than an understimate.
   blk_t max_directory_blocks;
-  ZX_ASSERT(GetRequiredBlockCount(kOffset, kMinfsMaxDirentSize, &max_directory_blocks) == ZX_OK);
-  ZX_ASSERT(GetRequiredBlockCount(kOffset, kMaxWriteBytes, &max_data_blocks_) == ZX_OK);
+  ZX_ASSERT(GetRequiredBlockCount(info, kOffset, kMinfsMaxDirentSize, &max_directory_blocks) ==
+            ZX_OK);
+  ZX_ASSERT(GetRequiredBlockCount(info, kOffset, kMaxWriteBytes, &max_data_blocks_) == ZX_OK);
 
   blk_t direct_blocks = (fbl::round_up(kMaxWriteBytes, kMinfsBlockSize) / kMinfsBlockSize) + 1;
   blk_t max_indirect_blocks = max_data_blocks_ - direct_blocks;
@@ -13,6 +13,7 @@
 #include <zircon/time.h>
 
 #include <memory>
+#include <set>
 
 #include <fbl/algorithm.h>
 #include <fbl/auto_call.h>
@@ -31,6 +32,7 @@
 #endif
 
 #include "directory.h"
+#include "extent-tree.h"
 #include "file.h"
 #include "minfs-private.h"
 #include "vnode.h"
@@ -68,6 +70,148 @@ void VnodeMinfs::SetIno(ino_t ino) {
   ino_ = ino;
 }
 
+// Keeps the nodes of a vnode's extent tree in |extent_nodes_|, allocating and freeing their blocks
+// within |transaction|. Modified nodes are written back by |Flush|.
+class VnodeMinfs::ExtentNodes final : public ExtentNodeStorage {
+ public:
+  // |transaction| may only be null if the tree is not modified.
+  ExtentNodes(VnodeMinfs* vnode, Transaction* transaction)
+      : vnode_(vnode), transaction_(transaction) {}
+
+  zx_status_t GetNode(blk_t bno, ExtentHeader** out) final {
+    auto iter = vnode_->extent_nodes_.find(bno);
+    if (iter == vnode_->extent_nodes_.end()) {
+      if (bno >= vnode_->fs_->Info().block_count) {
+        FS_TRACE_ERROR("minfs: ino#%u: extent node %u out of range\n", vnode_->ino_, bno);
+        return ZX_ERR_IO_DATA_INTEGRITY;
+      }
+      ExtentNode node = {.data = std::unique_ptr<uint8_t[]>(new uint8_t[kMinfsBlockSize])};
+      zx_status_t status = vnode_->fs_->ReadDat(bno, node.data.get());
+      if (status != ZX_OK) {
+        return status;
+      }
+      iter = vnode_->extent_nodes_.emplace(bno, std::move(node)).first;
+    }
+    *out = reinterpret_cast<ExtentHeader*>(iter->second.data.get());
+    return ZX_OK;
+  }
+
+  void AllocateNode(blk_t* out_bno, ExtentHeader** out) final {
+    ZX_DEBUG_ASSERT(transaction_ != nullptr);
+    // Nodes are allocated wherever there is space, leaving the hint for the data blocks.
+    vnode_->fs_->BlockNew(transaction_, 0, out_bno);
+    vnode_->inode_.block_count++;
+    inode_dirty_ = true;
+
+    ExtentNode node = {.data = std::unique_ptr<uint8_t[]>(new uint8_t[kMinfsBlockSize])};
+    memset(node.data.get(), 0, kMinfsBlockSize);
+    *out = reinterpret_cast<ExtentHeader*>(node.data.get());
+    vnode_->extent_nodes_.emplace(*out_bno, std::move(node));
+  }
+
+  void FreeNode(blk_t bno) final {
+    ZX_DEBUG_ASSERT(transaction_ != nullptr);
+    vnode_->fs_->BlockFree(transaction_, bno);
+    vnode_->inode_.block_count--;
+    inode_dirty_ = true;
+
+    auto iter = vnode_->extent_nodes_.find(bno);
+    ZX_DEBUG_ASSERT(iter != vnode_->extent_nodes_.end());
+#ifdef __Fuchsia__
+    if (iter->second.slot) {
+      vnode_->free_extent_slots_.push_back(*iter->second.slot);
+    }
+#endif
+    vnode_->extent_nodes_.erase(iter);
+    dirty_.erase(bno);
+  }
+
+  void DirtyNode(blk_t bno) final {
+    if (bno == kExtentRootNode) {
+      inode_dirty_ = true;
+    } else {
+      dirty_.insert(bno);
+    }
+  }
+
+  // Writes back every node modified through this object, and the inode if the root or the block
+  // count of the vnode changed.
+  zx_status_t Flush() {
+    if (dirty_.empty() && !inode_dirty_) {
+      return ZX_OK;
+    }
+    ZX_DEBUG_ASSERT(transaction_ != nullptr);
+    for (blk_t bno : dirty_) {
+      zx_status_t status = vnode_->WriteExtentNode(transaction_, bno);
+      if (status != ZX_OK) {
+        return status;
+      }
+    }
+    dirty_.clear();
+    if (inode_dirty_) {
+      vnode_->InodeSync(transaction_, kMxFsSyncDefault);
+      inode_dirty_ = false;
+    }
+    return ZX_OK;
+  }
+
+ private:
+  VnodeMinfs* const vnode_;
+  Transaction* const transaction_;
+  std::set<blk_t> dirty_;
+  bool inode_dirty_ = false;
+};
+
+bool VnodeMinfs::UsesExtents() const { return GetMinfsFlagExtents(fs_->Info()); }
+
+zx_status_t VnodeMinfs::WriteExtentNode(Transaction* transaction, blk_t bno) {
+  ExtentNode& node = extent_nodes_.at(bno);
+#ifdef __Fuchsia__
+  // The write is only issued once the transaction commits, so it is made from a block of
+  // vmo_indirect_ reserved for this node rather than from |node.data|, which may change again.
+  if (!node.slot) {
+    uint32_t slot = extent_slot_count_;
+    if (!free_extent_slots_.empty()) {
+      slot = free_extent_slots_.back();
+    }
+    zx_status_t status = EnsureExtentSlot(slot);
+    if (status != ZX_OK) {
+      return status;
+    }
+    if (slot == extent_slot_count_) {
+      extent_slot_count_++;
+    } else {
+      free_extent_slots_.pop_back();
+    }
+    node.slot = slot;
+  }
+
+  zx_status_t status =
+      vmo_indirect_->vmo().write(node.data.get(), *node.slot * kMinfsBlockSize, kMinfsBlockSize);
+  if (status != ZX_OK) {
+    return status;
+  }
+  storage::Operation op = {
+      .type = storage::OperationType::kWrite,
+      .vmo_offset = *node.slot,
+      .dev_offset = bno + fs_->Info().dat_block,
+      .length = 1,
+  };
+  transaction->EnqueueMetadata(vmo_indirect_->vmo().get(), std::move(op));
+  return ZX_OK;
+#else
+  return fs_->bc_->Writeblk(bno + fs_->Info().dat_block, node.data.get());
+#endif
+}
+
+zx_status_t VnodeMinfs::WalkExtents(ExtentTree::ExtentCallback extent_callback,
+                                    ExtentTree::NodeCallback node_callback) {
+  ZX_DEBUG_ASSERT(UsesExtents());
+  ExtentNodes nodes(this, nullptr);
+  ExtentTree tree(InodeExtentRoot(&inode_), &nodes);
+  return tree.Walk(std::move(extent_callback), std::move(node_callback));
+}
+
 void VnodeMinfs::InodeSync(PendingWork* transaction, uint32_t flags) {
   // by default, c/mtimes are not updated to current time
   if (flags != kMxFsSyncDefault) {
@@ -101,6 +245,20 @@ zx_status_t VnodeMinfs::BlocksShrink(Transaction* transaction, blk_t start) {
     return status;
   }
 
+  if (UsesExtents()) {
+#ifdef __Fuchsia__
+    // The extent tree only reports the blocks it maps, so also drop any blocks which are still
+    // waiting to be allocated.
+    blk_t end = static_cast<blk_t>(
+        fbl::min<uint64_t>(fbl::round_up(GetSize(), kMinfsBlockSize) / kMinfsBlockSize,
+                           kMinfsMaxFileBlock));
+    for (blk_t n = start; n < end; n++) {
+      DeleteBlock(transaction, n, 0);
+    }
+#endif
+    return ZX_OK;
+  }
+
 #ifdef __Fuchsia__
   // Arbitrary minimum size for indirect vmo
   size_t size = GetVmoSizeForDoublyIndirect();
@@ -140,6 +298,30 @@ zx_status_t VnodeMinfs::BlocksShrink(Transaction* transaction, blk_t start) {
 
 #ifdef __Fuchsia__
 
+zx_status_t VnodeMinfs::EnsureExtentSlot(uint32_t slot) {
+  if (vmo_indirect_ == nullptr) {
+    vmo_indirect_ = fzl::ResizeableVmoMapper::Create(kMinfsBlockSize, "minfs-extents");
+    if (vmo_indirect_ == nullptr) {
+      return ZX_ERR_NO_MEMORY;
+    }
+    zx_status_t status =
+        fs_->bc_->device()->BlockAttachVmo(vmo_indirect_->vmo(), &vmoid_indirect_);
+    if (status != ZX_OK) {
+      vmo_indirect_ = nullptr;
+      return status;
+    }
+  }
+
+  uint64_t size = vmo_indirect_->size();
+  if ((slot + 1) * kMinfsBlockSize <= size) {
+    return ZX_OK;
+  }
+  while (size < (slot + 1) * kMinfsBlockSize) {
+    size *= 2;
+  }
+  return vmo_indirect_->Grow(size);
+}
+
 zx_status_t VnodeMinfs::LoadIndirectBlocks(blk_t* iarray, uint32_t count, uint32_t offset,
                                            uint64_t size) {
   zx_status_t status;
@@ -247,6 +429,29 @@ zx_status_t VnodeMinfs::InitVmo(PendingWork* transaction) {
     fs_->UpdateInitMetrics(dnum_count, inum_count, dinum_count, vmo_size, ticker.End());
   });
 
+  if (UsesExtents()) {
+    // Each extent is read with a single request. Data blocks and tree nodes are reported as
+    // direct and indirect blocks.
+    const blk_t vmo_blocks = static_cast<blk_t>(vmo_size / kMinfsBlockSize);
+    if ((status = WalkExtents(
+             [&](const Extent& extent) {
+               dnum_count += extent.length;
+               if (extent.file_block < vmo_blocks) {
+                 fs_->ValidateBno(extent.start);
+                 read_transaction.Enqueue(vmoid_.id, extent.file_block,
+                                          extent.start + fs_->Info().dat_block,
+                                          fbl::min(extent.length, vmo_blocks - extent.file_block));
+               }
+             },
+             [&inum_count](blk_t) { inum_count++; })) != ZX_OK) {
+      vmo_.reset();
+      return status;
+    }
+    status = read_transaction.Transact();
+    ValidateVmoTail(GetSize());
+    return status;
+  }
+
   // Initialize all direct blocks
   blk_t bno;
   for (uint32_t d = 0; d < kMinfsDirect; d++) {
@@ -341,7 +546,7 @@ void VnodeMinfs::AllocateIndirect(Transaction* transaction, blk_t index, Indirec
 
   // allocate new indirect block
   blk_t bno;
-  fs_->BlockNew(transaction, &bno);
+  fs_->BlockNew(transaction, 0, &bno);
 
 #ifdef __Fuchsia__
   ClearIndirectVmoBlock(args->GetOffset() + index);
@@ -358,6 +563,9 @@ zx_status_t VnodeMinfs::BlockOpDirect(BlockOpArgs* op_args, DirectArgs* params)
     blk_t bno = params->GetBno(i);
     op_args->callback(params->GetRelativeBlock() + i, bno, &bno);
     params->SetBno(i, bno);
+    if (bno != 0 && params->GetOp() != BlockOp::kDelete) {
+      next_block_hint_ = bno + 1;
+    }
   }
   return ZX_OK;
 }
@@ -532,7 +740,63 @@ void VnodeMinfs::ClearIndirectBlock(blk_t bno) {
 }
 #endif
 
+zx_status_t VnodeMinfs::ApplyExtentOperation(BlockOpArgs* op_args) {
+  ExtentNodes nodes(this, op_args->transaction);
+  ExtentTree tree(InodeExtentRoot(&inode_), &nodes);
+
+  zx_status_t status = ZX_OK;
+  if (op_args->op == BlockOp::kDelete) {
+    // Deletions always run to the end of the file, and only visit the blocks which are mapped.
+    status = tree.Truncate(op_args->start, [op_args](blk_t file_block, blk_t bno) {
+      blk_t out_bno = 0;
+      op_args->callback(file_block, bno, &out_bno);
+      ZX_DEBUG_ASSERT(out_bno == 0);
+    });
+  } else {
+    for (blk_t i = 0; i < op_args->count; i++) {
+      blk_t file_block = op_args->start + i;
+      if (file_block >= kMinfsMaxFileBlock) {
+        status = ZX_ERR_OUT_OF_RANGE;
+        break;
+      }
+      blk_t bno;
+      if ((status = tree.Lookup(file_block, &bno)) != ZX_OK) {
+        break;
+      }
+      if (i == 0 && file_block > 0 && op_args->op != BlockOp::kRead) {
+        // Continue from the preceding block of the file, wherever the vnode last allocated.
+        blk_t prev_bno;
+        if ((status = tree.Lookup(file_block - 1, &prev_bno)) != ZX_OK) {
+          break;
+        }
+        if (prev_bno != 0) {
+          next_block_hint_ = prev_bno + 1;
+        }
+      }
+
+      blk_t new_bno = bno;
+      op_args->callback(file_block, bno, &new_bno);
+      if (new_bno != bno && (status = tree.Map(file_block, new_bno)) != ZX_OK) {
+        break;
+      }
+      if (new_bno != 0 && op_args->op != BlockOp::kRead) {
+        next_block_hint_ = new_bno + 1;
+      }
+      if (op_args->bnos != nullptr) {
+        op_args->bnos[i] = new_bno ? new_bno : bno;
+      }
+    }
+  }
+
+  zx_status_t flush_status = nodes.Flush();
+  return status != ZX_OK ? status : flush_status;
+}
+
 zx_status_t VnodeMinfs::ApplyOperation(BlockOpArgs* op_args) {
+  if (UsesExtents()) {
+    return ApplyExtentOperation(op_args);
+  }
+
   blk_t start = op_args->start;
   blk_t found = 0;
   bool dirty = false;
@@ -640,7 +904,7 @@ zx_status_t VnodeMinfs::ApplyOperation(BlockOpArgs* op_args) {
 zx_status_t VnodeMinfs::EnsureIndirectVmoSize(blk_t n) {
 #ifdef __Fuchsia__
   uint64_t vmo_size = VnodeBlockOffsetToIndirectVmoSize(n);
-  if (vmo_size == 0) {
+  if (vmo_size == 0 || UsesExtents()) {
     return ZX_OK;
   }
 
@@ -801,7 +1065,7 @@ void VnodeMinfs::Purge(PendingWork* transaction) {
   fs_->VnodeRelease(this);
 #ifdef __Fuchsia__
   // TODO(smklein): Only init indirect vmo if it's needed
-  if (InitIndirectVmo() == ZX_OK) {
+  if (UsesExtents() || InitIndirectVmo() == ZX_OK) {
     fs_->InoFree(transaction, this);
   } else {
     FS_TRACE_ERROR("minfs: Failed to Init Indirect VMO while purging %u\n", ino_);
@@ -1055,6 +1319,9 @@ void VnodeMinfs::Allocate(Minfs* fs, uint32_t type, fbl::RefPtr<VnodeMinfs>* out
   memset(&(*out)->inode_, 0, sizeof((*out)->inode_));
   (*out)->inode_.magic = MinfsMagic(type);
   (*out)->inode_.create_time = (*out)->inode_.modify_time = GetTimeUTC();
+  if (GetMinfsFlagExtents(fs->Info())) {
+    ExtentTree::InitRoot(InodeExtentRoot(&(*out)->inode_));
+  }
   if (type == kMinfsTypeDir) {
     (*out)->inode_.link_count = 2;
     // "." and "..".
@@ -7,8 +7,11 @@
 
 #include <inttypes.h>
 
+#include <map>
 #include <memory>
+#include <optional>
 #include <utility>
+#include <vector>
 
 #ifdef __Fuchsia__
 #include <fuchsia/io/llcpp/fidl.h>
@@ -39,6 +42,8 @@
 #include <minfs/transaction-limits.h>
 #include <minfs/writeback.h>
 
+#include "extent-tree.h"
+
 namespace minfs {
 
 // Used by fsck
@@ -194,6 +199,11 @@ class VnodeMinfs : public fs::Vnode,
   void ReadIndirectBlock(blk_t bno, uint32_t* entry);
 #endif
 
+  // Walks the extent tree of a node on an extent-mapped filesystem, calling |extent_callback|
+  // on every extent and |node_callback| on every block holding a node of the tree.
+  zx_status_t WalkExtents(ExtentTree::ExtentCallback extent_callback,
+                          ExtentTree::NodeCallback node_callback);
+
   // Update the vnode's inode and write it to disk.
   void InodeSync(PendingWork* transaction, uint32_t flags);
 
@@ -384,6 +394,7 @@ class VnodeMinfs : public fs::Vnode,
   // The BlockOp methods should not be called directly
   // All BlockOp methods assume that vmo_indirect_ has been grown to the required size
   zx_status_t ApplyOperation(BlockOpArgs* params);
+  zx_status_t ApplyExtentOperation(BlockOpArgs* params);
   zx_status_t BlockOpDirect(BlockOpArgs* op_args, DirectArgs* params);
   zx_status_t BlockOpIndirect(BlockOpArgs* op_args, IndirectArgs* params);
   zx_status_t BlockOpDindirect(BlockOpArgs* op_args, DindirectArgs* params);
@@ -392,6 +403,13 @@ class VnodeMinfs : public fs::Vnode,
   // relative block address |n| within the file.
   zx_status_t EnsureIndirectVmoSize(blk_t n);
 
+  // Returns true if the blocks of this node are mapped by an extent tree rooted in the inode,
+  // rather than by direct and indirect block pointers.
+  bool UsesExtents() const;
+
+  // Writes back the extent tree node held by |bno|.
+  zx_status_t WriteExtentNode(Transaction* transaction, blk_t bno);
+
   // Get the disk block 'bno' corresponding to the 'n' block
   //
   // May or may not allocate |bno|; certain Vnodes (like File) delay allocation
@@ -433,6 +451,9 @@ class VnodeMinfs : public fs::Vnode,
   // Assumes that vmo_indirect_ has already been initialized
   void ClearIndirectVmoBlock(uint32_t offset);
 
+  // Ensures that vmo_indirect_ can hold extent tree node |slot| for writeback.
+  zx_status_t EnsureExtentSlot(uint32_t slot);
+
   // Use the watcher container to implement a directory watcher
   void Notify(fbl::StringPiece name, unsigned event) final;
   zx_status_t WatchDir(fs::Vfs* vfs, uint32_t mask, uint32_t options, zx::channel watcher) final;
@@ -443,6 +464,9 @@ class VnodeMinfs : public fs::Vnode,
 #endif
   uint32_t FdCount() const { return fd_count_; }
 
+  // Gives the extent tree of this node access to |extent_nodes_|.
+  class ExtentNodes;
+
   Minfs* const fs_;
 #ifdef __Fuchsia__
   // TODO(smklein): When we have can register MinFS as a pager service, and
@@ -484,6 +508,27 @@ class VnodeMinfs : public fs::Vnode,
   // be held before accessing it.
   Inode inode_{};
 
+  // The nodes of the extent tree below the root which have been read or written, by the data
+  // block holding them. Only used on extent-mapped filesystems, and guarded like |inode_|.
+  struct ExtentNode {
+    std::unique_ptr<uint8_t[]> data;
+#ifdef __Fuchsia__
+    // The block of vmo_indirect_ from which this node is written back, once it has been modified.
+    std::optional<uint32_t> slot;
+#endif
+  };
+  std::map<blk_t, ExtentNode> extent_nodes_;
+#ifdef __Fuchsia__
+  // On extent-mapped filesystems, vmo_indirect_ holds the nodes being written back rather than
+  // indirect blocks. These are the blocks of it which no node uses.
+  std::vector<uint32_t> free_extent_slots_;
+  uint32_t extent_slot_count_ = 0;
+#endif
+
+  // One past the data block most recently mapped into this node. New blocks are allocated from
+  // here first, so that files written sequentially stay contiguous on disk.
+  blk_t next_block_hint_ = 0;
+
   // This field tracks the current number of file descriptors with
   // an open reference to this Vnode. Notably, this is distinct from the
   // VnodeMinfs's own refcount, since there may still be filesystem
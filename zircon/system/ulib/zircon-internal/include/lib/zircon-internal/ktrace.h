@@ -121,6 +121,25 @@ enum {
 #define KTRACE_ACTION_STOP      2 // options ignored
 #define KTRACE_ACTION_REWIND    3 // options ignored
 #define KTRACE_ACTION_NEW_PROBE 4 // options ignored, ptr = name
+#define KTRACE_ACTION_SET_MODE  5 // options = mode, tracing must be stopped,
+                                  // discards the contents of the buffers
+
+// Modes for ktrace buffers. Each cpu writes to its own buffer, and reads
+// return the contents of each buffer in turn, preceded by a CPU_BUFFER record
+// giving the cpu and the number of bytes that follow. A cpu's records are in
+// timestamp order, and its sections appear in the order they were written.
+// Readers must skip PADDING records, which may be as small as 8 bytes.
+//
+// SAVE hands out the buffer to cpus a block at a time as they need it, and
+// stops tracing once all of it is used. Each block is its own section.
+// CIRCULAR overwrites the oldest records of a full buffer, keeping the most
+// recent history. The buffers should only be read while tracing is stopped.
+// STREAMING drops new records while a buffer is full. Each read consumes the
+// whole records it returns, so the buffers can be drained while tracing
+// continues, and the read offset is ignored.
+#define KTRACE_MODE_SAVE        0
+#define KTRACE_MODE_CIRCULAR    1
+#define KTRACE_MODE_STREAMING   2
 
 // Flags defined for the INHERIT_PRIORITY ktrace event.  See ktrace-def.h for details.
 #define KTRACE_FLAGS_INHERIT_PRIORITY_CPUID_MASK ((uint32_t)0xFF)
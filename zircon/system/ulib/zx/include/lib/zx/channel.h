@@ -43,6 +43,11 @@ class channel final : public object<channel> {
                                actual_handles);
   }
 
+  zx_status_t read_many(uint32_t flags, zx_channel_message_t* messages, size_t num_messages,
+                        size_t* actual) const {
+    return zx_channel_read_many(get(), flags, messages, num_messages, actual);
+  }
+
   zx_status_t write(uint32_t flags, const void* bytes, uint32_t num_bytes,
                     const zx_handle_t* handles, uint32_t num_handles) const {
     return zx_channel_write(get(), flags, bytes, num_bytes, handles, num_handles);
@@ -53,6 +58,11 @@ class channel final : public object<channel> {
     return zx_channel_write_etc(get(), flags, bytes, num_bytes, handles, num_handles);
   }
 
+  zx_status_t write_many(uint32_t flags, zx_channel_message_t* messages, size_t num_messages,
+                         size_t* actual) const {
+    return zx_channel_write_many(get(), flags, messages, num_messages, actual);
+  }
+
   zx_status_t call(uint32_t flags, zx::time deadline, const zx_channel_call_args_t* args,
                    uint32_t* actual_bytes, uint32_t* actual_handles) const {
     return zx_channel_call(get(), flags, deadline.get(), args, actual_bytes, actual_handles);
@@ -23,6 +23,7 @@ class socket;
 class thread;
 class vmar;
 class vmo;
+class waitset;
 
 // The default traits supports:
 // - bti
@@ -191,6 +192,16 @@ struct object_traits<resource> {
   static constexpr bool has_peer_handle = false;
 };
 
+template <>
+struct object_traits<waitset> {
+  static constexpr bool supports_duplication = true;
+  static constexpr bool supports_get_child = false;
+  static constexpr bool supports_set_profile = false;
+  static constexpr bool supports_user_signal = false;
+  static constexpr bool supports_wait = false;
+  static constexpr bool has_peer_handle = false;
+};
+
 }  // namespace zx
 
 #endif  // LIB_ZX_OBJECT_TRAITS_H_
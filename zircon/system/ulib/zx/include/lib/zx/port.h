@@ -36,6 +36,11 @@ class port final : public object<port> {
     return zx_port_wait(get(), deadline.get(), packet);
   }
 
+  zx_status_t wait_many(zx::time deadline, zx_port_packet_t* packets, size_t count,
+                        size_t* actual) const {
+    return zx_port_wait_many(get(), deadline.get(), packets, count, actual);
+  }
+
   zx_status_t cancel(const object_base& source, uint64_t key) const {
     return zx_port_cancel(get(), source.get(), key);
   }
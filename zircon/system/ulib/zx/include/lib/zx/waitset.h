@@ -0,0 +1,49 @@
+// Copyright 2020 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef LIB_ZX_WAITSET_H_
+#define LIB_ZX_WAITSET_H_
+
+#include <lib/zx/handle.h>
+#include <lib/zx/object.h>
+#include <lib/zx/time.h>
+
+namespace zx {
+
+class waitset final : public object<waitset> {
+ public:
+  static constexpr zx_obj_type_t TYPE = ZX_OBJ_TYPE_WAITSET;
+
+  constexpr waitset() = default;
+
+  explicit waitset(zx_handle_t value) : object(value) {}
+
+  explicit waitset(handle&& h) : object(h.release()) {}
+
+  waitset(waitset&& other) : object(other.release()) {}
+
+  waitset& operator=(waitset&& other) {
+    reset(other.release());
+    return *this;
+  }
+
+  static zx_status_t create(uint32_t options, waitset* result);
+
+  zx_status_t add(uint64_t cookie, const object_base& object, zx_signals_t signals) const {
+    return zx_waitset_add(get(), cookie, object.get(), signals);
+  }
+
+  zx_status_t remove(uint64_t cookie) const { return zx_waitset_remove(get(), cookie); }
+
+  zx_status_t wait(zx::time deadline, zx_waitset_result_t* results, size_t count,
+                   size_t* actual) const {
+    return zx_waitset_wait(get(), deadline.get(), results, count, actual);
+  }
+};
+
+using unowned_waitset = unowned<waitset>;
+
+}  // namespace zx
+
+#endif  // LIB_ZX_WAITSET_H_
@@ -0,0 +1,15 @@
+// Copyright 2020 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <lib/zx/waitset.h>
+
+#include <zircon/syscalls.h>
+
+namespace zx {
+
+zx_status_t waitset::create(uint32_t options, waitset* result) {
+  return zx_waitset_create(options, result->reset_and_get_address());
+}
+
+}  // namespace zx
@@ -21,6 +21,7 @@
 #include <lib/zx/event.h>
 #include <lib/zx/fifo.h>
 #include <lib/zx/object.h>
+#include <lib/zx/time.h>
 #include <zircon/compiler.h>
 #include <zircon/errors.h>
 #include <zircon/rights.h>
@@ -1370,5 +1371,139 @@ TEST(ChannelTest, ReadAndWriteWithMultipleSizes) {
   }
 }
 
+TEST(ChannelTest, WriteManyReadMany) {
+  zx::channel local;
+  zx::channel remote;
+  ASSERT_OK(zx::channel::create(0, &local, &remote));
+
+  constexpr size_t kCount = 5;
+  uint32_t out[kCount][kCount] = {};
+  zx_channel_message_t write_msgs[kCount] = {};
+  zx::event events[kCount];
+  zx_handle_t handles[kCount];
+  for (size_t i = 0; i < kCount; ++i) {
+    for (size_t j = 0; j <= i; ++j) {
+      out[i][j] = static_cast<uint32_t>(i * 100 + j);
+    }
+    ASSERT_OK(zx::event::create(0, &events[i]));
+    handles[i] = events[i].release();
+    write_msgs[i].bytes = out[i];
+    write_msgs[i].num_bytes = static_cast<uint32_t>((i + 1) * sizeof(uint32_t));
+    write_msgs[i].handles = &handles[i];
+    write_msgs[i].num_handles = (i % 2 == 0) ? 1 : 0;
+  }
+  // The handles of messages that carry none still belong to us.
+  auto cleanup = fbl::MakeAutoCall([&handles]() {
+    for (size_t i = 1; i < kCount; i += 2) {
+      zx_handle_close(handles[i]);
+    }
+  });
+
+  size_t actual = 0;
+  ASSERT_OK(local.write_many(0, write_msgs, kCount, &actual));
+  ASSERT_EQ(kCount, actual);
+  for (const zx_channel_message_t& msg : write_msgs) {
+    EXPECT_OK(msg.status);
+  }
+
+  // Read them back into more slots than there are messages.
+  constexpr size_t kSlots = kCount + 3;
+  uint32_t in[kSlots][kCount] = {};
+  zx_handle_t in_handles[kSlots] = {};
+  zx_channel_message_t read_msgs[kSlots] = {};
+  for (size_t i = 0; i < kSlots; ++i) {
+    read_msgs[i].bytes = in[i];
+    read_msgs[i].num_bytes = sizeof(in[i]);
+    read_msgs[i].handles = &in_handles[i];
+    read_msgs[i].num_handles = 1;
+  }
+  ASSERT_OK(remote.read_many(0, read_msgs, kSlots, &actual));
+  ASSERT_EQ(kCount, actual);
+  for (size_t i = 0; i < kCount; ++i) {
+    EXPECT_OK(read_msgs[i].status);
+    ASSERT_EQ(write_msgs[i].num_bytes, read_msgs[i].num_bytes);
+    EXPECT_BYTES_EQ(out[i], in[i], read_msgs[i].num_bytes);
+    ASSERT_EQ(write_msgs[i].num_handles, read_msgs[i].num_handles);
+    if (read_msgs[i].num_handles > 0) {
+      EXPECT_OK(zx_handle_close(in_handles[i]));
+    }
+  }
+
+  EXPECT_EQ(ZX_ERR_SHOULD_WAIT, remote.read_many(0, read_msgs, kSlots, &actual));
+}
+
+TEST(ChannelTest, ReadManyStopsAtMessageThatDoesNotFit) {
+  zx::channel local;
+  zx::channel remote;
+  ASSERT_OK(zx::channel::create(0, &local, &remote));
+
+  uint32_t small = 1;
+  uint32_t large[4] = {2, 3, 4, 5};
+  ASSERT_OK(local.write(0, &small, sizeof(small), nullptr, 0));
+  ASSERT_OK(local.write(0, large, sizeof(large), nullptr, 0));
+
+  uint32_t in[2] = {};
+  zx_channel_message_t read_msgs[2] = {};
+  for (size_t i = 0; i < 2; ++i) {
+    read_msgs[i].bytes = &in[i];
+    read_msgs[i].num_bytes = sizeof(in[i]);
+  }
+
+  size_t actual = 0;
+  ASSERT_OK(remote.read_many(0, read_msgs, 2, &actual));
+  ASSERT_EQ(1u, actual);
+  EXPECT_EQ(small, in[0]);
+  EXPECT_EQ(ZX_ERR_BUFFER_TOO_SMALL, read_msgs[1].status);
+  EXPECT_EQ(sizeof(large), read_msgs[1].num_bytes);
+
+  // The message that did not fit is still queued.
+  EXPECT_EQ(ZX_ERR_BUFFER_TOO_SMALL, remote.read_many(0, &read_msgs[1], 1, &actual));
+  uint32_t large_in[4] = {};
+  uint32_t actual_bytes = 0;
+  ASSERT_OK(remote.read(0, large_in, nullptr, sizeof(large_in), 0, &actual_bytes, nullptr));
+  EXPECT_EQ(sizeof(large), actual_bytes);
+  EXPECT_BYTES_EQ(large, large_in, sizeof(large));
+}
+
+TEST(ChannelTest, WriteManyStopsAtFirstFailureAndConsumesHandles) {
+  zx::channel local;
+  zx::channel remote;
+  ASSERT_OK(zx::channel::create(0, &local, &remote));
+
+  uint32_t data = 7;
+  std::vector<uint8_t> too_big(ZX_CHANNEL_MAX_MSG_BYTES + 1);
+  zx::event event;
+  ASSERT_OK(zx::event::create(0, &event));
+  zx_handle_t handle = event.release();
+
+  zx_channel_message_t write_msgs[3] = {};
+  write_msgs[0].bytes = &data;
+  write_msgs[0].num_bytes = sizeof(data);
+  write_msgs[1].bytes = too_big.data();
+  write_msgs[1].num_bytes = static_cast<uint32_t>(too_big.size());
+  write_msgs[2].bytes = &data;
+  write_msgs[2].num_bytes = sizeof(data);
+  write_msgs[2].handles = &handle;
+  write_msgs[2].num_handles = 1;
+
+  size_t actual = 0;
+  EXPECT_EQ(ZX_ERR_OUT_OF_RANGE, local.write_many(0, write_msgs, 3, &actual));
+  EXPECT_EQ(1u, actual);
+  EXPECT_OK(write_msgs[0].status);
+  EXPECT_EQ(ZX_ERR_OUT_OF_RANGE, write_msgs[1].status);
+  EXPECT_EQ(ZX_ERR_CANCELED, write_msgs[2].status);
+
+  // The handle of the message that was not written was closed anyway.
+  EXPECT_EQ(ZX_ERR_BAD_HANDLE,
+            zx_object_get_info(handle, ZX_INFO_HANDLE_VALID, nullptr, 0, nullptr, nullptr));
+
+  uint32_t in = 0;
+  uint32_t actual_bytes = 0;
+  ASSERT_OK(remote.read(0, &in, nullptr, sizeof(in), 0, &actual_bytes, nullptr));
+  EXPECT_EQ(data, in);
+  EXPECT_EQ(ZX_ERR_SHOULD_WAIT, remote.read(0, &in, nullptr, sizeof(in), 0, &actual_bytes,
+                                            nullptr));
+}
+
 }  // namespace
 }  // namespace channel
@@ -3,6 +3,8 @@
 // found in the LICENSE file.
 
 #include <lib/zx/eventpair.h>
+#include <lib/zx/port.h>
+#include <lib/zx/time.h>
 #include <zircon/syscalls.h>
 #include <zircon/syscalls/object.h>
 #include <zxtest/zxtest.h>
@@ -130,4 +132,27 @@ TEST(EventPairTest, SignalingClosedPeerReturnsPeerClosed) {
   EXPECT_STATUS(ZX_ERR_PEER_CLOSED, eventpair_0.signal_peer(0, ZX_USER_SIGNAL_0));
 }
 
+TEST(EventPairTest, SelfSignalWakesPortObserver) {
+  zx::eventpair eventpair_0, eventpair_1;
+  ASSERT_OK(zx::eventpair::create(0, &eventpair_0, &eventpair_1));
+  zx::port port;
+  ASSERT_OK(zx::port::create(0, &port));
+
+  // A signal set before anyone is watching is still observed.
+  ASSERT_OK(eventpair_0.signal(0, ZX_USER_SIGNAL_0));
+  ASSERT_OK(eventpair_0.wait_async(port, 1u, ZX_USER_SIGNAL_0 | ZX_USER_SIGNAL_1, 0));
+  zx_port_packet_t packet;
+  ASSERT_OK(port.wait(zx::time::infinite(), &packet));
+  EXPECT_EQ(1u, packet.key);
+  EXPECT_EQ(ZX_USER_SIGNAL_0, packet.signal.observed & ZX_USER_SIGNAL_0);
+
+  // So is one set after.
+  ASSERT_OK(eventpair_0.wait_async(port, 2u, ZX_USER_SIGNAL_1, 0));
+  ASSERT_OK(eventpair_0.signal(ZX_USER_SIGNAL_0, ZX_USER_SIGNAL_1));
+  ASSERT_OK(port.wait(zx::time::infinite(), &packet));
+  EXPECT_EQ(2u, packet.key);
+  EXPECT_EQ(ZX_USER_SIGNAL_1, packet.signal.observed & ZX_USER_SIGNAL_1);
+  EXPECT_EQ(GetPendingSignals(eventpair_0), ZX_USER_SIGNAL_1);
+}
+
 }  // namespace
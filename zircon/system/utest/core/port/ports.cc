@@ -2,6 +2,8 @@
 // Use of this source code is governed by a BSD-style license that can be
 // found in the LICENSE file.
 
+#include <limits.h>
+
 #include <atomic>
 #include <cstdio>
 #include <string>
@@ -11,6 +13,8 @@
 #include <lib/zx/clock.h>
 #include <lib/zx/event.h>
 #include <lib/zx/port.h>
+#include <lib/zx/vmar.h>
+#include <lib/zx/vmo.h>
 #include <zircon/errors.h>
 #include <zircon/syscalls.h>
 #include <zircon/syscalls/port.h>
@@ -58,6 +62,99 @@ TEST(PortTest, PortTimeout) {
   EXPECT_EQ(port.wait(zx::deadline_after(zx::nsec(1)), &packet), ZX_ERR_TIMED_OUT);
 }
 
+TEST(PortTest, WaitManyZeroCountReturnsInvalidArgs) {
+  zx::port port;
+  ASSERT_OK(zx::port::create(0u, &port));
+
+  zx_port_packet_t packet = {};
+  size_t actual = 0;
+  EXPECT_EQ(port.wait_many(zx::time::infinite_past(), &packet, 0u, &actual), ZX_ERR_INVALID_ARGS);
+}
+
+TEST(PortTest, WaitManyTimeout) {
+  zx::port port;
+  ASSERT_OK(zx::port::create(0u, &port));
+
+  zx_port_packet_t packets[4] = {};
+  size_t actual = 0;
+  EXPECT_EQ(port.wait_many(zx::deadline_after(zx::nsec(1)), packets, fbl::count_of(packets),
+                           &actual),
+            ZX_ERR_TIMED_OUT);
+}
+
+TEST(PortTest, WaitManyDequeuesInOrder) {
+  zx::port port;
+  ASSERT_OK(zx::port::create(0u, &port));
+
+  // More packets than the kernel copies out per batch, so the syscall has to
+  // go around its inner loop.
+  constexpr uint64_t kPacketCount = 40;
+  for (uint64_t key = 0; key < kPacketCount; ++key) {
+    const zx_port_packet_t packet = {key, ZX_PKT_TYPE_USER, 0, {{}}};
+    ASSERT_OK(port.queue(&packet));
+  }
+
+  zx_port_packet_t packets[kPacketCount - 8] = {};
+  size_t actual = 0;
+  ASSERT_OK(port.wait_many(zx::time::infinite(), packets, fbl::count_of(packets), &actual));
+  ASSERT_EQ(actual, fbl::count_of(packets));
+  for (size_t i = 0; i < actual; ++i) {
+    EXPECT_EQ(packets[i].key, i);
+    EXPECT_EQ(packets[i].type, ZX_PKT_TYPE_USER);
+  }
+
+  // The remainder comes back as a short batch without blocking.
+  ASSERT_OK(port.wait_many(zx::time::infinite(), packets, fbl::count_of(packets), &actual));
+  ASSERT_EQ(actual, 8u);
+  for (size_t i = 0; i < actual; ++i) {
+    EXPECT_EQ(packets[i].key, kPacketCount - 8 + i);
+  }
+
+  EXPECT_EQ(port.wait_many(zx::time::infinite_past(), packets, fbl::count_of(packets), &actual),
+            ZX_ERR_TIMED_OUT);
+}
+
+TEST(PortTest, WaitManyReportsPacketsDeliveredBeforeBadBuffer) {
+  zx::port port;
+  ASSERT_OK(zx::port::create(0u, &port));
+
+  constexpr uint64_t kPacketCount = 40;
+  for (uint64_t key = 0; key < kPacketCount; ++key) {
+    const zx_port_packet_t packet = {key, ZX_PKT_TYPE_USER, 0, {{}}};
+    ASSERT_OK(port.queue(&packet));
+  }
+
+  // Map only the first of two pages, and place the buffer so that the first
+  // batch of 16 packets the kernel copies out ends exactly at the end of it.
+  zx::vmar vmar;
+  uintptr_t base;
+  ASSERT_OK(zx::vmar::root_self()->allocate(0, 2 * PAGE_SIZE,
+                                            ZX_VM_CAN_MAP_READ | ZX_VM_CAN_MAP_WRITE |
+                                                ZX_VM_CAN_MAP_SPECIFIC,
+                                            &vmar, &base));
+  zx::vmo vmo;
+  ASSERT_OK(zx::vmo::create(PAGE_SIZE, 0, &vmo));
+  uintptr_t mapped;
+  ASSERT_OK(vmar.map(0, vmo, 0, PAGE_SIZE, ZX_VM_PERM_READ | ZX_VM_PERM_WRITE | ZX_VM_SPECIFIC,
+                     &mapped));
+  auto* packets =
+      reinterpret_cast<zx_port_packet_t*>(base + PAGE_SIZE - 16 * sizeof(zx_port_packet_t));
+
+  // The second batch can't be copied out, but the first one was delivered.
+  size_t actual = 0;
+  ASSERT_OK(port.wait_many(zx::time::infinite(), packets, 32u, &actual));
+  ASSERT_EQ(actual, 16u);
+  for (size_t i = 0; i < actual; ++i) {
+    EXPECT_EQ(packets[i].key, i);
+  }
+
+  // When nothing could be delivered the copy failure is returned.
+  auto* unmapped = reinterpret_cast<zx_port_packet_t*>(base + PAGE_SIZE);
+  EXPECT_EQ(port.wait_many(zx::time::infinite(), unmapped, 4u, &actual), ZX_ERR_INVALID_ARGS);
+
+  vmar.destroy();
+}
+
 TEST(PortTest, QueueAndClose) {
   zx::port port;
   ASSERT_OK(zx::port::create(0u, &port));
@@ -0,0 +1,153 @@
+// Copyright 2020 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <lib/zx/event.h>
+#include <lib/zx/time.h>
+#include <lib/zx/waitset.h>
+#include <zircon/syscalls/object.h>
+
+#include <vector>
+
+#include <zxtest/zxtest.h>
+
+namespace {
+
+TEST(WaitSetTestCase, CreateRights) {
+  zx_handle_t raw = ZX_HANDLE_INVALID;
+  EXPECT_EQ(ZX_ERR_INVALID_ARGS, zx_waitset_create(1u, &raw));
+
+  zx::waitset waitset;
+  ASSERT_OK(zx::waitset::create(0, &waitset));
+
+  zx_info_handle_basic_t info = {};
+  ASSERT_OK(waitset.get_info(ZX_INFO_HANDLE_BASIC, &info, sizeof(info), nullptr, nullptr));
+  EXPECT_EQ(ZX_OBJ_TYPE_WAITSET, info.type);
+  EXPECT_EQ(ZX_DEFAULT_WAITSET_RIGHTS, info.rights);
+
+  // A wait set can't be waited on, so it can't be added to another one.
+  zx::waitset other;
+  ASSERT_OK(zx::waitset::create(0, &other));
+  EXPECT_EQ(ZX_ERR_ACCESS_DENIED, waitset.add(1u, other, ZX_USER_SIGNAL_0));
+}
+
+TEST(WaitSetTestCase, AddRemove) {
+  zx::waitset waitset;
+  ASSERT_OK(zx::waitset::create(0, &waitset));
+  zx::event event;
+  ASSERT_OK(zx::event::create(0, &event));
+
+  ASSERT_OK(waitset.add(1u, event, ZX_USER_SIGNAL_0));
+  EXPECT_EQ(ZX_ERR_ALREADY_EXISTS, waitset.add(1u, event, ZX_USER_SIGNAL_1));
+  EXPECT_OK(waitset.add(2u, event, ZX_USER_SIGNAL_1));
+
+  EXPECT_OK(waitset.remove(1u));
+  EXPECT_EQ(ZX_ERR_NOT_FOUND, waitset.remove(1u));
+  EXPECT_OK(waitset.remove(2u));
+
+  zx::waitset no_write;
+  ASSERT_OK(waitset.duplicate(ZX_RIGHT_READ, &no_write));
+  EXPECT_EQ(ZX_ERR_ACCESS_DENIED, no_write.add(3u, event, ZX_USER_SIGNAL_0));
+}
+
+TEST(WaitSetTestCase, LevelTriggered) {
+  zx::waitset waitset;
+  ASSERT_OK(zx::waitset::create(0, &waitset));
+  zx::event event;
+  ASSERT_OK(zx::event::create(0, &event));
+  ASSERT_OK(waitset.add(7u, event, ZX_USER_SIGNAL_0));
+
+  zx_waitset_result_t results[4];
+  size_t actual = 0;
+  EXPECT_EQ(ZX_ERR_TIMED_OUT, waitset.wait(zx::time::infinite_past(), results, 4, &actual));
+
+  // Signals asserted before the wait are seen, and stay seen until cleared.
+  ASSERT_OK(event.signal(0, ZX_USER_SIGNAL_0));
+  for (int i = 0; i < 2; ++i) {
+    ASSERT_OK(waitset.wait(zx::time::infinite_past(), results, 4, &actual));
+    ASSERT_EQ(1u, actual);
+    EXPECT_EQ(7u, results[0].cookie);
+    EXPECT_OK(results[0].status);
+    EXPECT_EQ(ZX_USER_SIGNAL_0, results[0].observed & ZX_USER_SIGNAL_0);
+  }
+
+  ASSERT_OK(event.signal(ZX_USER_SIGNAL_0, 0));
+  EXPECT_EQ(ZX_ERR_TIMED_OUT, waitset.wait(zx::time::infinite_past(), results, 4, &actual));
+}
+
+TEST(WaitSetTestCase, ReportsOnlyReadyEntriesWithoutRepeats) {
+  constexpr size_t kEntries = 200;
+  zx::waitset waitset;
+  ASSERT_OK(zx::waitset::create(0, &waitset));
+
+  std::vector<zx::event> events(kEntries);
+  for (size_t i = 0; i < kEntries; ++i) {
+    ASSERT_OK(zx::event::create(0, &events[i]));
+    ASSERT_OK(waitset.add(i, events[i], ZX_USER_SIGNAL_0));
+  }
+  // Every third entry is ready.
+  for (size_t i = 0; i < kEntries; i += 3) {
+    ASSERT_OK(events[i].signal(0, ZX_USER_SIGNAL_0));
+  }
+  const size_t kReady = (kEntries + 2) / 3;
+
+  std::vector<zx_waitset_result_t> results(kEntries);
+  size_t actual = 0;
+  ASSERT_OK(waitset.wait(zx::time::infinite_past(), results.data(), results.size(), &actual));
+  ASSERT_EQ(kReady, actual);
+  std::vector<bool> seen(kEntries);
+  for (size_t i = 0; i < actual; ++i) {
+    ASSERT_LT(results[i].cookie, kEntries);
+    EXPECT_EQ(0u, results[i].cookie % 3);
+    EXPECT_FALSE(seen[results[i].cookie]);
+    seen[results[i].cookie] = true;
+  }
+
+  // Small waits rotate through all ready entries.
+  std::vector<bool> rotated(kEntries);
+  for (size_t i = 0; i < kReady; ++i) {
+    ASSERT_OK(waitset.wait(zx::time::infinite_past(), results.data(), 1, &actual));
+    ASSERT_EQ(1u, actual);
+    EXPECT_FALSE(rotated[results[0].cookie]);
+    rotated[results[0].cookie] = true;
+  }
+}
+
+TEST(WaitSetTestCase, WakesBlockedWaiter) {
+  zx::waitset waitset;
+  ASSERT_OK(zx::waitset::create(0, &waitset));
+  zx::event event;
+  ASSERT_OK(zx::event::create(0, &event));
+  ASSERT_OK(waitset.add(3u, event, ZX_EVENT_SIGNALED));
+
+  zx_waitset_result_t result;
+  size_t actual = 0;
+  EXPECT_EQ(ZX_ERR_TIMED_OUT,
+            waitset.wait(zx::deadline_after(zx::msec(1)), &result, 1, &actual));
+
+  ASSERT_OK(event.signal(0, ZX_EVENT_SIGNALED));
+  ASSERT_OK(waitset.wait(zx::time::infinite(), &result, 1, &actual));
+  EXPECT_EQ(3u, result.cookie);
+}
+
+TEST(WaitSetTestCase, ClosedHandleIsReportedOnce) {
+  zx::waitset waitset;
+  ASSERT_OK(zx::waitset::create(0, &waitset));
+  zx::event event;
+  ASSERT_OK(zx::event::create(0, &event));
+  ASSERT_OK(waitset.add(5u, event, ZX_USER_SIGNAL_0));
+
+  event.reset();
+
+  zx_waitset_result_t result;
+  size_t actual = 0;
+  ASSERT_OK(waitset.wait(zx::time::infinite_past(), &result, 1, &actual));
+  EXPECT_EQ(5u, result.cookie);
+  EXPECT_EQ(ZX_ERR_CANCELED, result.status);
+
+  // The entry is gone now.
+  EXPECT_EQ(ZX_ERR_TIMED_OUT, waitset.wait(zx::time::infinite_past(), &result, 1, &actual));
+  EXPECT_EQ(ZX_ERR_NOT_FOUND, waitset.remove(5u));
+}
+
+}  // namespace
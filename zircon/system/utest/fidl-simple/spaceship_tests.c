@@ -5,7 +5,9 @@
 #include <lib/async-loop/default.h>
 #include <lib/async-loop/loop.h>
 #include <lib/fidl-async/bind.h>
+#include <stdatomic.h>
 #include <string.h>
+#include <threads.h>
 #include <zircon/fidl.h>
 #include <zircon/syscalls.h>
 
@@ -183,6 +185,118 @@ static bool spaceship_test(void) {
   END_TEST;
 }
 
+// Number of async txns that have been completed.
+static atomic_int completed_async_txns;
+
+static int SpaceShip_CompleteFuelRemaining(void* arg) {
+  fidl_async_txn_t* async_txn = arg;
+  const fidl_test_spaceship_FuelLevel level = {
+      .reaction_mass = 1641u,
+  };
+  fidl_test_spaceship_SpaceShipGetFuelRemaining_reply(fidl_async_txn_borrow(async_txn), ZX_OK,
+                                                      &level);
+  fidl_async_txn_complete(async_txn, true);
+  atomic_fetch_add(&completed_async_txns, 1);
+  return 0;
+}
+
+// Replies to GetFuelRemaining from another thread, racing with the dispatch
+// thread returning from the handler.
+static zx_status_t SpaceShip_GetFuelRemainingAsync(void* ctx, zx_handle_t cancel,
+                                                   fidl_txn_t* txn) {
+  fidl_async_txn_t* async_txn = fidl_async_txn_create(txn);
+  thrd_t thread;
+  if (thrd_create(&thread, SpaceShip_CompleteFuelRemaining, async_txn) != thrd_success) {
+    fidl_async_txn_complete(async_txn, false);
+    return ZX_ERR_NO_RESOURCES;
+  }
+  thrd_detach(thread);
+  return ZX_ERR_ASYNC;
+}
+
+static const fidl_test_spaceship_SpaceShip_ops_t kAsyncOps = {
+    .AdjustHeading = SpaceShip_AdjustHeading,
+    .ScanForLifeforms = SpaceShip_ScanForLifeforms,
+    .SetAstrometricsListener = SpaceShip_SetAstrometricsListener,
+    .SetDefenseCondition = SpaceShip_SetDefenseCondition,
+    .GetFuelRemaining = SpaceShip_GetFuelRemainingAsync,
+    .AddFuelTank = SpaceShip_AddFuelTank,
+    .ScanForTensorLifeforms = SpaceShip_ScanForTensorLifeforms,
+};
+
+#define BATCHED_CLIENTS 4
+#define BATCHED_CLIENT_ITERATIONS 50
+
+// Alternates between requests answered with queued synchronous replies and
+// asynchronous ones. Returns the number of unexpected results.
+static int spaceship_batched_client(void* arg) {
+  zx_handle_t client = *(zx_handle_t*)arg;
+  int failures = 0;
+  for (int i = 0; i < BATCHED_CLIENT_ITERATIONS; i++) {
+    fidl_test_spaceship_FuelLevel level = {
+        .reaction_mass = 9482,
+    };
+    uint32_t out_consumed = 0u;
+    if (fidl_test_spaceship_SpaceShipAddFuelTank(client, &level, &out_consumed) != ZX_OK ||
+        out_consumed != 4741u) {
+      failures++;
+    }
+
+    zx_status_t status = ZX_ERR_INTERNAL;
+    if (fidl_test_spaceship_SpaceShipGetFuelRemaining(client, ZX_HANDLE_INVALID, &status,
+                                                      &level) != ZX_OK ||
+        status != ZX_OK || level.reaction_mass != 1641u) {
+      failures++;
+    }
+  }
+  return failures;
+}
+
+static bool spaceship_batched_async_test(void) {
+  BEGIN_TEST;
+
+  zx_handle_t client, server;
+  zx_status_t status = zx_channel_create(0, &client, &server);
+  ASSERT_EQ(ZX_OK, status, "");
+
+  async_loop_t* loop = NULL;
+  ASSERT_EQ(ZX_OK, async_loop_create(&kAsyncLoopConfigNoAttachToCurrentThread, &loop), "");
+  ASSERT_EQ(ZX_OK, async_loop_start_thread(loop, "spaceship-dispatcher", NULL), "");
+
+  async_dispatcher_t* dispatcher = async_loop_get_dispatcher(loop);
+  ASSERT_EQ(ZX_OK,
+            fidl_bind_batched(dispatcher, server,
+                              (fidl_dispatch_t*)fidl_test_spaceship_SpaceShip_dispatch, NULL,
+                              &kAsyncOps),
+            "");
+
+  // Several clients keep requests pipelined, so that synchronous replies are
+  // still queued when an asynchronous txn is created and then completed on
+  // another thread.
+  thrd_t clients[BATCHED_CLIENTS];
+  for (size_t i = 0; i < BATCHED_CLIENTS; i++) {
+    ASSERT_EQ(thrd_success, thrd_create(&clients[i], spaceship_batched_client, &client), "");
+  }
+  for (size_t i = 0; i < BATCHED_CLIENTS; i++) {
+    int failures = -1;
+    ASSERT_EQ(thrd_success, thrd_join(clients[i], &failures), "");
+    EXPECT_EQ(0, failures, "");
+  }
+
+  // A reply can arrive before the txn that sent it has rebound the channel.
+  const int expected_txns = BATCHED_CLIENTS * BATCHED_CLIENT_ITERATIONS;
+  while (atomic_load(&completed_async_txns) < expected_txns) {
+    zx_nanosleep(zx_deadline_after(ZX_MSEC(1)));
+  }
+
+  ASSERT_EQ(ZX_OK, zx_handle_close(client), "");
+
+  async_loop_destroy(loop);
+
+  END_TEST;
+}
+
 BEGIN_TEST_CASE(spaceship_tests)
 RUN_NAMED_TEST("fidl.test.spaceship.SpaceShip test", spaceship_test)
+RUN_NAMED_TEST("fidl.test.spaceship.SpaceShip batched async test", spaceship_batched_async_test)
 END_TEST_CASE(spaceship_tests);
@@ -0,0 +1,148 @@
+// Copyright 2020 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <lib/zx/channel.h>
+#include <lib/zx/time.h>
+#include <zircon/assert.h>
+
+#include <thread>
+#include <vector>
+
+#include <fbl/string_printf.h>
+#include <perftest/perftest.h>
+
+namespace {
+
+// Measure the time taken to write a message of |size| bytes to a channel and read it back from the
+// other end. For messages spanning several pages this is dominated by allocating and freeing the
+// kernel buffers holding the message.
+bool WriteReadTest(perftest::RepeatState* state, uint32_t size) {
+  state->SetBytesProcessedPerRun(size);
+  state->DeclareStep("write");
+  state->DeclareStep("read");
+
+  zx::channel local;
+  zx::channel remote;
+  ZX_ASSERT(zx::channel::create(0, &local, &remote) == ZX_OK);
+
+  std::vector<uint8_t> data(size, 0x5a);
+  std::vector<uint8_t> read_data(size);
+  while (state->KeepRunning()) {
+    ZX_ASSERT(local.write(0, data.data(), size, nullptr, 0) == ZX_OK);
+    state->NextStep();
+    uint32_t actual_bytes = 0;
+    ZX_ASSERT(remote.read(0, read_data.data(), nullptr, size, 0, &actual_bytes, nullptr) ==
+              ZX_OK);
+    ZX_ASSERT(actual_bytes == size);
+  }
+  return true;
+}
+
+// Measure the time taken to flush a queue of |batch| messages of |size| bytes into a channel,
+// either one zx_channel_write at a time or with a single zx_channel_write_many, and to drain them
+// again on the other end.
+bool WriteBatchTest(perftest::RepeatState* state, size_t batch, uint32_t size, bool write_many) {
+  state->SetBytesProcessedPerRun(batch * size);
+  state->DeclareStep("write");
+  state->DeclareStep("read");
+
+  zx::channel local;
+  zx::channel remote;
+  ZX_ASSERT(zx::channel::create(0, &local, &remote) == ZX_OK);
+
+  std::vector<uint8_t> data(batch * size, 0x5a);
+  std::vector<uint8_t> read_data(size);
+  std::vector<zx_channel_message_t> msgs(batch);
+  while (state->KeepRunning()) {
+    if (write_many) {
+      // The kernel writes back each message's status, so the array is filled in every run.
+      for (size_t i = 0; i < batch; ++i) {
+        msgs[i] = {};
+        msgs[i].bytes = &data[i * size];
+        msgs[i].num_bytes = size;
+      }
+      size_t actual = 0;
+      ZX_ASSERT(local.write_many(0, msgs.data(), batch, &actual) == ZX_OK);
+      ZX_ASSERT(actual == batch);
+    } else {
+      for (size_t i = 0; i < batch; ++i) {
+        ZX_ASSERT(local.write(0, &data[i * size], size, nullptr, 0) == ZX_OK);
+      }
+    }
+    state->NextStep();
+    for (size_t i = 0; i < batch; ++i) {
+      uint32_t actual_bytes = 0;
+      ZX_ASSERT(remote.read(0, read_data.data(), nullptr, size, 0, &actual_bytes, nullptr) ==
+                ZX_OK);
+    }
+  }
+  return true;
+}
+
+// Echoes each message read from |svc| back to its sender until the peer is closed.
+void EchoUntilClosed(zx::channel svc) {
+  uint32_t buffer[16];
+  while (svc.wait_one(ZX_CHANNEL_READABLE | ZX_CHANNEL_PEER_CLOSED, zx::time::infinite(),
+                      nullptr) == ZX_OK) {
+    uint32_t actual_bytes = 0;
+    if (svc.read(0, buffer, nullptr, sizeof(buffer), 0, &actual_bytes, nullptr) != ZX_OK ||
+        svc.write(0, buffer, actual_bytes, nullptr, 0) != ZX_OK) {
+      return;
+    }
+  }
+}
+
+// Measure the round trip time of a synchronous zx_channel_call to a service thread that echoes the
+// request back. This is dominated by switching between the two threads.
+bool CallRoundTripTest(perftest::RepeatState* state) {
+  zx::channel local;
+  zx::channel remote;
+  ZX_ASSERT(zx::channel::create(0, &local, &remote) == ZX_OK);
+  std::thread service_thread(EchoUntilClosed, std::move(remote));
+
+  uint32_t request[4] = {};
+  uint32_t reply[4] = {};
+  zx_channel_call_args_t args = {
+      .wr_bytes = request,
+      .wr_handles = nullptr,
+      .rd_bytes = reply,
+      .rd_handles = nullptr,
+      .wr_num_bytes = sizeof(request),
+      .wr_num_handles = 0,
+      .rd_num_bytes = sizeof(reply),
+      .rd_num_handles = 0,
+  };
+  while (state->KeepRunning()) {
+    uint32_t actual_bytes = 0;
+    uint32_t actual_handles = 0;
+    ZX_ASSERT(local.call(0, zx::time::infinite(), &args, &actual_bytes, &actual_handles) == ZX_OK);
+    ZX_ASSERT(actual_bytes == sizeof(request));
+  }
+
+  // Closing our end stops the service thread.
+  local.reset();
+  service_thread.join();
+  return true;
+}
+
+void RegisterTests() {
+  static const uint32_t kSizes[] = {64, 4096, ZX_CHANNEL_MAX_MSG_BYTES};
+  for (uint32_t size : kSizes) {
+    auto name = fbl::StringPrintf("Channel/WriteRead/%ubytes", size);
+    perftest::RegisterTest(name.c_str(), WriteReadTest, size);
+  }
+
+  static const size_t kBatches[] = {1, 16, 64};
+  for (size_t batch : kBatches) {
+    auto write_name = fbl::StringPrintf("Channel/WriteBatch/Write/%zux64bytes", batch);
+    perftest::RegisterTest(write_name.c_str(), WriteBatchTest, batch, 64u, false);
+    auto write_many_name = fbl::StringPrintf("Channel/WriteBatch/WriteMany/%zux64bytes", batch);
+    perftest::RegisterTest(write_many_name.c_str(), WriteBatchTest, batch, 64u, true);
+  }
+
+  perftest::RegisterTest("Channel/CallRoundTrip", CallRoundTripTest);
+}
+PERFTEST_CTOR(RegisterTests)
+
+}  // namespace
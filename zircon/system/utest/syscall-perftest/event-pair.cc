@@ -0,0 +1,57 @@
+// Copyright 2020 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <lib/zx/event.h>
+#include <lib/zx/eventpair.h>
+#include <lib/zx/port.h>
+#include <zircon/assert.h>
+
+#include <perftest/perftest.h>
+
+namespace {
+
+// Holds the object being signaled, along with anything that has to stay alive with it.
+struct EventFixture {
+  EventFixture() { ZX_ASSERT(zx::event::create(0, &object) == ZX_OK); }
+  zx::event object;
+};
+
+struct EventPairFixture {
+  EventPairFixture() { ZX_ASSERT(zx::eventpair::create(0, &object, &peer) == ZX_OK); }
+  zx::eventpair object;
+  zx::eventpair peer;
+};
+
+// Measure the time taken to raise and clear a signal on an object. With no waiters the signal
+// update skips the object's lock. With |with_waiter| an observer for a signal that is never
+// raised stays registered throughout, so every update takes the lock.
+template <typename Fixture>
+bool SignalTest(perftest::RepeatState* state, bool with_waiter) {
+  state->DeclareStep("raise");
+  state->DeclareStep("clear");
+
+  Fixture fixture;
+  zx::port port;
+  ZX_ASSERT(zx::port::create(0, &port) == ZX_OK);
+  if (with_waiter) {
+    ZX_ASSERT(fixture.object.wait_async(port, 0u, ZX_USER_SIGNAL_1, 0) == ZX_OK);
+  }
+
+  while (state->KeepRunning()) {
+    ZX_ASSERT(fixture.object.signal(0, ZX_USER_SIGNAL_0) == ZX_OK);
+    state->NextStep();
+    ZX_ASSERT(fixture.object.signal(ZX_USER_SIGNAL_0, 0) == ZX_OK);
+  }
+  return true;
+}
+
+void RegisterTests() {
+  perftest::RegisterTest("Event/Signal/NoWaiters", SignalTest<EventFixture>, false);
+  perftest::RegisterTest("Event/Signal/OneWaiter", SignalTest<EventFixture>, true);
+  perftest::RegisterTest("EventPair/Signal/NoWaiters", SignalTest<EventPairFixture>, false);
+  perftest::RegisterTest("EventPair/Signal/OneWaiter", SignalTest<EventPairFixture>, true);
+}
+PERFTEST_CTOR(RegisterTests)
+
+}  // namespace
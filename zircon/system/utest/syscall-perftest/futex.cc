@@ -0,0 +1,122 @@
+// Copyright 2020 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <zircon/assert.h>
+#include <zircon/syscalls.h>
+#include <zircon/types.h>
+
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <fbl/futex.h>
+#include <fbl/string_printf.h>
+#include <perftest/perftest.h>
+
+namespace {
+
+// Each pair of threads passes a turn back and forth through its own futex, so every handoff
+// activates a futex in the waiting thread and retires it again in the woken one.  None of the
+// pairs share a futex, so the only thing they contend on is the process' futex table.
+struct alignas(64) PingPong {
+  fbl::futex_t turn{0};
+
+  // Both players play the same number of rounds, so the turn is back with player 0 afterwards.
+  void Play(zx_futex_t me, uint32_t rounds) {
+    const zx_futex_t other = me ^ 1;
+    for (uint32_t i = 0; i < rounds; ++i) {
+      zx_futex_t current;
+      while ((current = turn.load()) != me) {
+        zx_status_t res = zx_futex_wait(&turn, current, ZX_HANDLE_INVALID, ZX_TIME_INFINITE);
+        ZX_ASSERT(res == ZX_OK || res == ZX_ERR_BAD_STATE);
+      }
+      turn.store(other);
+      ZX_ASSERT(zx_futex_wake(&turn, 1) == ZX_OK);
+    }
+  }
+};
+
+// Runs |pairs| games of PingPong on threads that live as long as this object, so that a test run
+// does not pay for creating them.
+class IndependentPairs {
+ public:
+  static constexpr uint32_t kRoundsPerRun = 100;
+
+  explicit IndependentPairs(uint32_t pairs) : games_(new PingPong[pairs]) {
+    for (uint32_t i = 0; i < pairs * 2; ++i) {
+      threads_.emplace_back([this, i]() { Player(&games_[i / 2], i % 2); });
+    }
+  }
+
+  ~IndependentPairs() {
+    stop_.store(1);
+    StartRun();
+    for (auto& thread : threads_) {
+      thread.join();
+    }
+  }
+
+  // Plays kRoundsPerRun rounds of every game, returning once all of them are done.
+  void Run() {
+    remaining_.store(static_cast<zx_futex_t>(threads_.size()));
+    StartRun();
+    zx_futex_t current;
+    while ((current = remaining_.load()) != 0) {
+      zx_status_t res = zx_futex_wait(&remaining_, current, ZX_HANDLE_INVALID, ZX_TIME_INFINITE);
+      ZX_ASSERT(res == ZX_OK || res == ZX_ERR_BAD_STATE);
+    }
+  }
+
+ private:
+  void StartRun() {
+    __atomic_fetch_add(&generation_, 1, __ATOMIC_SEQ_CST);
+    ZX_ASSERT(zx_futex_wake(&generation_, UINT32_MAX) == ZX_OK);
+  }
+
+  void Player(PingPong* game, zx_futex_t me) {
+    zx_futex_t seen = 0;
+    for (;;) {
+      zx_futex_t current;
+      while ((current = generation_.load()) == seen) {
+        zx_status_t res = zx_futex_wait(&generation_, current, ZX_HANDLE_INVALID, ZX_TIME_INFINITE);
+        ZX_ASSERT(res == ZX_OK || res == ZX_ERR_BAD_STATE);
+      }
+      seen = current;
+      if (stop_.load()) {
+        return;
+      }
+      game->Play(me, kRoundsPerRun);
+      if (__atomic_sub_fetch(&remaining_, 1, __ATOMIC_SEQ_CST) == 0) {
+        ZX_ASSERT(zx_futex_wake(&remaining_, 1) == ZX_OK);
+      }
+    }
+  }
+
+  std::unique_ptr<PingPong[]> games_;
+  std::vector<std::thread> threads_;
+  fbl::futex_t generation_{0};
+  fbl::futex_t remaining_{0};
+  fbl::futex_t stop_{0};
+};
+
+// Measure the time taken for |pairs| independent pairs of threads to each hand a futex back and
+// forth IndependentPairs::kRoundsPerRun times. With the futex table sharded this should stay flat
+// as pairs are added, until the pairs outnumber the CPUs.
+bool IndependentPairsTest(perftest::RepeatState* state, uint32_t pairs) {
+  IndependentPairs game(pairs);
+  while (state->KeepRunning()) {
+    game.Run();
+  }
+  return true;
+}
+
+void RegisterTests() {
+  for (uint32_t pairs = 1; pairs <= 16; pairs *= 2) {
+    auto name = fbl::StringPrintf("Futex/IndependentPairs/%upairs", pairs);
+    perftest::RegisterTest(name.c_str(), IndependentPairsTest, pairs);
+  }
+}
+PERFTEST_CTOR(RegisterTests)
+
+}  // namespace
@@ -0,0 +1,71 @@
+// Copyright 2020 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <lib/zx/event.h>
+#include <lib/zx/handle.h>
+#include <lib/zx/waitset.h>
+#include <zircon/assert.h>
+
+#include <vector>
+
+#include <fbl/string_printf.h>
+#include <perftest/perftest.h>
+
+namespace {
+
+// Creates |count| events, of which only the last one is signaled.
+std::vector<zx::event> MakeEvents(size_t count) {
+  std::vector<zx::event> events(count);
+  for (auto& event : events) {
+    ZX_ASSERT(zx::event::create(0, &event) == ZX_OK);
+  }
+  ZX_ASSERT(events.back().signal(0, ZX_USER_SIGNAL_0) == ZX_OK);
+  return events;
+}
+
+// Measure the time taken by zx_object_wait_many to find the one ready object among |count|, which
+// registers with and unregisters from every object on every call.
+bool WaitManyTest(perftest::RepeatState* state, size_t count) {
+  std::vector<zx::event> events = MakeEvents(count);
+  std::vector<zx_wait_item_t> items(count);
+  for (size_t i = 0; i < count; ++i) {
+    items[i] = {events[i].get(), ZX_USER_SIGNAL_0, 0};
+  }
+  while (state->KeepRunning()) {
+    ZX_ASSERT(zx::handle::wait_many(items.data(), static_cast<uint32_t>(count),
+                                    zx::time::infinite()) == ZX_OK);
+  }
+  return true;
+}
+
+// Measure the time taken by zx_waitset_wait to report the one ready object among |count| that
+// were added to the wait set up front.
+bool WaitSetTest(perftest::RepeatState* state, size_t count) {
+  std::vector<zx::event> events = MakeEvents(count);
+  zx::waitset waitset;
+  ZX_ASSERT(zx::waitset::create(0, &waitset) == ZX_OK);
+  for (size_t i = 0; i < count; ++i) {
+    ZX_ASSERT(waitset.add(i, events[i], ZX_USER_SIGNAL_0) == ZX_OK);
+  }
+  while (state->KeepRunning()) {
+    zx_waitset_result_t result;
+    size_t actual;
+    ZX_ASSERT(waitset.wait(zx::time::infinite(), &result, 1, &actual) == ZX_OK);
+    ZX_ASSERT(result.cookie == count - 1);
+  }
+  return true;
+}
+
+void RegisterTests() {
+  static const size_t kCounts[] = {1, 8, ZX_WAIT_MANY_MAX_ITEMS};
+  for (size_t count : kCounts) {
+    auto wait_many_name = fbl::StringPrintf("Object/WaitMany/%zuhandles", count);
+    perftest::RegisterTest(wait_many_name.c_str(), WaitManyTest, count);
+    auto waitset_name = fbl::StringPrintf("WaitSet/Wait/%zuhandles", count);
+    perftest::RegisterTest(waitset_name.c_str(), WaitSetTest, count);
+  }
+}
+PERFTEST_CTOR(RegisterTests)
+
+}  // namespace
@@ -31,6 +31,11 @@ bool AliasWorkaround(const std::string& name, const SyscallLibrary& library, Typ
     *type = Type(TypePointer(Type(TypeSizeT{})), Constness::kMutable);
     return true;
   }
+  if (name == "mutable_vector_ChannelMessage") {
+    *type = Type(TypeVector(Type(library.TypeFromIdentifier("zz/ChannelMessage"))),
+                 Constness::kMutable);
+    return true;
+  }
   if (name == "mutable_vector_HandleDisposition_u32size") {
     *type = Type(TypeVector(Type(library.TypeFromIdentifier("zz/HandleDisposition")),
                             UseUint32ForVectorSizeTag{}),
@@ -104,6 +109,15 @@ bool AliasWorkaround(const std::string& name, const SyscallLibrary& library, Typ
     *type = Type(TypeVector(Type(TypeZxBasicAlias("paddr"))), Constness::kConst);
     return true;
   }
+  if (name == "vector_PortPacket") {
+    *type = Type(TypeVector(Type(library.TypeFromIdentifier("zz/PortPacket"))), Constness::kConst);
+    return true;
+  }
+  if (name == "vector_WaitsetResult") {
+    *type =
+        Type(TypeVector(Type(library.TypeFromIdentifier("zz/WaitsetResult"))), Constness::kConst);
+    return true;
+  }
   if (name == "vector_void") {
     *type = Type(TypeVector(Type(TypeVoid{})), Constness::kConst);
     return true;
@@ -92,6 +92,18 @@ TEST(AliasWorkaround, Mappings) {
   // voidptr
   CHECK_ARG("void*", "q");
 
+  // vector_PortPacket
+  CHECK_ARG("const zx_port_packet_t*", "z");
+  CHECK_ARG("size_t", "num_z");
+
+  // mutable_vector_ChannelMessage
+  CHECK_ARG("zx_channel_message_t*", "za");
+  CHECK_ARG("size_t", "num_za");
+
+  // vector_WaitsetResult
+  CHECK_ARG("const zx_waitset_result_t*", "zb");
+  CHECK_ARG("size_t", "num_zb");
+
   // Optionality only shows up in __NONNULL() header markup, not the actual type info when it's
   // converted to a C type, so check that setting specifically for the optional outputs.
 #define CHECK_IS_OPTIONAL() \
@@ -123,7 +135,7 @@ TEST(AliasWorkaround, Mappings) {
 #undef CHECK_IS_OPTIONAL
 #undef CHECK_ARG
 
-  EXPECT_EQ(cur_arg, 36u);  // 25 fidl args + 11 that expand to pointer+size.
+  EXPECT_EQ(cur_arg, 42u);  // 28 fidl args + 14 that expand to pointer+size.
 }
 
 }  // namespace
@@ -3,6 +3,7 @@
 // found in the LICENSE file.
 
 #include <assert.h>
+#include <errno.h>
 #include <fcntl.h>
 #include <inttypes.h>
 #include <lib/zircon-internal/ktrace.h>
@@ -11,9 +12,11 @@
 #include <string.h>
 #include <unistd.h>
 
-#include <fbl/unique_fd.h>
+#include <algorithm>
+#include <map>
+#include <vector>
 
-constexpr uint32_t kChunkSize = 65536;
+#include <fbl/unique_fd.h>
 
 typedef enum { Tag16B, Tag32B, TagNAME } TagType;
 
@@ -35,70 +38,59 @@ Usage: ktrace-pretty-print <path>\n\
        ktrace-pretty-print --help\n\
 ";
 
-static uint8_t buffer[kChunkSize];
-
-// Where to read from next.
-static uint8_t* current = buffer;
-
-// Limit of data read into |buffer|.
-static uint8_t* marker = buffer;
-
-static uint8_t* const end = buffer + kChunkSize;
+// A stream of records written by one cpu, gathered from the CPU_BUFFER
+// sections of the trace in the order they appear.
+struct CpuStream {
+  std::vector<const ktrace_header_t*> records;
+  size_t next = 0;
+  // Timestamp of the last record taken from the stream. Name records carry no
+  // timestamp and are ordered as if they had this one.
+  uint64_t last_ts = 0;
+};
 
 static size_t number_records_read = 0;
 static size_t number_bytes_read = 0;
-
-static inline size_t AvailableBytes() {
-  assert(marker >= current);
-  return marker - current;
-}
+static size_t number_records_dropped = 0;
 
 static void PrintUsage(FILE* f) { fputs(kUsage, f); }
 
-static void ReadMoreData(int fd) {
-  memcpy(buffer, current, AvailableBytes());
-  marker = buffer + AvailableBytes();
-
-  while (marker < end) {
-    ssize_t bytes_read = read(fd, marker, end - marker);
-    if (bytes_read <= 0)
-      break;
-
-    marker += bytes_read;
+static bool ReadFile(int fd, std::vector<uint8_t>* data) {
+  uint8_t chunk[65536];
+  ssize_t bytes_read;
+  while ((bytes_read = read(fd, chunk, sizeof(chunk))) > 0) {
+    data->insert(data->end(), chunk, chunk + bytes_read);
   }
-
-  current = buffer;
+  return bytes_read == 0;
 }
 
-// no-inline for easier debugging in gdb
-__NO_INLINE static ktrace_header_t* ReadNextRecord(int fd) {
-  if (AvailableBytes() < sizeof(ktrace_header_t))
-    ReadMoreData(fd);
-
-  if (AvailableBytes() < sizeof(ktrace_header_t))
+// Returns the record at |offset| in |data|, or nullptr if there is no whole
+// record there.
+static const ktrace_header_t* RecordAt(const std::vector<uint8_t>& data, size_t offset,
+                                      size_t limit) {
+  if (limit - offset < sizeof(uint32_t)) {
     return nullptr;
-
-  ktrace_header_t* record = (ktrace_header_t*)current;
-
-  if (AvailableBytes() < KTRACE_LEN(record->tag))
-    ReadMoreData(fd);
-
-  if (AvailableBytes() < KTRACE_LEN(record->tag))
-    return nullptr;
-
-  record = (ktrace_header_t*)current;
-
+  }
+  const ktrace_header_t* record = reinterpret_cast<const ktrace_header_t*>(data.data() + offset);
+  const size_t len = KTRACE_LEN(record->tag);
   // If the record has zero length we're hosed.
-  if (KTRACE_LEN(record->tag) == 0) {
+  if (len == 0) {
     printf("Zero length tag, done.\n");
     return nullptr;
   }
+  if (limit - offset < len) {
+    return nullptr;
+  }
+  return record;
+}
 
-  current += KTRACE_LEN(record->tag);
+static bool IsPadding(const ktrace_header_t* record) {
+  return KTRACE_EVENT(record->tag) == KTRACE_EVENT(TAG_PADDING);
+}
 
-  number_bytes_read += KTRACE_LEN(record->tag);
-  number_records_read += 1;
-  return record;
+static bool HasTimestamp(const ktrace_header_t* record) {
+  return KTRACE_LEN(record->tag) >= sizeof(ktrace_header_t) &&
+         KTRACE_EVENT(record->tag) < countof(g_tags) &&
+         g_tags[KTRACE_EVENT(record->tag)].type != TagNAME;
 }
 
 static void PrintTag(uint32_t tag) {
@@ -112,56 +104,129 @@ static void PrintTag(uint32_t tag) {
   }
 }
 
-static void Dump16B(const TagInfo* info, ktrace_header_t* r) {
+static void Dump16B(const TagInfo* info, const ktrace_header_t* r) {
   printf("%" PRIu64 ": ", r->ts);
   PrintTag(r->tag);
   // TODO(dje): Further decode args.
   printf(", arg 0x%x\n", r->tid);
 }
 
-static void Dump32B(const TagInfo* info, ktrace_rec_32b_t* r) {
+static void Dump32B(const TagInfo* info, const ktrace_rec_32b_t* r) {
   printf("%" PRIu64 ": ", r->ts);
   PrintTag(r->tag);
   // TODO(dje): Further decode args.
   printf(", tid 0x%x, a 0x%x, b 0x%x, c 0x%x, d 0x%x\n", r->tid, r->a, r->b, r->c, r->d);
 }
 
-static void DumpName(const TagInfo* info, ktrace_rec_name_t* r) {
+static void DumpName(const TagInfo* info, const ktrace_rec_name_t* r) {
   PrintTag(r->tag);
   printf(", id 0x%x, arg 0x%x, %s\n", r->id, r->arg, r->name);
 }
 
-static int DoDump(const fbl::unique_fd& fd) {
-  ktrace_header_t* record;
+static void DumpRecord(const ktrace_header_t* record) {
+  number_bytes_read += KTRACE_LEN(record->tag);
+  number_records_read += 1;
 
-  while ((record = ReadNextRecord(fd.get())) != nullptr) {
-    uint32_t event = KTRACE_EVENT(record->tag);
-    if (event >= countof(g_tags)) {
-      printf("Unexpected event: 0x%x\n", event);
-      continue;
+  uint32_t event = KTRACE_EVENT(record->tag);
+  if (event >= countof(g_tags)) {
+    printf("Unexpected event: 0x%x\n", event);
+    return;
+  }
+  const TagInfo* info = &g_tags[event];
+  if (info->name == nullptr) {
+    printf("Unexpected event: 0x%x\n", event);
+    return;
+  }
+  // The records are only 8 byte aligned in the buffer, so copy them out before decoding.
+  union {
+    ktrace_header_t hdr;
+    ktrace_rec_32b_t rec_32b;
+    uint8_t bytes[KTRACE_LEN(0xF) + 1];
+  } copy = {};
+  memcpy(copy.bytes, record, KTRACE_LEN(record->tag));
+  switch (info->type) {
+    case Tag16B:
+      Dump16B(info, &copy.hdr);
+      break;
+    case Tag32B:
+      Dump32B(info, &copy.rec_32b);
+      break;
+    case TagNAME:
+      DumpName(info, reinterpret_cast<ktrace_rec_name_t*>(copy.bytes));
+      break;
+    default:
+      printf("Unexpected tag type: 0x%x\n", info->type);
+      break;
+  }
+}
+
+// Prints the records of all streams interleaved in timestamp order. The
+// records of each stream stay in the order they were written.
+static void MergeStreams(std::map<uint32_t, CpuStream>* streams) {
+  while (true) {
+    CpuStream* best = nullptr;
+    uint64_t best_ts = 0;
+    for (auto& [cpu, stream] : *streams) {
+      if (stream.next == stream.records.size()) {
+        continue;
+      }
+      const ktrace_header_t* record = stream.records[stream.next];
+      const uint64_t ts = HasTimestamp(record) ? record->ts : stream.last_ts;
+      if (best == nullptr || ts < best_ts) {
+        best = &stream;
+        best_ts = ts;
+      }
+    }
+    if (best == nullptr) {
+      return;
     }
-    const TagInfo* info = &g_tags[event];
-    if (info->name == nullptr) {
-      printf("Unexpected event: 0x%x\n", event);
+    best->last_ts = best_ts;
+    DumpRecord(best->records[best->next++]);
+  }
+}
+
+static int DoDump(const fbl::unique_fd& fd) {
+  std::vector<uint8_t> data;
+  if (!ReadFile(fd.get(), &data)) {
+    fprintf(stderr, "I/O error reading trace: %s\n", strerror(errno));
+    return EXIT_FAILURE;
+  }
+
+  // Records outside of any CPU_BUFFER section, such as the metadata at the
+  // start of the trace, are printed as they are found. The records of each
+  // cpu are gathered and merged by timestamp at the end.
+  std::map<uint32_t, CpuStream> streams;
+  size_t offset = 0;
+  const ktrace_header_t* record;
+  while ((record = RecordAt(data, offset, data.size())) != nullptr) {
+    offset += KTRACE_LEN(record->tag);
+    if (KTRACE_EVENT(record->tag) != KTRACE_EVENT(TAG_CPU_BUFFER)) {
+      if (!IsPadding(record)) {
+        DumpRecord(record);
+      }
       continue;
     }
-    switch (info->type) {
-      case Tag16B:
-        Dump16B(info, record);
-        break;
-      case Tag32B:
-        Dump32B(info, (ktrace_rec_32b_t*)record);
-        break;
-      case TagNAME:
-        DumpName(info, (ktrace_rec_name_t*)record);
-        break;
-      default:
-        printf("Unexpected tag type: 0x%x\n", info->type);
-        break;
+
+    ktrace_rec_32b_t header;
+    memcpy(&header, record, sizeof(header));
+    number_records_dropped += header.c;
+    const size_t limit = std::min(data.size(), offset + header.b);
+    CpuStream& stream = streams[header.a];
+    while ((record = RecordAt(data, offset, limit)) != nullptr) {
+      offset += KTRACE_LEN(record->tag);
+      if (!IsPadding(record)) {
+        stream.records.push_back(record);
+      }
     }
+    offset = limit;
   }
+  MergeStreams(&streams);
 
-  printf("%zu records, %zu bytes\n", number_records_read, number_bytes_read);
+  printf("%zu records, %zu bytes", number_records_read, number_bytes_read);
+  if (!streams.empty()) {
+    printf(" from %zu cpus, %zu records dropped", streams.size(), number_records_dropped);
+  }
+  printf("\n");
   return EXIT_SUCCESS;
 }
 
@@ -69,7 +69,8 @@ int handle_argument(char** argv, const char* arg, std::vector<FileEntry>* entrie
   }
 }
 
-void handle_entry(FileEntry* entry) {
+// Hashes one file, using up to |hash_threads| threads for the file's own Merkle tree.
+void handle_entry(FileEntry* entry, size_t hash_threads) {
   fbl::unique_fd fd{open(entry->filename.c_str(), O_RDONLY)};
   if (!fd) {
     perror(entry->filename.c_str());
@@ -97,7 +98,8 @@ void handle_entry(FileEntry* entry) {
   std::unique_ptr<uint8_t[]> tree;
   size_t len;
   Digest digest;
-  zx_status_t rc = MerkleTreeCreator::Create(data, info.st_size, &tree, &len, &digest);
+  zx_status_t rc =
+      MerkleTreeCreator::Create(data, info.st_size, &tree, &len, &digest, hash_threads);
   if (info.st_size != 0 && munmap(data, info.st_size) != 0) {
     perror("munmap");
     exit(1);
@@ -144,7 +146,10 @@ int main(int argc, char** argv) {
   if (!n_threads) {
     n_threads = 4;
   }
+  // With fewer files than threads, put the spare threads to work on each file's Merkle tree.
+  size_t hash_threads = 1;
   if (n_threads > entries.size()) {
+    hash_threads = entries.empty() ? 1 : n_threads / entries.size();
     n_threads = entries.size();
   }
   for (size_t i = n_threads; i > 0; --i) {
@@ -156,7 +161,7 @@ int main(int argc, char** argv) {
         if (j >= entries.size()) {
           return;
         }
-        handle_entry(&entries[j]);
+        handle_entry(&entries[j], hash_threads);
       }
     }));
   }